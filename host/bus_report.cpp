@@ -0,0 +1,246 @@
+/**
+ * the firmware's LCD, RTC and valve drivers against the device models,
+ * reporting the bus transactions each operation costs and checking the
+ * result in the models: what the glass shows after every frame, the
+ * time the RTC counts to across month, leap day and century rollovers,
+ * and the valve pin level.
+ *
+ *   bus_report            table of transactions, wire bytes and bus time
+ *   bus_report --trace    every transaction as well
+ *
+ * exits 1 if any model disagrees with what the driver meant to do.
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "hal_i2c.h"
+#include "hal_gpio.h"
+#include "DFRobot_LCD.h"
+#include "DS3231_RTC.h"
+#include "Valve.h"
+#include "menu.h"
+#include "lcd_format.h"
+#include "ds3231_model.h"
+#include "aip31068_model.h"
+
+static bool trace = false;
+static int failures = 0;
+
+static Aip31068Model lcd_model;
+static RegisterModel backlight_model;
+static Ds3231Model rtc_model;
+
+static DFRobot_LCD lcd(LCD_COLS, 2);
+static DS3231_RTC rtc;
+static lcd_row_t shown[2];
+
+/* bound by menu.cpp. fixed values, only the rendering is of interest */
+int32_t menu_editor_get(menu_editor_t editor, uint8_t arg)
+{
+    return editor == EDIT_START ? 8 * 60 : 10;
+}
+
+void menu_editor_set(menu_editor_t editor, uint8_t arg, int32_t value)
+{
+}
+
+void menu_action(menu_action_t action, uint8_t arg)
+{
+}
+
+void menu_diag_render(int32_t page, lcd_row_t row)
+{
+}
+
+static void check(bool ok, const char *what)
+{
+    if(!ok) {
+        printf("  FAIL %s\n", what);
+        failures++;
+    }
+}
+
+/* one line per operation: transactions, bytes on the wire, bus time */
+static void report(const char *what)
+{
+    size_t bytes = 0;
+    uint32_t us = 0;
+
+    for(const i2c_transaction_t &t : ModelI2c::log()) {
+        bytes += i2c_wire_bytes(t);
+        us += i2c_wire_us(t);
+        if(trace) {
+            printf("    %02x %s", t.addr, t.op == I2C_OP_READ ? "R" : t.op == I2C_OP_WRITE ? "W" : "WR");
+            for(uint8_t b : t.out) {
+                printf(" %02x", b);
+            }
+            if(t.in_len) {
+                printf(" [%zu in]", t.in_len);
+            }
+            printf("%s\n", t.result == ESP_OK ? "" : " NACK");
+        }
+    }
+    printf("%-28s %5zu %7zu %8" PRIu32 "\n", what, ModelI2c::log().size(), bytes, us);
+    ModelI2c::clear_log();
+}
+
+/* the firmware's lcd_show(), then compare the glass */
+static void frame(const char *what, const lcd_row_t top, const lcd_row_t bottom)
+{
+    char glass[Aip31068Model::COLS + 1];
+
+    lcd_show_row(lcd, 0, shown[0], top);
+    lcd_show_row(lcd, 1, shown[1], bottom);
+    report(what);
+
+    lcd_model.row(0, glass);
+    check(memcmp(glass, top, LCD_COLS) == 0, "top row on the glass");
+    lcd_model.row(1, glass);
+    check(memcmp(glass, bottom, LCD_COLS) == 0, "bottom row on the glass");
+}
+
+static void status_row(lcd_row_t row, uint8_t hour, uint8_t minute)
+{
+    lcd_row_clear(row);
+    lcd_put_clock<0>(row, hour, minute);
+    lcd_put_char<15>(row, LCD_GLYPH(1));
+}
+
+static void lcd_frames()
+{
+    static uint8_t wifi[8] = {0x00, 0x0E, 0x11, 0x04, 0x0A, 0x00, 0x04, 0x00};
+    static uint8_t no_wifi[8] = {0x00, 0x0E, 0x13, 0x04, 0x0A, 0x10, 0x04, 0x00};
+    static uint8_t check_mark[8] = {0x00, 0x01, 0x03, 0x16, 0x1C, 0x08, 0x00, 0x00};
+    menu_cursor_t menu;
+    lcd_row_t top, bottom;
+
+    check(lcd.init() == ESP_OK, "lcd init");
+    lcd.customSymbol(0, wifi);
+    lcd.customSymbol(1, no_wifi);
+    lcd.customSymbol(2, check_mark);
+    lcd.clear();
+    report("lcd init, glyphs, clear");
+    check(lcd_model.display_on() && lcd_model.two_lines(), "display on, two lines");
+    check(memcmp(lcd_model.glyph(1), no_wifi, 8) == 0, "glyph 1 in CGRAM");
+    lcd_row_clear(shown[0]);
+    lcd_row_clear(shown[1]);
+
+    menu_home(&menu);
+    status_row(top, 12, 34);
+    menu_render(&menu, bottom);
+    frame("first frame", top, bottom);
+
+    status_row(top, 12, 35);
+    frame("clock 12:34 -> 12:35", top, bottom);
+    status_row(top, 12, 59);
+    frame("clock 12:35 -> 12:59", top, bottom);
+    status_row(top, 13, 0);
+    frame("clock 12:59 -> 13:00", top, bottom);
+    frame("nothing changed", top, bottom);
+
+    menu_rotate(&menu, 1, 1);
+    menu_render(&menu, bottom);
+    frame("rotate HOME list", top, bottom);
+
+    menu_rotate(&menu, -1, -1);
+    menu_select(&menu); // VALVES
+    menu_render(&menu, bottom);
+    frame("select VALVES", top, bottom);
+
+    menu_select(&menu); // ZONE 1
+    menu_select(&menu); // START editor
+    menu_render(&menu, bottom);
+    frame("open START editor", top, bottom);
+
+    menu_rotate(&menu, 1, 1);
+    menu_render(&menu, bottom);
+    frame("editor step", top, bottom);
+    menu_rotate(&menu, 3, 30);
+    menu_render(&menu, bottom);
+    frame("editor fast spin", top, bottom);
+}
+
+/* set, run the oscillator, read back: the chip's counters must agree */
+static void rtc_rollover(const char *what, int year, int mon, int mday, int hour, int min, int sec,
+                         uint32_t run_s)
+{
+    struct tm set = {};
+    struct tm got = {};
+    char label[40];
+
+    set.tm_year = year - 1900;
+    set.tm_mon = mon - 1;
+    set.tm_mday = mday;
+    set.tm_hour = hour;
+    set.tm_min = min;
+    set.tm_sec = sec;
+    time_t start = timegm(&set); // fills tm_wday
+
+    check(rtc.setTime(&set) == ESP_OK, "rtc setTime");
+    snprintf(label, sizeof(label), "rtc set %s", what);
+    report(label);
+
+    rtc_model.tick(run_s);
+    check(rtc.getTime(&got) == ESP_OK, "rtc getTime");
+    snprintf(label, sizeof(label), "rtc read %s", what);
+    report(label);
+
+    struct tm expect;
+    time_t want = start + run_s;
+    gmtime_r(&want, &expect);
+    check(got.tm_year == expect.tm_year && got.tm_mon == expect.tm_mon && got.tm_mday == expect.tm_mday &&
+          got.tm_hour == expect.tm_hour && got.tm_min == expect.tm_min && got.tm_sec == expect.tm_sec &&
+          got.tm_wday == expect.tm_wday, what);
+}
+
+static void rtc_reads()
+{
+    int16_t quarter = 0;
+
+    check(rtc.init() == ESP_OK, "rtc init");
+    rtc_rollover("month end", 2025, 11, 30, 23, 59, 59, 1);
+    rtc_rollover("year end", 2025, 12, 31, 23, 59, 50, 20);
+    rtc_rollover("leap day", 2028, 2, 28, 23, 59, 59, 2);
+    rtc_rollover("century", 2099, 12, 31, 23, 59, 59, 1);
+    rtc_rollover("40 days", 2026, 3, 1, 0, 0, 0, 40 * 86400);
+
+    rtc_model.set_temperature(-21); // -5.25 C
+    check(rtc.getTemperature(&quarter) == ESP_OK && quarter == -21, "rtc temperature");
+    report("rtc temperature");
+}
+
+static void valves()
+{
+    Valve valve(4);
+
+    check(ModelGpio::is_output(4) && !ModelGpio::get(4), "valve pin low after init");
+    valve.activate_valve();
+    check(ModelGpio::get(4) && valve.get_active(), "valve open");
+    valve.deactivate_valve();
+    valve.toggle_valve_on(false);
+    valve.activate_valve();
+    check(!ModelGpio::get(4) && ModelGpio::changes(4) == 2, "valve toggled off stays shut");
+}
+
+int main(int argc, char **argv)
+{
+    trace = argc > 1 && strcmp(argv[1], "--trace") == 0;
+
+    ModelI2c::attach(Aip31068Model::ADDR, &lcd_model);
+    ModelI2c::attach(RGB_ADDRESS, &backlight_model);
+    ModelI2c::attach(Ds3231Model::ADDR, &rtc_model);
+
+    printf("%-28s %5s %7s %8s\n", "operation", "xfers", "bytes", "bus us");
+    lcd_frames();
+    rtc_reads();
+    valves();
+
+    if(failures) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
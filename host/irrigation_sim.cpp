@@ -0,0 +1,690 @@
+/**
+ * time-accelerated run of the irrigation core on a laptop.
+ *
+ * the firmware's own schedule_step() and programs_next_start() drive
+ * simulated valves, and the firmware's menu and button gesture code
+ * take random encoder sessions that edit programs and run zones by
+ * hand, as on the board. time is virtual: the loop jumps straight to
+ * the next event, so a year of schedules takes well under a second.
+ *
+ * every local day is checked: a zone must open once per distinct start
+ * time of its enabled programs for that weekday. days on which one of
+ * the zone's programs was edited are not checked.
+ *
+ *   irrigation_sim --days 365 --programs 3 --sessions 2 --seed 7
+ *
+ * --step-s moves the wall clock as an SNTP step would, at noon every
+ * --step-days, by up to 10 hours either way. the firmware only steps
+ * for offsets over 30 minutes. a start a step forward jumps over by
+ * more than SCHEDULE_GRACE_S is skipped, not opened late, and is not
+ * expected; a step back over a start runs it again by design, so
+ * expect reports with a negative step.
+ *
+ * the PM locks are taken where the firmware takes them, on the esp_pm
+ * model (models/pm_model.h): "valves" while a zone is open, "ui" while
+ * the display is lit, "i2c" for each redraw and "wifi" for each sync.
+ * time per CPU frequency and in light sleep is reported per day.
+ *
+ * exits 1 if any run was missed or duplicated, or a PM lock was
+ * released more often than acquired.
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <random>
+#include <set>
+
+#include "schedule.h"
+#include "tz.h"
+#include "menu.h"
+#include "button_gesture.h"
+#include "board_config.h"
+#include "pm_model.h"
+
+#define PROGRAM_MAX 32       // as program_store.h
+#define MANUAL_RUN_SEC 600   // as irrigation-proj.cpp
+#define TICK_US 10000        // the scheduler sleeps one tick past a start
+#define DISPLAY_SLEEP_MS 30000 // as irrigation-proj.cpp
+#define SYNC_INTERVAL_S (24 * 3600) // SYNC_FIRST_INTERVAL_S, sync_service.cpp
+#define PM_MAX_MHZ 160       // IRRIGATION_PM_ defaults, Kconfig.projbuild
+#define PM_MIN_MHZ 40
+#define LCD_REDRAW_US 3770   // bus_report, "rotate HOME list"
+#define WIFI_CONNECT_US 1500000 // connect, query and result, at CPU max
+#define US 1000000LL
+#define NEVER INT64_MAX
+
+typedef struct {
+    int days = 365;
+    const char *start = "2025-01-01";
+    const char *tz = "PST8PDT,M3.2.0/2,M11.1.0/2"; // CONFIG_IRRIGATION_TZ's default
+    unsigned seed = 1;
+    int programs = 2;   // random programs per zone on top of the defaults
+    int sessions = 1;   // encoder sessions per day
+    int jitter_ms = 20; // extra wake latency, uniform
+    int step_s = 0;     // wall clock step applied by a simulated sync
+    int step_days = 7;
+    int show = 10;      // issues listed
+} options_t;
+
+typedef struct {
+    bool open;
+    int64_t open_us;
+    int64_t close_us; // esp_timer expiry, NEVER while shut
+    uint64_t runtime_s;
+    uint32_t runs;
+    uint32_t manual;
+    uint32_t missed;
+    uint32_t duplicate;
+} zone_t;
+
+typedef struct {
+    int expected;
+    int actual;
+    bool edited;
+} day_check_t;
+
+static options_t opt;
+static std::mt19937 rng;
+
+static int64_t now_us;
+static program_t programs[PROGRAM_MAX];
+static uint32_t used = 0;
+static bool replan = true; // valve_scheduler_reschedule()
+
+static zone_t zones[ZONE_COUNT];
+static zone_plan_t plans[ZONE_COUNT];
+static day_check_t today[ZONE_COUNT];
+static struct tm today_tm;
+
+static menu_cursor_t menu;
+static ButtonGesture button;
+static bool pin = false;      // button level, true while held
+static int session_left = 0;  // inputs left in the current session
+
+static uint32_t wakes, edits, syncs, stops, sessions_run, issues, skipped_starts;
+
+static esp_pm_lock_handle_t valve_lock, ui_lock, i2c_lock, wifi_lock;
+static int64_t display_off_us = NEVER; // lit until then
+
+static int rand_int(int lo, int hi)
+{
+    return std::uniform_int_distribution<int>(lo, hi)(rng);
+}
+
+static time_t now_s()
+{
+    return (time_t) (now_us / US);
+}
+
+/*******************************valves*********************************/
+
+static void valve_close(uint8_t zone)
+{
+    zone_t *z = &zones[zone];
+    if(z->open) {
+        z->runtime_s += (now_us - z->open_us) / US;
+        z->open = false;
+        esp_pm_lock_release(valve_lock);
+    }
+    z->close_us = NEVER;
+}
+
+/* open_valve() in valve_scheduler.cpp: reopening restarts the timer */
+static void valve_open(uint8_t zone, uint16_t duration_sec, bool manual)
+{
+    zone_t *z = &zones[zone];
+    if(!z->open) {
+        z->open = true;
+        z->open_us = now_us;
+        esp_pm_lock_acquire(valve_lock);
+    }
+    z->close_us = now_us + duration_sec * US;
+    if(manual) {
+        z->manual++;
+    } else {
+        z->runs++;
+        today[zone].actual++;
+    }
+}
+
+static time_t plan_next(void *ctx, uint8_t zone, time_t now, uint16_t *duration_sec)
+{
+    return programs_next_start(programs, PROGRAM_MAX, used, zone, now, duration_sec);
+}
+
+static void plan_open(void *ctx, uint8_t zone, uint16_t duration_sec)
+{
+    valve_open(zone, duration_sec, false);
+}
+
+/**
+ * one pass of valve_task(). returns when it wakes next: a whole
+ * second start is slept to from the truncated time(NULL), plus a tick.
+ */
+static int64_t scheduler_wake(uint64_t *cpu_ns)
+{
+    struct timespec t0, t1;
+    time_t now = now_s();
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t0);
+    time_t next = schedule_step(plans, ZONE_COUNT, now, replan, plan_next, plan_open, NULL);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t1);
+    *cpu_ns += (t1.tv_sec - t0.tv_sec) * 1000000000ULL + t1.tv_nsec - t0.tv_nsec;
+    replan = false;
+    wakes++;
+
+    if(next == (time_t) -1) {
+        return NEVER;
+    }
+    return now_us + (next - now) * US + TICK_US + rand_int(0, opt.jitter_ms) * 1000LL;
+}
+
+/*******************************power**********************************/
+
+/* refresh_disp_task(): anything published lights the display and redraws */
+static void display_event()
+{
+    if(display_off_us == NEVER) {
+        esp_pm_lock_acquire(ui_lock);
+    }
+    display_off_us = now_us + DISPLAY_SLEEP_MS * 1000LL;
+    pm_model_burst(i2c_lock, LCD_REDRAW_US);
+}
+
+static void display_off()
+{
+    display_off_us = NEVER;
+    esp_pm_lock_release(ui_lock);
+}
+
+/* the sync task: its stages and result are published to the display */
+static void sync_run()
+{
+    display_event();
+    pm_model_burst(wifi_lock, WIFI_CONNECT_US);
+    display_event();
+}
+
+static void pm_init()
+{
+    const esp_pm_config_t config = {PM_MAX_MHZ, PM_MIN_MHZ, true};
+    pm_model_init(&now_us);
+    esp_pm_configure(&config);
+    esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "valves", &valve_lock);
+    esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "ui", &ui_lock);
+    esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, "i2c", &i2c_lock);
+    esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "wifi", &wifi_lock);
+    /* the display task starts lit with the boot splash */
+    display_event();
+}
+
+/*******************************programs*******************************/
+
+static uint8_t zone_program(uint8_t zone, program_t *program)
+{
+    for(uint8_t id = 0; id < PROGRAM_MAX; id++) {
+        if((used & (1UL << id)) && programs[id].zone == zone) {
+            *program = programs[id];
+            return id;
+        }
+    }
+    *program = {zone, 8, 0, 0b01111111, MANUAL_RUN_SEC, true};
+    return PROGRAM_MAX;
+}
+
+static bool program_add(const program_t *program)
+{
+    for(uint8_t id = 0; id < PROGRAM_MAX; id++) {
+        if(!(used & (1UL << id))) {
+            programs[id] = *program;
+            used |= 1UL << id;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* bound by menu.cpp, as in irrigation-proj.cpp */
+int32_t menu_editor_get(menu_editor_t editor, uint8_t arg)
+{
+    program_t program;
+    zone_program(arg, &program);
+    switch(editor) {
+        case EDIT_START:
+            return program.hour * 60 + program.minute;
+        case EDIT_DURATION:
+            return program.duration_sec / 60;
+        default:
+            return 0;
+    }
+}
+
+void menu_editor_set(menu_editor_t editor, uint8_t arg, int32_t value)
+{
+    program_t program;
+    uint8_t id = zone_program(arg, &program);
+    switch(editor) {
+        case EDIT_START:
+            program.hour = value / 60;
+            program.minute = value % 60;
+            break;
+        case EDIT_DURATION:
+            program.duration_sec = value * 60;
+            break;
+        default:
+            return;
+    }
+    if(!program_valid(&program, ZONE_COUNT)) {
+        return; // the store refuses it too
+    }
+    if(id == PROGRAM_MAX) {
+        program_add(&program);
+    } else {
+        programs[id] = program;
+    }
+    today[arg].edited = true;
+    replan = true;
+    edits++;
+}
+
+void menu_action(menu_action_t action, uint8_t arg)
+{
+    switch(action) {
+        case ACT_SYNC:
+            syncs++;
+            sync_run();
+            break;
+        case ACT_RUN: {
+            program_t program;
+            zone_program(arg, &program);
+            valve_open(arg, program.duration_sec, true);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+/* no device to report on, the page is only drawn */
+void menu_diag_render(int32_t page, lcd_row_t row)
+{
+    lcd_put_lit<0, 5>(row, "PAGE");
+    lcd_put_uint<5, 2>(row, page);
+}
+
+static void programs_init()
+{
+    /* app_main's defaults */
+    const program_t defaults[] = {
+        {0, 20, 53, 0b01111111, 600, true},
+        {1, 8, 0, 0b01111111, 600, true},
+    };
+    for(const program_t &program : defaults) {
+        if(program.zone < ZONE_COUNT) {
+            program_add(&program);
+        }
+    }
+    for(uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+        for(int i = 0; i < opt.programs; i++) {
+            program_t program;
+            program.zone = zone;
+            program.hour = rand_int(0, 23);
+            program.minute = rand_int(0, 59);
+            program.wday_bv = rand_int(1, 0x7F);
+            program.duration_sec = rand_int(1, 60) * 60;
+            program.enabled = rand_int(0, 7) != 0;
+            program_add(&program);
+        }
+    }
+}
+
+/*******************************days***********************************/
+
+static int64_t local_midnight_us(const struct tm *day, int offset_days)
+{
+    struct tm midnight = {};
+    midnight.tm_year = day->tm_year;
+    midnight.tm_mon = day->tm_mon;
+    midnight.tm_mday = day->tm_mday + offset_days;
+    midnight.tm_isdst = -1;
+    return mktime(&midnight) * US;
+}
+
+static void day_begin()
+{
+    time_t now = now_s();
+    localtime_r(&now, &today_tm);
+
+    for(uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+        std::set<int> starts;
+        for(uint8_t id = 0; id < PROGRAM_MAX; id++) {
+            const program_t *program = &programs[id];
+            if((used & (1UL << id)) && program->zone == zone && program->enabled &&
+               (program->wday_bv & (1 << today_tm.tm_wday))) {
+                starts.insert(program->hour * 60 + program->minute);
+            }
+        }
+        today[zone] = {(int) starts.size(), 0, false};
+    }
+}
+
+static void day_end()
+{
+    for(uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+        const day_check_t *check = &today[zone];
+        if(check->edited || check->actual == check->expected) {
+            continue;
+        }
+        if(check->actual < check->expected) {
+            zones[zone].missed += check->expected - check->actual;
+        } else {
+            zones[zone].duplicate += check->actual - check->expected;
+        }
+        if(issues++ < (uint32_t) opt.show) {
+            char date[16];
+            strftime(date, sizeof(date), "%Y-%m-%d %a", &today_tm);
+            printf("%s zone %d: %d runs, %d expected\n", date, zone + 1, check->actual, check->expected);
+        }
+    }
+}
+
+/**
+ * a forward step from before to after: the starts of today it jumps
+ * over by more than the grace are skipped, so they are not expected.
+ * steps land at noon and end before midnight.
+ */
+static void step_skip(time_t before, time_t after)
+{
+    struct tm from, to;
+    tz_local(before, &from);
+    tz_local(after, &to);
+    int from_s = from.tm_hour * 3600 + from.tm_min * 60 + from.tm_sec;
+    int to_s = to.tm_hour * 3600 + to.tm_min * 60 + to.tm_sec;
+
+    for(uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+        std::set<int> skipped;
+        for(uint8_t id = 0; id < PROGRAM_MAX; id++) {
+            const program_t *program = &programs[id];
+            int start_s = program->hour * 3600 + program->minute * 60;
+            if((used & (1UL << id)) && program->zone == zone && program->enabled &&
+               (program->wday_bv & (1 << today_tm.tm_wday)) && start_s >= from_s &&
+               start_s < to_s - SCHEDULE_GRACE_S) {
+                skipped.insert(start_s);
+            }
+        }
+        today[zone].expected -= skipped.size();
+        skipped_starts += skipped.size();
+    }
+}
+
+/*******************************input**********************************/
+
+/* handle_input() in irrigation-proj.cpp */
+static void gesture(button_gesture_t g)
+{
+    switch(g) {
+        case BUTTON_CLICK:
+            menu_select(&menu);
+            break;
+        case BUTTON_DOUBLE_CLICK:
+            menu_home(&menu);
+            break;
+        case BUTTON_LONG_PRESS:
+            for(uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+                valve_close(zone);
+            }
+            stops++;
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * next raw input of a session: release a held button, turn the knob
+ * or press. returns when the following one is due, NEVER at the end.
+ */
+static int64_t input_step()
+{
+    display_event();
+    if(pin) {
+        pin = false;
+        button.edge(now_us);
+        return session_left > 0 ? now_us + rand_int(120, 900) * 1000LL : NEVER;
+    }
+    session_left--;
+    if(rand_int(0, 99) < 65) {
+        int16_t detents = rand_int(1, 3) * (rand_int(0, 1) ? 1 : -1);
+        menu_rotate(&menu, detents, detents * rand_int(1, 5));
+        return session_left > 0 ? now_us + rand_int(120, 900) * 1000LL : NEVER;
+    }
+    pin = true;
+    button.edge(now_us);
+    /* mostly clicks, sometimes a long press that stops every valve */
+    int hold_ms = rand_int(0, 19) ? rand_int(60, 250) : 1800;
+    return now_us + hold_ms * 1000LL;
+}
+
+/* session start times for the day ahead, 07:00 to 22:00 local */
+static void plan_sessions(std::multiset<int64_t> *sessions)
+{
+    int64_t midnight = local_midnight_us(&today_tm, 0);
+    for(int i = 0; i < opt.sessions; i++) {
+        sessions->insert(midnight + rand_int(7 * 3600, 22 * 3600) * US);
+    }
+}
+
+/*******************************main***********************************/
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [--days N] [--start YYYY-MM-DD] [--tz POSIX_TZ] [--seed N]\n"
+            "          [--programs N] [--sessions N] [--jitter-ms N]\n"
+            "          [--step-s N] [--step-days N] [--show N]\n", name);
+    exit(2);
+}
+
+static void parse(int argc, char **argv)
+{
+    for(int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if(i + 1 >= argc) {
+            usage(argv[0]);
+        }
+        const char *value = argv[++i];
+        if(strcmp(arg, "--days") == 0) opt.days = atoi(value);
+        else if(strcmp(arg, "--start") == 0) opt.start = value;
+        else if(strcmp(arg, "--tz") == 0) opt.tz = value;
+        else if(strcmp(arg, "--seed") == 0) opt.seed = strtoul(value, NULL, 0);
+        else if(strcmp(arg, "--programs") == 0) opt.programs = atoi(value);
+        else if(strcmp(arg, "--sessions") == 0) opt.sessions = atoi(value);
+        else if(strcmp(arg, "--jitter-ms") == 0) opt.jitter_ms = atoi(value);
+        else if(strcmp(arg, "--step-s") == 0) opt.step_s = atoi(value);
+        else if(strcmp(arg, "--step-days") == 0) opt.step_days = atoi(value);
+        else if(strcmp(arg, "--show") == 0) opt.show = atoi(value);
+        else usage(argv[0]);
+    }
+    if(opt.days < 1 || opt.programs < 0 || opt.sessions < 0 || opt.jitter_ms < 0 ||
+       opt.jitter_ms >= SCHEDULE_GRACE_S * 1000 || opt.step_days < 1 || abs(opt.step_s) >= 36000) {
+        usage(argv[0]);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    struct tm start = {};
+    std::multiset<int64_t> sessions;
+    uint64_t sched_ns = 0, sched_day_ns = 0, sched_max_ns = 0;
+    uint64_t cpu_max_ns = 0;
+    struct timespec cpu_day, cpu_begin, cpu_end;
+    int days_done = 0;
+
+    parse(argc, argv);
+    /* the firmware's zone, and newlib's for the checks here */
+    if(!tz_set(opt.tz)) {
+        fprintf(stderr, "not a POSIX TZ string: %s\n", opt.tz);
+        usage(argv[0]);
+    }
+    rng.seed(opt.seed);
+    if(sscanf(opt.start, "%d-%d-%d", &start.tm_year, &start.tm_mon, &start.tm_mday) != 3) {
+        usage(argv[0]);
+    }
+    start.tm_year -= 1900;
+    start.tm_mon -= 1;
+    start.tm_isdst = -1;
+    now_us = mktime(&start) * US;
+
+    programs_init();
+    pm_init();
+    menu_home(&menu);
+    for(uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+        zones[zone].close_us = NEVER;
+        plans[zone].next_start = (time_t) -1; // as valve_scheduler_init
+    }
+    day_begin();
+    plan_sessions(&sessions);
+
+    int64_t midnight_us = local_midnight_us(&today_tm, 1);
+    int64_t wake_us = now_us; // valve_task starts with a replan
+    int64_t input_us = NEVER;
+    int64_t step_us = opt.step_s ? local_midnight_us(&today_tm, opt.step_days - 1) + 43200 * US : NEVER;
+    int64_t sync_us = now_us + SYNC_INTERVAL_S * US;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_begin);
+    cpu_day = cpu_begin;
+    while(days_done < opt.days) {
+        int64_t close_us = NEVER;
+        uint8_t closing = 0;
+        for(uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+            if(zones[zone].close_us < close_us) {
+                close_us = zones[zone].close_us;
+                closing = zone;
+            }
+        }
+        int64_t session_us = sessions.empty() ? NEVER : *sessions.begin();
+        int64_t button_us = button.deadline() ? button.deadline() : NEVER;
+
+        /* equal times: a close before a reopen, a day boundary before a start */
+        int64_t next = std::min({close_us, midnight_us, step_us, session_us, input_us, button_us,
+                                 display_off_us, sync_us, wake_us});
+        /* past a step forward, what was due in the span jumped over
+         * happens at once rather than back in time */
+        now_us = std::max(now_us, next);
+        if(next == close_us) {
+            valve_close(closing);
+        } else if(next == midnight_us) {
+            struct timespec t;
+            day_end();
+            day_begin();
+            plan_sessions(&sessions);
+            midnight_us = local_midnight_us(&today_tm, 1);
+            clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+            cpu_max_ns = std::max<uint64_t>(cpu_max_ns, (t.tv_sec - cpu_day.tv_sec) * 1000000000ULL +
+                                                        t.tv_nsec - cpu_day.tv_nsec);
+            cpu_day = t;
+            sched_max_ns = std::max(sched_max_ns, sched_day_ns);
+            sched_day_ns = 0;
+            days_done++;
+        } else if(next == step_us) {
+            /* a sync stepped the wall clock. esp_timer closes keep
+             * their duration, and the scheduler replans */
+            if(opt.step_s > 0) {
+                step_skip(now_us / US, now_us / US + opt.step_s);
+            }
+            now_us += opt.step_s * US;
+            for(zone_t &z : zones) {
+                if(z.open) {
+                    z.open_us += opt.step_s * US;
+                    z.close_us += opt.step_s * US;
+                }
+            }
+            step_us = local_midnight_us(&today_tm, opt.step_days) + 43200 * US;
+            replan = true;
+            wake_us = now_us;
+        } else if(next == session_us) {
+            sessions.erase(sessions.begin());
+            if(input_us == NEVER && !pin) {
+                sessions_run++;
+                session_left = rand_int(4, 16);
+                input_us = now_us;
+            }
+        } else if(next == input_us) {
+            input_us = input_step();
+        } else if(next == button_us) {
+            gesture(button.expire(now_us, pin));
+        } else if(next == display_off_us) {
+            display_off();
+        } else if(next == sync_us) {
+            sync_run();
+            sync_us = now_us + SYNC_INTERVAL_S * US;
+        } else {
+            uint64_t ns = 0;
+            wake_us = scheduler_wake(&ns);
+            sched_ns += ns;
+            sched_day_ns += ns;
+        }
+        if(replan) {
+            /* an edit notified the scheduler */
+            uint64_t ns = 0;
+            wake_us = scheduler_wake(&ns);
+            sched_ns += ns;
+            sched_day_ns += ns;
+        }
+    }
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_end);
+
+    double cpu_s = (cpu_end.tv_sec - cpu_begin.tv_sec) + (cpu_end.tv_nsec - cpu_begin.tv_nsec) / 1e9;
+    uint32_t missed = 0, duplicate = 0;
+
+    if(issues > (uint32_t) opt.show) {
+        printf("... %" PRIu32 " more\n", issues - opt.show);
+    }
+    printf("%d days from %s, TZ %s, seed %u\n", opt.days, opt.start, opt.tz, opt.seed);
+    printf("zone  programs   runs  manual  runtime h  missed  duplicate\n");
+    for(uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+        const zone_t *z = &zones[zone];
+        int count = 0;
+        for(uint8_t id = 0; id < PROGRAM_MAX; id++) {
+            count += (used & (1UL << id)) && programs[id].zone == zone;
+        }
+        printf("%4d  %8d  %5" PRIu32 "  %6" PRIu32 "  %9.1f  %6" PRIu32 "  %9" PRIu32 "\n", zone + 1, count,
+               z->runs, z->manual, z->runtime_s / 3600.0, z->missed, z->duplicate);
+        missed += z->missed;
+        duplicate += z->duplicate;
+    }
+    if(opt.step_s > 0) {
+        printf("%" PRIu32 " starts skipped by clock steps\n", skipped_starts);
+    }
+    printf("cpu per day: %.2f us mean, %.2f us max (scheduler %.3f us mean, %.3f us max)\n",
+           cpu_s * 1e6 / opt.days, cpu_max_ns / 1e3, sched_ns / 1e3 / opt.days, sched_max_ns / 1e3);
+    printf("%" PRIu32 " scheduler wakes, %" PRIu32 " input sessions, %" PRIu32 " edits, %" PRIu32
+           " long press stops, %" PRIu32 " sync requests, %.3f s cpu\n",
+           wakes, sessions_run, edits, stops, syncs, cpu_s);
+
+    pm_stats_t pm;
+    pm_model_stats(&pm);
+    int64_t total_us = 0;
+    for(int64_t us : pm.us) {
+        total_us += us;
+    }
+    printf("power     per day  share\n");
+    for(int mode = 0; mode < PM_MODE_COUNT; mode++) {
+        int mhz = pm_model_mode_mhz(static_cast<pm_mode_t>(mode));
+        char name[16];
+        if(mhz) {
+            snprintf(name, sizeof(name), "%d MHz", mhz);
+        } else {
+            snprintf(name, sizeof(name), "sleep");
+        }
+        printf("%-8s %8.1f s %5.1f%%\n", name, pm.us[mode] / 1e6 / opt.days,
+               total_us ? pm.us[mode] * 100.0 / total_us : 0.0);
+    }
+    printf("%.1f light sleeps per day, %" PRIu32 " lock imbalances\n", (double) pm.sleeps / opt.days,
+           pm.imbalance);
+    esp_pm_dump_locks(stdout);
+    return missed || duplicate || pm.imbalance ? 1 : 0;
+}
@@ -0,0 +1,117 @@
+#include <inttypes.h>
+#include <string.h>
+
+#include "aip31068_model.h"
+
+#define CO 0x80
+#define RS 0x40
+
+Aip31068Model::Aip31068Model()
+{
+    memset(_ddram, ' ', sizeof(_ddram));
+    memset(_cgram, 0, sizeof(_cgram));
+}
+
+void Aip31068Model::write(const uint8_t *bytes, size_t len)
+{
+    size_t i = 0;
+    while(i + 1 < len) {
+        uint8_t control = bytes[i++];
+        if(control & CO) {
+            (control & RS) ? data(bytes[i]) : command(bytes[i]);
+            i++;
+            continue;
+        }
+        for(; i < len; i++) {
+            (control & RS) ? data(bytes[i]) : command(bytes[i]);
+        }
+    }
+}
+
+void Aip31068Model::read(uint8_t *data, size_t len)
+{
+    memset(data, 0xFF, len);
+}
+
+/* step the address counter, DDRAM wraps line to line in two line mode */
+void Aip31068Model::move(bool increment)
+{
+    if(_to_cgram) {
+        _cgram_ac = (_cgram_ac + (increment ? 1 : -1)) & 0x3F;
+        return;
+    }
+    uint8_t line = _ac & 0x40;
+    uint8_t col = _ac & 0x3F;
+    if(increment) {
+        if(++col < LINE) {
+            _ac = line | col;
+        } else {
+            _ac = line ^ 0x40;
+        }
+    } else {
+        if(col > 0) {
+            _ac = line | (col - 1);
+        } else {
+            _ac = (line ^ 0x40) | (LINE - 1);
+        }
+    }
+}
+
+void Aip31068Model::command(uint8_t cmd)
+{
+    _commands++;
+    if(cmd & 0x80) {               // set DDRAM address
+        _ac = cmd & 0x7F;
+        _to_cgram = false;
+    } else if(cmd & 0x40) {        // set CGRAM address
+        _cgram_ac = cmd & 0x3F;
+        _to_cgram = true;
+    } else if(cmd & 0x20) {        // function set
+        _function = cmd & 0x1C;
+    } else if(cmd & 0x10) {        // cursor or display shift
+        bool right = cmd & 0x04;
+        if(cmd & 0x08) {
+            _shift = (_shift + (right ? LINE - 1 : 1)) % LINE;
+        } else {
+            move(right);
+        }
+    } else if(cmd & 0x08) {        // display on/off control
+        _display = cmd & 0x07;
+    } else if(cmd & 0x04) {        // entry mode set
+        _increment = cmd & 0x02;
+        _entry_shift = cmd & 0x01;
+    } else if(cmd & 0x02) {        // return home
+        _ac = 0;
+        _shift = 0;
+        _to_cgram = false;
+    } else if(cmd & 0x01) {        // clear display
+        memset(_ddram, ' ', sizeof(_ddram));
+        _ac = 0;
+        _shift = 0;
+        _increment = true;
+        _to_cgram = false;
+    }
+}
+
+void Aip31068Model::data(uint8_t value)
+{
+    _data_writes++;
+    if(_to_cgram) {
+        _cgram[_cgram_ac] = value & 0x1F;
+    } else {
+        _ddram[(_ac & 0x40 ? LINE : 0) + (_ac & 0x3F) % LINE] = value;
+        if(_entry_shift) {
+            _shift = (_shift + (_increment ? 1 : LINE - 1)) % LINE;
+        }
+    }
+    move(_increment);
+}
+
+void Aip31068Model::row(uint8_t r, char out[COLS + 1]) const
+{
+    for(uint8_t col = 0; col < COLS; col++) {
+        uint8_t c = _ddram[(r ? LINE : 0) + (_shift + col) % LINE];
+        out[col] = display_on() ? static_cast<char>(c) : ' ';
+    }
+    out[COLS] = '\0';
+}
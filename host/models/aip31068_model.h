@@ -0,0 +1,59 @@
+#ifndef __AIP31068_MODEL_H__
+#define __AIP31068_MODEL_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "model_i2c.h"
+
+/**
+ * behavioural AIP31068, the HD44780 compatible controller behind the
+ * DFRobot LCD's I2C port. every write is control byte, data pairs: Co
+ * (bit 7) set means one byte follows before the next control byte, Co
+ * clear means the rest of the transfer is data. RS (bit 6) selects
+ * data RAM over the instruction register.
+ *
+ * the model keeps 80 bytes of DDRAM (two lines of 40, at 0x00 and
+ * 0x40), 64 bytes of CGRAM, the address counter, entry mode, display
+ * shift and on/off state, and shows what the glass would.
+ */
+class Aip31068Model : public I2cDeviceModel {
+public:
+    static constexpr uint8_t ADDR = 0x3E;
+    static constexpr uint8_t COLS = 16;
+    static constexpr uint8_t LINE = 40;
+
+    Aip31068Model(); // power on: blank, display off
+
+    void write(const uint8_t *data, size_t len) override;
+    void read(uint8_t *data, size_t len) override; // not wired on the board
+
+    /* the characters on row r, codes as written, terminated */
+    void row(uint8_t r, char out[COLS + 1]) const;
+    const uint8_t *glyph(uint8_t n) const { return &_cgram[(n & 0x07) * 8]; }
+    bool display_on() const { return _display & 0x04; }
+    bool two_lines() const { return _function & 0x08; }
+
+    uint32_t commands() const { return _commands; }
+    uint32_t data_writes() const { return _data_writes; }
+
+private:
+    void command(uint8_t cmd);
+    void data(uint8_t value);
+    void move(bool increment);
+
+    uint8_t _ddram[2 * LINE];
+    uint8_t _cgram[64];
+    uint8_t _ac = 0;         // DDRAM address, 0x00-0x27 or 0x40-0x67
+    uint8_t _cgram_ac = 0;
+    bool _to_cgram = false;  // which RAM the address counter points at
+    bool _increment = true;
+    bool _entry_shift = false;
+    int8_t _shift = 0;       // display window offset, 0 to LINE - 1
+    uint8_t _display = 0;    // D C B
+    uint8_t _function = 0;   // DL N F
+    uint32_t _commands = 0;
+    uint32_t _data_writes = 0;
+};
+
+#endif /* aip31068_model.h */
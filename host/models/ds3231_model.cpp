@@ -0,0 +1,141 @@
+#include <inttypes.h>
+#include <string.h>
+
+#include "ds3231_model.h"
+
+#define REG_SECONDS 0x00
+#define REG_MINUTES 0x01
+#define REG_HOURS   0x02
+#define REG_DAY     0x03
+#define REG_DATE    0x04
+#define REG_MONTH   0x05
+#define REG_YEAR    0x06
+#define REG_CONTROL 0x0E
+#define REG_STATUS  0x0F
+#define REG_TEMP    0x11
+
+#define CENTURY 0x80
+#define OSF     0x80
+
+/* bits each register keeps, the rest read as 0 */
+static const uint8_t reg_mask[Ds3231Model::REGS] = {
+    0x7F, 0x7F, 0x7F, 0x07, 0x3F, 0x9F, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xDF, 0x8F, 0xFF, 0xFF, 0xC0
+};
+
+static uint8_t bcd_inc(uint8_t bcd)
+{
+    return (bcd & 0x0F) == 9 ? (bcd & 0xF0) + 0x10 : bcd + 1;
+}
+
+static uint8_t bcd_dec(uint8_t bcd)
+{
+    return (bcd >> 4) * 10 + (bcd & 0x0F);
+}
+
+static uint8_t days_in_month(uint8_t month, uint8_t year)
+{
+    static const uint8_t days[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    if(month < 1 || month > 12) {
+        return 31; // garbage in, the chip counts on regardless
+    }
+    /* the chip treats every year divisible by 4 as leap, 2100 included */
+    if(month == 2 && year % 4 == 0) {
+        return 29;
+    }
+    return days[month - 1];
+}
+
+Ds3231Model::Ds3231Model()
+{
+    memset(_regs, 0, sizeof(_regs));
+    _regs[REG_DAY] = 0x01;
+    _regs[REG_DATE] = 0x01;
+    _regs[REG_MONTH] = 0x01;
+    _regs[REG_CONTROL] = 0x1C; // INTCN, RS2, RS1
+    _regs[REG_STATUS] = OSF | 0x08; // EN32kHz
+    set_temperature(25 * 4);
+}
+
+/**
+ * the first byte sets the pointer, the rest are stored from there on.
+ * the temperature is read only, the status flags can only be cleared.
+ */
+void Ds3231Model::write(const uint8_t *data, size_t len)
+{
+    if(len == 0) {
+        return;
+    }
+    _pointer = data[0] % REGS;
+    for(size_t i = 1; i < len; i++) {
+        uint8_t r = _pointer;
+        uint8_t value = data[i] & reg_mask[r];
+        if(r == REG_STATUS) {
+            _regs[r] = (_regs[r] & data[i] & 0x83) | (data[i] & 0x08) | (_regs[r] & 0x04); // BSY is read only
+        } else if(r < REG_TEMP) {
+            _regs[r] = value;
+        }
+        _pointer = (_pointer + 1) % REGS;
+    }
+}
+
+/* the time registers are latched at the start, so a read is coherent */
+void Ds3231Model::read(uint8_t *data, size_t len)
+{
+    for(size_t i = 0; i < len; i++) {
+        data[i] = _regs[_pointer];
+        _pointer = (_pointer + 1) % REGS;
+    }
+}
+
+void Ds3231Model::tick_second()
+{
+    if((_regs[REG_SECONDS] = bcd_inc(_regs[REG_SECONDS])) < 0x60) return;
+    _regs[REG_SECONDS] = 0;
+    if((_regs[REG_MINUTES] = bcd_inc(_regs[REG_MINUTES])) < 0x60) return;
+    _regs[REG_MINUTES] = 0;
+    if((_regs[REG_HOURS] = bcd_inc(_regs[REG_HOURS])) < 0x24) return;
+    _regs[REG_HOURS] = 0;
+
+    _regs[REG_DAY] = _regs[REG_DAY] >= 7 ? 1 : _regs[REG_DAY] + 1;
+    uint8_t month = bcd_dec(_regs[REG_MONTH] & 0x1F);
+    uint8_t date = bcd_dec(_regs[REG_DATE]);
+    if(date < days_in_month(month, bcd_dec(_regs[REG_YEAR]))) {
+        _regs[REG_DATE] = bcd_inc(_regs[REG_DATE]);
+        return;
+    }
+    _regs[REG_DATE] = 0x01;
+    if(month < 12) {
+        _regs[REG_MONTH] = (_regs[REG_MONTH] & CENTURY) | bcd_inc(_regs[REG_MONTH] & 0x1F);
+        return;
+    }
+    _regs[REG_MONTH] = (_regs[REG_MONTH] & CENTURY) | 0x01;
+    if(_regs[REG_YEAR] == 0x99) {
+        _regs[REG_YEAR] = 0;
+        _regs[REG_MONTH] ^= CENTURY;
+    } else {
+        _regs[REG_YEAR] = bcd_inc(_regs[REG_YEAR]);
+    }
+}
+
+/*******************************public*********************************/
+
+/**
+ * second by second, as the counters carry. fast enough for a year of
+ * simulated time; whole days are not skipped because a register a
+ * driver left out of range must carry the way the chip's would.
+ */
+void Ds3231Model::tick(uint32_t seconds)
+{
+    while(seconds-- > 0) {
+        tick_second();
+    }
+}
+
+void Ds3231Model::set_temperature(int16_t quarter_deg)
+{
+    uint16_t raw = static_cast<uint16_t>(quarter_deg) << 6;
+    _regs[REG_TEMP] = raw >> 8;
+    _regs[REG_TEMP + 1] = raw & 0xC0;
+}
@@ -0,0 +1,48 @@
+#ifndef __DS3231_MODEL_H__
+#define __DS3231_MODEL_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "model_i2c.h"
+
+/**
+ * behavioural DS3231: the 19 register map behind an auto-incrementing
+ * pointer, and timekeeping counters that carry the way the chip's do.
+ *
+ *   0x00-0x06 seconds .. year, BCD. month bit 7 is the century, it
+ *             toggles when the year rolls 99 -> 00. the weekday counts
+ *             1-7 on its own, the chip never derives it from the date
+ *   0x07-0x0D alarms, stored only
+ *   0x0E      control
+ *   0x0F      status: OSF is set at power up and only cleared by a write
+ *   0x10      aging offset
+ *   0x11-0x12 temperature, read only, quarter degrees left aligned
+ *
+ * 24 hour mode only, which is all DS3231_RTC writes.
+ */
+class Ds3231Model : public I2cDeviceModel {
+public:
+    static constexpr uint8_t ADDR = 0x68;
+    static constexpr uint8_t REGS = 0x13;
+
+    Ds3231Model(); // power on: 2000-01-01 00:00:00, OSF set, 25 C
+
+    void write(const uint8_t *data, size_t len) override;
+    void read(uint8_t *data, size_t len) override;
+
+    /* run the oscillator for seconds */
+    void tick(uint32_t seconds);
+    void set_temperature(int16_t quarter_deg);
+
+    uint8_t reg(uint8_t r) const { return _regs[r % REGS]; }
+    bool oscillator_stopped() const { return _regs[0x0F] & 0x80; }
+
+private:
+    void tick_second();
+
+    uint8_t _regs[REGS];
+    uint8_t _pointer = 0;
+};
+
+#endif /* ds3231_model.h */
@@ -0,0 +1,75 @@
+#include <inttypes.h>
+#include <string.h>
+
+#include "hal_gpio.h"
+
+typedef struct {
+    bool configured;
+    bool output;
+    bool level;
+    hal_edge_t edge;
+    uint32_t changes;
+} pin_model_t;
+
+static pin_model_t pins[MODEL_GPIO_MAX];
+
+esp_err_t ModelGpio::output(uint8_t pin)
+{
+    if(pin >= MODEL_GPIO_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pins[pin] = {true, true, false, HAL_EDGE_NONE, 0};
+    return ESP_OK;
+}
+
+esp_err_t ModelGpio::input(uint8_t pin, hal_edge_t edge)
+{
+    if(pin >= MODEL_GPIO_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pins[pin] = {true, false, true, edge, 0};
+    return ESP_OK;
+}
+
+void ModelGpio::set(uint8_t pin, bool level)
+{
+    if(pin >= MODEL_GPIO_MAX || !pins[pin].output) {
+        return; // the pad ignores it, as on the chip
+    }
+    if(pins[pin].level != level) {
+        pins[pin].changes++;
+    }
+    pins[pin].level = level;
+}
+
+bool ModelGpio::get(uint8_t pin)
+{
+    return pin < MODEL_GPIO_MAX && pins[pin].level;
+}
+
+void ModelGpio::drive(uint8_t pin, bool level)
+{
+    if(pin < MODEL_GPIO_MAX && !pins[pin].output) {
+        pins[pin].level = level;
+    }
+}
+
+bool ModelGpio::is_output(uint8_t pin)
+{
+    return pin < MODEL_GPIO_MAX && pins[pin].output;
+}
+
+hal_edge_t ModelGpio::edge(uint8_t pin)
+{
+    return pin < MODEL_GPIO_MAX ? pins[pin].edge : HAL_EDGE_NONE;
+}
+
+uint32_t ModelGpio::changes(uint8_t pin)
+{
+    return pin < MODEL_GPIO_MAX ? pins[pin].changes : 0;
+}
+
+void ModelGpio::reset()
+{
+    memset(pins, 0, sizeof(pins));
+}
@@ -0,0 +1,27 @@
+#ifndef __MODEL_GPIO_H__
+#define __MODEL_GPIO_H__
+
+#include <inttypes.h>
+#include "esp_err.h"
+
+#define MODEL_GPIO_MAX 49 // ESP32-S3 pads
+
+/**
+ * the host Gpio (hal_gpio.h). outputs keep the level last set and
+ * count their changes; inputs idle high (pulled up) until driven.
+ */
+struct ModelGpio {
+    static esp_err_t output(uint8_t pin);
+    static esp_err_t input(uint8_t pin, hal_edge_t edge);
+    static void set(uint8_t pin, bool level);
+    static bool get(uint8_t pin);
+
+    /* outside view of the pins */
+    static void drive(uint8_t pin, bool level); // an input, as the hardware would
+    static bool is_output(uint8_t pin);
+    static hal_edge_t edge(uint8_t pin);
+    static uint32_t changes(uint8_t pin);       // level changes an output made
+    static void reset();
+};
+
+#endif /* model_gpio.h */
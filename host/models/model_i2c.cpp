@@ -0,0 +1,121 @@
+#include <inttypes.h>
+#include <string.h>
+#include <vector>
+
+#include "model_i2c.h"
+#include "board_config.h"
+
+#define I2C_ADDR_MAX    0x80
+
+static I2cDeviceModel *devices[I2C_ADDR_MAX];
+static std::vector<i2c_transaction_t> transactions;
+
+/* start, stop and a restart are about a bit time each */
+size_t i2c_wire_bytes(const i2c_transaction_t &t)
+{
+    size_t bytes = 1 + t.out.size(); // address, then data
+    if(t.op == I2C_OP_WRITE_READ) {
+        bytes += 1; // address again after the restart
+    }
+    return bytes + t.in_len;
+}
+
+uint32_t i2c_wire_us(const i2c_transaction_t &t)
+{
+    /* 8 data bits and an ack per byte, plus start and stop */
+    uint32_t bits = i2c_wire_bytes(t) * 9 + 2 + (t.op == I2C_OP_WRITE_READ);
+    return bits * 1000000ULL / board::i2c_freq_hz;
+}
+
+static esp_err_t transfer(i2c_op_t op, uint8_t addr, const uint8_t *head, size_t head_len,
+                          const uint8_t *out, size_t out_len, uint8_t *in, size_t in_len)
+{
+    i2c_transaction_t t;
+    t.op = op;
+    t.addr = addr;
+    t.out.assign(head, head + head_len);
+    t.out.insert(t.out.end(), out, out + out_len);
+    t.in_len = in_len;
+    t.result = ESP_OK;
+
+    I2cDeviceModel *device = addr < I2C_ADDR_MAX ? devices[addr] : NULL;
+    if(device == NULL) {
+        t.result = ESP_FAIL;
+    } else {
+        if(op != I2C_OP_READ) {
+            device->write(t.out.data(), t.out.size());
+        }
+        if(op != I2C_OP_WRITE) {
+            device->read(in, in_len);
+        }
+    }
+    transactions.push_back(std::move(t));
+    return transactions.back().result;
+}
+
+/*******************************public*********************************/
+
+esp_err_t ModelI2c::init()
+{
+    return ESP_OK;
+}
+
+esp_err_t ModelI2c::write(uint8_t addr, const uint8_t *data, size_t len)
+{
+    return transfer(I2C_OP_WRITE, addr, NULL, 0, data, len, NULL, 0);
+}
+
+esp_err_t ModelI2c::read(uint8_t addr, uint8_t *data, size_t len)
+{
+    return transfer(I2C_OP_READ, addr, NULL, 0, NULL, 0, data, len);
+}
+
+esp_err_t ModelI2c::write_reg(uint8_t addr, uint8_t reg, const uint8_t *data, size_t len)
+{
+    return transfer(I2C_OP_WRITE, addr, &reg, 1, data, len, NULL, 0);
+}
+
+esp_err_t ModelI2c::read_reg(uint8_t addr, uint8_t reg, uint8_t *data, size_t len)
+{
+    return transfer(I2C_OP_WRITE_READ, addr, &reg, 1, NULL, 0, data, len);
+}
+
+void ModelI2c::attach(uint8_t addr, I2cDeviceModel *device)
+{
+    if(addr < I2C_ADDR_MAX) {
+        devices[addr] = device;
+    }
+}
+
+void ModelI2c::detach_all()
+{
+    memset(devices, 0, sizeof(devices));
+}
+
+const std::vector<i2c_transaction_t> &ModelI2c::log()
+{
+    return transactions;
+}
+
+void ModelI2c::clear_log()
+{
+    transactions.clear();
+}
+
+void RegisterModel::write(const uint8_t *data, size_t len)
+{
+    if(len == 0) {
+        return;
+    }
+    _pointer = data[0];
+    for(size_t i = 1; i < len; i++) {
+        _regs[_pointer++] = data[i];
+    }
+}
+
+void RegisterModel::read(uint8_t *data, size_t len)
+{
+    for(size_t i = 0; i < len; i++) {
+        data[i] = _regs[_pointer++];
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef __MODEL_I2C_H__
+#define __MODEL_I2C_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <vector>
+#include "esp_err.h"
+
+/**
+ * a device on the virtual bus. write gets the bytes after addr+W up to
+ * the stop or restart, read fills the bytes clocked out after addr+R.
+ */
+class I2cDeviceModel {
+public:
+    virtual ~I2cDeviceModel() = default;
+    virtual void write(const uint8_t *data, size_t len) = 0;
+    virtual void read(uint8_t *data, size_t len) = 0;
+};
+
+enum i2c_op_t : uint8_t {
+    I2C_OP_WRITE,     // write and write_reg
+    I2C_OP_READ,
+    I2C_OP_WRITE_READ // read_reg: write, restart, read
+};
+
+/* one transaction as it went over the wire */
+typedef struct {
+    i2c_op_t op;
+    uint8_t addr;
+    std::vector<uint8_t> out; // after addr+W, a register first
+    size_t in_len;            // bytes read back
+    esp_err_t result;         // ESP_FAIL if nobody acked
+} i2c_transaction_t;
+
+/* bytes on the wire including addresses, and time at board::i2c_freq_hz */
+size_t i2c_wire_bytes(const i2c_transaction_t &t);
+uint32_t i2c_wire_us(const i2c_transaction_t &t);
+
+/**
+ * the host I2cBus (hal_i2c.h). models attach at their address and
+ * every transaction is logged, so a caller can check exactly what a
+ * driver put on the wire. an address with no model NACKs: ESP_FAIL,
+ * as the legacy driver reports it.
+ */
+struct ModelI2c {
+    static esp_err_t init();
+    static esp_err_t write(uint8_t addr, const uint8_t *data, size_t len);
+    static esp_err_t read(uint8_t addr, uint8_t *data, size_t len);
+    static esp_err_t write_reg(uint8_t addr, uint8_t reg, const uint8_t *data, size_t len);
+    static esp_err_t read_reg(uint8_t addr, uint8_t reg, uint8_t *data, size_t len);
+
+    static void attach(uint8_t addr, I2cDeviceModel *device);
+    static void detach_all();
+    static const std::vector<i2c_transaction_t> &log();
+    static void clear_log();
+};
+
+/**
+ * a plain register file behind an auto-incrementing pointer, for parts
+ * only written to, such as the LCD's backlight PWM controller
+ */
+class RegisterModel : public I2cDeviceModel {
+public:
+    void write(const uint8_t *data, size_t len) override;
+    void read(uint8_t *data, size_t len) override;
+    uint8_t reg(uint8_t r) const { return _regs[r]; }
+
+private:
+    uint8_t _regs[256] = {};
+    uint8_t _pointer = 0;
+};
+
+#endif /* model_i2c.h */
@@ -0,0 +1,173 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "pm_model.h"
+
+#define PM_LOCK_MAX 8
+#define APB_MAX_MHZ 80
+
+struct esp_pm_lock {
+    esp_pm_lock_type_t type;
+    const char *name;
+    uint32_t count;     // nested acquires
+    uint32_t acquires;
+};
+
+static esp_pm_lock locks[PM_LOCK_MAX];
+static size_t lock_count = 0;
+static uint32_t held[ESP_PM_NO_LIGHT_SLEEP + 1]; // acquires held, per lock type
+
+/* IDF's default before esp_pm_configure(): no scaling, no sleep */
+static esp_pm_config_t config = {160, 160, false};
+static const int64_t *clock_us = NULL;
+static int64_t charged_us = 0; // time up to which stats are charged
+static int64_t debt_us = 0;    // bursts still to take off the mode in effect
+static pm_stats_t stats;
+
+static pm_mode_t mode_now()
+{
+    if(held[ESP_PM_CPU_FREQ_MAX]) {
+        return PM_MODE_MAX;
+    }
+    if(held[ESP_PM_APB_FREQ_MAX]) {
+        return PM_MODE_APB;
+    }
+    if(held[ESP_PM_NO_LIGHT_SLEEP] || !config.light_sleep_enable) {
+        return PM_MODE_MIN;
+    }
+    return PM_MODE_SLEEP;
+}
+
+static pm_mode_t mode_of(esp_pm_lock_type_t type)
+{
+    return type == ESP_PM_CPU_FREQ_MAX ? PM_MODE_MAX :
+           type == ESP_PM_APB_FREQ_MAX ? PM_MODE_APB : PM_MODE_MIN;
+}
+
+/* charge the time since the last change to the mode in effect */
+static void advance()
+{
+    if(clock_us == NULL) {
+        return;
+    }
+    int64_t elapsed = *clock_us - charged_us;
+    int64_t paid = std::min(elapsed, debt_us);
+    stats.us[mode_now()] += elapsed - paid;
+    debt_us -= paid;
+    charged_us = *clock_us;
+}
+
+/*******************************esp_pm*********************************/
+
+esp_err_t esp_pm_configure(const void *vconfig)
+{
+    const esp_pm_config_t *c = static_cast<const esp_pm_config_t *>(vconfig);
+    if(c->min_freq_mhz > c->max_freq_mhz) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    advance();
+    config = *c;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_get_configuration(void *vconfig)
+{
+    *static_cast<esp_pm_config_t *>(vconfig) = config;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t lock_type, int arg, const char *name, esp_pm_lock_handle_t *out_handle)
+{
+    if(lock_count >= PM_LOCK_MAX) {
+        return ESP_ERR_NO_MEM;
+    }
+    locks[lock_count] = {lock_type, name, 0, 0};
+    *out_handle = &locks[lock_count++];
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle)
+{
+    if(handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    advance();
+    handle->count++;
+    handle->acquires++;
+    held[handle->type]++;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle)
+{
+    if(handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if(handle->count == 0) {
+        stats.imbalance++;
+        return ESP_ERR_INVALID_STATE;
+    }
+    advance();
+    handle->count--;
+    held[handle->type]--;
+    if(mode_now() == PM_MODE_SLEEP) {
+        stats.sleeps++;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_dump_locks(FILE *stream)
+{
+    fprintf(stream, "%-8s %-16s %6s %10s\n", "name", "type", "count", "acquires");
+    for(size_t i = 0; i < lock_count; i++) {
+        static const char *types[] = {"CPU_FREQ_MAX", "APB_FREQ_MAX", "NO_LIGHT_SLEEP"};
+        fprintf(stream, "%-8s %-16s %6" PRIu32 " %10" PRIu32 "\n", locks[i].name, types[locks[i].type],
+                locks[i].count, locks[i].acquires);
+    }
+    return ESP_OK;
+}
+
+/*******************************model**********************************/
+
+void pm_model_init(const int64_t *now_us)
+{
+    clock_us = now_us;
+    charged_us = *now_us;
+    debt_us = 0;
+    memset(&stats, 0, sizeof(stats));
+}
+
+void pm_model_burst(esp_pm_lock_handle_t handle, int64_t us)
+{
+    advance();
+    pm_mode_t mode = mode_of(handle->type);
+    /* a burst under a faster lock changes nothing */
+    if(mode >= mode_now()) {
+        return;
+    }
+    handle->acquires++;
+    stats.us[mode] += us;
+    debt_us += us;
+}
+
+void pm_model_stats(pm_stats_t *out)
+{
+    advance();
+    *out = stats;
+}
+
+int pm_model_mode_mhz(pm_mode_t mode)
+{
+    switch(mode) {
+        case PM_MODE_MAX:
+            return config.max_freq_mhz;
+        case PM_MODE_APB:
+            return std::max(APB_MAX_MHZ, config.min_freq_mhz);
+        case PM_MODE_MIN:
+            return config.min_freq_mhz;
+        default:
+            return 0;
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef __PM_MODEL_H__
+#define __PM_MODEL_H__
+
+#include <inttypes.h>
+#include "esp_pm.h"
+
+/**
+ * esp_pm on virtual time (shim/esp_pm.h). the mode follows the locks
+ * held as on the chip: CPU max runs at max_freq_mhz, APB max at no less
+ * than 80 MHz, no light sleep at min_freq_mhz, and with no lock held
+ * the chip light sleeps. time is charged to the mode in effect each
+ * time a lock changes, read from the clock given to pm_model_init().
+ */
+enum pm_mode_t {
+    PM_MODE_MAX,
+    PM_MODE_APB,
+    PM_MODE_MIN,
+    PM_MODE_SLEEP,
+    PM_MODE_COUNT
+};
+
+typedef struct {
+    int64_t us[PM_MODE_COUNT];
+    uint32_t sleeps;     // light sleep entries
+    uint32_t imbalance;  // releases without an acquire
+} pm_stats_t;
+
+void pm_model_init(const int64_t *now_us);
+
+/**
+ * a lock held for a stretch shorter than the model's events, as a
+ * redraw's APB lock: us are charged to its mode and taken off the
+ * mode in effect, no later event needed to release it.
+ */
+void pm_model_burst(esp_pm_lock_handle_t handle, int64_t us);
+
+/* charge time up to now, then the totals since init */
+void pm_model_stats(pm_stats_t *stats);
+int pm_model_mode_mhz(pm_mode_t mode); // 0 for light sleep
+
+#endif /* pm_model.h */
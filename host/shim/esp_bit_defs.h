@@ -0,0 +1,11 @@
+#ifndef __HOST_ESP_BIT_DEFS_H__
+#define __HOST_ESP_BIT_DEFS_H__
+
+/* the subset of esp_bit_defs.h soc/soc_caps.h uses, for the host build */
+
+#define BIT22 0x00400000
+#define BIT23 0x00800000
+#define BIT24 0x01000000
+#define BIT25 0x02000000
+
+#endif /* esp_bit_defs.h */
@@ -0,0 +1,43 @@
+#ifndef __HOST_ESP_ERR_H__
+#define __HOST_ESP_ERR_H__
+
+/* the subset of esp_err.h the drivers use, for the host build */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK                   0
+#define ESP_FAIL                 -1
+#define ESP_ERR_NO_MEM           0x101
+#define ESP_ERR_INVALID_ARG      0x102
+#define ESP_ERR_INVALID_STATE    0x103
+#define ESP_ERR_INVALID_SIZE     0x104
+#define ESP_ERR_NOT_FOUND        0x105
+#define ESP_ERR_NOT_SUPPORTED    0x106
+#define ESP_ERR_TIMEOUT          0x107
+#define ESP_ERR_INVALID_RESPONSE 0x108
+
+static inline const char *esp_err_to_name(esp_err_t err)
+{
+    switch(err) {
+        case ESP_OK: return "ESP_OK";
+        case ESP_FAIL: return "ESP_FAIL";
+        case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_RESPONSE: return "ESP_ERR_INVALID_RESPONSE";
+        default: return "ESP_ERR";
+    }
+}
+
+#define ESP_ERROR_CHECK(x) do {                                       \
+        esp_err_t err_ = (x);                                         \
+        if(err_ != ESP_OK) {                                          \
+            fprintf(stderr, "%s failed: %s\n", #x, esp_err_to_name(err_)); \
+            abort();                                                  \
+        }                                                             \
+    } while(0)
+
+#endif /* esp_err.h */
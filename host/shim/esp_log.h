@@ -0,0 +1,14 @@
+#ifndef __HOST_ESP_LOG_H__
+#define __HOST_ESP_LOG_H__
+
+/* errors and warnings to stderr, the rest is dropped */
+
+#include <stdio.h>
+
+#define ESP_LOGE(tag, fmt, ...) fprintf(stderr, "E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) fprintf(stderr, "W %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) do { (void) (tag); } while(0)
+#define ESP_LOGD(tag, fmt, ...) do { (void) (tag); } while(0)
+#define ESP_LOGV(tag, fmt, ...) do { (void) (tag); } while(0)
+
+#endif /* esp_log.h */
@@ -0,0 +1,11 @@
+#ifndef __HOST_FREERTOS_H__
+#define __HOST_FREERTOS_H__
+
+#include <inttypes.h>
+
+typedef uint32_t TickType_t;
+
+#define configTICK_RATE_HZ 100
+#define pdMS_TO_TICKS(ms) ((TickType_t) ((uint64_t) (ms) * configTICK_RATE_HZ / 1000))
+
+#endif /* FreeRTOS.h */
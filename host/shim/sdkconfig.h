@@ -0,0 +1,22 @@
+#ifndef __HOST_SDKCONFIG_H__
+#define __HOST_SDKCONFIG_H__
+
+/* the board options of main/Kconfig.projbuild at their defaults */
+#define CONFIG_IRRIGATION_ZONE_COUNT 2
+#define CONFIG_IRRIGATION_ZONE1_GPIO 0
+#define CONFIG_IRRIGATION_ZONE2_GPIO 1
+#define CONFIG_IRRIGATION_ZONE3_GPIO 10
+#define CONFIG_IRRIGATION_ZONE4_GPIO 11
+#define CONFIG_IRRIGATION_ZONE5_GPIO 12
+#define CONFIG_IRRIGATION_ZONE6_GPIO 13
+#define CONFIG_IRRIGATION_ZONE7_GPIO 14
+#define CONFIG_IRRIGATION_ZONE8_GPIO 15
+#define CONFIG_IRRIGATION_ENCODER_S1_GPIO 5
+#define CONFIG_IRRIGATION_ENCODER_S2_GPIO 6
+#define CONFIG_IRRIGATION_ENCODER_KEY_GPIO 7
+#define CONFIG_IRRIGATION_I2C_PORT 0
+#define CONFIG_IRRIGATION_I2C_SDA_GPIO 8
+#define CONFIG_IRRIGATION_I2C_SCL_GPIO 9
+#define CONFIG_IRRIGATION_I2C_FREQ_HZ 100000
+
+#endif /* sdkconfig.h */
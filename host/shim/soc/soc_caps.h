@@ -0,0 +1,11 @@
+#ifndef __HOST_SOC_CAPS_H__
+#define __HOST_SOC_CAPS_H__
+
+/* the ESP32-S3 GPIO capabilities board_config.h checks pins against */
+
+#define SOC_GPIO_PIN_COUNT 49
+/* 22 to 25 are not bonded out */
+#define SOC_GPIO_VALID_GPIO_MASK (0x1FFFFFFFFFFFFULL & ~(0ULL | BIT22 | BIT23 | BIT24 | BIT25))
+#define SOC_GPIO_VALID_OUTPUT_GPIO_MASK SOC_GPIO_VALID_GPIO_MASK
+
+#endif /* soc/soc_caps.h */
@@ -3,8 +3,7 @@
 
 #include <inttypes.h>
 #include <time.h>
-#include "freertos/FreeRTOS.h"
-#include "driver/i2c.h"
+#include "esp_err.h"
 
 class DS3231_RTC {
 public:
@@ -32,14 +31,7 @@ public:
     esp_err_t setTime(struct tm *timeinfo);
     esp_err_t getTime(struct tm *timeinfo);
     float readTemperature();
-
-private:
-
-    // private methods...
-    esp_err_t i2c_master_init();
-    esp_err_t i2c_send(uint8_t addr, uint8_t *data, size_t len);
-    esp_err_t i2c_receive(uint8_t *data);
-    esp_err_t i2c_send_receive(uint8_t addr, uint8_t *data, size_t len);
+    esp_err_t getTemperature(int16_t *quarter_deg);
 
 };
 
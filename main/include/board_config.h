@@ -0,0 +1,92 @@
+#ifndef __BOARD_CONFIG_H__
+#define __BOARD_CONFIG_H__
+
+#include <array>
+#include <bit>
+#include <inttypes.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+#include "esp_bit_defs.h"
+#include "soc/soc_caps.h"
+
+/**
+ * zones and pins, set in menuconfig ("Irrigation board") and turned
+ * into constexpr tables here. table sizes, loops and pin masks are
+ * fixed at compile time and a pin used twice does not build; nothing
+ * is parsed or allocated at run time.
+ */
+
+/* number of irrigation zones (one valve each) */
+#define ZONE_COUNT CONFIG_IRRIGATION_ZONE_COUNT
+/* zone GPIO options in Kconfig */
+#define ZONE_COUNT_MAX 8
+
+namespace board {
+
+/* every zone option is defined, the ones past ZONE_COUNT are hidden */
+constexpr std::array<uint8_t, ZONE_COUNT_MAX> zone_gpio_options = {
+    CONFIG_IRRIGATION_ZONE1_GPIO, CONFIG_IRRIGATION_ZONE2_GPIO, CONFIG_IRRIGATION_ZONE3_GPIO,
+    CONFIG_IRRIGATION_ZONE4_GPIO, CONFIG_IRRIGATION_ZONE5_GPIO, CONFIG_IRRIGATION_ZONE6_GPIO,
+    CONFIG_IRRIGATION_ZONE7_GPIO, CONFIG_IRRIGATION_ZONE8_GPIO,
+};
+
+static_assert(ZONE_COUNT >= 1 && ZONE_COUNT <= ZONE_COUNT_MAX, "zone count out of the Kconfig range");
+
+/* valve output of each zone */
+constexpr std::array<uint8_t, ZONE_COUNT> zone_gpio = [] {
+    std::array<uint8_t, ZONE_COUNT> pins{};
+    for(size_t i = 0; i < pins.size(); i++) {
+        pins[i] = zone_gpio_options[i];
+    }
+    return pins;
+}();
+
+constexpr uint8_t encoder_s1_gpio = CONFIG_IRRIGATION_ENCODER_S1_GPIO;
+constexpr uint8_t encoder_s2_gpio = CONFIG_IRRIGATION_ENCODER_S2_GPIO;
+constexpr uint8_t encoder_key_gpio = CONFIG_IRRIGATION_ENCODER_KEY_GPIO;
+
+/* the LCD and the DS3231 share one bus */
+constexpr int i2c_port = CONFIG_IRRIGATION_I2C_PORT;
+constexpr uint8_t i2c_sda_gpio = CONFIG_IRRIGATION_I2C_SDA_GPIO;
+constexpr uint8_t i2c_scl_gpio = CONFIG_IRRIGATION_I2C_SCL_GPIO;
+constexpr uint32_t i2c_freq_hz = CONFIG_IRRIGATION_I2C_FREQ_HZ;
+
+template <size_t N>
+constexpr uint64_t pin_mask(const std::array<uint8_t, N> &pins)
+{
+    uint64_t mask = 0;
+    for(uint8_t pin : pins) {
+        mask |= 1ULL << pin;
+    }
+    return mask;
+}
+
+constexpr std::array<uint8_t, 3> encoder_gpio = {encoder_s1_gpio, encoder_s2_gpio, encoder_key_gpio};
+constexpr std::array<uint8_t, 2> i2c_gpio = {i2c_sda_gpio, i2c_scl_gpio};
+
+constexpr uint64_t zone_pin_mask = pin_mask(zone_gpio);
+constexpr uint64_t encoder_pin_mask = pin_mask(encoder_gpio);
+constexpr uint64_t i2c_pin_mask = pin_mask(i2c_gpio);
+
+/* the SPI flash and PSRAM lines, 33-37 too with octal flash or PSRAM */
+constexpr uint64_t flash_pin_mask = 0x7FULL << 26
+#if CONFIG_SPIRAM_MODE_OCT || CONFIG_ESPTOOLPY_OCT_FLASH
+                                    | 0x1FULL << 33
+#endif
+    ;
+
+/* valves and the bus drive their pins, the encoder only reads */
+constexpr bool pins_valid()
+{
+    constexpr uint64_t output = SOC_GPIO_VALID_OUTPUT_GPIO_MASK & ~flash_pin_mask;
+    constexpr uint64_t input = SOC_GPIO_VALID_GPIO_MASK & ~flash_pin_mask;
+    return (zone_pin_mask & ~output) == 0 && (i2c_pin_mask & ~output) == 0 && (encoder_pin_mask & ~input) == 0;
+}
+
+static_assert(pins_valid(), "a board GPIO is not a pad of the chip, or is a flash or PSRAM line");
+static_assert(std::popcount(zone_pin_mask | encoder_pin_mask | i2c_pin_mask) ==
+              ZONE_COUNT + encoder_gpio.size() + i2c_gpio.size(), "a board GPIO is assigned twice");
+
+} // namespace board
+
+#endif /* board_config.h */
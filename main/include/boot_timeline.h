@@ -0,0 +1,16 @@
+#ifndef __BOOT_TIMELINE_H__
+#define __BOOT_TIMELINE_H__
+
+#include <inttypes.h>
+
+#define BOOT_STAGES_MAX 16
+
+/**
+ * boot stages are stamped with esp_timer_get_time as they finish, from
+ * whichever task ran them, and logged together once boot settles.
+ * times count from esp_timer start, just after the bootloader.
+ */
+int64_t boot_mark(const char *stage);
+void boot_report();
+
+#endif /* boot_timeline.h */
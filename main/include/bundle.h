@@ -0,0 +1,81 @@
+#ifndef __BUNDLE_H__
+#define __BUNDLE_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "cbor_stream.h"
+#include "schedule.h"
+
+/**
+ * a schedule bundle: every program of a controller in one CBOR map,
+ * to copy a site's schedule from one unit to others.
+ *
+ *   { 0: version, 1: zones, 2: [[zone, hour, minute, days, duration, enabled], ...] }
+ *
+ * integer keys keep it small, about 10 bytes a program. the version
+ * key comes first; zones is the exporting unit's count, for reference.
+ * a reader skips keys it does not know, so later versions can add
+ * config without breaking older readers of the programs.
+ */
+#define BUNDLE_VERSION 1
+
+enum bundle_key_t : uint8_t {
+    BUNDLE_KEY_VERSION,
+    BUNDLE_KEY_ZONES,
+    BUNDLE_KEY_PROGRAMS
+};
+
+#define BUNDLE_PROGRAM_FIELDS 6
+
+/* largest encoding of count programs */
+constexpr size_t bundle_size_max(size_t count)
+{
+    return 16 + count * 12;
+}
+
+/**
+ * encode programs into buf. returns the length, 0 if buf is too small
+ */
+size_t bundle_write(uint8_t *buf, size_t size, const program_t *programs, size_t count, uint8_t zones);
+
+/**
+ * checks a bundle in one pass as it is fed, in chunks of any size,
+ * into a caller's program array. a program is range checked against
+ * zone_count the moment its last field arrives, so the first bad byte
+ * stops the read. nothing is applied here: once finish() is true the
+ * caller swaps the whole array in (program_store_replace()).
+ */
+class BundleReader {
+public:
+    BundleReader(program_t *programs, size_t max, uint8_t zone_count);
+
+    cbor_status_t feed(const uint8_t *data, size_t len);
+    /* end of input: true if a complete and valid bundle was read */
+    bool finish();
+    void reset();
+
+    size_t count() const { return _count; }
+    /* what was wrong, for the response */
+    const char *error() const { return _error; }
+
+private:
+    static bool item_cb(void *ctx, uint8_t depth, cbor_type_t type, uint64_t value);
+    bool item(uint8_t depth, cbor_type_t type, uint64_t value);
+    bool program_field(cbor_type_t type, uint64_t value);
+    bool fail(const char *why);
+
+    CborStream _cbor;
+    program_t *_programs;
+    size_t _max;
+    uint8_t _zone_count;
+
+    size_t _count = 0;
+    uint8_t _field = 0;
+    uint64_t _key = 0;   // top level key of the value being read
+    bool _value = false; // next top level map item is a value
+    uint8_t _seen = 0;   // bit n: key n was read
+    const char *_error = NULL;
+};
+
+#endif /* bundle.h */
@@ -0,0 +1,38 @@
+#ifndef __BUTTON_GESTURE_H__
+#define __BUTTON_GESTURE_H__
+
+#include <inttypes.h>
+
+enum button_gesture_t : uint8_t {
+    BUTTON_NONE,
+    BUTTON_CLICK,        // delivered on release, never held back for a possible second click
+    BUTTON_DOUBLE_CLICK, // second release within DOUBLE_CLICK_US of a click
+    BUTTON_LONG_PRESS    // held for LONG_PRESS_US; the release that follows is swallowed
+};
+
+/**
+ * debounce and gesture state machine for one push button.
+ * hardware independent: the caller reports raw edges, samples the pin
+ * when deadline() passes and arms a single one-shot timer for the next
+ * deadline(). times are microseconds from any monotonic clock.
+ */
+class ButtonGesture {
+public:
+    static constexpr int64_t DEBOUNCE_US = 8000;
+    static constexpr int64_t DOUBLE_CLICK_US = 350000;
+    static constexpr int64_t LONG_PRESS_US = 1500000;
+
+    void edge(int64_t now_us);
+    button_gesture_t expire(int64_t now_us, bool pressed);
+    int64_t deadline() const;
+    bool pressed() const { return _pressed; }
+
+private:
+    int64_t _debounce_at = 0;  // settle time of the last raw edge, 0 if idle
+    int64_t _long_at = 0;      // long press fires here while held, 0 if idle
+    int64_t _last_click_us = 0; // release time of a lone click, 0 if none
+    bool _pressed = false;     // debounced level
+    bool _long_fired = false;
+};
+
+#endif /* button_gesture.h */
@@ -0,0 +1,91 @@
+#ifndef __CBOR_STREAM_H__
+#define __CBOR_STREAM_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+
+/* containers open at once */
+#define CBOR_DEPTH_MAX 4
+/* longest array or map taken, a guard against junk lengths */
+#define CBOR_LENGTH_MAX 0xFFFF
+
+enum cbor_status_t : uint8_t {
+    CBOR_MORE,  // need more input
+    CBOR_DONE,  // the top level item is complete
+    CBOR_ERROR  // malformed, unsupported, or rejected by the callback
+};
+
+enum cbor_type_t : uint8_t {
+    CBOR_UINT,
+    CBOR_NEGINT, // value is -1 - n
+    CBOR_ARRAY,  // value is the item count
+    CBOR_MAP,    // value is the pair count
+    CBOR_FALSE,
+    CBOR_TRUE,
+    CBOR_NULL
+};
+
+/**
+ * push parser for the subset of CBOR (RFC 8949) the firmware speaks:
+ * integers, booleans, null, and definite length arrays and maps.
+ * strings, tags, floats and indefinite lengths are rejected. like
+ * JsonStream, bytes are fed in chunks of any size and each item goes to
+ * the callback as soon as its head is complete, with its depth (0 for
+ * the top level item), so a reader validates while the bytes arrive.
+ */
+class CborStream {
+public:
+    /* return false to abort the parse */
+    typedef bool (*item_cb_t)(void *ctx, uint8_t depth, cbor_type_t type, uint64_t value);
+
+    CborStream(item_cb_t cb, void *ctx) : _cb(cb), _ctx(ctx) {}
+
+    cbor_status_t feed(const uint8_t *data, size_t len);
+    /* end of input: CBOR_DONE only if the top level item was completed */
+    cbor_status_t finish() const { return _state == S_DONE ? CBOR_DONE : CBOR_ERROR; }
+    void reset();
+
+private:
+    enum state_t : uint8_t { S_HEAD, S_ARG, S_DONE, S_ERROR };
+
+    cbor_status_t step(uint8_t b);
+    bool item(cbor_type_t type, uint64_t value);
+    void consume();
+
+    item_cb_t _cb;
+    void *_ctx;
+    state_t _state = S_HEAD;
+    uint8_t _major = 0;
+    uint8_t _need = 0;   // argument bytes still to come
+    uint64_t _arg = 0;
+    uint8_t _depth = 0;  // containers open
+    uint32_t _left[CBOR_DEPTH_MAX] = {}; // items still to come in each
+};
+
+/**
+ * encoder for the same subset into a fixed buffer. writes past the end
+ * are dropped and flagged, check ok() once done.
+ */
+class CborWriter {
+public:
+    CborWriter(uint8_t *buf, size_t size) : _buf(buf), _size(size) {}
+
+    void uint(uint64_t value) { head(0, value); }
+    void array(size_t count) { head(4, count); }
+    void map(size_t pairs) { head(5, pairs); }
+    void boolean(bool value) { put(value ? 0xF5 : 0xF4); }
+
+    size_t length() const { return _len; }
+    bool ok() const { return !_overflow; }
+
+private:
+    void head(uint8_t major, uint64_t value);
+    void put(uint8_t b);
+
+    uint8_t *_buf;
+    size_t _size;
+    size_t _len = 0;
+    bool _overflow = false;
+};
+
+#endif /* cbor_stream.h */
@@ -0,0 +1,12 @@
+#ifndef __DIAG_CONSOLE_H__
+#define __DIAG_CONSOLE_H__
+
+#include "esp_err.h"
+
+/**
+ * esp_console REPL on the console port (UART or USB serial/JTAG,
+ * whichever the log goes to) with the diagnostics commands.
+ */
+esp_err_t diag_console_init();
+
+#endif /* diag_console.h */
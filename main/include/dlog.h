@@ -0,0 +1,126 @@
+#ifndef __DLOG_H__
+#define __DLOG_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
+#include <type_traits>
+#include "esp_err.h"
+#include "esp_log.h"
+
+/**
+ * deferred logging for the paths that must not wait on the UART.
+ * DLOGE/W/I/D/V take the same arguments as ESP_LOGx, but the caller only
+ * copies the format pointer and the raw argument values into a queue
+ * record; the dlog task formats and writes it later, at the lowest
+ * priority.
+ *
+ * because only pointers are copied, a %s argument must outlive the
+ * record: a string literal, a TAG or esp_err_to_name(), never a buffer
+ * on the stack. numbers, enums and pointers only, at most
+ * DLOG_ARG_BYTES of them. when the queue is full the record is dropped
+ * and counted, and a crash loses what is still queued.
+ *
+ * levels are filtered at compile time per file: define DLOG_LEVEL
+ * before including this header, otherwise CONFIG_IRRIGATION_DLOG_LEVEL
+ * applies. a log above it compiles to nothing, though its format and
+ * arguments are still checked. esp_log_level_set() filters further at
+ * run time, as for ESP_LOGx.
+ */
+
+#ifndef DLOG_LEVEL
+#define DLOG_LEVEL CONFIG_IRRIGATION_DLOG_LEVEL
+#endif
+
+#define DLOG_ARG_BYTES 24
+
+typedef struct {
+    const char *fmt;
+    const char *tag;
+    uint32_t time_ms;
+    uint8_t level; // esp_log_level_t
+    uint8_t len;   // bytes of args used
+    uint8_t args[DLOG_ARG_BYTES];
+} dlog_record_t;
+
+/* start the dlog task. records logged before it runs are written at once */
+esp_err_t dlog_init();
+
+/* stamp and queue a packed record, from a task, or from an ISR after dlog_init() */
+void dlog_commit(dlog_record_t *record);
+
+/* records dropped on a full queue since boot */
+uint32_t dlog_dropped();
+
+/**
+ * the bytes an argument takes in a record, as printf reads it back:
+ * promoted to int or double, pointers as they are
+ */
+template <typename T>
+constexpr size_t dlog_arg_size()
+{
+    static_assert(std::is_arithmetic_v<T> || std::is_enum_v<T> || std::is_pointer_v<T> ||
+                  std::is_null_pointer_v<T>, "log arguments are copied raw: numbers, enums and pointers only");
+    if constexpr(std::is_floating_point_v<T>) {
+        return sizeof(double);
+    } else if constexpr(std::is_pointer_v<T> || std::is_null_pointer_v<T>) {
+        return sizeof(const void *);
+    } else {
+        return sizeof(T) < sizeof(int) ? sizeof(int) : sizeof(T);
+    }
+}
+
+template <typename T>
+static inline void dlog_pack(dlog_record_t &record, T value)
+{
+    uint8_t *out = record.args + record.len;
+
+    if constexpr(std::is_floating_point_v<T>) {
+        double promoted = value;
+        memcpy(out, &promoted, sizeof(promoted));
+    } else if constexpr(std::is_pointer_v<T> || std::is_null_pointer_v<T>) {
+        const void *pointer = value;
+        memcpy(out, &pointer, sizeof(pointer));
+    } else if constexpr(sizeof(T) < sizeof(int)) {
+        int promoted = static_cast<int>(value);
+        memcpy(out, &promoted, sizeof(promoted));
+    } else {
+        memcpy(out, &value, sizeof(value));
+    }
+    record.len += dlog_arg_size<T>();
+}
+
+template <typename... Args>
+static inline void dlog_write(esp_log_level_t level, const char *tag, const char *fmt, Args... args)
+{
+    static_assert((dlog_arg_size<Args>() + ... + 0) <= DLOG_ARG_BYTES, "too many log arguments for one record");
+    dlog_record_t record;
+    record.fmt = fmt;
+    record.tag = tag;
+    record.level = level;
+    record.len = 0;
+    (dlog_pack(record, args), ...);
+    dlog_commit(&record);
+}
+
+/* never called, lets -Wformat check the arguments against the format */
+static inline void dlog_check_format(const char *, ...) __attribute__((format(printf, 1, 2)));
+static inline void dlog_check_format(const char *, ...) {}
+
+#define DLOG_AT(level, tag, fmt, ...) do {                      \
+        if constexpr(false) {                                   \
+            dlog_check_format(fmt, ##__VA_ARGS__);              \
+            (void) (tag);                                       \
+        }                                                       \
+        if constexpr((level) <= DLOG_LEVEL) {                   \
+            dlog_write((level), (tag), (fmt), ##__VA_ARGS__);   \
+        }                                                       \
+    } while(0)
+
+#define DLOGE(tag, fmt, ...) DLOG_AT(ESP_LOG_ERROR, tag, fmt, ##__VA_ARGS__)
+#define DLOGW(tag, fmt, ...) DLOG_AT(ESP_LOG_WARN, tag, fmt, ##__VA_ARGS__)
+#define DLOGI(tag, fmt, ...) DLOG_AT(ESP_LOG_INFO, tag, fmt, ##__VA_ARGS__)
+#define DLOGD(tag, fmt, ...) DLOG_AT(ESP_LOG_DEBUG, tag, fmt, ##__VA_ARGS__)
+#define DLOGV(tag, fmt, ...) DLOG_AT(ESP_LOG_VERBOSE, tag, fmt, ##__VA_ARGS__)
+
+#endif /* dlog.h */
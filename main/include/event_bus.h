@@ -0,0 +1,87 @@
+#ifndef __EVENT_BUS_H__
+#define __EVENT_BUS_H__
+
+#include <atomic>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "spsc_ring.h"
+#include "menu.h"
+#include "trace.h"
+
+#define EVENT_BUS_DEPTH 32
+
+enum event_type_t : uint8_t {
+    EVT_ROTATE, // coalesced encoder burst
+    EVT_BUTTON, // debounced button gesture
+    EVT_STATE,  // menu/display state changed
+    EVT_SYNC    // time sync progress or result
+};
+
+/**
+ * timestamped event carried between tasks.
+ * the payload is selected by type.
+ */
+typedef struct {
+    int64_t timestamp_us; // esp_timer time the event happened
+    event_type_t type;
+    union {
+        struct {
+            int16_t detents;        // raw, CW positive
+            int16_t steps;          // velocity scaled
+            uint32_t min_period_us; // fastest detent in the burst
+            uint32_t edge_us;       // ISR time of its first edge (ui_latency.h)
+        } rotate;
+        struct {
+            uint8_t gesture; // button_gesture_t
+        } button;
+        struct {
+            menu_cursor_t menu; // navigation snapshot
+            uint8_t display;    // dispFlag
+            bool synced;        // last sync result
+            uint8_t sync_stage; // sync_stage_t, SYNC_IDLE when not running
+            uint32_t input_us;  // edge_us of the burst it answers, 0 if none
+        } state;
+        struct {
+            uint8_t stage;      // sync_stage_t
+            int32_t offset_ms;  // correction applied, on SYNC_DONE
+            uint32_t next_s;    // until the next automatic sync
+        } sync;
+    };
+} event_t;
+
+/**
+ * one producer task, one consumer task.
+ * the consumer sleeps on its task notification, the producer pushes
+ * into the ring and gives the notification, so nothing is polled and
+ * nothing is shared except the ring indices.
+ */
+class EventBus {
+public:
+    explicit EventBus(trace_queue_t trace_id) : _trace_id(trace_id) {}
+
+    /* called once from the consuming task before it waits */
+    void attach();
+
+    bool publish(const event_t &evt);
+    bool poll(event_t *evt);
+    bool wait(event_t *evt, TickType_t timeout);
+
+    size_t space() const { return _ring.space(); }
+    uint32_t dropped() const { return _ring.dropped(); }
+
+private:
+    SpscRing<event_t, EVENT_BUS_DEPTH> _ring;
+    std::atomic<TaskHandle_t> _consumer{nullptr};
+    trace_queue_t _trace_id; // names the bus in TRACE_QUEUE_* records
+};
+
+/* trigger_callback -> main_task */
+extern EventBus input_bus;
+/* main_task -> refresh_disp_task */
+extern EventBus ui_bus;
+/* sync_task -> main_task */
+extern EventBus sync_bus;
+
+#endif /* event_bus.h */
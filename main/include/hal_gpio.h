@@ -0,0 +1,70 @@
+#ifndef __HAL_GPIO_H__
+#define __HAL_GPIO_H__
+
+#include <inttypes.h>
+#include <concepts>
+#include "esp_err.h"
+
+enum hal_edge_t : uint8_t {
+    HAL_EDGE_NONE,
+    HAL_EDGE_FALLING,
+    HAL_EDGE_ANY
+};
+
+/**
+ * a GPIO policy, bound at compile time like I2cBus (hal_i2c.h).
+ * inputs are pulled up; edge selects the interrupt the pin raises,
+ * the handler itself stays with the driver that owns the pin.
+ */
+template <class Pins>
+concept GpioPolicy = requires(uint8_t pin, hal_edge_t edge, bool level) {
+    { Pins::output(pin) } -> std::same_as<esp_err_t>;
+    { Pins::input(pin, edge) } -> std::same_as<esp_err_t>;
+    { Pins::set(pin, level) } -> std::same_as<void>;
+    { Pins::get(pin) } -> std::same_as<bool>;
+};
+
+#ifdef IRRIGATION_HOST
+#include "model_gpio.h"
+using Gpio = ModelGpio;
+#else
+#include "driver/gpio.h"
+
+/* thin enough to inline: set and get compile to the driver call */
+struct IdfGpio {
+    static esp_err_t output(uint8_t pin)
+    {
+        gpio_config_t io_conf = {};
+        io_conf.intr_type = GPIO_INTR_DISABLE;
+        io_conf.mode = GPIO_MODE_OUTPUT;
+        io_conf.pin_bit_mask = 1ULL << pin;
+        return gpio_config(&io_conf);
+    }
+
+    static esp_err_t input(uint8_t pin, hal_edge_t edge)
+    {
+        gpio_config_t io_conf = {};
+        io_conf.intr_type = edge == HAL_EDGE_FALLING ? GPIO_INTR_NEGEDGE :
+                            edge == HAL_EDGE_ANY ? GPIO_INTR_ANYEDGE : GPIO_INTR_DISABLE;
+        io_conf.mode = GPIO_MODE_INPUT;
+        io_conf.pin_bit_mask = 1ULL << pin;
+        io_conf.pull_up_en = GPIO_PULLUP_ENABLE;
+        return gpio_config(&io_conf);
+    }
+
+    static void set(uint8_t pin, bool level)
+    {
+        gpio_set_level(static_cast<gpio_num_t>(pin), level);
+    }
+
+    static bool get(uint8_t pin)
+    {
+        return gpio_get_level(static_cast<gpio_num_t>(pin));
+    }
+};
+using Gpio = IdfGpio;
+#endif
+
+static_assert(GpioPolicy<Gpio>, "Gpio does not implement the GPIO policy");
+
+#endif /* hal_gpio.h */
@@ -0,0 +1,48 @@
+#ifndef __HAL_I2C_H__
+#define __HAL_I2C_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <concepts>
+#include "esp_err.h"
+
+/**
+ * an I2C bus policy is a class of static functions, each one complete
+ * bus transaction. addr is the 7 bit device address.
+ *
+ *   write      start, addr+W, data, stop
+ *   read       start, addr+R, data, stop
+ *   write_reg  start, addr+W, reg, data, stop
+ *   read_reg   start, addr+W, reg, restart, addr+R, data, stop
+ *
+ * drivers call the bus through I2cBus, bound at compile time: on target
+ * that is the IDF driver with no virtual dispatch, in the host build
+ * (host/) the behavioural device models.
+ */
+template <class Bus>
+concept I2cBusPolicy = requires(uint8_t addr, uint8_t reg, uint8_t *in, const uint8_t *out, size_t len) {
+    { Bus::init() } -> std::same_as<esp_err_t>;
+    { Bus::write(addr, out, len) } -> std::same_as<esp_err_t>;
+    { Bus::read(addr, in, len) } -> std::same_as<esp_err_t>;
+    { Bus::write_reg(addr, reg, out, len) } -> std::same_as<esp_err_t>;
+    { Bus::read_reg(addr, reg, in, len) } -> std::same_as<esp_err_t>;
+};
+
+#ifdef IRRIGATION_HOST
+#include "model_i2c.h"
+using I2cBus = ModelI2c;
+#else
+/* the legacy driver on I2C_BUS_PORT (i2c_bus.cpp) */
+struct IdfI2c {
+    static esp_err_t init();
+    static esp_err_t write(uint8_t addr, const uint8_t *data, size_t len);
+    static esp_err_t read(uint8_t addr, uint8_t *data, size_t len);
+    static esp_err_t write_reg(uint8_t addr, uint8_t reg, const uint8_t *data, size_t len);
+    static esp_err_t read_reg(uint8_t addr, uint8_t reg, uint8_t *data, size_t len);
+};
+using I2cBus = IdfI2c;
+#endif
+
+static_assert(I2cBusPolicy<I2cBus>, "I2cBus does not implement the bus policy");
+
+#endif /* hal_i2c.h */
@@ -0,0 +1,70 @@
+#ifndef __HEALTH_H__
+#define __HEALTH_H__
+
+#include <inttypes.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#include "event_bus.h"
+#include "lcd_format.h"
+
+/**
+ * runtime health: per-task CPU share and stack high-water marks, free
+ * and largest free heap block, and the depth of the queues that feed
+ * the UI. sampled every CONFIG_IRRIGATION_HEALTH_PERIOD_S and whenever
+ * the console command asks; the LCD page shows the last sample. a task whose stack has
+ * come within HEALTH_STACK_WARN bytes of the end is logged once.
+ */
+
+#define HEALTH_TASKS_MAX 24
+#define HEALTH_QUEUES_MAX 6
+#define HEALTH_NAME_LEN 16
+/* stack bytes left that count as a near miss */
+#define HEALTH_STACK_WARN 384
+
+typedef struct {
+    char name[HEALTH_NAME_LEN];
+    uint32_t stack_free;   // bytes never touched since the task started
+    uint16_t cpu_permille; // share of all cores over the last window
+    int8_t core;           // -1 when not pinned
+    uint8_t priority;
+} health_task_t;
+
+typedef struct {
+    const char *name;
+    uint16_t depth;
+    uint16_t peak; // deepest seen by a sample
+    uint16_t capacity;
+    uint32_t dropped; // event buses only
+} health_queue_t;
+
+typedef struct {
+    int64_t sampled_us;
+    uint32_t window_ms; // what the CPU shares cover
+    uint32_t heap_free;
+    uint32_t heap_min_free;
+    uint32_t heap_largest;
+    uint8_t task_count;
+    uint8_t queue_count;
+    health_task_t tasks[HEALTH_TASKS_MAX]; // least stack left first
+    health_queue_t queues[HEALTH_QUEUES_MAX];
+} health_t;
+
+esp_err_t health_init();
+esp_err_t health_watch_queue(const char *name, QueueHandle_t queue);
+esp_err_t health_watch_bus(const char *name, const EventBus *bus);
+
+/* take a sample now and copy it out */
+void health_sample(health_t *out);
+
+/**
+ * LCD pages, one row each: heap, then the queues, then the tasks, from
+ * the last sample. page numbers wrap around however many there are.
+ */
+void health_render_page(int32_t page, lcd_row_t row);
+
+/* the "health" console command */
+esp_err_t health_register_command();
+
+#endif /* health.h */
@@ -0,0 +1,93 @@
+#ifndef __HISTORY_H__
+#define __HISTORY_H__
+
+#include <inttypes.h>
+#include <time.h>
+#include "esp_err.h"
+
+#define HISTORY_ZONES_MAX 16
+
+enum history_kind_t : uint8_t {
+    HIST_RUN,     // a programmed run that closed on time
+    HIST_MANUAL,  // a run from the menu or the REST API
+    HIST_STOPPED, // cut short by a long press or /api/zones/stop
+    HIST_SKIPPED  // a programmed start that did not open the valve
+};
+
+enum history_reason_t : uint8_t {
+    HIST_REASON_NONE,
+    HIST_REASON_ZONE_OFF // the zone is toggled off
+};
+
+/**
+ * one valve run, written when it ends. 16 bytes in flash
+ */
+typedef struct {
+    uint32_t start;     // epoch seconds the valve opened, or was due to
+    uint16_t seconds;   // open for
+    uint16_t planned;   // seconds it was opened for
+    uint8_t zone;
+    uint8_t kind;       // history_kind_t
+    uint8_t reason;     // history_reason_t
+    uint8_t check;      // torn write detection
+    uint32_t reserved;
+} history_event_t;
+
+typedef struct {
+    uint32_t runtime_s;
+    uint16_t volume_l;  // runtime at CONFIG_IRRIGATION_HISTORY_FLOW_LPM
+    uint8_t runs;
+    uint8_t skips;
+} history_zone_day_t;
+
+/**
+ * one local day of every zone, written once the day is over.
+ * a day without runs has no record.
+ */
+typedef struct {
+    uint16_t day;       // local days since 1970-01-01
+    uint8_t zones;      // entries used in zone[]
+    uint8_t check;
+    history_zone_day_t zone[HISTORY_ZONES_MAX];
+} history_day_t;
+
+static_assert(sizeof(history_event_t) == 16, "events are 16 bytes in flash");
+static_assert(sizeof(history_day_t) == 132, "a day record is 132 bytes in flash");
+
+/* return false to stop the walk */
+typedef bool (*history_event_cb_t)(void *ctx, const history_event_t *event);
+typedef bool (*history_day_cb_t)(void *ctx, const history_day_t *day);
+
+/**
+ * append-only watering history on the "history" partition. events and
+ * day rollups each go to a ring of flash sectors that is written front
+ * to back and erased a sector at a time when it wraps, so every sector
+ * wears the same. the newest sector is found from sector sequence
+ * numbers at boot, and the first key of every sector is indexed in RAM.
+ * the rollups of days the device was off across are rebuilt from the
+ * events.
+ */
+esp_err_t history_init(uint8_t zones);
+
+/* any task, never blocks: queued for the history task to write */
+void history_record(uint8_t zone, history_kind_t kind, history_reason_t reason, time_t start,
+                    uint16_t seconds, uint16_t planned);
+
+/**
+ * records in a range, as pointers into the mapped partition: no copy,
+ * valid only during the callback. the sector index finds the first
+ * one. events are picked by start and come in the order they ended;
+ * days come oldest first and end with the ones still in RAM, today and
+ * yesterday until its last run can have ended.
+ */
+esp_err_t history_events(time_t from, time_t to, history_event_cb_t cb, void *ctx);
+esp_err_t history_days(uint16_t from_day, uint16_t to_day, history_day_cb_t cb, void *ctx);
+
+/* local day number of t, and back to a date */
+uint16_t history_day_of(time_t t);
+void history_day_date(uint16_t day, int *year, int *month, int *mday);
+
+/* the "history" console command: per zone totals, or the runs */
+esp_err_t history_register_command();
+
+#endif /* history.h */
@@ -0,0 +1,17 @@
+#ifndef __I2C_BUS_H__
+#define __I2C_BUS_H__
+
+#include "esp_err.h"
+#include "driver/i2c.h"
+#include "board_config.h"
+
+/* the LCD and the DS3231 share one bus, pins in board_config.h */
+#define I2C_BUS_PORT static_cast<i2c_port_t>(board::i2c_port)
+
+/**
+ * install the master driver once. every device init calls this, so
+ * devices can come up in any order and from any task.
+ */
+esp_err_t i2c_bus_init();
+
+#endif /* i2c_bus.h */
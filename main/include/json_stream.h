@@ -0,0 +1,65 @@
+#ifndef __JSON_STREAM_H__
+#define __JSON_STREAM_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#define JSON_KEY_MAX   16
+/* fits a POSIX TZ string, TZ_SPEC_MAX */
+#define JSON_VALUE_MAX 48
+
+enum json_status_t : uint8_t {
+    JSON_MORE,  // need more input
+    JSON_DONE,  // closing brace seen
+    JSON_ERROR  // malformed, too long, nested, or rejected by the callback
+};
+
+enum json_kind_t : uint8_t {
+    JSON_STRING,
+    JSON_NUMBER,
+    JSON_BOOL,
+    JSON_NULL
+};
+
+/**
+ * push parser for one flat JSON object: { "key": scalar, ... }.
+ * bytes are fed as they come off the socket, in chunks of any size,
+ * and each member is handed to the callback the moment its value
+ * ends. memory use is the two fixed buffers below, whatever the body
+ * length. nested objects and arrays are rejected.
+ */
+class JsonStream {
+public:
+    /* return false to abort the parse */
+    typedef bool (*member_cb_t)(void *ctx, const char *key, const char *value, json_kind_t kind);
+
+    JsonStream(member_cb_t cb, void *ctx) : _cb(cb), _ctx(ctx) {}
+
+    json_status_t feed(const char *data, size_t len);
+    /* end of input: JSON_DONE only if the object was closed */
+    json_status_t finish() const { return _state == S_DONE ? JSON_DONE : JSON_ERROR; }
+
+    /* number parsing helper for callbacks */
+    static bool to_int(const char *value, long min, long max, long *out);
+
+private:
+    enum state_t : uint8_t {
+        S_OPEN, S_KEY_OR_END, S_KEY, S_KEY_ESC, S_COLON, S_VALUE,
+        S_STRING, S_STRING_ESC, S_SCALAR, S_NEXT_OR_END, S_KEY_START,
+        S_DONE, S_ERROR
+    };
+
+    json_status_t step(char c);
+    bool append(char *buf, uint8_t &len, uint8_t max, char c);
+    bool emit(json_kind_t kind);
+
+    member_cb_t _cb;
+    void *_ctx;
+    state_t _state = S_OPEN;
+    char _key[JSON_KEY_MAX + 1] = {};
+    char _value[JSON_VALUE_MAX + 1] = {};
+    uint8_t _key_len = 0;
+    uint8_t _value_len = 0;
+};
+
+#endif /* json_stream.h */
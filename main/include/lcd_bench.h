@@ -0,0 +1,11 @@
+#ifndef __LCD_BENCH_H__
+#define __LCD_BENCH_H__
+
+/**
+ * compare the legacy strftime/snprintf home screen against the
+ * fixed-width formatter: cycles per frame and stack bytes used.
+ * built with CONFIG_IRRIGATION_LCD_FORMAT_BENCH.
+ */
+void lcd_format_benchmark();
+
+#endif /* lcd_bench.h */
@@ -0,0 +1,147 @@
+#ifndef __LCD_FORMAT_H__
+#define __LCD_FORMAT_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+
+/**
+ * fixed-width field formatting straight into LCD row buffers.
+ * no printf, no locale, no heap and a few bytes of stack. the
+ * templated forms take the column and width as template arguments
+ * so a field that would overrun the row fails to compile.
+ */
+
+#define LCD_COLS 16
+
+/* CGRAM glyphs 0-7 are mirrored at codes 8-15, so a custom symbol can
+ * live inside a NUL terminated row */
+#define LCD_GLYPH(n) ((char) (0x08 | (n)))
+
+enum lcd_align_t : uint8_t {
+    LCD_LEFT,
+    LCD_CENTER,
+    LCD_RIGHT
+};
+
+typedef char lcd_row_t[LCD_COLS + 1];
+
+/* blank row, terminated */
+static inline void lcd_row_clear(lcd_row_t row)
+{
+    for(size_t i = 0; i < LCD_COLS; i++) {
+        row[i] = ' ';
+    }
+    row[LCD_COLS] = '\0';
+}
+
+/**
+ * right aligned unsigned integer, padded with pad.
+ * a value too wide for the field shows as '*'s.
+ */
+static inline void lcd_fmt_uint(char *dst, size_t width, uint32_t value, char pad)
+{
+    for(size_t i = width; i-- > 0;) {
+        dst[i] = (value != 0 || i == width - 1) ? (char) ('0' + value % 10) : pad;
+        value /= 10;
+    }
+    if(value != 0) {
+        for(size_t i = 0; i < width; i++) {
+            dst[i] = '*';
+        }
+    }
+}
+
+/* number of characters s takes in a field of width (truncated) */
+static inline size_t lcd_fmt_len(const char *s, size_t width)
+{
+    size_t len = 0;
+    while(len < width && s[len] != '\0') {
+        len++;
+    }
+    return len;
+}
+
+/* text aligned in a space padded field, truncated to width */
+static inline void lcd_fmt_str(char *dst, size_t width, const char *s, lcd_align_t align)
+{
+    size_t len = lcd_fmt_len(s, width);
+    size_t lead = align == LCD_LEFT ? 0 : align == LCD_RIGHT ? width - len : (width - len) / 2;
+
+    for(size_t i = 0; i < width; i++) {
+        dst[i] = (i >= lead && i < lead + len) ? s[i - lead] : ' ';
+    }
+}
+
+template <size_t COL, size_t WIDTH>
+static inline void lcd_put_uint(char *row, uint32_t value, char pad = ' ')
+{
+    static_assert(WIDTH > 0 && COL + WIDTH <= LCD_COLS, "field overruns the LCD row");
+    lcd_fmt_uint(row + COL, WIDTH, value, pad);
+}
+
+/* two digits, zero padded */
+template <size_t COL>
+static inline void lcd_put_2d(char *row, uint8_t value)
+{
+    static_assert(COL + 2 <= LCD_COLS, "field overruns the LCD row");
+    row[COL] = (char) ('0' + value / 10 % 10);
+    row[COL + 1] = (char) ('0' + value % 10);
+}
+
+/* HH:MM */
+template <size_t COL>
+static inline void lcd_put_clock(char *row, uint8_t hour, uint8_t minute)
+{
+    static_assert(COL + 5 <= LCD_COLS, "field overruns the LCD row");
+    lcd_put_2d<COL>(row, hour);
+    row[COL + 2] = ':';
+    lcd_put_2d<COL + 3>(row, minute);
+}
+
+template <size_t COL>
+static inline void lcd_put_char(char *row, char c)
+{
+    static_assert(COL < LCD_COLS, "field overruns the LCD row");
+    row[COL] = c;
+}
+
+/* runtime text, truncated to the field */
+template <size_t COL, size_t WIDTH>
+static inline void lcd_put_str(char *row, const char *s, lcd_align_t align = LCD_LEFT)
+{
+    static_assert(WIDTH > 0 && COL + WIDTH <= LCD_COLS, "field overruns the LCD row");
+    lcd_fmt_str(row + COL, WIDTH, s, align);
+}
+
+/* literal text, checked to fit at compile time */
+template <size_t COL, size_t WIDTH, size_t N>
+static inline void lcd_put_lit(char *row, const char (&s)[N], lcd_align_t align = LCD_LEFT)
+{
+    static_assert(N - 1 <= WIDTH, "literal is wider than its field");
+    lcd_put_str<COL, WIDTH>(row, s, align);
+}
+
+/**
+ * bring one line of the glass from shown to row. only the characters
+ * that differ are sent: a cursor move per run of changes, then the run.
+ * works with any display that has setCursor(col, row) and write(c).
+ */
+template <class Lcd>
+static inline void lcd_show_row(Lcd &lcd, uint8_t r, lcd_row_t shown, const lcd_row_t row)
+{
+    uint8_t col = 0;
+    while(col < LCD_COLS) {
+        if(row[col] == shown[col]) {
+            col++;
+            continue;
+        }
+        lcd.setCursor(col, r);
+        while(col < LCD_COLS && row[col] != shown[col]) {
+            lcd.write(row[col]);
+            shown[col] = row[col];
+            col++;
+        }
+    }
+}
+
+#endif /* lcd_format.h */
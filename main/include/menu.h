@@ -0,0 +1,96 @@
+#ifndef __MENU_H__
+#define __MENU_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "board_config.h"
+#include "lcd_format.h"
+
+/**
+ * the whole menu is one constexpr node table in flash (menu.cpp).
+ * a node either has children (contiguous in the table), runs an
+ * action, or opens an editor. per-zone nodes carry the zone in arg,
+ * so more zones only add rodata rows.
+ *
+ *          HOME
+ *            |
+ *      -------------
+ *      |           |
+ *    VALVES     SETTINGS
+ *      |           |
+ *   ZONE 1..n    SYNC TIME
+ *      |         DIAGNOSTICS
+ *      |
+ *   START / DURATION / RUN NOW
+ *
+ * every non-root list ends with BACK.
+ */
+
+enum menu_action_t : uint8_t {
+    ACT_NONE,
+    ACT_BACK,  // handled by the engine
+    ACT_SYNC,  // sync the clock
+    ACT_RUN    // run zone arg now for its programmed duration
+};
+
+enum menu_editor_t : uint8_t {
+    EDIT_NONE,
+    EDIT_START,    // start time, minutes since midnight
+    EDIT_DURATION, // run time, minutes
+    EDIT_DIAG,     // read-only, the value pages through diagnostics
+    EDIT_COUNT
+};
+
+#define MENU_LABEL_ARG 0x01 // label is followed by arg + 1
+/* page range of EDIT_DIAG, more than there are diagnostics pages */
+#define MENU_DIAG_PAGES 64
+
+typedef struct {
+    const char *label;
+    uint16_t parent;
+    uint16_t first_child;
+    uint16_t child_count;
+    menu_action_t action;
+    menu_editor_t editor;
+    uint8_t arg;
+    uint8_t flags;
+} menu_node_t;
+
+typedef struct {
+    int32_t min;
+    int32_t max;
+    bool wrap; // roll over at the ends instead of stopping
+} menu_editor_def_t;
+
+/**
+ * navigation state. small and trivially copyable so a snapshot can be
+ * handed to the display task in an event.
+ */
+typedef struct {
+    uint16_t node;   // node whose children are listed
+    uint16_t cursor; // highlighted child
+    int32_t value;   // editor value while editing
+    bool editing;
+} menu_cursor_t;
+
+#define MENU_ROOT 0
+
+void menu_home(menu_cursor_t *menu);
+void menu_rotate(menu_cursor_t *menu, int16_t detents, int16_t steps);
+void menu_select(menu_cursor_t *menu);
+void menu_cancel(menu_cursor_t *menu);
+const menu_node_t *menu_highlighted(const menu_cursor_t *menu);
+void menu_render(const menu_cursor_t *menu, lcd_row_t row);
+
+/**
+ * provided by the application, bound at link time: editors read and
+ * commit values through these, actions are dispatched through the last.
+ */
+int32_t menu_editor_get(menu_editor_t editor, uint8_t arg);
+void menu_editor_set(menu_editor_t editor, uint8_t arg, int32_t value);
+void menu_action(menu_action_t action, uint8_t arg);
+/* the row for a diagnostics page, which wraps however many there are */
+void menu_diag_render(int32_t page, lcd_row_t row);
+
+#endif /* menu.h */
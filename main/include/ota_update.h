@@ -0,0 +1,48 @@
+#ifndef __OTA_UPDATE_H__
+#define __OTA_UPDATE_H__
+
+#include <inttypes.h>
+#include "esp_err.h"
+
+enum ota_state_t : uint8_t {
+    OTA_IDLE,
+    OTA_DOWNLOADING,
+    OTA_VERIFYING,
+    OTA_REBOOTING, // verified and set as the boot partition
+    OTA_FAILED
+};
+
+typedef struct {
+    ota_state_t state;
+    uint32_t written;  // bytes in the update partition
+    uint32_t total;    // image size, 0 until the server said
+    uint16_t resumes;  // range requests after an interrupted transfer
+    esp_err_t error;   // why the last attempt failed
+} ota_status_t;
+
+/* true if the app is fit to keep, see ota_update_init */
+typedef bool (*ota_health_cb_t)();
+
+/**
+ * HTTP OTA from CONFIG_IRRIGATION_OTA_URL into the inactive app slot.
+ *
+ * the image is streamed through one sector-sized buffer, each flash
+ * sector erased just before it is written. a transfer cut off resumes
+ * with a range request from the last whole sector instead of starting
+ * over. progress reaches NVS every 16 sectors (OTA_SAVE_EVERY) and when
+ * a request ends, so after a reboot up to 64 KB are fetched again.
+ * the bootloader's image check
+ * runs before the slot is made bootable.
+ *
+ * after an update the new app boots pending verification: health is
+ * asked after CONFIG_IRRIGATION_OTA_HEALTH_DELAY_S and the app is
+ * kept or rolled back. a crash before then rolls back too.
+ */
+esp_err_t ota_update_init(ota_health_cb_t health);
+
+/* start a download in the background. ESP_ERR_INVALID_STATE if one runs */
+esp_err_t ota_update_start();
+
+void ota_update_status(ota_status_t *status);
+
+#endif /* ota_update.h */
@@ -0,0 +1,23 @@
+#ifndef __POWER_H__
+#define __POWER_H__
+
+#include "esp_err.h"
+
+/**
+ * dynamic frequency scaling and automatic light sleep (esp_pm).
+ * the CPU runs at CONFIG_IRRIGATION_PM_MIN_MHZ and sleeps whenever
+ * nothing holds a PM lock; subsystems hold one only while they need
+ * more:
+ *  "i2c"    APB max, for the length of a transfer (i2c_bus.cpp)
+ *  "valves" no light sleep, while any valve is open (valve_scheduler.cpp)
+ *  "wifi"   CPU max, while connecting or power save is off (wifi_setup.c)
+ *  "ui"     no light sleep, while the display is lit (irrigation-proj.cpp)
+ * a connected station without a lock is left to the Wi-Fi driver,
+ * which sleeps between beacons.
+ */
+esp_err_t power_init();
+
+/* the "power" console command: PM locks and time in each mode */
+esp_err_t power_register_command();
+
+#endif /* power.h */
@@ -0,0 +1,49 @@
+#ifndef __PROGRAM_STORE_H__
+#define __PROGRAM_STORE_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <time.h>
+#include "esp_err.h"
+
+#include "schedule.h"
+
+#define PROGRAM_MAX  32
+#define PROGRAM_NONE 0xFF
+
+/**
+ * every zone program, kept in RAM and written through to NVS. ids are
+ * table slots and stay stable until the program is removed. any task
+ * may call in; every change reschedules the valves.
+ */
+esp_err_t program_store_init(const program_t *defaults, size_t default_count, uint8_t zone_count);
+
+bool program_store_get(uint8_t id, program_t *program);
+
+/* ids in order: start with PROGRAM_NONE, stop at PROGRAM_NONE */
+uint8_t program_store_next(uint8_t after);
+
+/* lowest id for a zone, PROGRAM_NONE if it has none */
+uint8_t program_store_first(uint8_t zone);
+
+esp_err_t program_store_add(const program_t *program, uint8_t *id);
+esp_err_t program_store_set(uint8_t id, const program_t *program);
+esp_err_t program_store_remove(uint8_t id);
+
+/**
+ * swap the whole table for count programs, as a bundle import does.
+ * all or nothing: every program is checked first, and if the NVS write
+ * fails the old table stays. ids are renumbered from 0.
+ */
+esp_err_t program_store_replace(const program_t *programs, size_t count);
+
+/* the table as a schedule bundle (bundle.h). returns the length, 0 if buf is too small */
+size_t program_store_export(uint8_t *buf, size_t size);
+
+/* the "bundle" console command: export and import over the UART */
+esp_err_t program_store_register_command();
+
+/* earliest start for a zone over all its programs, with that program's duration */
+time_t program_store_next_start(uint8_t zone, time_t now, uint16_t *duration_sec);
+
+#endif /* program_store.h */
@@ -0,0 +1,31 @@
+#ifndef __REST_API_H__
+#define __REST_API_H__
+
+#include <stddef.h>
+#include "esp_err.h"
+
+#include "Valve.h"
+
+/**
+ * local HTTP API on CONFIG_IRRIGATION_REST_PORT:
+ *
+ *   GET    /api/programs        list, streamed as chunks
+ *   POST   /api/programs        create
+ *   GET    /api/programs/<id>   read
+ *   PUT    /api/programs/<id>   update the fields given
+ *   DELETE /api/programs/<id>   delete
+ *   GET    /api/zones           zone states
+ *   POST   /api/zones/<n>/run   {"duration": seconds}
+ *   POST   /api/zones/stop      close every valve
+ *   GET    /api/stats           request counts and heap watermarks
+ *   POST   /api/ota             fetch and install CONFIG_IRRIGATION_OTA_URL
+ *   GET    /api/ota             update progress
+ *
+ * bodies are parsed as they are read, into fixed buffers, and
+ * responses are written a program at a time with chunked encoding, so
+ * neither side of a request is ever held whole in RAM. call after
+ * wifi_manager_init(): the server's socket needs lwIP running.
+ */
+esp_err_t rest_api_init(Valve **valves, size_t count);
+
+#endif /* rest_api.h */
@@ -3,10 +3,12 @@
 
 #include "esp_err.h"
 
-extern volatile bool buttonPressed;
-extern volatile int16_t position;
-extern volatile int8_t direction; // Counter-Clockwise = 0 , Clockwise = 1
-
+/**
+ * rotation bursts and button presses are published on input_bus
+ * (see event_bus.h) as EVT_ROTATE / EVT_BUTTON events.
+ */
 esp_err_t rotary_init();
+/* the display went dark or lit up: arm or disarm the GPIO wakeup */
+void rotary_sleep(bool asleep);
 
 #endif /* rotary_encoder.h */
@@ -0,0 +1,74 @@
+#ifndef __SCHEDULE_H__
+#define __SCHEDULE_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <time.h>
+
+/**
+ * first local start time strictly after now for a program that starts
+ * at hour:minute on the days in wday_bv (bit n = tm_wday n, Sunday = 0).
+ * local time is tz.h's, so starts land on the local wall clock time
+ * across DST changes; in the hour repeated when clocks fall back only
+ * the first reading counts, and a start in the hour skipped when they
+ * spring forward runs that much after the change. returns (time_t)-1
+ * if no day is set.
+ */
+time_t schedule_next_start(time_t now, uint8_t hour, uint8_t minute, uint8_t wday_bv);
+
+#define PROGRAM_DURATION_MAX (999 * 60)
+
+/**
+ * one watering program: open a zone at hour:minute on the days in
+ * wday_bv for duration_sec. a zone may have any number of them.
+ */
+typedef struct {
+    uint8_t zone;
+    uint8_t hour;
+    uint8_t minute;
+    uint8_t wday_bv;       // bit n = tm_wday n, Sunday = 0
+    uint16_t duration_sec;
+    bool enabled;
+} program_t;
+
+/* fields in range for zone_count zones */
+bool program_valid(const program_t *program, uint8_t zone_count);
+
+/* next start of an enabled program, (time_t)-1 if it never runs */
+time_t program_next_start(const program_t *program, time_t now);
+
+/**
+ * earliest next start among the programs of one zone. bit n of used
+ * marks programs[n] as in use, so count is at most 32. duration_sec
+ * gets the duration of the program starting then.
+ */
+time_t programs_next_start(const program_t *programs, size_t count, uint32_t used,
+                           uint8_t zone, time_t now, uint16_t *duration_sec);
+
+/**
+ * what the valve scheduler knows about one zone
+ */
+typedef struct {
+    time_t next_start;      // (time_t)-1 if no program runs
+    uint16_t next_duration; // of the program starting then
+} zone_plan_t;
+
+typedef time_t (*zone_next_cb_t)(void *ctx, uint8_t zone, time_t now, uint16_t *duration_sec);
+typedef void (*zone_open_cb_t)(void *ctx, uint8_t zone, uint16_t duration_sec);
+
+/* how late a start may still open. the scheduler wakes a tick after
+ * it; anything later is a clock stepped forward over it, and opening
+ * every start of the skipped span at once would be worse than none */
+#define SCHEDULE_GRACE_S 5
+
+/**
+ * one wake of the valve scheduler. replan recomputes every zone's next
+ * start; otherwise zones whose start has passed, by SCHEDULE_GRACE_S
+ * at most, are opened and planned again. older starts are skipped.
+ * returns the earliest next start to sleep until, (time_t)-1 if
+ * nothing is scheduled. the firmware and the host simulator share it.
+ */
+time_t schedule_step(zone_plan_t *plans, size_t count, time_t now, bool replan,
+                     zone_next_cb_t next_cb, zone_open_cb_t open_cb, void *ctx);
+
+#endif /* schedule.h */
@@ -1,15 +1,25 @@
 #ifndef SNTP_H
 #define SNTP_H
 
+#include <stdbool.h>
+#include <stdint.h>
 #include "esp_err.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-extern bool time_synced;
+/**
+ * called from the lwIP task once a server answered.
+ * offset_us is server time minus local time before correction,
+ * stepped is true if the clock was set rather than slewed, settled is
+ * false if an earlier slew was still running, so offset_us is not
+ * drift alone.
+ */
+typedef void (*sntp_result_cb_t)(int64_t offset_us, bool stepped, bool settled);
 
-void initialize_sntp();
+void initialize_sntp(sntp_result_cb_t cb);
+void stop_sntp(void);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,56 @@
+#ifndef __SPSC_RING_H__
+#define __SPSC_RING_H__
+
+#include <atomic>
+#include <inttypes.h>
+#include <stddef.h>
+
+/**
+ * single-producer/single-consumer lock-free ring.
+ * exactly one task (or ISR) may push and exactly one task may pop.
+ * head/tail are free-running counters; the acquire/release pairs make
+ * the slot contents visible across both cores before the index moves.
+ */
+template <typename T, size_t N>
+class SpscRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "ring size must be a power of two");
+
+public:
+    bool push(const T &item) {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        uint32_t tail = _tail.load(std::memory_order_acquire);
+        if(head - tail == N) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        _buf[head & (N - 1)] = item;
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &item) {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        uint32_t head = _head.load(std::memory_order_acquire);
+        if(head == tail) {
+            return false;
+        }
+        item = _buf[tail & (N - 1)];
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+    }
+    size_t space() const { return N - size(); }
+    static constexpr size_t capacity() { return N; }
+    uint32_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+private:
+    T _buf[N];
+    std::atomic<uint32_t> _head{0};
+    std::atomic<uint32_t> _tail{0};
+    std::atomic<uint32_t> _dropped{0};
+};
+
+#endif /* spsc_ring.h */
@@ -0,0 +1,62 @@
+#ifndef __STATIC_RTOS_H__
+#define __STATIC_RTOS_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+/**
+ * storage for long-lived RTOS objects, sized at compile time and
+ * declared static, so it lands in .bss instead of the heap.
+ * creating from it cannot fail on a fragmented heap, and the map file
+ * accounts for every byte (tools/mem_budget.py).
+ *
+ * one object per storage: a task that deletes itself must not be
+ * created again from the same storage.
+ */
+
+template <size_t STACK_BYTES>
+class StaticTask {
+public:
+    static_assert(STACK_BYTES % sizeof(StackType_t) == 0, "stack must be whole StackType_t words");
+
+    /* stack depth is in bytes on ESP-IDF */
+    TaskHandle_t create(TaskFunction_t fn, const char *name, void *arg, UBaseType_t priority,
+                        BaseType_t core = tskNO_AFFINITY)
+    {
+        return xTaskCreateStaticPinnedToCore(fn, name, STACK_BYTES, arg, priority, _stack, &_tcb, core);
+    }
+
+private:
+    StackType_t _stack[STACK_BYTES / sizeof(StackType_t)];
+    StaticTask_t _tcb;
+};
+
+template <typename T, size_t LENGTH>
+class StaticQueue {
+public:
+    QueueHandle_t create()
+    {
+        return xQueueCreateStatic(LENGTH, sizeof(T), _storage, &_queue);
+    }
+
+private:
+    uint8_t _storage[LENGTH * sizeof(T)];
+    StaticQueue_t _queue;
+};
+
+class StaticMutex {
+public:
+    SemaphoreHandle_t create()
+    {
+        return xSemaphoreCreateMutexStatic(&_mutex);
+    }
+
+private:
+    StaticSemaphore_t _mutex;
+};
+
+#endif /* static_rtos.h */
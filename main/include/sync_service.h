@@ -0,0 +1,30 @@
+#ifndef __SYNC_SERVICE_H__
+#define __SYNC_SERVICE_H__
+
+#include <inttypes.h>
+#include "esp_err.h"
+
+#include "DS3231_RTC.h"
+
+enum sync_stage_t : uint8_t {
+    SYNC_IDLE,
+    SYNC_CONNECTING, // bringing the station up
+    SYNC_QUERYING,   // waiting on an NTP server
+    SYNC_DONE,       // clock corrected, RTC written
+    SYNC_FAILED      // no network or no answer
+};
+
+/**
+ * background time sync. the sync task owns the radio for the length of
+ * a sync and reports every stage as EVT_SYNC on sync_bus, so nothing
+ * on the UI side ever waits on the network. besides manual requests it
+ * resyncs on its own, spacing syncs by the clock drift it measures.
+ */
+esp_err_t sync_service_init(DS3231_RTC *rtc);
+
+/* sync now. one asked for during a sync runs right after it */
+void sync_service_request();
+
+bool sync_service_busy();
+
+#endif /* sync_service.h */
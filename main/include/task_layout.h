@@ -0,0 +1,82 @@
+#ifndef __TASK_LAYOUT_H__
+#define __TASK_LAYOUT_H__
+
+#include "sdkconfig.h"
+#include "esp_err.h"
+#if !CONFIG_FREERTOS_UNICORE
+#include "esp_ipc.h"
+#endif
+
+/**
+ * which core each of our tasks runs on, and at what priority.
+ *
+ * the radio lives on core 0: the Wi-Fi driver is pinned there, and
+ * sdkconfig.defaults pins lwIP (and with it SNTP) beside it. everything
+ * that talks to the network joins them. core 1 keeps valves, input and
+ * the display, with the GPIO and I2C interrupts allocated there too
+ * (rotary_encoder.cpp, i2c_bus.cpp), so a burst of Wi-Fi interrupts
+ * never sits between a detent and the redraw it causes.
+ *
+ *   core 1, control and UI
+ *     refresh_disp_task  10  redraws; waits on ui_bus, then on I2C
+ *     valve_task          6  opens and closes on the second
+ *     trigger_callback    5  encoder and button, ISR -> input_bus
+ *     main_task           3  menu, input_bus -> ui_bus
+ *
+ *   core 0, network and background
+ *     (Wi-Fi driver)     23
+ *     (esp_timer)        22  button deadlines, short callbacks only
+ *     (lwIP tcpip, SNTP) 18
+ *     (httpd)             5  REST API and /ws
+ *     sync_task           4
+ *     history_task        2  flash writes
+ *     telemetry           2
+ *     ota_task            2
+ *     rest_wifi           2
+ *     dlog_task           1  formats deferred logs
+ *     (console REPL)      1
+ *
+ * lcd_bench pins itself for its cycle counts. within core 1 a redraw
+ * outranks the input that queues the next one, so a burst of detents
+ * collapses into one frame rather than a frame per detent. "latency"
+ * on the console (ui_latency.h) measures detent to glass, radio on and
+ * off, against CONFIG_IRRIGATION_UI_LATENCY_TARGET_MS.
+ */
+#if CONFIG_FREERTOS_UNICORE
+#define CORE_NET  0
+#define CORE_CTRL 0
+#else
+#define CORE_NET  0
+#define CORE_CTRL 1
+#endif
+
+#define DISPLAY_TASK_PRIO   10
+#define VALVE_TASK_PRIO     6
+#define TRIGGER_TASK_PRIO   5
+#define MAIN_TASK_PRIO      3
+
+#define SYNC_TASK_PRIO      4
+#define HISTORY_TASK_PRIO   2
+#define TELEMETRY_TASK_PRIO 2
+#define OTA_TASK_PRIO       2
+#define REST_WIFI_TASK_PRIO 2
+#define DLOG_TASK_PRIO      1
+#define CONSOLE_TASK_PRIO   1
+
+/**
+ * run fn(arg) on core and wait for it. an interrupt is allocated on
+ * the core that asks for it, and app_main runs on core 0. runs on the
+ * IPC task, whose stack sdkconfig.defaults sizes for a driver install
+ */
+static inline esp_err_t call_on_core(int core, void (*fn)(void *), void *arg)
+{
+#if CONFIG_FREERTOS_UNICORE
+    (void) core;
+    fn(arg);
+    return ESP_OK;
+#else
+    return esp_ipc_call_blocking(core, fn, arg);
+#endif
+}
+
+#endif /* task_layout.h */
@@ -0,0 +1,56 @@
+#ifndef __TELEMETRY_H__
+#define __TELEMETRY_H__
+
+#include <inttypes.h>
+#include "esp_err.h"
+
+#include "DS3231_RTC.h"
+
+enum telemetry_type_t : uint8_t {
+    TLM_VALVE_OPEN,  // value: seconds it will stay open
+    TLM_VALVE_CLOSE, // value: 0
+    TLM_SYNC_OK,     // value: clock offset corrected, ms
+    TLM_SYNC_FAIL,   // value: 0
+    TLM_TEMPERATURE, // value: RTC die temperature, quarter degrees C
+    TLM_BOOT         // value: reset reason
+};
+
+/**
+ * 12 bytes per event in RAM and flash, expanded to JSON only on the
+ * way out
+ */
+typedef struct {
+    uint32_t time;  // epoch seconds
+    int32_t value;
+    uint8_t type;   // telemetry_type_t
+    uint8_t zone;   // 0xFF if not zone related
+} telemetry_record_t;
+
+typedef struct {
+    uint32_t recorded; // accepted into the RAM ring
+    uint32_t sent;     // acknowledged by the broker
+    uint32_t spilled;  // written to the flash overflow
+    uint32_t dropped;  // lost: ring full or oldest overflow batch evicted
+    uint32_t flushes;  // radio bursts
+    uint16_t queued;   // in RAM now
+    uint16_t batches;  // in flash now
+} telemetry_stats_t;
+
+#define TELEMETRY_NO_ZONE 0xFF
+
+/**
+ * events are batched and published with QoS 1 to
+ * CONFIG_IRRIGATION_MQTT_TOPIC/<mac>. the radio is woken once per
+ * CONFIG_IRRIGATION_MQTT_FLUSH_S for one burst; whatever does not fit
+ * in RAM until then goes to NVS and is sent first on the next burst.
+ * if another user already holds the station, batches go out as soon
+ * as they fill.
+ */
+esp_err_t telemetry_init(DS3231_RTC *rtc);
+
+/* any task, never blocks. false if the RAM ring is full */
+bool telemetry_record(telemetry_type_t type, uint8_t zone, int32_t value);
+
+void telemetry_get_stats(telemetry_stats_t *stats);
+
+#endif /* telemetry.h */
@@ -0,0 +1,69 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <inttypes.h>
+#include "esp_err.h"
+
+/**
+ * binary event trace. fixed 16 byte records go into a RAM ring that
+ * any task or ISR on either core can write without a lock: the writer
+ * claims a slot with one atomic add and marks it complete last, so a
+ * reader can tell a finished record from one being overwritten.
+ * the oldest records are overwritten once the ring is full.
+ *
+ * "trace dump" on the console prints the ring as hex lines between
+ * TRACE BEGIN and TRACE END, tools/trace_to_perfetto.py turns a capture
+ * of that into a Chrome/Perfetto trace.
+ *
+ * TRACE() compiles away, arguments included, without
+ * CONFIG_IRRIGATION_TRACE.
+ */
+
+enum trace_id_t : uint8_t {
+    TRACE_NONE,
+    TRACE_GPIO_ISR,    // a: pin
+    TRACE_QUEUE_SEND,  // a: trace_queue_t, b: depth after, TRACE_FULL if dropped
+    TRACE_QUEUE_RECV,  // a: trace_queue_t, b: depth after
+    TRACE_I2C_BEGIN,   // a: address, b: bytes
+    TRACE_I2C_END,     // a: address, b: esp_err_t
+    TRACE_VALVE_OPEN,  // a: zone, b: seconds
+    TRACE_VALVE_CLOSE, // a: zone, b: 1 if stopped by hand
+    TRACE_MENU,        // a: node, b: cursor | editing << 16
+    TRACE_LCD_BEGIN,   // a: display state
+    TRACE_LCD_END,     // redraw done, its I2C transfers are in between
+    TRACE_SYNC,        // a: sync_stage_t, b: offset applied in ms
+    TRACE_ID_MAX
+};
+
+enum trace_queue_t : uint8_t {
+    TRACE_Q_GPIO,  // gpio_evt_queue
+    TRACE_Q_INPUT, // input_bus
+    TRACE_Q_UI,    // ui_bus
+    TRACE_Q_SYNC   // sync_bus
+};
+
+#define TRACE_FULL UINT32_MAX
+
+typedef struct {
+    uint32_t seq;     // slot index + 1 once written, 0 while writing
+    uint32_t time_us; // low half of esp_timer_get_time()
+    uint8_t id;       // trace_id_t
+    uint8_t core;
+    uint16_t a;
+    uint32_t b;
+} trace_record_t;
+
+static_assert(sizeof(trace_record_t) == 16, "records are dumped as 16 bytes");
+
+#if CONFIG_IRRIGATION_TRACE
+void trace_record(trace_id_t id, uint16_t a, uint32_t b);
+#define TRACE(id, a, b) trace_record((id), (a), (b))
+#else
+/* unevaluated, but the arguments still count as used */
+#define TRACE(id, a, b) do { (void) sizeof(id); (void) sizeof(a); (void) sizeof(b); } while(0)
+#endif
+
+/* the "trace" console command: stats, dump, clear */
+esp_err_t trace_register_command();
+
+#endif /* trace.h */
@@ -0,0 +1,88 @@
+#ifndef __TZ_H__
+#define __TZ_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <time.h>
+
+/* longest POSIX TZ string taken */
+#define TZ_SPEC_MAX 47
+
+enum tz_change_kind_t : uint8_t {
+    TZ_MONTH_WEEK_DAY, // Mm.w.d
+    TZ_JULIAN,         // Jn, February 29 never counted
+    TZ_DAY_OF_YEAR     // n, from 0
+};
+
+/* a DST change, at time seconds past local midnight of its day */
+typedef struct {
+    tz_change_kind_t kind;
+    uint8_t month;  // 1-12
+    uint8_t week;   // 1-5, 5 is the last
+    uint8_t wday;   // 0-6, Sunday = 0
+    uint16_t day;   // Jn 1-365, n 0-365
+    int32_t time;
+} tz_change_t;
+
+/* a parsed POSIX TZ string. offsets are seconds east of UTC */
+typedef struct {
+    int32_t std_offset;
+    int32_t dst_offset;
+    bool dst;           // false: standard time all year
+    tz_change_t start;  // into DST, in standard time
+    tz_change_t end;    // out of DST, in DST
+} tz_rule_t;
+
+/**
+ * parse a POSIX TZ string such as "PST8PDT,M3.2.0/2,M11.1.0/2" or
+ * "CET-1CEST,M3.5.0,M10.5.0/3". names are checked and dropped: letters,
+ * or letters, digits, '+' and '-' inside <>. a DST name without rules
+ * gets the US rules, as newlib does.
+ */
+bool tz_parse(const char *spec, tz_rule_t *rule);
+
+/**
+ * one year of a rule as UTC instants: the span it covers, and when
+ * DST starts and ends in it. conversion inside the span is a compare.
+ */
+typedef struct {
+    int64_t from, to;           // [from, to): the year in standard time
+    int64_t dst_start, dst_end; // equal when there is no DST
+    int32_t std_offset, dst_offset;
+} tz_year_t;
+
+void tz_year(const tz_rule_t *rule, int year, tz_year_t *out);
+
+/**
+ * the local time zone. tz_set() parses once and caches the current
+ * year's transitions; tz_local() and tz_offset() then convert in O(1)
+ * off the cache, without locks, from any task. the first call in a
+ * new year computes that year and caches it for the rest.
+ */
+bool tz_set(const char *spec);
+
+/* the spec in use, "UTC0" before tz_set() */
+void tz_get(char *spec, size_t size);
+
+/* seconds east of UTC at t, and whether DST applies */
+int32_t tz_offset(time_t t, bool *dst = NULL);
+
+/* localtime_r() without newlib's rule evaluation. tm_zone and tm_gmtoff are not set */
+void tz_local(time_t t, struct tm *tm);
+
+/**
+ * the UTC instant of a local wall time, seconds since 1970-01-01 as if
+ * local time were UTC. a wall time the clocks fall back across maps
+ * to its first reading; one skipped by spring forward maps to the
+ * instant as far past the change as the wall time is.
+ */
+time_t tz_utc(int64_t local);
+
+/* days since 1970-01-01 of a civil date, and back */
+int32_t tz_days_from_civil(int year, int month, int mday);
+void tz_civil_from_days(int32_t days, int *year, int *month, int *mday);
+
+/* timegm(): a broken-down UTC time to time_t */
+time_t tz_timegm(const struct tm *tm);
+
+#endif /* tz.h */
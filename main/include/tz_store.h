@@ -0,0 +1,19 @@
+#ifndef __TZ_STORE_H__
+#define __TZ_STORE_H__
+
+#include "esp_err.h"
+
+/**
+ * the controller's time zone as a POSIX TZ string (tz.h), kept in NVS
+ * so it can change without a rebuild. CONFIG_IRRIGATION_TZ until one
+ * is set. call after nvs_flash_init(), before anything reads local time.
+ */
+esp_err_t tz_store_init();
+
+/* check, keep and apply a new spec, then reschedule the valves. not applied if it cannot be kept */
+esp_err_t tz_store_set(const char *spec);
+
+/* the "tz" console command: show or set the zone, or time conversion */
+esp_err_t tz_register_command();
+
+#endif /* tz_store.h */
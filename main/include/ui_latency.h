@@ -0,0 +1,35 @@
+#ifndef __UI_LATENCY_H__
+#define __UI_LATENCY_H__
+
+#include <inttypes.h>
+#include "esp_err.h"
+
+/**
+ * input-to-display latency: from the interrupt of the encoder edge that
+ * starts a burst to the end of the LCD flush that shows its result.
+ * the edge time rides the burst (event_t rotate.edge_us), the menu
+ * snapshot it causes (state.input_us) and the redraw that collapses
+ * it, so a frame drawn for the clock is never counted.
+ *
+ * each sample is filed by whether Wi-Fi was up or a sync running when
+ * the frame landed. "latency" on the console prints p50, p99 and the
+ * worst of each against CONFIG_IRRIGATION_UI_LATENCY_TARGET_MS.
+ * times are the low half of esp_timer_get_time(), as in trace.h.
+ *
+ * a click is not measured: the gesture engine holds it back for the
+ * double click window on purpose.
+ */
+
+/* S1 edge ISR: note the time, unless an earlier edge is still untaken */
+void ui_latency_edge();
+
+/* trigger_callback, per S1 edge dequeued: that edge's time, 0 if none */
+uint32_t ui_latency_take_edge();
+
+/* refresh_disp_task, once the frame answering input_us is on the glass */
+void ui_latency_record(uint32_t input_us);
+
+/* the "latency" console command: report, clear, sync */
+esp_err_t ui_latency_register_command();
+
+#endif /* ui_latency.h */
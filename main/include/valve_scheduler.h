@@ -0,0 +1,29 @@
+#ifndef __VALVE_SCHEDULER_H__
+#define __VALVE_SCHEDULER_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#include "Valve.h"
+
+/**
+ * the scheduler task sleeps until the next programmed start, opens the
+ * valve and closes it from a one-shot esp_timer. nothing is polled: it
+ * only wakes for a start, a close or valve_scheduler_reschedule().
+ */
+esp_err_t valve_scheduler_init(Valve **valves, size_t count);
+
+/* programs or the wall clock changed, recompute every start */
+void valve_scheduler_reschedule();
+
+/* open a valve now for duration_sec, outside its program */
+esp_err_t valve_scheduler_run(size_t index, uint16_t duration_sec);
+
+/* close every valve and cancel pending closes */
+void valve_scheduler_stop_all();
+
+/* esp_timer time of the earliest pending close, -1 if every valve is shut */
+int64_t valve_scheduler_next_close_us();
+
+#endif /* valve_scheduler.h */
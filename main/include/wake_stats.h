@@ -0,0 +1,28 @@
+#ifndef __WAKE_STATS_H__
+#define __WAKE_STATS_H__
+
+#include <inttypes.h>
+#include "esp_err.h"
+
+/**
+ * idle wakeup accounting. the FreeRTOS idle hook runs once each time a
+ * core drops back to idle, i.e. once per wakeup from waiti or light
+ * sleep, so its count is the number of times the core was woken.
+ * our own tasks also record why they woke, for attribution.
+ */
+enum wake_source_t : uint8_t {
+    WAKE_INPUT,   // trigger_callback: gpio edge or button timer
+    WAKE_MENU,    // main_task: input event
+    WAKE_DISPLAY, // refresh_disp_task: state change or clock minute
+    WAKE_VALVE,   // valve_task or a close timer
+    WAKE_SYNC,    // sync_task: request or periodic resync
+    WAKE_TELEMETRY, // telemetry task: batch full, flush or sample
+    WAKE_SOURCE_MAX
+};
+
+esp_err_t wake_stats_init();
+void wake_stats_record(wake_source_t source);
+void wake_stats_reset();
+void wake_stats_report(const char *label);
+
+#endif /* wake_stats.h */
@@ -1,11 +1,36 @@
 #ifndef WIFI_SETUP_H
 #define WIFI_SETUP_H
 
+#include <stdbool.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-void wifi_init_sta(void);
+/**
+ * station manager. the netif, event loop and driver are created once
+ * by wifi_manager_init(), from app_main before any task connects; the
+ * radio is only on while at least one wifi_connect() is not yet
+ * matched by a wifi_disconnect().
+ */
+typedef struct {
+    uint32_t connects;       // successful connects since boot
+    uint32_t fast_connects;  // of which used the cached BSSID/channel
+    uint32_t last_connect_ms; // wifi_connect() call to link + address
+    uint32_t avg_scan_ms;    // mean connect time with a full scan
+    uint32_t avg_fast_ms;    // mean connect time on the fast path
+    uint64_t radio_on_ms;    // total time the radio has been started
+} wifi_stats_t;
+
+esp_err_t wifi_manager_init(void);
+esp_err_t wifi_connect(TickType_t timeout);
+esp_err_t wifi_disconnect(void);
+bool wifi_is_connected(void);
+/* modem sleep between beacons (default) or full throughput */
+void wifi_set_power_save(bool enable);
+void wifi_get_stats(wifi_stats_t *stats);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,51 @@
+#ifndef __WS_PUSH_H__
+#define __WS_PUSH_H__
+
+#include <inttypes.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#define WS_MAX_CLIENTS 3
+
+/**
+ * state a dashboard mirrors. a zone's valve is WS_KEY_VALVE + zone.
+ */
+enum ws_key_t : uint8_t {
+    WS_KEY_MENU     = 0x01, // node << 16 | cursor
+    WS_KEY_SYNC     = 0x02, // last correction in ms, WS_SYNC_FAILED if none
+    WS_KEY_PROGRAMS = 0x03, // bumped on every program change, refetch /api/programs
+    WS_KEY_VALVE    = 0x10, // seconds the valve was opened for, 0 when shut
+    WS_KEY_MAX      = 0x20
+};
+
+#define WS_SYNC_FAILED INT32_MIN
+
+/**
+ * binary frames, little endian:
+ *
+ *   u8 kind   'S' full snapshot, 'D' delta
+ *   u16 seq   per server, bumped per delta. a gap means a lost delta
+ *             (not on TCP); a snapshot carries the latest
+ *   u32 time  epoch seconds when sent, the dashboard's clock
+ *   then per field: u8 key, i32 value
+ *
+ * a delta carries only the fields changed since the previous frame.
+ */
+typedef struct {
+    uint32_t frames;   // sent, all clients
+    uint32_t bytes;
+    uint32_t deferred; // skipped for a full socket, snapshot later
+    uint32_t rejected; // over WS_MAX_CLIENTS, closed right after the handshake
+    uint8_t clients;
+} ws_push_stats_t;
+
+/* adds GET /ws to the REST server */
+esp_err_t ws_push_register(httpd_handle_t server);
+
+/* any task. a change wakes the server, an equal value does nothing */
+void ws_push_set(uint8_t key, int32_t value);
+void ws_push_bump(uint8_t key);
+
+void ws_push_get_stats(ws_push_stats_t *stats);
+
+#endif /* ws_push.h */
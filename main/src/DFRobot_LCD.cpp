@@ -1,23 +1,11 @@
 #include <stdio.h>
 #include <string.h>
 #include <inttypes.h>
-#include "driver/i2c.h"
+#include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "sdkconfig.h"
 #include "esp_err.h"
 #include "DFRobot_LCD.h"
-
-// Configuration for I2C
-#define I2C_MASTER_SCL_IO    9        /*!< GPIO number for I2C master clock */
-#define I2C_MASTER_SDA_IO    8        /*!< GPIO number for I2C master data  */
-#define I2C_MASTER_FREQ_HZ   100000    /*!< I2C master clock frequency */
-#define I2C_MASTER_NUM       I2C_NUM_0 /*!< I2C port number for master dev */
-#define I2C_MASTER_TX_BUF_DISABLE 0
-#define I2C_MASTER_RX_BUF_DISABLE 0
-
-// Function prototypes for internal functions
-static esp_err_t i2c_master_init();
-void i2c_send(uint8_t addr, uint8_t *data, size_t len);
+#include "hal_i2c.h"
 
 /*******************************public*********************************/
 
@@ -33,7 +21,7 @@ DFRobot_LCD::DFRobot_LCD(uint8_t lcd_cols, uint8_t lcd_rows, uint8_t lcd_Addr, u
  */
 esp_err_t DFRobot_LCD::init() {
     esp_err_t ret;
-    ret = i2c_master_init(); // Initialize I2C at constructor
+    ret = I2cBus::init(); // shared with the RTC
     if(ret != ESP_OK) {
         return ret;
     }
@@ -47,7 +35,7 @@ esp_err_t DFRobot_LCD::init() {
  */
 void DFRobot_LCD::command(uint8_t value) {
     uint8_t data[3] = {0x80, value}; // Control byte + command byte
-    i2c_send(_lcdAddr, data, 2);
+    I2cBus::write(_lcdAddr, data, 2);
 }
 
 /**
@@ -62,7 +50,7 @@ void DFRobot_LCD::display() {
  * turn off display
  */
 void DFRobot_LCD::noDisplay() {
-    _showcontrol |= ~LCD_DISPLAYON;
+    _showcontrol &= ~LCD_DISPLAYON;
     command(LCD_DISPLAYCONTROL | _showcontrol);
 }
 
@@ -163,7 +151,7 @@ void DFRobot_LCD::customSymbol(uint8_t location, uint8_t charmap[])
     {
         data[i+1] = charmap[i];
     }
-    i2c_send(_lcdAddr, data, 9);
+    I2cBus::write(_lcdAddr, data, 9);
 }
 
 void DFRobot_LCD::blinkLED(void) 
@@ -214,7 +202,7 @@ inline size_t DFRobot_LCD::write(uint8_t value)
 {
 
     uint8_t data[3] = {0x40, value};
-    i2c_send(_lcdAddr, data, 2);
+    I2cBus::write(_lcdAddr, data, 2);
     return 1; // assume sucess
 }
 
@@ -230,7 +218,7 @@ void DFRobot_LCD::setCursor(uint8_t col, uint8_t row)
     col = (row == 0 ? col|0x80 : col|0xc0);
     uint8_t data[3] = {0x80, col};
 
-    i2c_send(_lcdAddr, data, 2);
+    I2cBus::write(_lcdAddr, data, 2);
 
 }
 
@@ -238,39 +226,9 @@ void DFRobot_LCD::setCursor(uint8_t col, uint8_t row)
 
 /*******************************private*******************************/
 
-/**
- * I2C Master Initialization
- */
-esp_err_t i2c_master_init() {
-    i2c_config_t conf;
-    conf.mode = I2C_MODE_MASTER;
-    conf.sda_io_num = I2C_MASTER_SDA_IO;
-    conf.sda_pullup_en = GPIO_PULLUP_ENABLE;
-    conf.scl_io_num = I2C_MASTER_SCL_IO;
-    conf.scl_pullup_en = GPIO_PULLUP_ENABLE;
-    conf.master.clk_speed = I2C_MASTER_FREQ_HZ;
-    conf.clk_flags = 0;
-    i2c_param_config(I2C_MASTER_NUM, &conf);
-    return i2c_driver_install(I2C_MASTER_NUM, conf.mode, 0, 0, 0);
-}
-
-/**
- * Function to send data over I2C
- */
-void i2c_send(uint8_t addr, uint8_t *data, size_t len) {
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (addr << 1) | I2C_MASTER_WRITE, true);
-    i2c_master_write(cmd, data, len, true);
-    i2c_master_stop(cmd);
-    i2c_master_cmd_begin(I2C_MASTER_NUM, cmd, pdMS_TO_TICKS(1000));
-    i2c_cmd_link_delete(cmd);
-}
-
-
 void DFRobot_LCD::setReg(uint8_t addr, uint8_t data) {
     uint8_t buf[2] = {addr, data}; // Register address + data
-    i2c_send(_RGBAddr, buf, sizeof(buf));
+    I2cBus::write(_RGBAddr, buf, sizeof(buf));
 }
 
 void DFRobot_LCD::begin(uint8_t cols, uint8_t lines, uint8_t dotsize) {
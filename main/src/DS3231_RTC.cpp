@@ -1,20 +1,16 @@
 #include <inttypes.h>
 #include <time.h>
-#include "driver/i2c.h"
 #include "esp_log.h"
 #include "esp_err.h"
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
 
 #include "DS3231_RTC.h"
+#include "hal_i2c.h"
 
-#define I2C_MASTER_PORT I2C_NUM_0
-#define I2C_MASTER_SCL_IO 9
-#define I2C_MASTER_SDA_IO 8
-#define I2C_MASTER_FREQ_HZ 100000
 #define I2C_SLAVE_ADDR 0x68
-#define I2C_MASTER_TX_BUF_DISABLE 0
-#define I2C_MASTER_RX_BUF_DISABLE 0
+
+#define DS3231_REG_TIME     0x00
+#define DS3231_REG_TEMP     0x11
+#define DS3231_CENTURY      0x80 // month register, years 2100 and on
 
 static const char* TAG = "DS3231";
 
@@ -48,15 +44,18 @@ static uint8_t dec_to_bcd(uint8_t dec) {
     return ((dec / 10 * 16) + (dec % 10));
 }
 
-/*******************************public*********************************/
+/**
+ * both digits 0-9, so the counter was not left in a state the chip
+ * never produces (e.g. by firmware that wrote a year of 125)
+ */
+static bool bcd_valid(uint8_t bcd) {
+    return (bcd & 0x0F) <= 9 && (bcd >> 4) <= 9;
+}
 
-DS3231_RTC::DS3231_RTC() {
-    // temperature reading
-    float temperature = 0.0;
+/*******************************public*********************************/
 
-    // control and status
-    uint8_t control_register = 0;
-    uint8_t status_register = 0;
+/* the members, not locals that shadowed them and were never used */
+DS3231_RTC::DS3231_RTC() : temperature(0.0), control_register(0), status_register(0) {
 }
 
 /*
@@ -64,7 +63,7 @@ DS3231_RTC::DS3231_RTC() {
  */
 esp_err_t DS3231_RTC::init(){
     esp_err_t ret;
-    ret = i2c_master_init();
+    ret = I2cBus::init();
     if(ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed RTC init: %s", esp_err_to_name(ret));
         return ret;
@@ -74,26 +73,26 @@ esp_err_t DS3231_RTC::init(){
 
 /*
  * Set the time on the DS3231
- * requirements: 
- * 	all arguments are assumed to be binary-coded-decimal(BCD)
- * 	see RTC_example.cpp for an exmaple conversion
- *
- * 	design considerations:
- * 	    consolidate time members into a struct?
+ * the chip counts weekday 1-7, month 1-12 and a two digit year with a
+ * century bit, all BCD. timeinfo is a normal struct tm.
  */
 esp_err_t DS3231_RTC::setTime(struct tm *timeinfo) {
+    int year = timeinfo->tm_year - 100; // 2000 based
     uint8_t buf[7] = {
                     dec_to_bcd(timeinfo->tm_sec),
                     dec_to_bcd(timeinfo->tm_min),
-                    dec_to_bcd(timeinfo->tm_hour),
-                    dec_to_bcd(timeinfo->tm_wday),
+                    dec_to_bcd(timeinfo->tm_hour), // 24 hour mode
+                    dec_to_bcd(timeinfo->tm_wday + 1),
                     dec_to_bcd(timeinfo->tm_mday),
-                    dec_to_bcd(timeinfo->tm_mon),
-                    dec_to_bcd(timeinfo->tm_year),
+                    static_cast<uint8_t>(dec_to_bcd(timeinfo->tm_mon + 1) | (year >= 100 ? DS3231_CENTURY : 0)),
+                    dec_to_bcd(year % 100),
                     };
 
+    if(year < 0 || year > 199) {
+        return ESP_ERR_INVALID_ARG;
+    }
     esp_err_t ret;
-    ret = i2c_send(0x0,buf,sizeof(buf));
+    ret = I2cBus::write_reg(I2C_SLAVE_ADDR, DS3231_REG_TIME, buf, sizeof(buf));
     if(ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to write time to DS3231: %s", esp_err_to_name(ret));
         return ret;
@@ -102,26 +101,35 @@ esp_err_t DS3231_RTC::setTime(struct tm *timeinfo) {
 }
 
 /*
- * get time from the DS3231
- * the resulting memeber values are in BCD
+ * get time from the DS3231, as setTime wrote it. one bus transaction.
+ * registers that do not hold a valid date give ESP_ERR_INVALID_RESPONSE.
  */
 esp_err_t DS3231_RTC::getTime(struct tm *timeinfo) {
     uint8_t buffer[7];
 
     esp_err_t ret;
-    ret = i2c_send_receive(0x0, buffer, sizeof(buffer));
+    ret = I2cBus::read_reg(I2C_SLAVE_ADDR, DS3231_REG_TIME, buffer, sizeof(buffer));
     if(ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to retreive time from DS3231: %s", esp_err_to_name(ret));
         return ret;
     }
 
+    uint8_t month = buffer[5] & ~DS3231_CENTURY;
+    if(!bcd_valid(buffer[0]) || !bcd_valid(buffer[1]) || !bcd_valid(buffer[2] & 0x3F) ||
+       !bcd_valid(buffer[4]) || !bcd_valid(month) || !bcd_valid(buffer[6]) ||
+       month == 0 || bcd_to_dec(month) > 12 || (buffer[2] & 0x40)) {
+        ESP_LOGW(TAG, "DS3231 holds no valid time");
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
     timeinfo->tm_sec = bcd_to_dec(buffer[0]);
     timeinfo->tm_min = bcd_to_dec(buffer[1]);
     timeinfo->tm_hour = bcd_to_dec(buffer[2]);
-    timeinfo->tm_wday = bcd_to_dec(buffer[3]);
+    timeinfo->tm_wday = bcd_to_dec(buffer[3]) - 1;
     timeinfo->tm_mday = bcd_to_dec(buffer[4]);
-    timeinfo->tm_mon = bcd_to_dec(buffer[5]);
-    timeinfo->tm_year = bcd_to_dec(buffer[6]);
+    timeinfo->tm_mon = bcd_to_dec(month) - 1;
+    timeinfo->tm_year = bcd_to_dec(buffer[6]) + 100 + (buffer[5] & DS3231_CENTURY ? 100 : 0);
+    timeinfo->tm_isdst = 0;
 
     return ESP_OK;
 }
@@ -133,93 +141,26 @@ float DS3231_RTC::readTemperature() {
     float temperature = 0;
     uint8_t buf[2];
     
-    ESP_ERROR_CHECK(i2c_send_receive(0x11, buf, sizeof(buf)));
+    ESP_ERROR_CHECK(I2cBus::read_reg(I2C_SLAVE_ADDR, DS3231_REG_TEMP, buf, sizeof(buf)));
 
     temperature = (float) ((float)(((buf[0] << 8) | buf[1]) >> 6) / 4);
 
     return temperature;
 }
 
-/*******************************private*******************************/
-
 /**
- * I2C Master Initialization
+ * temperature in quarter degrees C. the register is a 10 bit two's
+ * complement value, left aligned in two bytes. unlike readTemperature
+ * a bus error is returned rather than aborting.
  */
-esp_err_t DS3231_RTC::i2c_master_init() {
-    i2c_config_t conf;
-    conf.mode = I2C_MODE_MASTER;
-    conf.sda_io_num = I2C_MASTER_SDA_IO;
-    conf.scl_io_num = I2C_MASTER_SCL_IO;
-    conf.sda_pullup_en = GPIO_PULLUP_ENABLE;
-    conf.scl_pullup_en = GPIO_PULLUP_ENABLE;
-    conf.master.clk_speed = I2C_MASTER_FREQ_HZ;
-    conf.clk_flags = 0;
-
-    esp_err_t ret = i2c_param_config(I2C_MASTER_PORT, &conf);
+esp_err_t DS3231_RTC::getTemperature(int16_t *quarter_deg) {
+    uint8_t buf[2];
+
+    esp_err_t ret = I2cBus::read_reg(I2C_SLAVE_ADDR, DS3231_REG_TEMP, buf, sizeof(buf));
     if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to read temperature from DS3231: %s", esp_err_to_name(ret));
         return ret;
     }
-
-    return i2c_driver_install(I2C_MASTER_PORT,conf.mode,0,0,0);
-}
-
-/**
- * Function to send data over I2C
- * args:
- * 	addr : address to send pointer on DS3231
- * 	data : data pointer
- * 	len  : length of array data
- */
-esp_err_t DS3231_RTC::i2c_send(uint8_t addr, uint8_t *data, size_t len) {
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (I2C_SLAVE_ADDR << 1) | I2C_MASTER_WRITE, true);
-    i2c_master_write_byte(cmd, addr, true);
-    i2c_master_write(cmd, data, len, I2C_MASTER_ACK);
-    i2c_master_stop(cmd);
-
-    esp_err_t ret = i2c_master_cmd_begin(I2C_MASTER_PORT, cmd, pdMS_TO_TICKS(1000));
-    i2c_cmd_link_delete(cmd);
-
-    return ret;
-}
-
-/**
- * Function to receive data over I2C
- * INCOMPLETE!!! potentially uncessesary for this use-case
- */
-esp_err_t DS3231_RTC::i2c_receive(uint8_t *data) {
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (I2C_SLAVE_ADDR << 1) | I2C_MASTER_READ, true);
-    i2c_master_read_byte(cmd, data, I2C_MASTER_NACK);
-    i2c_master_stop(cmd);
-
-    esp_err_t ret = i2c_master_cmd_begin(I2C_MASTER_PORT, cmd, pdMS_TO_TICKS(1000));
-    i2c_cmd_link_delete(cmd);
-
-    return ret;
-}
-
-/**
- * Function to direct pointer then read
- * args:
- * 	addr : address to send pointer for reading
- * 	data : pointer to uint8 array to be overwritten by read from DS3231
- * 	len  : size of array data
- */
-esp_err_t DS3231_RTC::i2c_send_receive(uint8_t addr, uint8_t *data, size_t len) {
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (I2C_SLAVE_ADDR << 1) | I2C_MASTER_WRITE, true);
-    i2c_master_write_byte(cmd, addr, true);
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (I2C_SLAVE_ADDR << 1) | I2C_MASTER_READ, true);
-    i2c_master_read(cmd, data, len, I2C_MASTER_LAST_NACK);
-    i2c_master_stop(cmd);
-
-    esp_err_t ret = i2c_master_cmd_begin(I2C_MASTER_PORT, cmd, pdMS_TO_TICKS(1000));
-    i2c_cmd_link_delete(cmd);
-
-    return ret;
+    *quarter_deg = static_cast<int16_t>((buf[0] << 8) | buf[1]) >> 6;
+    return ESP_OK;
 }
@@ -0,0 +1,51 @@
+#include <inttypes.h>
+#include <atomic>
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "boot_timeline.h"
+
+static const char *TAG = "BOOT";
+
+typedef struct {
+    std::atomic<const char *> stage; // set last, marks the slot valid
+    int64_t time_us;
+} boot_stage_t;
+
+static boot_stage_t stages[BOOT_STAGES_MAX];
+static std::atomic<uint8_t> stage_count{0};
+
+/**
+ * returns the stamp, so callers can check a budget
+ */
+int64_t boot_mark(const char *stage)
+{
+    int64_t now = esp_timer_get_time();
+    uint8_t i = stage_count.fetch_add(1, std::memory_order_relaxed);
+
+    if(i < BOOT_STAGES_MAX) {
+        stages[i].time_us = now;
+        stages[i].stage.store(stage, std::memory_order_release);
+    }
+    return now;
+}
+
+void boot_report()
+{
+    uint8_t count = stage_count.load(std::memory_order_relaxed);
+    int64_t prev_us = 0;
+
+    if(count > BOOT_STAGES_MAX) {
+        count = BOOT_STAGES_MAX;
+    }
+    ESP_LOGI(TAG, "%8s %8s  stage", "ms", "+ms");
+    for(uint8_t i = 0; i < count; i++) {
+        const char *stage = stages[i].stage.load(std::memory_order_acquire);
+        if(stage == nullptr) {
+            continue; // still being written
+        }
+        int64_t t = stages[i].time_us;
+        ESP_LOGI(TAG, "%8.1f %8.1f  %s", t / 1000.0, (t - prev_us) / 1000.0, stage);
+        prev_us = t;
+    }
+}
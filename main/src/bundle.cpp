@@ -0,0 +1,163 @@
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "bundle.h"
+
+size_t bundle_write(uint8_t *buf, size_t size, const program_t *programs, size_t count, uint8_t zones)
+{
+    CborWriter out(buf, size);
+
+    out.map(3);
+    out.uint(BUNDLE_KEY_VERSION);
+    out.uint(BUNDLE_VERSION);
+    out.uint(BUNDLE_KEY_ZONES);
+    out.uint(zones);
+    out.uint(BUNDLE_KEY_PROGRAMS);
+    out.array(count);
+    for(size_t i = 0; i < count; i++) {
+        const program_t *p = &programs[i];
+        out.array(BUNDLE_PROGRAM_FIELDS);
+        out.uint(p->zone);
+        out.uint(p->hour);
+        out.uint(p->minute);
+        out.uint(p->wday_bv);
+        out.uint(p->duration_sec);
+        out.boolean(p->enabled);
+    }
+    return out.ok() ? out.length() : 0;
+}
+
+/*******************************BundleReader*********************************/
+
+BundleReader::BundleReader(program_t *programs, size_t max, uint8_t zone_count)
+    : _cbor(item_cb, this), _programs(programs), _max(max), _zone_count(zone_count)
+{
+}
+
+void BundleReader::reset()
+{
+    _cbor.reset();
+    _count = 0;
+    _field = 0;
+    _key = 0;
+    _value = false;
+    _seen = 0;
+    _error = NULL;
+}
+
+bool BundleReader::fail(const char *why)
+{
+    if(_error == NULL) {
+        _error = why;
+    }
+    return false;
+}
+
+bool BundleReader::item_cb(void *ctx, uint8_t depth, cbor_type_t type, uint64_t value)
+{
+    return static_cast<BundleReader *>(ctx)->item(depth, type, value);
+}
+
+/* one field of [zone, hour, minute, days, duration, enabled] */
+bool BundleReader::program_field(cbor_type_t type, uint64_t value)
+{
+    program_t *p = &_programs[_count];
+
+    if(_field == BUNDLE_PROGRAM_FIELDS - 1) {
+        if(type != CBOR_TRUE && type != CBOR_FALSE) {
+            return fail("program enabled is not a boolean");
+        }
+        p->enabled = type == CBOR_TRUE;
+        if(!program_valid(p, _zone_count)) {
+            return fail("program out of range for this controller");
+        }
+        _count++;
+        return true;
+    }
+    if(type != CBOR_UINT || value > (_field == 4 ? UINT16_MAX : UINT8_MAX)) {
+        return fail("program field out of range");
+    }
+    switch(_field++) {
+        case 0: p->zone = value; break;
+        case 1: p->hour = value; break;
+        case 2: p->minute = value; break;
+        case 3: p->wday_bv = value; break;
+        case 4: p->duration_sec = value; break;
+    }
+    return true;
+}
+
+bool BundleReader::item(uint8_t depth, cbor_type_t type, uint64_t value)
+{
+    if(depth == 0) {
+        return type == CBOR_MAP || fail("not a bundle");
+    }
+    if(depth == 1) {
+        if(!_value) {
+            if(type != CBOR_UINT) {
+                return fail("bundle keys are integers");
+            }
+            if(_seen == 0 && value != BUNDLE_KEY_VERSION) {
+                return fail("bundle version must come first");
+            }
+            if(value <= BUNDLE_KEY_PROGRAMS && (_seen & (1 << value))) {
+                return fail("key repeated");
+            }
+            _key = value;
+            _value = true;
+            return true;
+        }
+        _value = false;
+        if(_key <= BUNDLE_KEY_PROGRAMS) {
+            _seen |= 1 << _key;
+        }
+        switch(_key) {
+            case BUNDLE_KEY_VERSION:
+                return (type == CBOR_UINT && value >= 1 && value <= BUNDLE_VERSION) || fail("unsupported bundle version");
+            case BUNDLE_KEY_ZONES:
+                return (type == CBOR_UINT && value <= UINT8_MAX) || fail("zones is not a count");
+            case BUNDLE_KEY_PROGRAMS:
+                if(type != CBOR_ARRAY) {
+                    return fail("programs is not an array");
+                }
+                return value <= _max || fail("too many programs");
+            default:
+                return true; // a later version's key, whatever it holds
+        }
+    }
+    /* below a key we skip */
+    if(_key != BUNDLE_KEY_PROGRAMS) {
+        return true;
+    }
+    if(depth == 2) {
+        if(type != CBOR_ARRAY || value != BUNDLE_PROGRAM_FIELDS) {
+            return fail("a program is an array of 6 fields");
+        }
+        _field = 0;
+        return true;
+    }
+    return program_field(type, value);
+}
+
+cbor_status_t BundleReader::feed(const uint8_t *data, size_t len)
+{
+    cbor_status_t status = _cbor.feed(data, len);
+    if(status == CBOR_ERROR) {
+        fail("malformed CBOR");
+    }
+    return status;
+}
+
+bool BundleReader::finish()
+{
+    if(_error != NULL) {
+        return false;
+    }
+    if(_cbor.finish() != CBOR_DONE) {
+        return fail("bundle cut short");
+    }
+    if(!(_seen & (1 << BUNDLE_KEY_PROGRAMS))) {
+        return fail("no programs key");
+    }
+    return true;
+}
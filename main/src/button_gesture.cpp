@@ -0,0 +1,64 @@
+#include <inttypes.h>
+
+#include "button_gesture.h"
+
+/**
+ * a raw edge was seen. the pin is sampled once DEBOUNCE_US after the
+ * first edge of a bounce train; later edges in the train are ignored.
+ */
+void ButtonGesture::edge(int64_t now_us)
+{
+    if(_debounce_at == 0) {
+        _debounce_at = now_us + DEBOUNCE_US;
+    }
+}
+
+/**
+ * a deadline passed. pressed is the pin level sampled now.
+ * returns the gesture completed by this step, if any.
+ */
+button_gesture_t ButtonGesture::expire(int64_t now_us, bool pressed)
+{
+    button_gesture_t gesture = BUTTON_NONE;
+
+    if(_debounce_at != 0 && now_us >= _debounce_at) {
+        _debounce_at = 0;
+        if(pressed != _pressed) {
+            _pressed = pressed;
+            if(pressed) {
+                _long_at = now_us + LONG_PRESS_US;
+                _long_fired = false;
+            } else {
+                _long_at = 0;
+                if(!_long_fired) {
+                    if(_last_click_us != 0 && now_us - _last_click_us <= DOUBLE_CLICK_US) {
+                        gesture = BUTTON_DOUBLE_CLICK;
+                        _last_click_us = 0;
+                    } else {
+                        gesture = BUTTON_CLICK;
+                        _last_click_us = now_us;
+                    }
+                }
+            }
+        }
+    }
+
+    if(_long_at != 0 && now_us >= _long_at) {
+        _long_at = 0;
+        _long_fired = true;
+        _last_click_us = 0;
+        gesture = BUTTON_LONG_PRESS;
+    }
+
+    return gesture;
+}
+
+/**
+ * earliest time expire() must run, or 0 if nothing is pending
+ */
+int64_t ButtonGesture::deadline() const
+{
+    if(_debounce_at == 0) return _long_at;
+    if(_long_at == 0) return _debounce_at;
+    return _debounce_at < _long_at ? _debounce_at : _long_at;
+}
@@ -0,0 +1,152 @@
+#include <inttypes.h>
+
+#include "cbor_stream.h"
+
+/* additional information 24..27: the argument follows in 1, 2, 4 or 8 bytes */
+#define CBOR_INFO_ARG8 24
+#define CBOR_INFO_ARG64 27
+
+#define CBOR_SIMPLE_FALSE 20
+#define CBOR_SIMPLE_TRUE  21
+#define CBOR_SIMPLE_NULL  22
+
+/* the item each major type gives, CBOR_NULL where it is not supported */
+static const cbor_type_t types[8] = {
+    CBOR_UINT, CBOR_NEGINT, CBOR_NULL, CBOR_NULL, CBOR_ARRAY, CBOR_MAP, CBOR_NULL, CBOR_NULL
+};
+
+/**
+ * an item is complete: count it against the container it is in, and
+ * close every container that it completes
+ */
+void CborStream::consume()
+{
+    while(_depth > 0) {
+        if(--_left[_depth - 1] > 0) {
+            return;
+        }
+        _depth--;
+    }
+    _state = S_DONE;
+}
+
+bool CborStream::item(cbor_type_t type, uint64_t value)
+{
+    if(!_cb(_ctx, _depth, type, value)) {
+        return false;
+    }
+    if((type == CBOR_ARRAY || type == CBOR_MAP) && value > 0) {
+        if(_depth >= CBOR_DEPTH_MAX || value > CBOR_LENGTH_MAX) {
+            return false;
+        }
+        _left[_depth++] = type == CBOR_MAP ? value * 2 : value;
+    } else {
+        consume();
+    }
+    return true;
+}
+
+cbor_status_t CborStream::step(uint8_t b)
+{
+    switch(_state) {
+        case S_HEAD: {
+            _major = b >> 5;
+            uint8_t info = b & 0x1F;
+            if(_major == 7) {
+                /* floats, undefined and break are not taken */
+                bool ok = false;
+                if(info == CBOR_SIMPLE_FALSE) {
+                    ok = item(CBOR_FALSE, 0);
+                } else if(info == CBOR_SIMPLE_TRUE) {
+                    ok = item(CBOR_TRUE, 0);
+                } else if(info == CBOR_SIMPLE_NULL) {
+                    ok = item(CBOR_NULL, 0);
+                }
+                if(!ok) {
+                    _state = S_ERROR;
+                }
+            } else if(types[_major] == CBOR_NULL || info > CBOR_INFO_ARG64) {
+                _state = S_ERROR; // strings, tags, indefinite lengths
+            } else if(info >= CBOR_INFO_ARG8) {
+                _arg = 0;
+                _need = 1 << (info - CBOR_INFO_ARG8);
+                _state = S_ARG;
+            } else if(!item(types[_major], info)) {
+                _state = S_ERROR;
+            }
+            break;
+        }
+        case S_ARG:
+            _arg = _arg << 8 | b;
+            if(--_need == 0) {
+                _state = S_HEAD;
+                if(!item(types[_major], _arg)) {
+                    _state = S_ERROR;
+                }
+            }
+            break;
+        case S_DONE:
+            _state = S_ERROR; // trailing bytes
+            break;
+        case S_ERROR:
+            break;
+    }
+    return _state == S_ERROR ? CBOR_ERROR : _state == S_DONE ? CBOR_DONE : CBOR_MORE;
+}
+
+cbor_status_t CborStream::feed(const uint8_t *data, size_t len)
+{
+    cbor_status_t status = _state == S_DONE ? CBOR_DONE : CBOR_MORE;
+
+    for(size_t i = 0; i < len; i++) {
+        status = step(data[i]);
+        if(status == CBOR_ERROR) {
+            break;
+        }
+    }
+    return status;
+}
+
+void CborStream::reset()
+{
+    _state = S_HEAD;
+    _need = 0;
+    _arg = 0;
+    _depth = 0;
+}
+
+/*******************************CborWriter*********************************/
+
+void CborWriter::put(uint8_t b)
+{
+    if(_len >= _size) {
+        _overflow = true;
+        return;
+    }
+    _buf[_len++] = b;
+}
+
+/* shortest head for the value, as RFC 8949 preferred serialization */
+void CborWriter::head(uint8_t major, uint64_t value)
+{
+    uint8_t info;
+    uint8_t bytes;
+
+    if(value < CBOR_INFO_ARG8) {
+        put(major << 5 | value);
+        return;
+    }
+    if(value <= UINT8_MAX) {
+        info = 24, bytes = 1;
+    } else if(value <= UINT16_MAX) {
+        info = 25, bytes = 2;
+    } else if(value <= UINT32_MAX) {
+        info = 26, bytes = 4;
+    } else {
+        info = 27, bytes = 8;
+    }
+    put(major << 5 | info);
+    while(bytes-- > 0) {
+        put(value >> (bytes * 8));
+    }
+}
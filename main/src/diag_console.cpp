@@ -0,0 +1,80 @@
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_console.h"
+
+#include "diag_console.h"
+#include "health.h"
+#include "history.h"
+#include "power.h"
+#include "program_store.h"
+#include "trace.h"
+#include "tz_store.h"
+#include "ui_latency.h"
+#include "task_layout.h"
+
+static const char *TAG = "DIAG_CONSOLE";
+
+/*******************************public*********************************/
+
+esp_err_t diag_console_init()
+{
+    esp_console_repl_t *repl = NULL;
+    esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+    esp_err_t ret;
+
+    repl_config.prompt = "irrigation>";
+    repl_config.max_cmdline_length = 64;
+    /* lowest of our tasks, the console only ever waits on the port */
+    repl_config.task_priority = CONSOLE_TASK_PRIO;
+    repl_config.task_core_id = CORE_NET;
+
+#if CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG
+    esp_console_dev_usb_serial_jtag_config_t dev_config = ESP_CONSOLE_DEV_USB_SERIAL_JTAG_CONFIG_DEFAULT();
+    ret = esp_console_new_repl_usb_serial_jtag(&dev_config, &repl_config, &repl);
+#else
+    esp_console_dev_uart_config_t dev_config = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+    ret = esp_console_new_repl_uart(&dev_config, &repl_config, &repl);
+#endif
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed creating REPL: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    esp_console_register_help_command();
+    ret = health_register_command();
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed registering health: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    ret = trace_register_command();
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed registering trace: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    ret = power_register_command();
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed registering power: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    ret = history_register_command();
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed registering history: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    ret = program_store_register_command();
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed registering bundle: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    ret = tz_register_command();
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed registering tz: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    ret = ui_latency_register_command();
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed registering latency: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    return esp_console_start_repl(repl);
+}
@@ -0,0 +1,222 @@
+#include <atomic>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+#include "dlog.h"
+#include "task_layout.h"
+#include "static_rtos.h"
+
+static const char *TAG = "DLOG";
+
+#define DLOG_RECORDS CONFIG_IRRIGATION_DLOG_RECORDS
+#define DLOG_TASK_STACK 3072
+/* one formatted message, longer ones are cut */
+#define DLOG_LINE 160
+
+static QueueHandle_t queue = NULL;
+static StaticQueue<dlog_record_t, DLOG_RECORDS> queue_mem;
+static StaticTask<DLOG_TASK_STACK> task_mem;
+static std::atomic<uint32_t> dropped{0};
+
+/**
+ * the next argument as printf would read it, from the bytes packed by
+ * dlog_pack(). a record shorter than its format reads zeros.
+ */
+template <typename T>
+static T dlog_take(const uint8_t **arg, const uint8_t *end)
+{
+    T value = {};
+    if(*arg + sizeof(T) <= end) {
+        memcpy(&value, *arg, sizeof(T));
+    }
+    *arg += sizeof(T);
+    return value;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+
+/**
+ * printf the record into out. literal text is copied, each conversion
+ * is handed to snprintf alone with the argument read back at the size
+ * its length modifier gives. '*' widths are not supported.
+ */
+static void dlog_format(char *out, size_t size, const dlog_record_t *record)
+{
+    const uint8_t *arg = record->args;
+    const uint8_t *end = record->args + record->len;
+    const char *p = record->fmt;
+    size_t n = 0;
+
+    while(*p && n + 1 < size) {
+        if(*p != '%') {
+            out[n++] = *p++;
+            continue;
+        }
+        if(p[1] == '%') {
+            out[n++] = '%';
+            p += 2;
+            continue;
+        }
+
+        const char *start = p++;
+        p += strspn(p, "-+ #0");
+        p += strspn(p, "0123456789");
+        if(*p == '.') {
+            p++;
+            p += strspn(p, "0123456789");
+        }
+        int longs = 0;
+        char size_mod = 0;
+        while(*p == 'h') {
+            p++;
+        }
+        while(*p == 'l') {
+            longs++;
+            p++;
+        }
+        if(*p == 'z' || *p == 'j' || *p == 't') {
+            size_mod = *p++;
+        }
+        char conv = *p ? *p++ : 0;
+
+        char spec[16];
+        size_t spec_len = p - start;
+        if(spec_len >= sizeof(spec)) {
+            spec_len = sizeof(spec) - 1;
+        }
+        memcpy(spec, start, spec_len);
+        spec[spec_len] = '\0';
+
+        int w = 0;
+        switch(conv) {
+            case 'd':
+            case 'i':
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o':
+            case 'c':
+                if(size_mod == 'z') {
+                    w = snprintf(out + n, size - n, spec, dlog_take<size_t>(&arg, end));
+                } else if(size_mod == 'j') {
+                    w = snprintf(out + n, size - n, spec, dlog_take<intmax_t>(&arg, end));
+                } else if(size_mod == 't') {
+                    w = snprintf(out + n, size - n, spec, dlog_take<ptrdiff_t>(&arg, end));
+                } else if(longs >= 2) {
+                    w = snprintf(out + n, size - n, spec, dlog_take<long long>(&arg, end));
+                } else if(longs == 1) {
+                    w = snprintf(out + n, size - n, spec, dlog_take<long>(&arg, end));
+                } else {
+                    w = snprintf(out + n, size - n, spec, dlog_take<int>(&arg, end));
+                }
+                break;
+            case 's': {
+                const char *s = static_cast<const char *>(dlog_take<const void *>(&arg, end));
+                w = snprintf(out + n, size - n, spec, s ? s : "(null)");
+                break;
+            }
+            case 'p':
+                w = snprintf(out + n, size - n, spec, dlog_take<const void *>(&arg, end));
+                break;
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                w = snprintf(out + n, size - n, spec, dlog_take<double>(&arg, end));
+                break;
+            default:
+                /* not a conversion we know: show it as written */
+                w = snprintf(out + n, size - n, "%s", spec);
+                break;
+        }
+        if(w > 0) {
+            n += (size_t) w < size - n ? (size_t) w : size - n - 1;
+        }
+    }
+    /* ESP_LOGx add the newline themselves */
+    if(n > 0 && out[n - 1] == '\n') {
+        n--;
+    }
+    out[n] = '\0';
+}
+
+#pragma GCC diagnostic pop
+
+static void dlog_output(const dlog_record_t *record)
+{
+    static const char letters[] = {'N', 'E', 'W', 'I', 'D', 'V'};
+    char line[DLOG_LINE];
+    esp_log_level_t level = static_cast<esp_log_level_t>(record->level);
+
+    dlog_format(line, sizeof(line), record);
+    esp_log_write(level, record->tag, "%c (%" PRIu32 ") %s: %s\n", letters[level % sizeof(letters)],
+                  record->time_ms, record->tag, line);
+}
+
+/* lowest priority: it only runs when nothing else has work */
+static void dlog_task(void *arg)
+{
+    dlog_record_t record;
+    uint32_t reported = 0;
+
+    for(;;) {
+        xQueueReceive(queue, &record, portMAX_DELAY);
+        uint32_t lost = dropped.load(std::memory_order_relaxed);
+        if(lost != reported) {
+            esp_log_write(ESP_LOG_WARN, TAG, "W (%" PRIu32 ") %s: %" PRIu32 " records dropped, queue full\n",
+                          record.time_ms, TAG, lost - reported);
+            reported = lost;
+        }
+        dlog_output(&record);
+    }
+}
+
+/*******************************public*********************************/
+
+esp_err_t dlog_init()
+{
+    queue = queue_mem.create();
+    if(task_mem.create(dlog_task, "dlog_task", NULL, DLOG_TASK_PRIO, CORE_NET) == NULL) {
+        queue = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void dlog_commit(dlog_record_t *record)
+{
+    record->time_ms = esp_timer_get_time() / 1000;
+    if(queue == NULL) {
+        /* before dlog_init(): nothing to defer to */
+        dlog_output(record);
+        return;
+    }
+    BaseType_t queued;
+    if(xPortInIsrContext()) {
+        BaseType_t woken = pdFALSE;
+        queued = xQueueSendFromISR(queue, record, &woken);
+        portYIELD_FROM_ISR(woken);
+    } else {
+        queued = xQueueSend(queue, record, 0);
+    }
+    if(queued != pdTRUE) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+uint32_t dlog_dropped()
+{
+    return dropped.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,74 @@
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "event_bus.h"
+
+EventBus input_bus(TRACE_Q_INPUT);
+EventBus ui_bus(TRACE_Q_UI);
+EventBus sync_bus(TRACE_Q_SYNC);
+
+void EventBus::attach()
+{
+    _consumer.store(xTaskGetCurrentTaskHandle(), std::memory_order_release);
+}
+
+/**
+ * queue an event and wake the consumer.
+ * returns false (and counts a drop) if the ring is full.
+ */
+bool EventBus::publish(const event_t &evt)
+{
+    if(!_ring.push(evt)) {
+        TRACE(TRACE_QUEUE_SEND, _trace_id, TRACE_FULL);
+        return false;
+    }
+    TRACE(TRACE_QUEUE_SEND, _trace_id, _ring.size());
+    TaskHandle_t consumer = _consumer.load(std::memory_order_acquire);
+    if(consumer != nullptr) {
+        xTaskNotifyGive(consumer);
+    }
+    return true;
+}
+
+/**
+ * take the next event without blocking.
+ * must only be called from the attached consumer task.
+ */
+bool EventBus::poll(event_t *evt)
+{
+    if(!_ring.pop(*evt)) {
+        return false;
+    }
+    TRACE(TRACE_QUEUE_RECV, _trace_id, _ring.size());
+    return true;
+}
+
+/**
+ * take the next event, sleeping up to timeout for one to arrive.
+ * must only be called from the attached consumer task.
+ */
+bool EventBus::wait(event_t *evt, TickType_t timeout)
+{
+    TickType_t start = xTaskGetTickCount();
+
+    for(;;) {
+        if(poll(evt)) {
+            return true;
+        }
+        TickType_t remaining = portMAX_DELAY;
+        if(timeout != portMAX_DELAY) {
+            TickType_t elapsed = xTaskGetTickCount() - start;
+            if(elapsed >= timeout) {
+                return false;
+            }
+            remaining = timeout - elapsed;
+        }
+        /* a give that lands between the pop and here is latched in the
+         * notification count, so the take returns at once instead of
+         * sleeping on a non-empty ring. a stale count just loops. */
+        if(ulTaskNotifyTake(pdTRUE, remaining) == 0) {
+            return poll(evt);
+        }
+    }
+}
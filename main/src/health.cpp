@@ -0,0 +1,313 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_console.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "health.h"
+#include "lcd_format.h"
+#include "static_rtos.h"
+
+static const char *TAG = "HEALTH";
+
+#if !CONFIG_FREERTOS_USE_TRACE_FACILITY || !CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+#error "health needs CONFIG_FREERTOS_USE_TRACE_FACILITY and CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS"
+#endif
+
+typedef struct {
+    health_queue_t stats;
+    QueueHandle_t queue;
+    const EventBus *bus;
+} watched_t;
+
+/* run time counters of the previous sample, to turn totals into shares */
+typedef struct {
+    UBaseType_t number;
+    uint32_t run_time;
+    bool warned;
+} previous_t;
+
+static SemaphoreHandle_t lock = NULL;
+#if CONFIG_IRRIGATION_HEALTH_PERIOD_S > 0
+static esp_timer_handle_t sample_timer = NULL;
+#endif
+
+static health_t current;
+static watched_t watched[HEALTH_QUEUES_MAX];
+static uint8_t watched_count = 0;
+
+/* static so a sample costs no heap and little stack in the caller */
+static TaskStatus_t status[HEALTH_TASKS_MAX];
+static previous_t previous[HEALTH_TASKS_MAX];
+static uint8_t previous_count = 0;
+static uint32_t previous_total = 0;
+
+static const previous_t *find_previous(UBaseType_t number)
+{
+    for(uint8_t i = 0; i < previous_count; i++) {
+        if(previous[i].number == number) {
+            return &previous[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * called with the lock held. with more tasks than fit the task list
+ * of the previous sample is kept rather than emptied.
+ */
+static void sample_tasks_locked()
+{
+    static previous_t next[HEALTH_TASKS_MAX];
+    static bool overflow_warned = false;
+    uint32_t total = 0;
+    UBaseType_t count = uxTaskGetSystemState(status, HEALTH_TASKS_MAX, &total);
+
+    if(count == 0) {
+        if(!overflow_warned) {
+            ESP_LOGW(TAG, "More than %d tasks, raise HEALTH_TASKS_MAX", HEALTH_TASKS_MAX);
+            overflow_warned = true;
+        }
+        return;
+    }
+
+    /* the run time counter is per core, shares are of all cores */
+    uint64_t window = (uint64_t) (total - previous_total) * portNUM_PROCESSORS;
+    for(UBaseType_t i = 0; i < count; i++) {
+        const TaskStatus_t &s = status[i];
+        const previous_t *prev = find_previous(s.xTaskNumber);
+        health_task_t &t = current.tasks[i];
+
+        strncpy(t.name, s.pcTaskName, sizeof(t.name) - 1);
+        t.name[sizeof(t.name) - 1] = '\0';
+        t.stack_free = s.usStackHighWaterMark;
+        t.priority = s.uxCurrentPriority;
+        t.core = s.xCoreID == tskNO_AFFINITY ? -1 : s.xCoreID;
+        /* a task that was not there last time has no window yet */
+        t.cpu_permille = prev != NULL && window > 0 ? (s.ulRunTimeCounter - prev->run_time) * 1000ULL / window : 0;
+
+        next[i] = {s.xTaskNumber, s.ulRunTimeCounter, prev != NULL && prev->warned};
+        if(t.stack_free < HEALTH_STACK_WARN && !next[i].warned) {
+            ESP_LOGW(TAG, "%s has %" PRIu32 " bytes of stack left", t.name, t.stack_free);
+            next[i].warned = true;
+        }
+    }
+    memcpy(previous, next, count * sizeof(previous_t));
+    previous_count = count;
+    previous_total = total;
+
+    std::sort(current.tasks, current.tasks + count, [](const health_task_t &a, const health_task_t &b) {
+        return a.stack_free < b.stack_free;
+    });
+    current.task_count = count;
+}
+
+/**
+ * called with the lock held
+ */
+static void sample_locked()
+{
+    sample_tasks_locked();
+
+    for(uint8_t i = 0; i < watched_count; i++) {
+        health_queue_t &q = watched[i].stats;
+        if(watched[i].queue != NULL) {
+            q.depth = uxQueueMessagesWaiting(watched[i].queue);
+        } else {
+            q.depth = q.capacity - watched[i].bus->space();
+            q.dropped = watched[i].bus->dropped();
+        }
+        q.peak = std::max(q.peak, q.depth);
+        current.queues[i] = q;
+    }
+    current.queue_count = watched_count;
+
+    current.heap_free = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    current.heap_min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT);
+    current.heap_largest = heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT);
+
+    int64_t now_us = esp_timer_get_time();
+    current.window_ms = current.sampled_us ? (now_us - current.sampled_us) / 1000 : 0;
+    current.sampled_us = now_us;
+}
+
+#if CONFIG_IRRIGATION_HEALTH_PERIOD_S > 0
+/**
+ * runs in the esp_timer task, which also serves the button deadlines:
+ * never wait for the lock, a sample already under way does the job
+ */
+static void sample_timer_cb(void *arg)
+{
+    if(xSemaphoreTake(lock, 0) != pdTRUE) {
+        return;
+    }
+    sample_locked();
+    xSemaphoreGive(lock);
+}
+#endif
+
+static esp_err_t watch(const char *name, QueueHandle_t queue, const EventBus *bus, uint16_t capacity)
+{
+    if(lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if(watched_count == HEALTH_QUEUES_MAX) {
+        xSemaphoreGive(lock);
+        ESP_LOGE(TAG, "No room to watch %s", name);
+        return ESP_ERR_NO_MEM;
+    }
+    watched[watched_count++] = {{name, 0, 0, capacity, 0}, queue, bus};
+    xSemaphoreGive(lock);
+    return ESP_OK;
+}
+
+/*******************************public*********************************/
+
+esp_err_t health_init()
+{
+    static StaticMutex lock_mem;
+    lock = lock_mem.create();
+    if(lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    /* the first sample only sets the baseline for the CPU shares */
+    health_sample(NULL);
+
+#if CONFIG_IRRIGATION_HEALTH_PERIOD_S > 0
+    esp_err_t ret;
+    const esp_timer_create_args_t timer_args = {
+        .callback = sample_timer_cb,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "health",
+        .skip_unhandled_events = true,
+    };
+    ret = esp_timer_create(&timer_args, &sample_timer);
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed creating sample timer: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    ret = esp_timer_start_periodic(sample_timer, CONFIG_IRRIGATION_HEALTH_PERIOD_S * 1000000ULL);
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed starting sample timer: %s", esp_err_to_name(ret));
+        return ret;
+    }
+#endif
+    return ESP_OK;
+}
+
+esp_err_t health_watch_queue(const char *name, QueueHandle_t queue)
+{
+    if(queue == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return watch(name, queue, NULL, uxQueueMessagesWaiting(queue) + uxQueueSpacesAvailable(queue));
+}
+
+esp_err_t health_watch_bus(const char *name, const EventBus *bus)
+{
+    return watch(name, NULL, bus, EVENT_BUS_DEPTH);
+}
+
+void health_sample(health_t *out)
+{
+    if(lock == NULL) {
+        return;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    sample_locked();
+    if(out != NULL) {
+        *out = current;
+    }
+    xSemaphoreGive(lock);
+}
+
+/**
+ *   HEAP 187K BIG 96    free and largest block
+ *   HEAP LOW 160K       lowest free since boot
+ *   input  0/16  ^3     depth, capacity, peak
+ *   refresh_ 312  4%    stack left, CPU share
+ */
+void health_render_page(int32_t page, lcd_row_t row)
+{
+    if(lock == NULL) {
+        lcd_row_clear(row);
+        lcd_put_lit<0, LCD_COLS>(row, "NO HEALTH DATA");
+        return;
+    }
+    /* the last sample: sampling here would suspend the scheduler on the
+     * display path and cut the CPU window down to one redraw */
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    int32_t pages = 2 + current.queue_count + current.task_count;
+    page = (page % pages + pages) % pages;
+
+    lcd_row_clear(row);
+    if(page == 0) {
+        lcd_put_lit<0, 5>(row, "HEAP");
+        lcd_put_uint<5, 3>(row, current.heap_free / 1024);
+        lcd_put_lit<8, 5>(row, "K BIG");
+        lcd_put_uint<13, 3>(row, current.heap_largest / 1024);
+    } else if(page == 1) {
+        lcd_put_lit<0, 9>(row, "HEAP LOW");
+        lcd_put_uint<9, 3>(row, current.heap_min_free / 1024);
+        lcd_put_char<12>(row, 'K');
+    } else if(page < 2 + current.queue_count) {
+        const health_queue_t &q = current.queues[page - 2];
+        lcd_put_str<0, 6>(row, q.name);
+        lcd_put_uint<6, 3>(row, q.depth);
+        lcd_put_char<9>(row, '/');
+        lcd_put_uint<10, 2>(row, q.capacity);
+        lcd_put_char<13>(row, '^');
+        lcd_put_uint<14, 2>(row, q.peak);
+    } else {
+        const health_task_t &t = current.tasks[page - 2 - current.queue_count];
+        lcd_put_str<0, 8>(row, t.name);
+        lcd_put_uint<8, 5>(row, t.stack_free);
+        lcd_put_uint<13, 2>(row, std::min<uint32_t>((t.cpu_permille + 5) / 10, 99));
+        lcd_put_char<15>(row, '%');
+    }
+    xSemaphoreGive(lock);
+}
+
+static int health_command(int argc, char **argv)
+{
+    static health_t h;
+
+    health_sample(&h);
+    printf("heap: %" PRIu32 " free, %" PRIu32 " lowest, %" PRIu32 " largest block\n", h.heap_free,
+           h.heap_min_free, h.heap_largest);
+    printf("%-10s %5s %5s %8s\n", "queue", "depth", "peak", "dropped");
+    for(uint8_t i = 0; i < h.queue_count; i++) {
+        const health_queue_t &q = h.queues[i];
+        printf("%-10s %2u/%-2u %5u %8" PRIu32 "\n", q.name, q.depth, q.capacity, q.peak, q.dropped);
+    }
+    printf("%-16s %4s %4s %10s %6s   over %" PRIu32 " ms\n", "task", "prio", "core", "stack left", "cpu",
+           h.window_ms);
+    for(uint8_t i = 0; i < h.task_count; i++) {
+        const health_task_t &t = h.tasks[i];
+        printf("%-16s %4u %4d %10" PRIu32 " %3u.%u%%%s\n", t.name, t.priority, t.core, t.stack_free,
+               t.cpu_permille / 10, t.cpu_permille % 10, t.stack_free < HEALTH_STACK_WARN ? "  LOW" : "");
+    }
+    return 0;
+}
+
+esp_err_t health_register_command()
+{
+    const esp_console_cmd_t cmd = {
+        .command = "health",
+        .help = "task CPU share and stack left, heap, queue depths",
+        .hint = NULL,
+        .func = health_command,
+        .argtable = NULL,
+    };
+    return esp_console_cmd_register(&cmd);
+}
@@ -0,0 +1,590 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_partition.h"
+#include "esp_console.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#include "history.h"
+#include "dlog.h"
+#include "task_layout.h"
+#include "static_rtos.h"
+#include "board_config.h"
+#include "tz.h"
+
+/* the flash layout has room for more zones than the board can have */
+static_assert(ZONE_COUNT <= HISTORY_ZONES_MAX, "day records hold HISTORY_ZONES_MAX zones");
+
+static const char *TAG = "HISTORY";
+
+#define HISTORY_PARTITION "history"
+#define HISTORY_SECTOR 4096
+#define HISTORY_SECTORS_MAX 64
+/* the first sectors hold day rollups, 30 a sector, the rest events */
+#define HISTORY_DAY_SECTORS 16
+#define HISTORY_MAGIC 0x54534948 // "HIST"
+#define HISTORY_QUEUE_LEN 8
+#define HISTORY_TASK_STACK 3072
+/* furthest local time gets from UTC, to bound a local day in epoch time */
+#define HISTORY_TZ_SLACK_S (14 * 3600)
+#define HISTORY_DEFAULT_DAYS 30
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;         // ring position, 1 for the first sector ever used
+    uint32_t record_size; // a layout change starts the ring over
+    uint32_t reserved;
+} sector_header_t;
+
+/**
+ * events are appended when a run ends, so the end keeps keys in append
+ * order even when zones overlap. the start of a run is at most
+ * UINT16_MAX s before its key.
+ */
+static uint32_t record_key(const history_event_t *event)
+{
+    return event->start + event->seconds;
+}
+
+static uint32_t record_key(const history_day_t *day)
+{
+    return day->day;
+}
+
+/* a byte sum over the record, so a write cut by a reset is not read */
+template <typename T>
+static uint8_t record_check(const T *record)
+{
+    T copy = *record;
+    copy.check = 0;
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&copy);
+    uint8_t sum = 0;
+    for(size_t i = 0; i < sizeof(copy); i++) {
+        sum += bytes[i];
+    }
+    return sum ^ 0xA5;
+}
+
+template <typename T>
+static bool record_free(const T *record)
+{
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(record);
+    for(size_t i = 0; i < sizeof(T); i++) {
+        if(bytes[i] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * fixed size records in a ring of flash sectors, read through the
+ * partition mapping. writes only ever go to erased flash: the next
+ * sector is erased when the current one is full, so the ring wears
+ * evenly. keys are expected not to go down; records after a clock
+ * stepped back are kept but a range may stop short of them.
+ */
+template <typename T>
+class SectorRing {
+public:
+    static constexpr uint32_t PER_SECTOR = (HISTORY_SECTOR - sizeof(sector_header_t)) / sizeof(T);
+
+    void attach(const esp_partition_t *part, const uint8_t *map, uint32_t first, uint32_t count)
+    {
+        _part = part;
+        _map = map;
+        _first = first;
+        _count = count;
+    }
+
+    /* index the sectors and find where the last write stopped */
+    esp_err_t mount()
+    {
+        bool found = false;
+        for(uint32_t s = 0; s < _count; s++) {
+            const sector_header_t *h = header(s);
+            _seq[s] = 0;
+            _first_key[s] = UINT32_MAX;
+            if(h->magic != HISTORY_MAGIC || h->record_size != sizeof(T)) {
+                continue;
+            }
+            _seq[s] = h->seq;
+            if(!record_free(slot(s, 0))) {
+                _first_key[s] = record_key(slot(s, 0));
+            }
+            if(!found || h->seq > _seq[_newest]) {
+                _newest = s;
+                found = true;
+            }
+        }
+        if(!found) {
+            _newest = 0;
+            _used = 0;
+            return start_sector(0, 1);
+        }
+        for(_used = 0; _used < PER_SECTOR && !record_free(slot(_newest, _used)); _used++) {
+        }
+        return ESP_OK;
+    }
+
+    esp_err_t append(const T &record)
+    {
+        if(_used == PER_SECTOR) {
+            uint32_t next = (_newest + 1) % _count;
+            esp_err_t ret = start_sector(next, _seq[_newest] + 1);
+            if(ret != ESP_OK) {
+                return ret;
+            }
+            _newest = next;
+            _used = 0;
+        }
+        size_t offset = (_first + _newest) * HISTORY_SECTOR + sizeof(sector_header_t) + _used * sizeof(T);
+        esp_err_t ret = esp_partition_write(_part, offset, &record, sizeof(T));
+        if(ret != ESP_OK) {
+            return ret;
+        }
+        if(_used == 0) {
+            _first_key[_newest] = record_key(&record);
+        }
+        _used++;
+        return ESP_OK;
+    }
+
+    /* the newest record, NULL if there is none */
+    const T *last() const
+    {
+        if(_used > 0) {
+            return slot(_newest, _used - 1);
+        }
+        uint32_t prev = (_newest + _count - 1) % _count;
+        return _seq[prev] != 0 && _seq[prev] + 1 == _seq[_newest] ? slot(prev, PER_SECTOR - 1) : NULL;
+    }
+
+    /**
+     * intact records with from <= key <= to, oldest first. a binary
+     * search over the sector index finds the sector to start from.
+     */
+    template <typename F>
+    void walk(uint32_t from, uint32_t to, F &&visit) const
+    {
+        uint32_t order[HISTORY_SECTORS_MAX];
+        uint32_t n = 0;
+        /* oldest first: the ring order after the newest sector */
+        for(uint32_t k = 1; k <= _count; k++) {
+            uint32_t s = (_newest + k) % _count;
+            if(_seq[s] != 0 && _first_key[s] != UINT32_MAX) {
+                order[n++] = s;
+            }
+        }
+
+        uint32_t lo = 0, hi = n;
+        while(hi - lo > 1) {
+            uint32_t mid = (lo + hi) / 2;
+            if(_first_key[order[mid]] <= from) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+
+        for(uint32_t k = lo; k < n; k++) {
+            uint32_t s = order[k];
+            uint32_t slots = s == _newest ? _used : PER_SECTOR;
+            for(uint32_t i = 0; i < slots; i++) {
+                const T *r = slot(s, i);
+                if(record_free(r)) {
+                    break;
+                }
+                if(record_check(r) != r->check) {
+                    continue;
+                }
+                uint32_t key = record_key(r);
+                if(key > to) {
+                    return;
+                }
+                if(key >= from && !visit(r)) {
+                    return;
+                }
+            }
+        }
+    }
+
+private:
+    const sector_header_t *header(uint32_t s) const
+    {
+        return reinterpret_cast<const sector_header_t *>(_map + (_first + s) * HISTORY_SECTOR);
+    }
+
+    const T *slot(uint32_t s, uint32_t i) const
+    {
+        return reinterpret_cast<const T *>(_map + (_first + s) * HISTORY_SECTOR + sizeof(sector_header_t)) + i;
+    }
+
+    esp_err_t start_sector(uint32_t s, uint32_t seq)
+    {
+        size_t offset = (_first + s) * HISTORY_SECTOR;
+        esp_err_t ret = esp_partition_erase_range(_part, offset, HISTORY_SECTOR);
+        if(ret != ESP_OK) {
+            return ret;
+        }
+        sector_header_t h = {HISTORY_MAGIC, seq, sizeof(T), 0};
+        ret = esp_partition_write(_part, offset, &h, sizeof(h));
+        if(ret != ESP_OK) {
+            return ret;
+        }
+        _seq[s] = seq;
+        _first_key[s] = UINT32_MAX;
+        return ESP_OK;
+    }
+
+    const esp_partition_t *_part = NULL;
+    const uint8_t *_map = NULL;
+    uint32_t _first = 0;
+    uint32_t _count = 0;
+    uint32_t _newest = 0; // sector being written
+    uint32_t _used = 0;   // records in it
+    uint32_t _seq[HISTORY_SECTORS_MAX] = {};       // 0: not part of the ring yet
+    uint32_t _first_key[HISTORY_SECTORS_MAX] = {}; // the date index
+};
+
+static SectorRing<history_event_t> events;
+static SectorRing<history_day_t> days;
+/* rollups not written yet, oldest first: a run can end the day after it started */
+static history_day_t pending[2];
+static uint8_t zone_count = 0;
+
+static SemaphoreHandle_t lock = NULL;
+static StaticMutex lock_mem;
+static QueueHandle_t queue = NULL;
+static StaticQueue<history_event_t, HISTORY_QUEUE_LEN> queue_mem;
+static StaticTask<HISTORY_TASK_STACK> task_mem;
+static bool ready = false;
+
+/*******************************dates**********************************/
+
+uint16_t history_day_of(time_t t)
+{
+    struct tm tm;
+    tz_local(t, &tm);
+    int32_t day = tz_days_from_civil(tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
+    return day < 0 ? 0 : (uint16_t) day;
+}
+
+void history_day_date(uint16_t day, int *year, int *month, int *mday)
+{
+    tz_civil_from_days(day, year, month, mday);
+}
+
+/*******************************rollups********************************/
+
+static void day_flush(history_day_t *day)
+{
+    if(day->zones == 0) {
+        return;
+    }
+    day->check = record_check(day);
+    esp_err_t ret = days.append(*day);
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed writing day %u: %s", day->day, esp_err_to_name(ret));
+    }
+    day->zones = 0;
+}
+
+/* write the oldest pending day */
+static void day_shift()
+{
+    day_flush(&pending[0]);
+    pending[0] = pending[1];
+    pending[1].zones = 0;
+}
+
+/**
+ * the rollup of the day a run started on. a day is written once no run
+ * started on it can still be open, UINT16_MAX s after it ended. a run
+ * dated before the pending days (the clock stepped back) counts to the
+ * oldest of them.
+ */
+static history_day_t *day_for(const history_event_t *event)
+{
+    uint16_t day = history_day_of(event->start);
+    uint32_t end = record_key(event);
+    uint16_t closed = history_day_of(end > UINT16_MAX ? end - UINT16_MAX : 0);
+
+    while(pending[0].zones != 0 && pending[0].day < closed) {
+        day_shift();
+    }
+    for(history_day_t &p : pending) {
+        if(p.zones != 0 && p.day == day) {
+            return &p;
+        }
+    }
+    const history_day_t &newest = pending[1].zones != 0 ? pending[1] : pending[0];
+    if(newest.zones != 0 && day < newest.day) {
+        return &pending[0];
+    }
+    if(pending[1].zones != 0) {
+        day_shift();
+    }
+    history_day_t *p = pending[0].zones == 0 ? &pending[0] : &pending[1];
+    memset(p, 0, sizeof(*p));
+    p->day = day;
+    p->zones = zone_count;
+    return p;
+}
+
+static void day_add(const history_event_t *event)
+{
+    history_day_t *day = day_for(event);
+    if(event->zone >= zone_count) {
+        return;
+    }
+    history_zone_day_t *z = &day->zone[event->zone];
+    if(event->kind == HIST_SKIPPED) {
+        z->skips += z->skips < UINT8_MAX;
+        return;
+    }
+    z->runs += z->runs < UINT8_MAX;
+    z->runtime_s += event->seconds;
+    uint32_t volume = z->volume_l + event->seconds * CONFIG_IRRIGATION_HISTORY_FLOW_LPM / 60;
+    z->volume_l = volume > UINT16_MAX ? UINT16_MAX : volume;
+}
+
+/**
+ * days the device did not see end (off at midnight, reset) have their
+ * events but no rollup: add up the events after the last rollup
+ */
+static void day_rebuild()
+{
+    const history_day_t *last = days.last();
+    uint16_t after = last != NULL ? last->day : 0;
+    int64_t from = (int64_t) (after + 1) * 86400 - HISTORY_TZ_SLACK_S;
+
+    memset(pending, 0, sizeof(pending));
+    events.walk(from < 0 ? 0 : (uint32_t) from, UINT32_MAX, [after](const history_event_t *event) {
+        if(history_day_of(event->start) > after) {
+            day_add(event);
+        }
+        return true;
+    });
+}
+
+/*******************************writer*********************************/
+
+/* flash writes and erases stall both cores' caches: not in the caller */
+static void history_task(void *arg)
+{
+    history_event_t event;
+
+    for(;;) {
+        xQueueReceive(queue, &event, portMAX_DELAY);
+        event.check = record_check(&event);
+        xSemaphoreTake(lock, portMAX_DELAY);
+        esp_err_t ret = events.append(event);
+        if(ret == ESP_OK) {
+            day_add(&event);
+        }
+        xSemaphoreGive(lock);
+        if(ret != ESP_OK) {
+            DLOGE(TAG, "Failed writing event: %s", esp_err_to_name(ret));
+        }
+    }
+}
+
+/*******************************console********************************/
+
+/* wider than the day fields, many days add up */
+typedef struct {
+    uint32_t runtime_s;
+    uint32_t volume_l;
+    uint32_t runs;
+    uint32_t skips;
+} zone_sum_t;
+
+static bool sum_day(void *ctx, const history_day_t *day)
+{
+    zone_sum_t *sum = static_cast<zone_sum_t *>(ctx);
+    for(uint8_t z = 0; z < day->zones && z < zone_count; z++) {
+        sum[z].runtime_s += day->zone[z].runtime_s;
+        sum[z].volume_l += day->zone[z].volume_l;
+        sum[z].runs += day->zone[z].runs;
+        sum[z].skips += day->zone[z].skips;
+    }
+    return true;
+}
+
+static bool print_event(void *ctx, const history_event_t *event)
+{
+    static const char *kinds[] = {"run", "manual", "stopped", "skipped"};
+    time_t start = event->start;
+    struct tm tm;
+    char when[20];
+
+    tz_local(start, &tm);
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M", &tm);
+    printf("%s zone %u %-7s %5u/%u s\n", when, event->zone + 1, event->kind < 4 ? kinds[event->kind] : "?",
+           event->seconds, event->planned);
+    return true;
+}
+
+static int history_command(int argc, char **argv)
+{
+    bool runs = argc > 1 && strcmp(argv[1], "runs") == 0;
+    int n = HISTORY_DEFAULT_DAYS;
+    if(argc > 1 + runs) {
+        n = atoi(argv[1 + runs]);
+    }
+    if(n < 1) {
+        printf("days must be at least 1\n");
+        return 1;
+    }
+    time_t now = time(NULL);
+    uint16_t last = history_day_of(now);
+    uint16_t first = last >= n - 1 ? last - (n - 1) : 0;
+    int64_t began = esp_timer_get_time();
+
+    if(runs) {
+        history_events(now - (time_t) n * 86400, now, print_event, NULL);
+        printf("%d days of runs in %lld us\n", n, (long long) (esp_timer_get_time() - began));
+        return 0;
+    }
+    zone_sum_t sum[HISTORY_ZONES_MAX] = {};
+    history_days(first, last, sum_day, sum);
+    int64_t took = esp_timer_get_time() - began;
+    printf("zone  runtime min  volume l  runs  skips\n");
+    for(uint8_t z = 0; z < zone_count; z++) {
+        printf("%4u  %11" PRIu32 "  %8" PRIu32 "  %4" PRIu32 "  %5" PRIu32 "\n", z + 1, sum[z].runtime_s / 60,
+               sum[z].volume_l, sum[z].runs, sum[z].skips);
+    }
+    printf("last %d days in %lld us\n", n, (long long) took);
+    return 0;
+}
+
+/*******************************public*********************************/
+
+esp_err_t history_init(uint8_t zones)
+{
+    if(zones > HISTORY_ZONES_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                           HISTORY_PARTITION);
+    if(part == NULL) {
+        ESP_LOGE(TAG, "No \"%s\" partition", HISTORY_PARTITION);
+        return ESP_ERR_NOT_FOUND;
+    }
+    uint32_t sectors = part->size / HISTORY_SECTOR;
+    if(sectors > HISTORY_SECTORS_MAX || sectors < HISTORY_DAY_SECTORS + 2) {
+        ESP_LOGE(TAG, "History partition of %" PRIu32 " sectors, want %d to %d", sectors,
+                 HISTORY_DAY_SECTORS + 2, HISTORY_SECTORS_MAX);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    /* mapped once for good: reads are plain loads through the cache */
+    const void *map;
+    esp_partition_mmap_handle_t handle;
+    esp_err_t ret = esp_partition_mmap(part, 0, part->size, ESP_PARTITION_MMAP_DATA, &map, &handle);
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed mapping history: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    const uint8_t *base = static_cast<const uint8_t *>(map);
+    days.attach(part, base, 0, HISTORY_DAY_SECTORS);
+    events.attach(part, base, HISTORY_DAY_SECTORS, sectors - HISTORY_DAY_SECTORS);
+    zone_count = zones;
+
+    ret = days.mount();
+    if(ret == ESP_OK) {
+        ret = events.mount();
+    }
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed mounting history: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    day_rebuild();
+
+    lock = lock_mem.create();
+    queue = queue_mem.create();
+    if(task_mem.create(history_task, "history_task", NULL, HISTORY_TASK_PRIO, CORE_NET) == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    ready = true;
+    return ESP_OK;
+}
+
+void history_record(uint8_t zone, history_kind_t kind, history_reason_t reason, time_t start,
+                    uint16_t seconds, uint16_t planned)
+{
+    if(!ready) {
+        return;
+    }
+    history_event_t event = {};
+    event.start = start;
+    event.seconds = seconds;
+    event.planned = planned;
+    event.zone = zone;
+    event.kind = kind;
+    event.reason = reason;
+    event.reserved = UINT32_MAX;
+    if(xQueueSend(queue, &event, 0) != pdTRUE) {
+        DLOGW(TAG, "History queue full, zone %u run lost", zone + 1);
+    }
+}
+
+esp_err_t history_events(time_t from, time_t to, history_event_cb_t cb, void *ctx)
+{
+    if(!ready) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    /* keyed by the end: a run that started by `to` ended within UINT16_MAX s of it */
+    int64_t last = (int64_t) to + UINT16_MAX;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    events.walk(from < 0 ? 0 : from, last > UINT32_MAX ? UINT32_MAX : last,
+                [from, to, cb, ctx](const history_event_t *event) {
+                    if((time_t) event->start < from || (time_t) event->start > to) {
+                        return true;
+                    }
+                    return cb(ctx, event);
+                });
+    xSemaphoreGive(lock);
+    return ESP_OK;
+}
+
+esp_err_t history_days(uint16_t from_day, uint16_t to_day, history_day_cb_t cb, void *ctx)
+{
+    if(!ready) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    bool more = true;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    days.walk(from_day, to_day, [cb, ctx, &more](const history_day_t *day) {
+        more = cb(ctx, day);
+        return more;
+    });
+    for(const history_day_t &p : pending) {
+        if(more && p.zones != 0 && p.day >= from_day && p.day <= to_day) {
+            more = cb(ctx, &p);
+        }
+    }
+    xSemaphoreGive(lock);
+    return ESP_OK;
+}
+
+esp_err_t history_register_command()
+{
+    const esp_console_cmd_t cmd = {
+        .command = "history",
+        .help = "watering history: per zone totals over the last days (default 30), or 'history runs' for each run",
+        .hint = "[runs] [days]",
+        .func = history_command,
+        .argtable = NULL,
+    };
+    return esp_console_cmd_register(&cmd);
+}
@@ -0,0 +1,165 @@
+#include "esp_log.h"
+#include "esp_err.h"
+#include "driver/i2c.h"
+#include "esp_pm.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "i2c_bus.h"
+#include "hal_i2c.h"
+#include "trace.h"
+#include "task_layout.h"
+#include "static_rtos.h"
+
+static const char *TAG = "I2C_BUS";
+
+/* the bus clock is derived from APB, which must not scale mid-transfer */
+static esp_pm_lock_handle_t pm_lock = NULL;
+/* one command list at a time, built in link_buf while this is held */
+static SemaphoreHandle_t bus_lock = NULL;
+
+/* through call_on_core(): the driver's interrupt lands on that core */
+static void i2c_driver_install_here(void *arg)
+{
+    *static_cast<esp_err_t *>(arg) = i2c_driver_install(I2C_BUS_PORT, I2C_MODE_MASTER, 0, 0, 0);
+}
+
+static esp_err_t i2c_bus_install()
+{
+    i2c_config_t conf = {};
+    conf.mode = I2C_MODE_MASTER;
+    conf.sda_io_num = board::i2c_sda_gpio;
+    conf.scl_io_num = board::i2c_scl_gpio;
+    conf.sda_pullup_en = GPIO_PULLUP_ENABLE;
+    conf.scl_pullup_en = GPIO_PULLUP_ENABLE;
+    conf.master.clk_speed = board::i2c_freq_hz;
+    conf.clk_flags = 0;
+
+    static StaticMutex bus_lock_mem;
+    bus_lock = bus_lock_mem.create();
+    if(bus_lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = i2c_param_config(I2C_BUS_PORT, &conf);
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed I2C config: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    /* not supported without CONFIG_PM_ENABLE, nothing scales then */
+    ret = esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, "i2c", &pm_lock);
+    if(ret != ESP_OK && ret != ESP_ERR_NOT_SUPPORTED) {
+        ESP_LOGE(TAG, "Failed creating PM lock: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    /* LCD flushes wait on it, keep it off the radio's core (task_layout.h) */
+    esp_err_t ipc = call_on_core(CORE_CTRL, i2c_driver_install_here, &ret);
+    if(ipc != ESP_OK) {
+        ret = ipc;
+    }
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed I2C driver install: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+esp_err_t i2c_bus_init()
+{
+    /* the static's guard serialises concurrent first calls */
+    static const esp_err_t installed = i2c_bus_install();
+    return installed;
+}
+
+/*******************************IdfI2c*********************************/
+
+#define I2C_BUS_TIMEOUT pdMS_TO_TICKS(1000)
+
+/* room for read_reg, the longest list: two starts, two addresses, register, data, stop */
+static uint8_t link_buf[I2C_LINK_RECOMMENDED_SIZE(2)];
+
+/* take the bus and start a command list in link_buf, no heap */
+static i2c_cmd_handle_t i2c_bus_begin()
+{
+    xSemaphoreTake(bus_lock, portMAX_DELAY);
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(link_buf, sizeof(link_buf));
+    if(cmd != NULL) {
+        i2c_master_start(cmd);
+    }
+    return cmd;
+}
+
+/**
+ * queue the stop, run the list at full APB and give the bus back.
+ * a list that did not fit link_buf is not run.
+ */
+static esp_err_t i2c_bus_run(i2c_cmd_handle_t cmd)
+{
+    esp_err_t ret = ESP_ERR_NO_MEM;
+    if(cmd != NULL && i2c_master_stop(cmd) == ESP_OK) {
+        esp_pm_lock_acquire(pm_lock);
+        ret = i2c_master_cmd_begin(I2C_BUS_PORT, cmd, I2C_BUS_TIMEOUT);
+        esp_pm_lock_release(pm_lock);
+    }
+    if(cmd != NULL) {
+        i2c_cmd_link_delete_static(cmd);
+    }
+    xSemaphoreGive(bus_lock);
+    return ret;
+}
+
+esp_err_t IdfI2c::init()
+{
+    return i2c_bus_init();
+}
+
+esp_err_t IdfI2c::write(uint8_t addr, const uint8_t *data, size_t len)
+{
+    TRACE(TRACE_I2C_BEGIN, addr, len);
+    i2c_cmd_handle_t cmd = i2c_bus_begin();
+    i2c_master_write_byte(cmd, (addr << 1) | I2C_MASTER_WRITE, true);
+    i2c_master_write(cmd, data, len, true);
+
+    esp_err_t ret = i2c_bus_run(cmd);
+    TRACE(TRACE_I2C_END, addr, ret);
+    return ret;
+}
+
+esp_err_t IdfI2c::read(uint8_t addr, uint8_t *data, size_t len)
+{
+    TRACE(TRACE_I2C_BEGIN, addr, len);
+    i2c_cmd_handle_t cmd = i2c_bus_begin();
+    i2c_master_write_byte(cmd, (addr << 1) | I2C_MASTER_READ, true);
+    i2c_master_read(cmd, data, len, I2C_MASTER_LAST_NACK);
+
+    esp_err_t ret = i2c_bus_run(cmd);
+    TRACE(TRACE_I2C_END, addr, ret);
+    return ret;
+}
+
+esp_err_t IdfI2c::write_reg(uint8_t addr, uint8_t reg, const uint8_t *data, size_t len)
+{
+    TRACE(TRACE_I2C_BEGIN, addr, len + 1);
+    i2c_cmd_handle_t cmd = i2c_bus_begin();
+    i2c_master_write_byte(cmd, (addr << 1) | I2C_MASTER_WRITE, true);
+    i2c_master_write_byte(cmd, reg, true);
+    i2c_master_write(cmd, data, len, true);
+
+    esp_err_t ret = i2c_bus_run(cmd);
+    TRACE(TRACE_I2C_END, addr, ret);
+    return ret;
+}
+
+esp_err_t IdfI2c::read_reg(uint8_t addr, uint8_t reg, uint8_t *data, size_t len)
+{
+    TRACE(TRACE_I2C_BEGIN, addr, len + 1);
+    i2c_cmd_handle_t cmd = i2c_bus_begin();
+    i2c_master_write_byte(cmd, (addr << 1) | I2C_MASTER_WRITE, true);
+    i2c_master_write_byte(cmd, reg, true);
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (addr << 1) | I2C_MASTER_READ, true);
+    i2c_master_read(cmd, data, len, I2C_MASTER_LAST_NACK);
+
+    esp_err_t ret = i2c_bus_run(cmd);
+    TRACE(TRACE_I2C_END, addr, ret);
+    return ret;
+}
@@ -1,27 +1,81 @@
 #include <stdio.h>
 #include <inttypes.h>
+#include <array>
+#include <utility>
 #include <time.h>
 #include <sys/time.h>
 #include "driver/i2c.h"
 #include "driver/gpio.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+#include "esp_pm.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_err.h"
 #include "nvs.h"
 #include "nvs_flash.h"
 #include "esp_wifi.h"
-#include "esp_netif_sntp.h"
 
 #include "DFRobot_LCD.h"
 #include "DS3231_RTC.h"
 #include "rotary_encoder.h"
+#include "button_gesture.h"
+#include "event_bus.h"
+#include "menu.h"
+#include "lcd_format.h"
+#include "lcd_bench.h"
+#include "board_config.h"
 #include "Valve.h"
+#include "valve_scheduler.h"
+#include "program_store.h"
+#include "rest_api.h"
+#include "telemetry.h"
+#include "ota_update.h"
+#include "wake_stats.h"
+#include "i2c_bus.h"
+#include "sync_service.h"
 #include "wifi_setup.h"
-#include "sntp_setup.h"
+#include "boot_timeline.h"
+#include "ws_push.h"
+#include "health.h"
+#include "diag_console.h"
+#include "trace.h"
+#include "dlog.h"
+#include "power.h"
+#include "history.h"
+#include "tz.h"
+#include "tz_store.h"
+#include "ui_latency.h"
+#include "task_layout.h"
+#include "static_rtos.h"
 
 static const char *TAG = "IRRIGATION_TOP";
 
+/* blank the LCD after this long without input */
+#define DISPLAY_SLEEP_MS 30000
+/* how long a sync result stays up before the menu returns */
+#define SYNC_STATUS_MS 3000
+/* the boot splash stays up this long, or until the first input */
+#define SPLASH_MS 3000
+/* the diagnostics page follows the numbers this often */
+#define DIAG_REFRESH_MS 1000
+/* the valve markers follow opens and closes from the timers this often */
+#define VALVE_REFRESH_MS 1000
+/* boot goal: programs running this soon after esp_timer start */
+#define VALVES_READY_BUDGET_US 300000
+
+#define LCD_READY_BIT BIT0
+
+#define DISPLAY_TASK_STACK 2048
+#define MAIN_TASK_STACK 4096
+
+/* manual run length for a zone without programs */
+#define MANUAL_RUN_SEC 600
+/* an update leaving less free heap than this is rolled back */
+#define HEALTHY_MIN_FREE_HEAP (16 * 1024)
+
 /* define wifi symbols for LCD */
 static uint8_t wifiSymbol[8] = {
     0b00000, // row 1
@@ -57,43 +111,38 @@ static uint8_t checkSymbol[8] = {
 };
 /* end symbols */
 
-/**
- *          HOME
- *            |
- *         -------
- *         |     |
- *      V_SEL   SETT
- *       |        |
- *      1/2      -------
- *               |     |
- *              SYNC  WEATHER_REACTANCE(T/F)
- *     
- */
-
-enum MenuState {
-    HOME,         // 0
-    VALVE_SELECT, // 1
-    SETTINGS,     // 2
-    SYNC          // 3
-};
-
-enum Direction {
-    CCW, // counter-clockwise
-    CW   // clockwise
-};
+/* the menu tree itself lives in menu.cpp */
 
 enum dispFlag {
     MENU,
-    SYNC_STATUS,
-    WAITING
+    SYNC_STATUS, // shown for SYNC_STATUS_MS, then back to MENU
+    SPLASH       // RTC result at boot, drawn by the display task
 };
 
-static volatile dispFlag displayFlag = MENU;
-
-static volatile MenuState currentMenu = HOME; // starting state
-static volatile MenuState nextMenu = VALVE_SELECT;
-static uint16_t prev_position = 0;
-static bool wifi_connected = false;
+/**
+ * menu state is owned by main_task. the display task never reads
+ * these directly, it keeps the copy below, fed by EVT_STATE on ui_bus.
+ */
+static dispFlag displayFlag = MENU;
+
+static menu_cursor_t menu; // starts at HOME
+
+static bool time_synced = false;
+/* set by app_main before the display task exists */
+static bool rtc_time_ok = false;
+static TaskHandle_t boot_task_handle = NULL;
+/* boot stages that must have come up for an update to be kept */
+static bool lcd_ok = false;
+static bool input_ok = false;
+static bool valves_ok = false;
+static sync_stage_t sync_stage = SYNC_IDLE;
+
+typedef struct {
+    menu_cursor_t menu;
+    dispFlag display;
+    bool synced;
+    sync_stage_t sync_stage;
+} ui_state_t;
 
 struct tm timeinfo;
 time_t now;
@@ -105,284 +154,445 @@ DS3231_RTC rtc;
 /* Valve pointer for changing properties */
 Valve *v_temp;
 
-/**
- * perform time sync. first attempt the internet, then call sntp.
- * report result (success/failure) to the LCD, setting proper flags.
- * bug: calling this code triggers stack protection fault
- */
-static void time_sync() {
-    esp_err_t ret;
+static Valve *valves[ZONE_COUNT];
 
-    displayFlag = WAITING;
+/* a valve on each zone pin of board_config.h */
+template <size_t... Zone>
+static std::array<Valve, sizeof...(Zone)> make_valves(std::index_sequence<Zone...>)
+{
+    return {Valve(board::zone_gpio[Zone])...};
+}
 
-    /**
-    * try wifi connection , then disconnect
-    */
-    wifi_init_sta();
+/**
+ * hand a snapshot of the menu state to the display task. input_us is
+ * the encoder edge it answers, for ui_latency.h
+ */
+static void publish_state(uint32_t input_us = 0) {
+    event_t evt = {};
+    evt.type = EVT_STATE;
+    evt.timestamp_us = esp_timer_get_time();
+    evt.state.input_us = input_us;
+    evt.state.menu = menu;
+    evt.state.display = displayFlag;
+    evt.state.synced = time_synced;
+    evt.state.sync_stage = sync_stage;
+    if(!ui_bus.publish(evt)) {
+        DLOGW(TAG, "UI bus full, state update dropped");
+    }
+    ws_push_set(WS_KEY_MENU, (int32_t) menu.node << 16 | menu.cursor);
+}
 
-    vTaskDelay(pdMS_TO_TICKS(5000));
+/**
+ * what is currently on the glass. rows are composed in RAM and only
+ * the characters that differ are sent over I2C, so no lcd.clear().
+ */
+static lcd_row_t shown[2];
 
-    initialize_sntp();
-    if((ret = esp_netif_sntp_sync_wait(pdMS_TO_TICKS(10000))) != ESP_OK) {
-    }    
+static void lcd_show(uint8_t r, const lcd_row_t row) {
+    lcd_show_row(lcd, r, shown[r], row);
+}
 
-    vTaskDelay(pdMS_TO_TICKS(5000));
-    /* update time variables */
-    if(time_synced) {
-        time(&now);
-        gmtime_r(&now, &timeinfo);
-        rtc.setTime(&timeinfo);
-        printf("UTC time: %s", asctime(&timeinfo));
+/**
+ * HH:MM in local time, converted only when the minute changes.
+ */
+template <size_t COL>
+static void put_clock(char *row) {
+    static time_t rendered_minute = -1;
+    static uint8_t hour, minute;
+    time_t t = time(NULL);
+
+    if(t / 60 != rendered_minute) {
+        struct tm local;
+        tz_local(t, &local);
+        hour = local.tm_hour;
+        minute = local.tm_min;
+        rendered_minute = t / 60;
     }
-    displayFlag = SYNC_STATUS;
-    vTaskDelay(pdMS_TO_TICKS(3000));
-    displayFlag = MENU;
+    lcd_put_clock<COL>(row, hour, minute);
+}
 
-    /* free resources from wifi_init and sntp_init 
-     * to avoid using too many resources if this is 
-     * called again.
-     */
+/**
+ * a marker per zone in the first 9 columns, checked while its valve is
+ * open: "1✓2-" for up to 4 zones, "V✓-✓-✓-✓-" for more
+ */
+static void put_valves(char *row) {
+    static_assert(ZONE_COUNT <= 8, "the clock starts at column 9");
+    for(size_t i = 0; i < ZONE_COUNT; i++) {
+        char marker = valves[i]->get_active() ? LCD_GLYPH(2) : '-';
+        if(ZONE_COUNT <= 4) {
+            row[2 * i] = '1' + i;
+            row[2 * i + 1] = marker;
+        } else {
+            row[1 + i] = marker;
+        }
+    }
+    if(ZONE_COUNT > 4) {
+        lcd_put_char<0>(row, 'V');
+    }
 }
 
 /** 
  * crux of the UI for the LCD
  */
-static void displayMenu(MenuState menuState) {
-    char top_row[17];
-    char bot_row[17];
-
-    switch (displayFlag) {
+static void displayMenu(const ui_state_t &state) {
+    lcd_row_t top_row;
+    lcd_row_t bot_row;
+
+    TRACE(TRACE_LCD_BEGIN, state.display, 0);
+    lcd_row_clear(top_row);
+    lcd_row_clear(bot_row);
+    switch (state.display) {
         case MENU:
-            time(&now);
-            localtime_r(&now, &timeinfo);
-
-            lcd.clear();
-            lcd.setCursor(0,0); // col, row
-            strftime(top_row, sizeof(top_row), "V1: V2:  %H:%M", &timeinfo);
-            lcd.printstr(top_row);
-            lcd.setCursor(15,0);
-            lcd.write(0); // print status wifi - functionality later
-            lcd.setCursor(3,0);
-            lcd.write(2);
-            lcd.setCursor(7,0);
-            lcd.write(2);
-
-            lcd.setCursor(0,1);
-            /* determine current state */
-            switch (menuState) {
-                case HOME:
-                    /* show highlighted option (next option) */
-                    switch(nextMenu) {
-                        case VALVE_SELECT:
-                            snprintf(bot_row, sizeof(bot_row), "   VALVE SEL.  >");
-                            break;
-                        case SETTINGS:
-                            snprintf(bot_row, sizeof(bot_row), "<   SETTINGS    ");
-                            break;
-                       default:
-                            ESP_LOGE(TAG, "Invalid next state");
-                            break;
-                    }
-                    lcd.printstr(bot_row);
+            /* valves, HH:MM, W. the valves give way to sync progress */
+            switch(state.sync_stage) {
+                case SYNC_CONNECTING:
+                    lcd_put_lit<0, 9>(top_row, "SYNC:WIFI");
                     break;
-               case VALVE_SELECT:
-                    snprintf(bot_row, sizeof(bot_row), "<     BACK     >");
-                    lcd.printstr(bot_row);
-                    break;
-               case SETTINGS:
-                    switch (nextMenu) {
-                        case SYNC:
-                            snprintf(bot_row, sizeof(bot_row), "   SYNC TIME   >");
-                            lcd.printstr(bot_row);
-                            break;
-                        case HOME:
-                            snprintf(bot_row, sizeof(bot_row), "<     BACK      ");
-                            lcd.printstr(bot_row);
-                            break;
-                        default:
-                            ESP_LOGE(TAG, "Invalid next state");
-                            break;
-                    }
+                case SYNC_QUERYING:
+                    lcd_put_lit<0, 9>(top_row, "SYNC:NTP");
                     break;
                 default:
-                    ESP_LOGE(TAG, "Invalid current state: %d", currentMenu);
+                    put_valves(top_row);
                     break;
             }
+            put_clock<9>(top_row);
+            /* the radio is only up while a sync talks to the server */
+            lcd_put_char<15>(top_row, LCD_GLYPH(state.sync_stage == SYNC_QUERYING ? 0 : 1));
+
+            menu_render(&state.menu, bot_row);
             break;
         case SYNC_STATUS:
-            char status_buf[17];
-            lcd.clear();
-            lcd.setCursor(0,0);
-
-            if(time_synced) {
-                snprintf(status_buf, sizeof(status_buf), "Sync successful!");
+            if(state.synced) {
+                lcd_put_lit<0, LCD_COLS>(top_row, "Sync successful!");
             } else {
-                snprintf(status_buf, sizeof(status_buf), "Sync failed...");
+                lcd_put_lit<0, LCD_COLS>(top_row, "Sync failed...");
             }
-
-            lcd.printstr(status_buf);
             break;
-        case WAITING:
-            char waiting_buf[17];
-            lcd.clear();
-            lcd.setCursor(0,0);
-            snprintf(waiting_buf, sizeof(waiting_buf), "Waiting . . .");
-            lcd.printstr(waiting_buf);
+        case SPLASH:
+            if(rtc_time_ok) {
+                lcd_put_lit<0, LCD_COLS>(top_row, "Time synced!");
+            } else {
+                lcd_put_lit<0, LCD_COLS>(top_row, "Time not synced!");
+            }
             break;
     }
+    lcd_show(0, top_row);
+    lcd_show(1, bot_row);
+    TRACE(TRACE_LCD_END, 0, 0);
 }
 
 /**
- * reaction to a button press, indicating a change in state
- * and what the default next state is. also reset position.
+ * the zone's first program, or a fresh everyday one if it has none.
+ * further programs are managed over the REST API.
  */
-static void processSelection() {
-    switch (currentMenu) {
-        case HOME:
-            switch (nextMenu) {
-                case VALVE_SELECT:
-                    currentMenu = VALVE_SELECT;
-                    nextMenu = HOME;
-                    break;
-                case SETTINGS:
-                    currentMenu = SETTINGS;
-                    nextMenu = SYNC;
-                    break;
-                default:
-                    break;
-            }
+static uint8_t zone_program(uint8_t zone, program_t *program) {
+    uint8_t id = program_store_first(zone);
+    if(id != PROGRAM_NONE && program_store_get(id, program)) {
+        return id;
+    }
+    *program = {zone, 8, 0, 0b01111111, MANUAL_RUN_SEC, true};
+    return PROGRAM_NONE;
+}
+
+/**
+ * editors read and write the zone's first program
+ */
+int32_t menu_editor_get(menu_editor_t editor, uint8_t arg) {
+    program_t program;
+    zone_program(arg, &program);
+    switch(editor) {
+        case EDIT_START:
+            return program.hour * 60 + program.minute;
+        case EDIT_DURATION:
+            return program.duration_sec / 60;
+        default:
+            return 0;
+    }
+}
+
+void menu_editor_set(menu_editor_t editor, uint8_t arg, int32_t value) {
+    program_t program;
+    uint8_t id = zone_program(arg, &program);
+    switch(editor) {
+        case EDIT_START:
+            program.hour = value / 60;
+            program.minute = value % 60;
             break;
-        case VALVE_SELECT:
-            currentMenu = nextMenu;
-            switch (nextMenu) {
-                case HOME:
-                    nextMenu = VALVE_SELECT;
-                    break;
-                default:
-                    break;
-            }
+        case EDIT_DURATION:
+            program.duration_sec = value * 60;
             break;
-        case SETTINGS:
-            switch (nextMenu) {
-                case HOME:
-                    nextMenu = VALVE_SELECT;
-                    currentMenu = HOME;
-                    break;
-                case SYNC:
-                    /* perform time sync */
-                    time_sync();
-                    nextMenu = VALVE_SELECT;
-                    currentMenu = HOME;
-                    break;
-                default:
-                    break;
-            }
+        default:
+            return;
+    }
+    DLOGI(TAG, "zone %d editor %d = %" PRId32, arg + 1, editor, value);
+    /* the store reschedules the valves */
+    esp_err_t ret = id == PROGRAM_NONE ? program_store_add(&program, NULL) : program_store_set(id, &program);
+    if(ret != ESP_OK) {
+        DLOGE(TAG, "Failed saving program: %s", esp_err_to_name(ret));
+    }
+}
+
+void menu_action(menu_action_t action, uint8_t arg) {
+    switch(action) {
+        case ACT_SYNC:
+            /* runs in the background, progress comes back on sync_bus */
+            sync_service_request();
+            break;
+        case ACT_RUN: {
+            /* as long as the zone's first program runs */
+            program_t program;
+            zone_program(arg, &program);
+            valve_scheduler_run(arg, program.duration_sec);
             break;
+        }
         default:
             break;
     }
-    ESP_LOGI(TAG, "current: %d next: %d", currentMenu, nextMenu);
-    position = 0;
+}
+
+void menu_diag_render(int32_t page, lcd_row_t row) {
+    health_render_page(page, row);
 }
 
 /**
- * changes next state, reacting to rotation of rotary encoder
+ * milliseconds until the wall clock reaches the next whole minute
  */
-void updateMenuFromEncoder() {
-    switch(currentMenu) {
-        case HOME:
-            if(position < 0 || position > 1) {// only 2 options in HOME screen
-                position = prev_position; 
-                break; 
+static uint32_t ms_to_next_minute() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (60 - tv.tv_sec % 60) * 1000 - tv.tv_usec / 1000;
+}
+
+static void refresh_disp_task(void* arg) {
+    ui_state_t state = {};
+    event_t evt;
+    uint32_t input_us = 0; // oldest edge not yet on the glass
+    bool awake = true;
+    int64_t last_input_us = esp_timer_get_time();
+    int64_t status_until_us = 0;
+    esp_pm_lock_handle_t pm_lock = NULL;
+    esp_err_t ret;
+
+    /* no light sleep while the display is lit: the chip only wakes
+     * for the encoder then, and the clock on screen would stall */
+    esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "ui", &pm_lock);
+    esp_pm_lock_acquire(pm_lock);
+
+    /* the LCD's power-up delays run here, beside the rest of boot */
+    ret = lcd.init();
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed LCD init: %s", esp_err_to_name(ret));
+        esp_pm_lock_release(pm_lock);
+        xTaskNotify(boot_task_handle, LCD_READY_BIT, eSetBits);
+        vTaskDelete(NULL);
+    }
+    /* create custom characters in LCD CGRAM */
+    lcd.customSymbol(0, wifiSymbol);
+    lcd.customSymbol(1, noWifiSymbol);
+    lcd.customSymbol(2, checkSymbol);
+
+    /* start from a known blank screen for the shadow rows */
+    lcd.clear();
+    lcd_row_clear(shown[0]);
+    lcd_row_clear(shown[1]);
+    lcd_ok = true;
+    boot_mark("lcd ready");
+    xTaskNotify(boot_task_handle, LCD_READY_BIT, eSetBits);
+
+    /* the splash is only a state: input or the timeout replaces it */
+    state.display = SPLASH;
+    status_until_us = esp_timer_get_time() + SPLASH_MS * 1000LL;
+
+    ui_bus.attach();
+    while(1) {
+        TickType_t wait = portMAX_DELAY;
+
+        if(awake) {
+            int64_t idle_ms = (esp_timer_get_time() - last_input_us) / 1000;
+            if(idle_ms >= DISPLAY_SLEEP_MS) {
+                /* nothing left to show: blank and sleep until input */
+                lcd.setColorAll();
+                lcd.noDisplay();
+                awake = false;
+                wake_stats_reset();
+                rotary_sleep(true);
+                esp_pm_lock_release(pm_lock);
+            } else {
+                if(status_until_us != 0 && esp_timer_get_time() >= status_until_us) {
+                    state.display = MENU; // sync status or splash done
+                    status_until_us = 0;
+                }
+                // display current highlighted option on LCD
+                displayMenu(state);
+                if(input_us != 0) {
+                    ui_latency_record(input_us);
+                    input_us = 0;
+                }
+                /* redraw for the next clock minute, the end of a sync
+                 * status or to blank, whichever is first */
+                uint32_t next_in = DISPLAY_SLEEP_MS - idle_ms;
+                uint32_t minute_in = ms_to_next_minute();
+                if(minute_in < next_in) {
+                    next_in = minute_in;
+                }
+                if(state.display == MENU && state.menu.editing &&
+                   menu_highlighted(&state.menu)->editor == EDIT_DIAG && DIAG_REFRESH_MS < next_in) {
+                    next_in = DIAG_REFRESH_MS;
+                }
+                if(state.display == MENU && VALVE_REFRESH_MS < next_in) {
+                    next_in = VALVE_REFRESH_MS;
+                }
+                if(status_until_us != 0) {
+                    uint32_t status_in = (status_until_us - esp_timer_get_time()) / 1000;
+                    if(status_in < next_in) {
+                        next_in = status_in;
+                    }
+                }
+                wait = pdMS_TO_TICKS(next_in) + 1;
+            }
+        }
+
+        /* a backlog of state changes collapses into one redraw */
+        bool changed = ui_bus.wait(&evt, wait);
+        wake_stats_record(WAKE_DISPLAY);
+        if(!changed) {
+            continue;
+        }
+        do {
+            if(evt.type == EVT_STATE) {
+                state.menu = evt.state.menu;
+                state.display = static_cast<dispFlag>(evt.state.display);
+                state.synced = evt.state.synced;
+                state.sync_stage = static_cast<sync_stage_t>(evt.state.sync_stage);
+                if(input_us == 0) {
+                    input_us = evt.state.input_us;
+                }
+                if(state.display == SYNC_STATUS) {
+                    status_until_us = evt.timestamp_us + SYNC_STATUS_MS * 1000LL;
+                }
             }
-            switch(direction) {
-                case CW:
-                    if(nextMenu != SETTINGS) nextMenu = SETTINGS;
+        } while(ui_bus.poll(&evt));
+
+        last_input_us = esp_timer_get_time();
+        if(!awake) {
+            esp_pm_lock_acquire(pm_lock);
+            rotary_sleep(false);
+            wake_stats_report("display asleep");
+            lcd.display();
+            lcd.setColorWhite();
+            awake = true;
+        }
+    }
+
+}
+
+/**
+ * sync progress from the sync task. the result is flashed once, the
+ * next snapshot is back to MENU so input during it is never lost.
+ */
+static void handle_sync(const event_t &evt) {
+    sync_stage = static_cast<sync_stage_t>(evt.sync.stage);
+    if(sync_stage != SYNC_DONE && sync_stage != SYNC_FAILED) {
+        publish_state();
+        return;
+    }
+    time_synced = sync_stage == SYNC_DONE;
+    sync_stage = SYNC_IDLE;
+    displayFlag = SYNC_STATUS;
+    publish_state();
+    displayFlag = MENU;
+}
+
+static void handle_input(const event_t &evt) {
+    switch(evt.type) {
+        case EVT_BUTTON:
+            switch(evt.button.gesture) {
+                case BUTTON_CLICK:
+                    menu_select(&menu);
                     break;
-                case CCW:
-                    if(nextMenu != VALVE_SELECT) nextMenu = VALVE_SELECT;
+                case BUTTON_DOUBLE_CLICK:
+                    /* the first click already acted, the second
+                     * takes the user straight back home, dropping
+                     * any edit in progress */
+                    menu_home(&menu);
                     break;
-            }
-            break;
-        case SETTINGS:
-            if(position < 0 || position > 1) {// only 2 options in SETTINGS screen
-                position = prev_position; 
-                break; 
-            }
-            switch(direction) {
-                case CCW:
-                    if(nextMenu != SYNC) nextMenu = SYNC;
+                case BUTTON_LONG_PRESS:
+                    valve_scheduler_stop_all();
                     break;
-                case CW:
-                    if(nextMenu != HOME) nextMenu = HOME;
+                default:
                     break;
             }
             break;
-        case VALVE_SELECT:
-            position = 0; // only one option for now... back
-            nextMenu = HOME;
+        case EVT_ROTATE:
+            /* one update per coalesced burst rather than per detent */
+            menu_rotate(&menu, evt.rotate.detents, evt.rotate.steps);
             break;
         default:
             break;
     }
-    ESP_LOGI(TAG, "current: %d next: %d", currentMenu, nextMenu);
-}
-
-static void refresh_disp_task(void* arg) {
-    while(1) {
-        // display current highlighted option on LCD
-        displayMenu(currentMenu);
-        vTaskDelay(250 / portTICK_PERIOD_MS);
-    }
-
+    TRACE(TRACE_MENU, menu.node, menu.cursor | (uint32_t) menu.editing << 16);
+    publish_state(evt.type == EVT_ROTATE ? evt.rotate.edge_us : 0);
 }
 
 static void main_task(void* arg) {
-    while(true) {
+    event_t evt;
 
-        // if button pressed, process the selection
-        if(buttonPressed) {
-            processSelection();
-            buttonPressed = false; // reset flag after processing
+    /* both buses give the same task notification */
+    input_bus.attach();
+    sync_bus.attach();
+    while(true) {
+        while(input_bus.poll(&evt)) {
+            wake_stats_record(WAKE_MENU);
+            handle_input(evt);
         }
-
-        if(prev_position != position) {
-            updateMenuFromEncoder();
-            prev_position = position;
+        while(sync_bus.poll(&evt)) {
+            handle_sync(evt);
         }
-
-        // simulate non-blocking loop, update display or do other tasks
-        vTaskDelay(10 / portTICK_PERIOD_MS);
+        /* sleep until trigger_callback or the sync task publishes */
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
     }
 }
 
 
+/**
+ * an update is kept only if everything came up and it is not eating
+ * the heap. a crash before this is asked rolls back on its own.
+ */
+static bool app_healthy() {
+    size_t min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT);
+    ESP_LOGI(TAG, "health: lcd %d input %d valves %d, min free heap %u", lcd_ok, input_ok, valves_ok,
+             (unsigned) min_free);
+    return lcd_ok && input_ok && valves_ok && min_free >= HEALTHY_MIN_FREE_HEAP;
+}
+
+/**
+ * boot is staged so nothing waits on something it does not need:
+ * the clock and the stored programs come first and the valves run
+ * from them, the LCD (with ~70 ms of power-up delays) comes up in its
+ * own task, and the network only gates the sync service and the API.
+ */
 extern "C" void app_main(void)
 {
     esp_err_t ret;
 
-    /* initialize display */
-    ret = lcd.init();
+    boot_task_handle = xTaskGetCurrentTaskHandle();
+    boot_mark("app_main");
+
+    /* before the subsystems that take PM locks */
+    ret = power_init();
     if(ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed LCD init: %s", esp_err_to_name(ret));
-        return;
+        ESP_LOGE(TAG, "Failed power init: %s", esp_err_to_name(ret));
     }
-    lcd.clear();
-    /* create custom characters in LCD CGRAM */
-    lcd.customSymbol(0, wifiSymbol);
-    lcd.customSymbol(1, noWifiSymbol);
-    lcd.customSymbol(2, checkSymbol);
-
-    /* initialize rotary encoder */
-    ret = rotary_init();
+    /* before the tasks that log through it */
+    ret = dlog_init();
     if(ret != ESP_OK) {
-        char str_buf[17];
-        snprintf(str_buf, sizeof(str_buf), "Rotary failed");
-        lcd.printstr(str_buf);
-        ESP_LOGE(TAG, "Failed to initialize rotary components: %s", esp_err_to_name(ret));
-        return;
+        ESP_LOGE(TAG, "Failed deferred log init: %s", esp_err_to_name(ret));
     }
 
+    ret = i2c_bus_init();
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed I2C init: %s", esp_err_to_name(ret));
+    }
 
     /**
      * check external RTC time, set system time
@@ -390,43 +600,151 @@ extern "C" void app_main(void)
      * can resync in settings
      */
     struct timeval now_temp;
-    rtc.getTime(&timeinfo);
-    now = mktime(&timeinfo);
-    now_temp.tv_sec = now; // set seconds (epoch time)
-    now_temp.tv_usec = 0;  // set microseconds
-
-    char time_status[32];
-    lcd.home();
-    if(settimeofday(&now_temp, NULL) == 0) {
-        snprintf(time_status, sizeof(time_status), "Time synced!");
-        lcd.printstr(time_status);
-    } else {
-        snprintf(time_status, sizeof(time_status), "Time not synced!");
-        lcd.printstr(time_status);
-    }
-    vTaskDelay(pdMS_TO_TICKS(3000));
-    lcd.clear();
-
-    printf("UTC time: %s", asctime(gmtime(&now)));
-    /* set locale */
-    setenv("TZ", "PST8PDT,M3.2.0/2,M11.1.0/2",1);
-    tzset();
-    printf("Local time: %s", asctime(localtime(&now)));
+    if(ret == ESP_OK && rtc.getTime(&timeinfo) == ESP_OK) {
+        /* the RTC keeps UTC */
+        now = tz_timegm(&timeinfo);
+        now_temp.tv_sec = now; // set seconds (epoch time)
+        now_temp.tv_usec = 0;  // set microseconds
+        rtc_time_ok = settimeofday(&now_temp, NULL) == 0;
+    }
+    boot_mark("clock");
 
-   //Initialize NVS
+    //Initialize NVS
     ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
       ESP_ERROR_CHECK(nvs_flash_erase());
       ret = nvs_flash_init();
     }
     ESP_ERROR_CHECK(ret);
+    boot_mark("nvs");
+
+    /* before the scheduler and the display read local time */
+    ret = tz_store_init();
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed time zone init: %s", esp_err_to_name(ret));
+    }
+
+    /* valve outputs. static so they outlive app_main */
+    static std::array<Valve, ZONE_COUNT> zone_valves = make_valves(std::make_index_sequence<ZONE_COUNT>{});
+    for(size_t i = 0; i < ZONE_COUNT; i++) {
+        valves[i] = &zone_valves[i];
+    }
+
+    /* first boot: everyday, zone 1 at 20:53 and zone 2 at 8:00, 10 mins.
+     * further zones start without a program */
+    static constexpr program_t default_programs[] = {
+        {0, 20, 53, 0b01111111, 600, true},
+        {1,  8,  0, 0b01111111, 600, true},
+    };
+    constexpr size_t default_count = ZONE_COUNT < 2 ? ZONE_COUNT : 2;
+    ret = program_store_init(default_programs, default_count, ZONE_COUNT);
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed program store init: %s", esp_err_to_name(ret));
+    }
+    boot_mark("programs");
+
+    /* before the scheduler, whose runs it records */
+    ret = history_init(ZONE_COUNT);
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed history init: %s", esp_err_to_name(ret));
+    }
+    boot_mark("history");
 
-    /* default valve config. everyday at 8am for 10 mins */
-    Valve v1(20,53,0b01111111,600,0);
-    Valve v2(8,0,0b01111111,600,1);
+    /* time and zone are set, the scheduler can compute starts */
+    ret = valve_scheduler_init(valves, ZONE_COUNT);
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed valve scheduler init: %s", esp_err_to_name(ret));
+        return;
+    }
+    valves_ok = true;
+    int64_t valves_ready_us = boot_mark("valves ready");
+
+    /* before the tasks and queues it watches are created */
+    ret = health_init();
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed health init: %s", esp_err_to_name(ret));
+    }
+    health_watch_bus("input", &input_bus);
+    health_watch_bus("ui", &ui_bus);
+    health_watch_bus("sync", &sync_bus);
+
+    static StaticTask<DISPLAY_TASK_STACK> display_task_mem;
+    display_task_mem.create(refresh_disp_task, "refresh_disp_task", NULL, DISPLAY_TASK_PRIO, CORE_CTRL);
+
+    /* initialize rotary encoder */
+    ret = rotary_init();
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize rotary components: %s", esp_err_to_name(ret));
+    }
+    input_ok = ret == ESP_OK;
+    static StaticTask<MAIN_TASK_STACK> main_task_mem;
+    main_task_mem.create(main_task, "main_task", NULL, MAIN_TASK_PRIO, CORE_CTRL);
+    boot_mark("input ready");
 
-    xTaskCreate(refresh_disp_task, "refresh_disp_task", 2048, NULL, 10, NULL);
-    xTaskCreate(main_task, "main_task", 4096, NULL, 3, NULL);
+    ret = wake_stats_init();
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed wakeup stats init: %s", esp_err_to_name(ret));
+    }
+
+    /* lwIP and the driver, before the server opens its socket and any
+     * task connects. the radio stays off until a wifi_connect() */
+    ret = wifi_manager_init();
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed wifi init: %s", esp_err_to_name(ret));
+    }
+    boot_mark("wifi init");
+
+    /* the RTC carries the clock until the first sync */
+    ret = sync_service_init(&rtc);
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed sync service init: %s", esp_err_to_name(ret));
+    }
+    boot_mark("sync service");
+
+#if CONFIG_IRRIGATION_TELEMETRY
+    ret = telemetry_init(&rtc);
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed telemetry init: %s", esp_err_to_name(ret));
+    }
+    telemetry_record(TLM_BOOT, TELEMETRY_NO_ZONE, esp_reset_reason());
+    boot_mark("telemetry");
+#endif
+
+    /* also decides whether a just-installed update is kept */
+    ret = ota_update_init(app_healthy);
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed OTA init: %s", esp_err_to_name(ret));
+    }
+
+#if CONFIG_IRRIGATION_REST_API
+    /* the network stack is up since wifi_manager_init() */
+    ret = rest_api_init(valves, ZONE_COUNT);
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed REST API init: %s", esp_err_to_name(ret));
+    }
+    boot_mark("rest api");
+#endif
+
+    /* the timeline is only complete once the LCD is up */
+    xTaskNotifyWait(0, LCD_READY_BIT, NULL, pdMS_TO_TICKS(1000));
+    boot_report();
+    printf("UTC time: %s", asctime(gmtime(&now)));
+    printf("Local time: %s", asctime(localtime(&now)));
+    if(valves_ready_us > VALVES_READY_BUDGET_US) {
+        ESP_LOGW(TAG, "Valves ready at %lld ms, over the %d ms budget",
+                 (long long) (valves_ready_us / 1000), VALVES_READY_BUDGET_US / 1000);
+    }
+
+#if CONFIG_IRRIGATION_LCD_FORMAT_BENCH
+    lcd_format_benchmark();
+#endif
+
+#if CONFIG_IRRIGATION_CONSOLE
+    ret = diag_console_init();
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed console init: %s", esp_err_to_name(ret));
+    }
+#endif
 
     vTaskDelete(NULL);
 
@@ -0,0 +1,181 @@
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "json_stream.h"
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static char unescape(char c)
+{
+    switch(c) {
+        case '"':  return '"';
+        case '\\': return '\\';
+        case '/':  return '/';
+        case 'b':  return '\b';
+        case 'f':  return '\f';
+        case 'n':  return '\n';
+        case 'r':  return '\r';
+        case 't':  return '\t';
+        default:   return 0; // \u and junk are not supported
+    }
+}
+
+bool JsonStream::append(char *buf, uint8_t &len, uint8_t max, char c)
+{
+    if(len >= max) {
+        return false;
+    }
+    buf[len++] = c;
+    buf[len] = '\0';
+    return true;
+}
+
+bool JsonStream::emit(json_kind_t kind)
+{
+    if(kind != JSON_STRING) {
+        if(strcmp(_value, "true") == 0 || strcmp(_value, "false") == 0) {
+            kind = JSON_BOOL;
+        } else if(strcmp(_value, "null") == 0) {
+            kind = JSON_NULL;
+        } else {
+            char *end;
+            strtod(_value, &end);
+            if(*end != '\0') {
+                return false;
+            }
+        }
+    }
+    bool ok = _cb(_ctx, _key, _value, kind);
+    _key_len = _value_len = 0;
+    _key[0] = _value[0] = '\0';
+    return ok;
+}
+
+json_status_t JsonStream::step(char c)
+{
+    switch(_state) {
+        case S_OPEN:
+            if(c == '{') {
+                _state = S_KEY_OR_END;
+            } else if(!is_space(c)) {
+                _state = S_ERROR;
+            }
+            break;
+        case S_KEY_OR_END:
+        case S_KEY_START:
+            if(c == '"') {
+                _state = S_KEY;
+            } else if(c == '}' && _state == S_KEY_OR_END) {
+                _state = S_DONE;
+            } else if(!is_space(c)) {
+                _state = S_ERROR;
+            }
+            break;
+        case S_KEY:
+            if(c == '"') {
+                _state = S_COLON;
+            } else if(c == '\\') {
+                _state = S_KEY_ESC;
+            } else if(!append(_key, _key_len, JSON_KEY_MAX, c)) {
+                _state = S_ERROR;
+            }
+            break;
+        case S_KEY_ESC:
+            c = unescape(c);
+            _state = c && append(_key, _key_len, JSON_KEY_MAX, c) ? S_KEY : S_ERROR;
+            break;
+        case S_COLON:
+            if(c == ':') {
+                _state = S_VALUE;
+            } else if(!is_space(c)) {
+                _state = S_ERROR;
+            }
+            break;
+        case S_VALUE:
+            if(c == '"') {
+                _state = S_STRING;
+            } else if(c == '{' || c == '[' || c == ',' || c == '}') {
+                _state = S_ERROR;
+            } else if(!is_space(c)) {
+                _state = append(_value, _value_len, JSON_VALUE_MAX, c) ? S_SCALAR : S_ERROR;
+            }
+            break;
+        case S_STRING:
+            if(c == '"') {
+                _state = emit(JSON_STRING) ? S_NEXT_OR_END : S_ERROR;
+            } else if(c == '\\') {
+                _state = S_STRING_ESC;
+            } else if(!append(_value, _value_len, JSON_VALUE_MAX, c)) {
+                _state = S_ERROR;
+            }
+            break;
+        case S_STRING_ESC:
+            c = unescape(c);
+            _state = c && append(_value, _value_len, JSON_VALUE_MAX, c) ? S_STRING : S_ERROR;
+            break;
+        case S_SCALAR:
+            if(c == ',' || c == '}' || is_space(c)) {
+                if(!emit(JSON_NUMBER)) {
+                    _state = S_ERROR;
+                    break;
+                }
+                _state = S_NEXT_OR_END;
+                return step(c);
+            }
+            if(!append(_value, _value_len, JSON_VALUE_MAX, c)) {
+                _state = S_ERROR;
+            }
+            break;
+        case S_NEXT_OR_END:
+            if(c == ',') {
+                _state = S_KEY_START;
+            } else if(c == '}') {
+                _state = S_DONE;
+            } else if(!is_space(c)) {
+                _state = S_ERROR;
+            }
+            break;
+        case S_DONE:
+            if(!is_space(c)) {
+                _state = S_ERROR; // trailing garbage
+            }
+            break;
+        case S_ERROR:
+            break;
+    }
+    if(_state == S_ERROR) {
+        return JSON_ERROR;
+    }
+    return _state == S_DONE ? JSON_DONE : JSON_MORE;
+}
+
+json_status_t JsonStream::feed(const char *data, size_t len)
+{
+    json_status_t status = _state == S_DONE ? JSON_DONE : JSON_MORE;
+
+    for(size_t i = 0; i < len; i++) {
+        status = step(data[i]);
+        if(status == JSON_ERROR) {
+            break;
+        }
+    }
+    return status;
+}
+
+bool JsonStream::to_int(const char *value, long min, long max, long *out)
+{
+    char *end;
+
+    errno = 0;
+    long v = strtol(value, &end, 10);
+    if(errno != 0 || end == value || *end != '\0' || v < min || v > max) {
+        return false;
+    }
+    *out = v;
+    return true;
+}
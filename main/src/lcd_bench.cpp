@@ -0,0 +1,119 @@
+#include "sdkconfig.h"
+
+#if CONFIG_IRRIGATION_LCD_FORMAT_BENCH
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <time.h>
+#include "esp_log.h"
+#include "esp_cpu.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "lcd_bench.h"
+#include "lcd_format.h"
+#include "menu.h"
+#include "tz.h"
+
+static const char *TAG = "LCD_BENCH";
+
+#define BENCH_FRAMES 1000
+#define BENCH_STACK 4096
+#define BENCH_CORE (portNUM_PROCESSORS - 1) // cycle counters are per core
+
+typedef void (*frame_fn_t)(char *top, char *bot);
+
+typedef struct {
+    const char *name;
+    frame_fn_t frame;
+    uint32_t cycles;     // per frame
+    uint32_t stack_used; // bytes, including task entry
+    TaskHandle_t caller;
+} bench_t;
+
+/* what displayMenu did before the formatter, for one home screen */
+static void legacy_frame(char *top, char *bot)
+{
+    struct tm timeinfo;
+    time_t now;
+
+    time(&now);
+    localtime_r(&now, &timeinfo);
+    strftime(top, LCD_COLS + 1, "V1: V2:  %H:%M", &timeinfo);
+    snprintf(bot, LCD_COLS + 1, "   VALVE SEL.  >");
+}
+
+/* the same screen through lcd_format.h, clock cached per minute */
+static void fixed_frame(char *top, char *bot)
+{
+    static time_t rendered_minute = -1;
+    static uint8_t hour, minute;
+    static const menu_cursor_t home = {};
+    time_t t = time(NULL);
+
+    if(t / 60 != rendered_minute) {
+        struct tm local;
+        tz_local(t, &local);
+        hour = local.tm_hour;
+        minute = local.tm_min;
+        rendered_minute = t / 60;
+    }
+    lcd_row_clear(top);
+    lcd_put_lit<0, 3>(top, "V1:");
+    lcd_put_char<3>(top, LCD_GLYPH(2));
+    lcd_put_lit<4, 3>(top, "V2:");
+    lcd_put_char<7>(top, LCD_GLYPH(2));
+    lcd_put_clock<9>(top, hour, minute);
+    lcd_put_char<15>(top, LCD_GLYPH(0));
+    menu_render(&home, bot);
+}
+
+/* task entry and frame call overhead, subtracted from both */
+static void empty_frame(char *top, char *bot)
+{
+    top[0] = bot[0] = '\0';
+}
+
+static void bench_task(void* arg)
+{
+    bench_t *bench = static_cast<bench_t *>(arg);
+    lcd_row_t top, bot;
+
+    uint32_t start = esp_cpu_get_cycle_count();
+    for(int i = 0; i < BENCH_FRAMES; i++) {
+        bench->frame(top, bot);
+    }
+    bench->cycles = (esp_cpu_get_cycle_count() - start) / BENCH_FRAMES;
+    bench->stack_used = BENCH_STACK - uxTaskGetStackHighWaterMark(NULL);
+
+    xTaskNotifyGive(bench->caller);
+    vTaskDelete(NULL);
+}
+
+void lcd_format_benchmark()
+{
+    bench_t benches[] = {
+        {"empty", empty_frame, 0, 0, NULL},
+        {"strftime/snprintf", legacy_frame, 0, 0, NULL},
+        {"lcd_format", fixed_frame, 0, 0, NULL},
+    };
+
+    for(bench_t &bench : benches) {
+        bench.caller = xTaskGetCurrentTaskHandle();
+        /* fresh task each run so high water marks don't mix */
+        if(xTaskCreatePinnedToCore(bench_task, "lcd_bench", BENCH_STACK, &bench, 1, NULL, BENCH_CORE) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to start %s", bench.name);
+            return;
+        }
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+
+    for(size_t i = 1; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        ESP_LOGI(TAG, "%-18s %6" PRIu32 " cycles/frame, %4" PRIu32 " bytes stack",
+                 benches[i].name,
+                 benches[i].cycles - benches[0].cycles,
+                 benches[i].stack_used - benches[0].stack_used);
+    }
+}
+
+#endif /* CONFIG_IRRIGATION_LCD_FORMAT_BENCH */
@@ -0,0 +1,210 @@
+#include <array>
+#include <inttypes.h>
+
+#include "menu.h"
+#include "lcd_format.h"
+
+/*******************************table**********************************/
+
+static_assert(ZONE_COUNT >= 1 && ZONE_COUNT <= 255, "zone index must fit in menu_node_t::arg");
+
+/* fixed layout: siblings are contiguous, per-zone lists come last */
+static constexpr uint16_t N_HOME = MENU_ROOT;
+static constexpr uint16_t N_VALVES = 1;
+static constexpr uint16_t N_SETTINGS = 2;
+static constexpr uint16_t N_ZONES = 3;                                // ZONE_COUNT zones, then BACK
+static constexpr uint16_t N_SETTINGS_ITEMS = N_ZONES + ZONE_COUNT + 1; // SYNC TIME, DIAGNOSTICS, BACK
+static constexpr uint16_t SETTINGS_ITEMS = 3;
+static constexpr uint16_t N_ZONE_ITEMS = N_SETTINGS_ITEMS + SETTINGS_ITEMS;
+static constexpr uint16_t ZONE_ITEMS = 4;                              // START, DURATION, RUN NOW, BACK
+static constexpr size_t MENU_SIZE = N_ZONE_ITEMS + ZONE_COUNT * ZONE_ITEMS;
+
+static constexpr menu_node_t node(const char *label, uint16_t parent,
+                                  uint16_t first_child = 0, uint16_t child_count = 0,
+                                  menu_action_t action = ACT_NONE, menu_editor_t editor = EDIT_NONE,
+                                  uint8_t arg = 0, uint8_t flags = 0)
+{
+    return menu_node_t{label, parent, first_child, child_count, action, editor, arg, flags};
+}
+
+static constexpr std::array<menu_node_t, MENU_SIZE> menu_build()
+{
+    std::array<menu_node_t, MENU_SIZE> t{};
+
+    t[N_HOME] = node("HOME", N_HOME, N_VALVES, 2);
+    t[N_VALVES] = node("VALVES", N_HOME, N_ZONES, ZONE_COUNT + 1);
+    t[N_SETTINGS] = node("SETTINGS", N_HOME, N_SETTINGS_ITEMS, SETTINGS_ITEMS);
+
+    for(uint16_t z = 0; z < ZONE_COUNT; z++) {
+        uint16_t zone = N_ZONES + z;
+        uint16_t items = N_ZONE_ITEMS + z * ZONE_ITEMS;
+        t[zone] = node("ZONE", N_VALVES, items, ZONE_ITEMS, ACT_NONE, EDIT_NONE, z, MENU_LABEL_ARG);
+        t[items + 0] = node("START", zone, 0, 0, ACT_NONE, EDIT_START, z);
+        t[items + 1] = node("DURATION", zone, 0, 0, ACT_NONE, EDIT_DURATION, z);
+        t[items + 2] = node("RUN NOW", zone, 0, 0, ACT_RUN, EDIT_NONE, z);
+        t[items + 3] = node("BACK", zone, 0, 0, ACT_BACK);
+    }
+    t[N_ZONES + ZONE_COUNT] = node("BACK", N_VALVES, 0, 0, ACT_BACK);
+
+    t[N_SETTINGS_ITEMS + 0] = node("SYNC TIME", N_SETTINGS, 0, 0, ACT_SYNC);
+    t[N_SETTINGS_ITEMS + 1] = node("DIAGNOSTICS", N_SETTINGS, 0, 0, ACT_NONE, EDIT_DIAG);
+    t[N_SETTINGS_ITEMS + 2] = node("BACK", N_SETTINGS, 0, 0, ACT_BACK);
+
+    return t;
+}
+
+/**
+ * every child points back at the node that lists it, every node is
+ * listed exactly once and labels fit between the arrows
+ */
+static constexpr bool menu_valid(const std::array<menu_node_t, MENU_SIZE> &t)
+{
+    size_t listed = 1; // root
+    for(size_t n = 0; n < MENU_SIZE; n++) {
+        if(t[n].label == nullptr) return false;
+        size_t len = 0;
+        while(t[n].label[len] != '\0') len++;
+        if(len > ((t[n].flags & MENU_LABEL_ARG) ? 10 : 14)) return false;
+        if(t[n].child_count > 0 && (t[n].action != ACT_NONE || t[n].editor != EDIT_NONE)) return false;
+        for(size_t c = t[n].first_child; c < t[n].first_child + t[n].child_count; c++) {
+            if(c >= MENU_SIZE || c == MENU_ROOT || t[c].parent != n) return false;
+            listed++;
+        }
+    }
+    return listed == MENU_SIZE;
+}
+
+static constexpr std::array<menu_node_t, MENU_SIZE> menu_nodes = menu_build();
+static_assert(menu_valid(menu_nodes), "menu table is malformed");
+
+static constexpr menu_editor_def_t menu_editors[EDIT_COUNT] = {
+    {0, 0, false},   // EDIT_NONE
+    {0, 1439, true}, // EDIT_START: 00:00 - 23:59
+    {1, 999, false}, // EDIT_DURATION
+    {0, MENU_DIAG_PAGES - 1, true}, // EDIT_DIAG
+};
+
+/*******************************engine*********************************/
+
+void menu_home(menu_cursor_t *menu)
+{
+    menu->node = MENU_ROOT;
+    menu->cursor = 0;
+    menu->value = 0;
+    menu->editing = false;
+}
+
+const menu_node_t *menu_highlighted(const menu_cursor_t *menu)
+{
+    return &menu_nodes[menu_nodes[menu->node].first_child + menu->cursor];
+}
+
+/**
+ * menus move one entry per detent and stop at the ends.
+ * editors move by the velocity scaled steps.
+ */
+void menu_rotate(menu_cursor_t *menu, int16_t detents, int16_t steps)
+{
+    if(menu->editing) {
+        const menu_editor_def_t &def = menu_editors[menu_highlighted(menu)->editor];
+        int32_t value = menu->value + steps;
+        if(def.wrap) {
+            int32_t span = def.max - def.min + 1;
+            value = def.min + ((value - def.min) % span + span) % span;
+        } else if(value < def.min) {
+            value = def.min;
+        } else if(value > def.max) {
+            value = def.max;
+        }
+        menu->value = value;
+        return;
+    }
+
+    int32_t cursor = menu->cursor + detents;
+    int32_t last = menu_nodes[menu->node].child_count - 1;
+    if(cursor < 0) cursor = 0;
+    if(cursor > last) cursor = last;
+    menu->cursor = cursor;
+}
+
+/**
+ * descend, go back, open or commit an editor, or run an action
+ */
+void menu_select(menu_cursor_t *menu)
+{
+    const menu_node_t *highlighted = menu_highlighted(menu);
+
+    if(menu->editing) {
+        menu_editor_set(highlighted->editor, highlighted->arg, menu->value);
+        menu->editing = false;
+    } else if(highlighted->child_count > 0) {
+        menu->node = highlighted - menu_nodes.data();
+        menu->cursor = 0;
+    } else if(highlighted->action == ACT_BACK) {
+        uint16_t from = menu->node;
+        menu->node = menu_nodes[from].parent;
+        menu->cursor = from - menu_nodes[menu->node].first_child;
+    } else if(highlighted->editor != EDIT_NONE) {
+        menu->value = menu_editor_get(highlighted->editor, highlighted->arg);
+        menu->editing = true;
+    } else if(highlighted->action != ACT_NONE) {
+        menu_action(highlighted->action, highlighted->arg);
+    }
+}
+
+/**
+ * leave an editor without committing
+ */
+void menu_cancel(menu_cursor_t *menu)
+{
+    menu->editing = false;
+}
+
+/**
+ * bottom LCD row: the highlighted entry between scroll arrows,
+ * or the entry and its value while editing
+ */
+void menu_render(const menu_cursor_t *menu, lcd_row_t row)
+{
+    const menu_node_t *highlighted = menu_highlighted(menu);
+    char label[LCD_COLS - 1]; // fits between the arrows, terminated
+    size_t len = lcd_fmt_len(highlighted->label, sizeof(label) - 1);
+
+    for(size_t i = 0; i < len; i++) {
+        label[i] = highlighted->label[i];
+    }
+    if(highlighted->flags & MENU_LABEL_ARG) {
+        uint32_t n = highlighted->arg + 1;
+        size_t digits = n >= 100 ? 3 : n >= 10 ? 2 : 1;
+        label[len++] = ' ';
+        lcd_fmt_uint(label + len, digits, n, ' ');
+        len += digits;
+    }
+    label[len] = '\0';
+
+    lcd_row_clear(row);
+    if(menu->editing) {
+        switch(highlighted->editor) {
+            case EDIT_START:
+                lcd_put_str<0, 11>(row, label);
+                lcd_put_clock<11>(row, menu->value / 60, menu->value % 60);
+                break;
+            case EDIT_DURATION:
+                lcd_put_str<0, 8>(row, label);
+                lcd_put_uint<8, 4>(row, menu->value);
+                lcd_put_lit<12, 4>(row, " min");
+                break;
+            case EDIT_DIAG:
+                menu_diag_render(menu->value, row);
+                break;
+            default:
+                lcd_put_str<0, LCD_COLS>(row, label);
+                break;
+        }
+        return;
+    }
+
+    lcd_put_char<0>(row, menu->cursor > 0 ? '<' : ' ');
+    lcd_put_str<1, LCD_COLS - 2>(row, label, LCD_CENTER);
+    lcd_put_char<LCD_COLS - 1>(row, menu->cursor + 1 < menu_nodes[menu->node].child_count ? '>' : ' ');
+}
@@ -0,0 +1,417 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_app_format.h"
+#include "esp_http_client.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "nvs.h"
+
+#include "ota_update.h"
+#include "valve_scheduler.h"
+#include "wifi_setup.h"
+#include "task_layout.h"
+#include "static_rtos.h"
+
+static const char *TAG = "OTA";
+
+#define OTA_SECTOR          4096
+/* persist progress every this many bytes, a multiple of OTA_SECTOR */
+#define OTA_SAVE_EVERY      (16 * OTA_SECTOR)
+#define OTA_RESUME_ATTEMPTS 5
+#define OTA_RETRY_MS        2000
+#define OTA_HTTP_TIMEOUT_MS 10000
+#define OTA_WIFI_TIMEOUT_MS 15000
+#define OTA_TASK_STACK      4096
+/* no flash erase or write this close to a valve closing: the cache is
+ * off during flash operations and the close timer would run late */
+#define OTA_CLOSE_GUARD_US  250000
+
+#define OTA_NVS_NAMESPACE "ota"
+#define OTA_NVS_KEY       "progress"
+
+#define START_BIT BIT0
+
+/**
+ * a partial download. only trusted if it was for the same slot, the
+ * same url and the server still reports the same size.
+ */
+typedef struct {
+    char label[17];
+    uint32_t url_hash;
+    uint32_t total;
+    uint32_t written; // multiple of OTA_SECTOR
+} ota_progress_t;
+
+static TaskHandle_t ota_task_handle = NULL;
+static ota_health_cb_t health_cb = NULL;
+static ota_status_t status;
+static portMUX_TYPE status_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* one sector: a whole erase block arrives before it is written */
+static char buf[OTA_SECTOR];
+
+/* set from the HTTP client's header event */
+static uint32_t range_total;
+
+static void set_state(ota_state_t state, esp_err_t error = ESP_OK)
+{
+    portENTER_CRITICAL(&status_lock);
+    status.state = state;
+    status.error = error;
+    portEXIT_CRITICAL(&status_lock);
+}
+
+static void set_progress(uint32_t written, uint32_t total)
+{
+    portENTER_CRITICAL(&status_lock);
+    status.written = written;
+    status.total = total;
+    portEXIT_CRITICAL(&status_lock);
+}
+
+/* FNV-1a */
+static uint32_t url_hash(const char *url)
+{
+    uint32_t h = 2166136261u;
+    while(*url) {
+        h = (h ^ (uint8_t) *url++) * 16777619u;
+    }
+    return h;
+}
+
+static bool progress_load(ota_progress_t *progress)
+{
+    nvs_handle_t nvs;
+    size_t len = sizeof(*progress);
+
+    if(nvs_open(OTA_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return false;
+    }
+    esp_err_t ret = nvs_get_blob(nvs, OTA_NVS_KEY, progress, &len);
+    nvs_close(nvs);
+    return ret == ESP_OK && len == sizeof(*progress);
+}
+
+static void progress_save(const ota_progress_t *progress)
+{
+    nvs_handle_t nvs;
+
+    if(nvs_open(OTA_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        return;
+    }
+    if(progress == NULL) {
+        nvs_erase_key(nvs, OTA_NVS_KEY);
+    } else {
+        nvs_set_blob(nvs, OTA_NVS_KEY, progress, sizeof(*progress));
+    }
+    nvs_commit(nvs);
+    nvs_close(nvs);
+}
+
+/**
+ * hold off while a valve close is due, so the close timer never
+ * waits on a flash operation
+ */
+static void valve_guard()
+{
+    for(;;) {
+        int64_t close = valve_scheduler_next_close_us();
+        int64_t until = close - esp_timer_get_time();
+        if(close < 0 || until > OTA_CLOSE_GUARD_US || until < -OTA_CLOSE_GUARD_US) {
+            return;
+        }
+        vTaskDelay(pdMS_TO_TICKS(until / 1000 + OTA_CLOSE_GUARD_US / 1000) + 1);
+    }
+}
+
+/**
+ * erase and write one sector-aligned block
+ */
+static esp_err_t write_block(const esp_partition_t *part, uint32_t offset, const char *data, size_t len)
+{
+    esp_err_t ret;
+
+    valve_guard();
+    ret = esp_partition_erase_range(part, offset, OTA_SECTOR);
+    if(ret != ESP_OK) {
+        return ret;
+    }
+    valve_guard();
+    return esp_partition_write(part, offset, data, len);
+}
+
+/**
+ * reject anything that is not an app image, and the image already
+ * running
+ */
+static esp_err_t check_image(const char *data, size_t len)
+{
+    const esp_image_header_t *header = reinterpret_cast<const esp_image_header_t *>(data);
+    size_t desc_at = sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t);
+
+    if(len < desc_at + sizeof(esp_app_desc_t) || header->magic != ESP_IMAGE_HEADER_MAGIC) {
+        ESP_LOGE(TAG, "Not an app image");
+        return ESP_ERR_INVALID_ARG;
+    }
+    const esp_app_desc_t *incoming = reinterpret_cast<const esp_app_desc_t *>(data + desc_at);
+    const esp_app_desc_t *running = esp_app_get_description();
+    ESP_LOGI(TAG, "Image %s, running %s", incoming->version, running->version);
+    if(memcmp(incoming->app_elf_sha256, running->app_elf_sha256, sizeof(running->app_elf_sha256)) == 0) {
+        ESP_LOGI(TAG, "Already running this image");
+        return ESP_ERR_INVALID_VERSION;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t http_event(esp_http_client_event_t *evt)
+{
+    /* Content-Range: bytes <first>-<last>/<total> */
+    if(evt->event_id == HTTP_EVENT_ON_HEADER && strcasecmp(evt->header_key, "Content-Range") == 0) {
+        const char *slash = strchr(evt->header_value, '/');
+        if(slash != NULL) {
+            range_total = strtoul(slash + 1, NULL, 10);
+        }
+    }
+    return ESP_OK;
+}
+
+/**
+ * one request from offset to the end. returns with offset advanced
+ * to the last whole sector written.
+ */
+static esp_err_t fetch(esp_http_client_handle_t client, const esp_partition_t *part,
+                       ota_progress_t *progress)
+{
+    char range[32];
+    esp_err_t ret;
+
+    snprintf(range, sizeof(range), "bytes=%" PRIu32 "-", progress->written);
+    esp_http_client_set_header(client, "Range", range);
+    range_total = 0;
+
+    ret = esp_http_client_open(client, 0);
+    if(ret != ESP_OK) {
+        return ret;
+    }
+    int64_t length = esp_http_client_fetch_headers(client);
+    int code = esp_http_client_get_status_code(client);
+
+    if(code == 206 && progress->written > 0 && range_total != progress->total) {
+        ESP_LOGW(TAG, "Image changed on the server, starting over");
+        progress->written = 0;
+        progress->total = 0;
+        esp_http_client_close(client);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    if(code == 206) {
+        progress->total = range_total;
+    } else if(code == 200) {
+        /* no range support: the whole image again */
+        progress->written = 0;
+        progress->total = length > 0 ? length : 0;
+    } else {
+        ESP_LOGE(TAG, "HTTP %d", code);
+        esp_http_client_close(client);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    if(progress->total == 0 || progress->total > part->size) {
+        ESP_LOGE(TAG, "Image size %" PRIu32 " unknown or over the %" PRIu32 " byte slot", progress->total,
+                 (uint32_t) part->size);
+        esp_http_client_close(client);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    size_t fill = 0;
+    uint32_t saved = progress->written;
+    while(progress->written + fill < progress->total) {
+        int n = esp_http_client_read(client, buf + fill, sizeof(buf) - fill);
+        if(n <= 0) {
+            ret = ESP_ERR_TIMEOUT; // cut off, the partial sector is fetched again
+            break;
+        }
+        fill += n;
+        if(fill < sizeof(buf) && progress->written + fill < progress->total) {
+            continue;
+        }
+        if(progress->written == 0 && (ret = check_image(buf, fill)) != ESP_OK) {
+            break;
+        }
+        ret = write_block(part, progress->written, buf, fill);
+        if(ret != ESP_OK) {
+            ESP_LOGE(TAG, "Flash write at %" PRIu32 ": %s", progress->written, esp_err_to_name(ret));
+            break;
+        }
+        progress->written += fill;
+        fill = 0;
+        set_progress(progress->written, progress->total);
+        if(progress->written - saved >= OTA_SAVE_EVERY) {
+            progress_save(progress);
+            saved = progress->written;
+        }
+    }
+    esp_http_client_close(client);
+    if(progress->written != saved) {
+        progress_save(progress);
+    }
+    return progress->written == progress->total ? ESP_OK : ret;
+}
+
+static esp_err_t download()
+{
+    const esp_partition_t *part = esp_ota_get_next_update_partition(NULL);
+    ota_progress_t progress = {};
+    esp_err_t ret;
+
+    if(part == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    uint32_t hash = url_hash(CONFIG_IRRIGATION_OTA_URL);
+    if(progress_load(&progress) && strcmp(progress.label, part->label) == 0 && progress.url_hash == hash &&
+       progress.written % OTA_SECTOR == 0 && progress.written < progress.total) {
+        ESP_LOGI(TAG, "Resuming at %" PRIu32 " of %" PRIu32, progress.written, progress.total);
+    } else {
+        memset(&progress, 0, sizeof(progress));
+        strncpy(progress.label, part->label, sizeof(progress.label) - 1);
+        progress.url_hash = hash;
+    }
+    set_progress(progress.written, progress.total);
+
+    ret = wifi_connect(pdMS_TO_TICKS(OTA_WIFI_TIMEOUT_MS));
+    if(ret != ESP_OK) {
+        return ret;
+    }
+    wifi_set_power_save(false);
+    int64_t start = esp_timer_get_time();
+    uint32_t first = progress.written;
+
+    esp_http_client_config_t config = {};
+    config.url = CONFIG_IRRIGATION_OTA_URL;
+    config.timeout_ms = OTA_HTTP_TIMEOUT_MS;
+    config.keep_alive_enable = true;
+    config.event_handler = http_event;
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if(client == NULL) {
+        ret = ESP_ERR_NO_MEM;
+    } else {
+        for(int attempt = 0; attempt <= OTA_RESUME_ATTEMPTS; attempt++) {
+            if(attempt > 0) {
+                portENTER_CRITICAL(&status_lock);
+                status.resumes++;
+                portEXIT_CRITICAL(&status_lock);
+                ESP_LOGW(TAG, "Interrupted at %" PRIu32 ", resuming", progress.written);
+                vTaskDelay(pdMS_TO_TICKS(OTA_RETRY_MS));
+            }
+            ret = fetch(client, part, &progress);
+            if(ret == ESP_OK || ret == ESP_ERR_INVALID_ARG || ret == ESP_ERR_INVALID_VERSION ||
+               ret == ESP_ERR_INVALID_SIZE) {
+                break;
+            }
+        }
+        esp_http_client_cleanup(client);
+    }
+
+    wifi_set_power_save(true);
+    wifi_disconnect();
+    int64_t ms = (esp_timer_get_time() - start) / 1000;
+    ESP_LOGI(TAG, "Radio window %lld ms, %" PRIu32 " bytes (%.1f kB/s)", (long long) ms,
+             progress.written - first, ms ? (progress.written - first) / (float) ms : 0.0f);
+    if(ret != ESP_OK) {
+        return ret;
+    }
+
+    /* runs the bootloader's image verification before touching otadata */
+    set_state(OTA_VERIFYING);
+    progress_save(NULL);
+    ret = esp_ota_set_boot_partition(part);
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Image rejected: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+/**
+ * keep a freshly updated app or roll it back
+ */
+static void health_check()
+{
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    esp_ota_img_states_t state;
+
+    if(esp_ota_get_state_partition(running, &state) != ESP_OK || state != ESP_OTA_IMG_PENDING_VERIFY) {
+        return;
+    }
+    ESP_LOGI(TAG, "New image on %s, health check in %d s", running->label, CONFIG_IRRIGATION_OTA_HEALTH_DELAY_S);
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_IRRIGATION_OTA_HEALTH_DELAY_S * 1000));
+    if(health_cb == NULL || health_cb()) {
+        ESP_LOGI(TAG, "Healthy, keeping the update");
+        esp_ota_mark_app_valid_cancel_rollback();
+        return;
+    }
+    ESP_LOGE(TAG, "Health check failed, rolling back");
+    esp_ota_mark_app_invalid_rollback_and_reboot();
+}
+
+static void ota_task(void* arg)
+{
+    health_check();
+
+    for(;;) {
+        xTaskNotifyWait(0, START_BIT, NULL, portMAX_DELAY);
+        set_state(OTA_DOWNLOADING);
+        esp_err_t ret = download();
+        if(ret != ESP_OK) {
+            ESP_LOGE(TAG, "Update failed: %s", esp_err_to_name(ret));
+            set_state(OTA_FAILED, ret);
+            continue;
+        }
+        set_state(OTA_REBOOTING);
+        /* never cut a watering short for a reboot */
+        while(valve_scheduler_next_close_us() >= 0) {
+            vTaskDelay(pdMS_TO_TICKS(1000));
+        }
+        ESP_LOGI(TAG, "Rebooting into the update");
+        esp_restart();
+    }
+}
+
+/*******************************public*********************************/
+
+esp_err_t ota_update_init(ota_health_cb_t health)
+{
+    health_cb = health;
+    static StaticTask<OTA_TASK_STACK> ota_task_mem;
+    ota_task_handle = ota_task_mem.create(ota_task, "ota_task", NULL, OTA_TASK_PRIO, CORE_NET);
+    if(ota_task_handle == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t ota_update_start()
+{
+    ota_status_t now;
+
+    ota_update_status(&now);
+    if(ota_task_handle == NULL || now.state == OTA_DOWNLOADING || now.state == OTA_VERIFYING ||
+       now.state == OTA_REBOOTING) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    set_state(OTA_DOWNLOADING);
+    xTaskNotify(ota_task_handle, START_BIT, eSetBits);
+    return ESP_OK;
+}
+
+void ota_update_status(ota_status_t *out)
+{
+    portENTER_CRITICAL(&status_lock);
+    *out = status;
+    portEXIT_CRITICAL(&status_lock);
+}
@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_pm.h"
+#include "esp_console.h"
+
+#include "power.h"
+
+static const char *TAG = "POWER";
+
+static int power_command(int argc, char **argv)
+{
+    esp_pm_config_t config = {};
+    if(esp_pm_get_configuration(&config) == ESP_OK) {
+        printf("%d-%d MHz, light sleep %s\n", config.min_freq_mhz, config.max_freq_mhz,
+               config.light_sleep_enable ? "on" : "off");
+    }
+    /* with CONFIG_PM_PROFILING this also has the time spent per mode */
+    esp_pm_dump_locks(stdout);
+    return 0;
+}
+
+/*******************************public*********************************/
+
+esp_err_t power_init()
+{
+    esp_pm_config_t config = {};
+    config.max_freq_mhz = CONFIG_IRRIGATION_PM_MAX_MHZ;
+    config.min_freq_mhz = CONFIG_IRRIGATION_PM_MIN_MHZ;
+#if CONFIG_IRRIGATION_PM_LIGHT_SLEEP
+    config.light_sleep_enable = true;
+#endif
+
+    esp_err_t ret = esp_pm_configure(&config);
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed configuring power management: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    ESP_LOGI(TAG, "%d-%d MHz, light sleep %s", config.min_freq_mhz, config.max_freq_mhz,
+             config.light_sleep_enable ? "on" : "off");
+    return ESP_OK;
+}
+
+esp_err_t power_register_command()
+{
+    const esp_console_cmd_t cmd = {
+        .command = "power",
+        .help = "frequency limits and the PM locks held, with time per mode if PM profiling is on",
+        .hint = NULL,
+        .func = power_command,
+        .argtable = NULL,
+    };
+    return esp_console_cmd_register(&cmd);
+}
@@ -0,0 +1,385 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_console.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "nvs.h"
+
+#include "program_store.h"
+#include "valve_scheduler.h"
+#include "ws_push.h"
+#include "bundle.h"
+#include "static_rtos.h"
+
+static const char *TAG = "PROGRAMS";
+
+#define PROGRAM_NVS_NAMESPACE "programs"
+#define PROGRAM_NVS_KEY       "table"
+/* bump when program_t changes, an old table is then replaced by defaults */
+#define PROGRAM_TABLE_VERSION 1
+/* bytes of one "bundle data" line, as hex within the console's 64 characters */
+#define BUNDLE_LINE_BYTES 24
+
+typedef struct {
+    uint8_t version;
+    uint32_t used; // bit n: slot n holds a program
+    program_t programs[PROGRAM_MAX];
+} program_table_t;
+
+static_assert(PROGRAM_MAX <= 32, "used is a 32 bit mask");
+static const uint32_t USED_ALL = PROGRAM_MAX == 32 ? UINT32_MAX : (1UL << PROGRAM_MAX) - 1;
+
+static program_table_t table;
+static uint8_t zones = 0;
+static SemaphoreHandle_t lock = NULL;
+
+/**
+ * write the table through. called with the lock held.
+ */
+static esp_err_t table_save()
+{
+    nvs_handle_t nvs;
+    esp_err_t ret;
+
+    ret = nvs_open(PROGRAM_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed opening NVS: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    ret = nvs_set_blob(nvs, PROGRAM_NVS_KEY, &table, sizeof(table));
+    if(ret == ESP_OK) {
+        ret = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed saving programs: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+static bool table_load()
+{
+    nvs_handle_t nvs;
+    size_t len = sizeof(table);
+
+    if(nvs_open(PROGRAM_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return false;
+    }
+    esp_err_t ret = nvs_get_blob(nvs, PROGRAM_NVS_KEY, &table, &len);
+    nvs_close(nvs);
+    if(ret != ESP_OK || len != sizeof(table) || table.version != PROGRAM_TABLE_VERSION) {
+        return false;
+    }
+    /* drop anything a smaller zone count no longer covers */
+    for(uint8_t id = 0; id < PROGRAM_MAX; id++) {
+        if((table.used & (1UL << id)) && !program_valid(&table.programs[id], zones)) {
+            table.used &= ~(1UL << id);
+        }
+    }
+    return true;
+}
+
+/**
+ * save and reschedule after a change. releases the lock.
+ */
+static esp_err_t commit_and_unlock()
+{
+    esp_err_t ret = table_save();
+    xSemaphoreGive(lock);
+    valve_scheduler_reschedule();
+    ws_push_bump(WS_KEY_PROGRAMS); // dashboards refetch /api/programs
+    return ret;
+}
+
+/*******************************console*********************************/
+
+static void print_hex(const uint8_t *data, size_t len)
+{
+    for(size_t i = 0; i < len; i++) {
+        printf("%02x", data[i]);
+    }
+    printf("\n");
+}
+
+static bool parse_hex(const char *hex, uint8_t *out, size_t max, size_t *len)
+{
+    size_t n = strlen(hex);
+    if(n % 2 != 0 || n / 2 > max) {
+        return false;
+    }
+    for(size_t i = 0; i < n / 2; i++) {
+        char byte[3] = {hex[2 * i], hex[2 * i + 1], '\0'};
+        char *end;
+        out[i] = strtoul(byte, &end, 16);
+        if(*end != '\0') {
+            return false;
+        }
+    }
+    *len = n / 2;
+    return true;
+}
+
+/**
+ * "bundle export" prints the table as hex lines between BUNDLE BEGIN and
+ * BUNDLE END. an import is "bundle begin", a "bundle data <hex>" line per
+ * chunk, each checked as it comes, and "bundle end", which applies it.
+ * tools/bundle.py does both ends.
+ */
+static int bundle_command(int argc, char **argv)
+{
+    static program_t staged[PROGRAM_MAX];
+    static BundleReader reader(staged, PROGRAM_MAX, zones);
+    static bool importing = false;
+
+    if(argc < 2) {
+        printf("bundle export|begin|data <hex>|end\n");
+        return 1;
+    }
+    if(strcmp(argv[1], "export") == 0) {
+        uint8_t buf[bundle_size_max(PROGRAM_MAX)];
+        size_t len = program_store_export(buf, sizeof(buf));
+        printf("BUNDLE BEGIN %u\n", (unsigned) len);
+        for(size_t i = 0; i < len; i += 32) {
+            print_hex(buf + i, len - i < 32 ? len - i : 32);
+        }
+        printf("BUNDLE END\n");
+        return len > 0 ? 0 : 1;
+    }
+    if(strcmp(argv[1], "begin") == 0) {
+        reader.reset();
+        importing = true;
+        printf("BUNDLE READY\n");
+        return 0;
+    }
+    if(!importing) {
+        printf("BUNDLE ERROR no import begun\n");
+        return 1;
+    }
+    if(strcmp(argv[1], "data") == 0 && argc == 3) {
+        uint8_t chunk[BUNDLE_LINE_BYTES];
+        size_t len;
+        if(!parse_hex(argv[2], chunk, sizeof(chunk), &len)) {
+            importing = false;
+            printf("BUNDLE ERROR bad hex line\n");
+            return 1;
+        }
+        if(reader.feed(chunk, len) == CBOR_ERROR) {
+            importing = false;
+            printf("BUNDLE ERROR %s\n", reader.error());
+            return 1;
+        }
+        printf("BUNDLE OK\n");
+        return 0;
+    }
+    if(strcmp(argv[1], "end") == 0) {
+        importing = false;
+        if(!reader.finish()) {
+            printf("BUNDLE ERROR %s\n", reader.error());
+            return 1;
+        }
+        int64_t began = esp_timer_get_time();
+        esp_err_t ret = program_store_replace(staged, reader.count());
+        if(ret != ESP_OK) {
+            printf("BUNDLE ERROR %s\n", esp_err_to_name(ret));
+            return 1;
+        }
+        printf("BUNDLE APPLIED %u programs in %lld us\n", (unsigned) reader.count(),
+               (long long) (esp_timer_get_time() - began));
+        return 0;
+    }
+    printf("bundle export|begin|data <hex>|end\n");
+    return 1;
+}
+
+/*******************************public*********************************/
+
+esp_err_t program_store_init(const program_t *defaults, size_t default_count, uint8_t zone_count)
+{
+    static StaticMutex lock_mem;
+    lock = lock_mem.create();
+    if(lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    zones = zone_count;
+
+    if(table_load()) {
+        ESP_LOGI(TAG, "Loaded %d programs", __builtin_popcount(table.used));
+        return ESP_OK;
+    }
+    memset(&table, 0, sizeof(table));
+    table.version = PROGRAM_TABLE_VERSION;
+    for(size_t i = 0; i < default_count && i < PROGRAM_MAX; i++) {
+        if(program_valid(&defaults[i], zones)) {
+            table.programs[i] = defaults[i];
+            table.used |= 1UL << i;
+        }
+    }
+    ESP_LOGI(TAG, "No stored programs, using %d defaults", __builtin_popcount(table.used));
+    return table_save();
+}
+
+bool program_store_get(uint8_t id, program_t *program)
+{
+    bool found = false;
+
+    if(id >= PROGRAM_MAX) {
+        return false;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if(table.used & (1UL << id)) {
+        *program = table.programs[id];
+        found = true;
+    }
+    xSemaphoreGive(lock);
+    return found;
+}
+
+uint8_t program_store_next(uint8_t after)
+{
+    uint8_t id = after == PROGRAM_NONE ? 0 : after + 1;
+    uint8_t next = PROGRAM_NONE;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for(; id < PROGRAM_MAX; id++) {
+        if(table.used & (1UL << id)) {
+            next = id;
+            break;
+        }
+    }
+    xSemaphoreGive(lock);
+    return next;
+}
+
+uint8_t program_store_first(uint8_t zone)
+{
+    uint8_t first = PROGRAM_NONE;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for(uint8_t id = 0; id < PROGRAM_MAX; id++) {
+        if((table.used & (1UL << id)) && table.programs[id].zone == zone) {
+            first = id;
+            break;
+        }
+    }
+    xSemaphoreGive(lock);
+    return first;
+}
+
+esp_err_t program_store_add(const program_t *program, uint8_t *id)
+{
+    if(!program_valid(program, zones)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if(table.used == USED_ALL) {
+        xSemaphoreGive(lock);
+        return ESP_ERR_NO_MEM;
+    }
+    uint8_t slot = __builtin_ctz(~table.used);
+    table.programs[slot] = *program;
+    table.used |= 1UL << slot;
+    if(id != NULL) {
+        *id = slot;
+    }
+    return commit_and_unlock();
+}
+
+esp_err_t program_store_set(uint8_t id, const program_t *program)
+{
+    if(id >= PROGRAM_MAX || !program_valid(program, zones)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if(!(table.used & (1UL << id))) {
+        xSemaphoreGive(lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+    table.programs[id] = *program;
+    return commit_and_unlock();
+}
+
+esp_err_t program_store_remove(uint8_t id)
+{
+    if(id >= PROGRAM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if(!(table.used & (1UL << id))) {
+        xSemaphoreGive(lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+    table.used &= ~(1UL << id);
+    return commit_and_unlock();
+}
+
+time_t program_store_next_start(uint8_t zone, time_t now, uint16_t *duration_sec)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    time_t next = programs_next_start(table.programs, PROGRAM_MAX, table.used, zone, now, duration_sec);
+    xSemaphoreGive(lock);
+    return next;
+}
+
+esp_err_t program_store_replace(const program_t *programs, size_t count)
+{
+    if(count > PROGRAM_MAX) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    for(size_t i = 0; i < count; i++) {
+        if(!program_valid(&programs[i], zones)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    program_table_t old = table;
+    table.used = 0;
+    for(size_t i = 0; i < count; i++) {
+        table.programs[i] = programs[i];
+        table.used |= 1UL << i;
+    }
+    /* one blob, so NVS keeps either the old table or the new one */
+    esp_err_t ret = table_save();
+    if(ret != ESP_OK) {
+        table = old;
+        xSemaphoreGive(lock);
+        return ret;
+    }
+    xSemaphoreGive(lock);
+    valve_scheduler_reschedule();
+    ws_push_bump(WS_KEY_PROGRAMS);
+    ESP_LOGI(TAG, "Replaced by %u programs", (unsigned) count);
+    return ESP_OK;
+}
+
+size_t program_store_export(uint8_t *buf, size_t size)
+{
+    program_t programs[PROGRAM_MAX];
+    size_t count = 0;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for(uint8_t id = 0; id < PROGRAM_MAX; id++) {
+        if(table.used & (1UL << id)) {
+            programs[count++] = table.programs[id];
+        }
+    }
+    xSemaphoreGive(lock);
+    return bundle_write(buf, size, programs, count, zones);
+}
+
+esp_err_t program_store_register_command()
+{
+    const esp_console_cmd_t cmd = {
+        .command = "bundle",
+        .help = "schedule bundle over the console: 'export' prints it, 'begin', 'data <hex>'... 'end' imports one",
+        .hint = "export|begin|data <hex>|end",
+        .func = bundle_command,
+        .argtable = NULL,
+    };
+    return esp_console_cmd_register(&cmd);
+}
@@ -0,0 +1,619 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "rest_api.h"
+#include "json_stream.h"
+#include "bundle.h"
+#include "program_store.h"
+#include "ota_update.h"
+#include "valve_scheduler.h"
+#include "wifi_setup.h"
+#include "ws_push.h"
+#include "tz.h"
+#include "tz_store.h"
+#include "task_layout.h"
+#include "static_rtos.h"
+
+static const char *TAG = "REST";
+
+/* socket reads go through this, the body is never buffered whole */
+#define REST_RECV_CHUNK  64
+/* a program is < 100 bytes of JSON, anything far past that is abuse */
+#define REST_BODY_MAX    1024
+#define REST_WIFI_TIMEOUT_MS 15000
+#define REST_WIFI_RETRY_MS   60000
+#define REST_WIFI_TASK_STACK 3072
+
+static Valve **rest_valves = NULL;
+static size_t rest_zone_count = 0;
+
+static std::atomic<uint32_t> requests{0};
+static std::atomic<uint32_t> errors{0};
+static std::atomic<uint32_t> body_bytes{0};
+
+/*******************************body parsing*********************************/
+
+/* fields a program body may carry */
+enum {
+    F_ZONE     = 1 << 0,
+    F_HOUR     = 1 << 1,
+    F_MINUTE   = 1 << 2,
+    F_DAYS     = 1 << 3,
+    F_DURATION = 1 << 4,
+    F_ENABLED  = 1 << 5,
+    F_PROGRAM  = F_ZONE | F_HOUR | F_MINUTE | F_DAYS | F_DURATION
+};
+
+typedef struct {
+    program_t program;
+    uint8_t seen;
+} program_body_t;
+
+/* the numeric fields, each with the largest value its program_t member holds */
+typedef struct {
+    const char *key;
+    uint8_t flag;
+    long max;
+} program_field_t;
+
+static const program_field_t program_fields[] = {
+    { "zone",     F_ZONE,     UINT8_MAX },
+    { "hour",     F_HOUR,     UINT8_MAX },
+    { "minute",   F_MINUTE,   UINT8_MAX },
+    { "days",     F_DAYS,     UINT8_MAX },
+    { "duration", F_DURATION, UINT16_MAX },
+};
+
+/**
+ * one member of a program body, straight into the program. each field
+ * is checked against its own type first, so nothing is truncated on the
+ * way in; the rest is left to program_valid() once the body is complete.
+ */
+static bool program_member(void *ctx, const char *key, const char *value, json_kind_t kind)
+{
+    program_body_t *body = static_cast<program_body_t *>(ctx);
+    long v;
+
+    if(strcmp(key, "enabled") == 0) {
+        if(kind != JSON_BOOL) {
+            return false;
+        }
+        body->program.enabled = value[0] == 't';
+        body->seen |= F_ENABLED;
+        return true;
+    }
+    for(const program_field_t &f : program_fields) {
+        if(strcmp(key, f.key) != 0) {
+            continue;
+        }
+        if(kind != JSON_NUMBER || !JsonStream::to_int(value, 0, f.max, &v)) {
+            return false;
+        }
+        switch(f.flag) {
+            case F_ZONE:     body->program.zone = v; break;
+            case F_HOUR:     body->program.hour = v; break;
+            case F_MINUTE:   body->program.minute = v; break;
+            case F_DAYS:     body->program.wday_bv = v; break;
+            case F_DURATION: body->program.duration_sec = v; break;
+        }
+        body->seen |= f.flag;
+        return true;
+    }
+    /* unknown keys are ignored */
+    return true;
+}
+
+typedef struct {
+    long duration;
+    bool seen;
+} run_body_t;
+
+static bool run_member(void *ctx, const char *key, const char *value, json_kind_t kind)
+{
+    run_body_t *body = static_cast<run_body_t *>(ctx);
+
+    if(strcmp(key, "duration") == 0) {
+        body->seen = kind == JSON_NUMBER && JsonStream::to_int(value, 1, PROGRAM_DURATION_MAX, &body->duration);
+        return body->seen;
+    }
+    return true;
+}
+
+/**
+ * feed the request body through the parser a chunk at a time.
+ * on failure the error response has already been sent.
+ */
+static esp_err_t read_body(httpd_req_t *req, JsonStream &json)
+{
+    char buf[REST_RECV_CHUNK];
+    size_t remaining = req->content_len;
+    json_status_t status = JSON_MORE;
+
+    if(remaining > REST_BODY_MAX) {
+        httpd_resp_set_status(req, "413 Payload Too Large");
+        httpd_resp_send(req, NULL, 0);
+        return ESP_FAIL;
+    }
+    body_bytes += remaining;
+    while(remaining > 0) {
+        int n = httpd_req_recv(req, buf, remaining < sizeof(buf) ? remaining : sizeof(buf));
+        if(n == HTTPD_SOCK_ERR_TIMEOUT) {
+            continue;
+        }
+        if(n <= 0) {
+            return ESP_FAIL; // connection gone, nothing to answer
+        }
+        remaining -= n;
+        status = json.feed(buf, n);
+        if(status == JSON_ERROR) {
+            break;
+        }
+    }
+    if(status == JSON_ERROR || json.finish() != JSON_DONE) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "malformed body");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+/*******************************responses*********************************/
+
+static int format_program(char *buf, size_t len, uint8_t id, const program_t *p)
+{
+    return snprintf(buf, len,
+                    "{\"id\":%u,\"zone\":%u,\"hour\":%u,\"minute\":%u,\"days\":%u,\"duration\":%u,\"enabled\":%s}",
+                    id, p->zone, p->hour, p->minute, p->wday_bv, p->duration_sec, p->enabled ? "true" : "false");
+}
+
+static esp_err_t send_program(httpd_req_t *req, uint8_t id, const program_t *program)
+{
+    char buf[128];
+    int len = format_program(buf, sizeof(buf), id, program);
+
+    httpd_resp_set_type(req, HTTPD_TYPE_JSON);
+    return httpd_resp_send(req, buf, len);
+}
+
+static esp_err_t send_error(httpd_req_t *req, esp_err_t err)
+{
+    errors++;
+    switch(err) {
+        case ESP_ERR_NOT_FOUND:
+            return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "no such program");
+        case ESP_ERR_INVALID_ARG:
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "field out of range");
+        case ESP_ERR_NO_MEM:
+            httpd_resp_set_status(req, "409 Conflict");
+            return httpd_resp_sendstr(req, "program table full");
+        default:
+            return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, esp_err_to_name(err));
+    }
+}
+
+/**
+ * the number after prefix in the uri, e.g. the id in /api/programs/3
+ */
+static bool uri_index(httpd_req_t *req, const char *prefix, long max, long *out, const char **rest)
+{
+    size_t n = strlen(prefix);
+    char *end;
+
+    if(strncmp(req->uri, prefix, n) != 0) {
+        return false;
+    }
+    long v = strtol(req->uri + n, &end, 10);
+    if(end == req->uri + n || v < 0 || v > max) {
+        return false;
+    }
+    *out = v;
+    if(rest != NULL) {
+        *rest = end;
+    } else if(*end != '\0' && *end != '?') {
+        return false;
+    }
+    return true;
+}
+
+/*******************************handlers*********************************/
+
+static esp_err_t programs_list(httpd_req_t *req)
+{
+    char buf[128];
+    program_t program;
+    bool first = true;
+
+    requests++;
+    httpd_resp_set_type(req, HTTPD_TYPE_JSON);
+    httpd_resp_sendstr_chunk(req, "[");
+    for(uint8_t id = program_store_next(PROGRAM_NONE); id != PROGRAM_NONE; id = program_store_next(id)) {
+        if(!program_store_get(id, &program)) {
+            continue; // removed since next() saw it
+        }
+        int len = 0;
+        if(!first) {
+            buf[len++] = ',';
+        }
+        len += format_program(buf + len, sizeof(buf) - len, id, &program);
+        if(httpd_resp_send_chunk(req, buf, len) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        first = false;
+    }
+    httpd_resp_sendstr_chunk(req, "]");
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+static esp_err_t programs_create(httpd_req_t *req)
+{
+    program_body_t body = {};
+    JsonStream json(program_member, &body);
+    uint8_t id;
+
+    requests++;
+    body.program.enabled = true;
+    if(read_body(req, json) != ESP_OK) {
+        errors++;
+        return ESP_OK;
+    }
+    if((body.seen & F_PROGRAM) != F_PROGRAM) {
+        errors++;
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "zone, hour, minute, days and duration are required");
+    }
+    esp_err_t ret = program_store_add(&body.program, &id);
+    if(ret != ESP_OK) {
+        return send_error(req, ret);
+    }
+    ESP_LOGI(TAG, "Program %u created", id);
+    httpd_resp_set_status(req, "201 Created");
+    return send_program(req, id, &body.program);
+}
+
+static esp_err_t program_read(httpd_req_t *req)
+{
+    program_t program;
+    long id;
+
+    requests++;
+    if(!uri_index(req, "/api/programs/", PROGRAM_MAX - 1, &id, NULL) || !program_store_get(id, &program)) {
+        return send_error(req, ESP_ERR_NOT_FOUND);
+    }
+    return send_program(req, id, &program);
+}
+
+static esp_err_t program_update(httpd_req_t *req)
+{
+    program_body_t body = {};
+    JsonStream json(program_member, &body);
+    long id;
+
+    requests++;
+    /* fields not in the body keep their value */
+    if(!uri_index(req, "/api/programs/", PROGRAM_MAX - 1, &id, NULL) || !program_store_get(id, &body.program)) {
+        return send_error(req, ESP_ERR_NOT_FOUND);
+    }
+    if(read_body(req, json) != ESP_OK) {
+        errors++;
+        return ESP_OK;
+    }
+    esp_err_t ret = program_store_set(id, &body.program);
+    if(ret != ESP_OK) {
+        return send_error(req, ret);
+    }
+    return send_program(req, id, &body.program);
+}
+
+static esp_err_t program_delete(httpd_req_t *req)
+{
+    long id;
+
+    requests++;
+    if(!uri_index(req, "/api/programs/", PROGRAM_MAX - 1, &id, NULL)) {
+        return send_error(req, ESP_ERR_NOT_FOUND);
+    }
+    esp_err_t ret = program_store_remove(id);
+    if(ret != ESP_OK) {
+        return send_error(req, ret);
+    }
+    ESP_LOGI(TAG, "Program %ld deleted", id);
+    httpd_resp_set_status(req, "204 No Content");
+    return httpd_resp_send(req, NULL, 0);
+}
+
+static esp_err_t zones_list(httpd_req_t *req)
+{
+    char buf[48];
+
+    requests++;
+    httpd_resp_set_type(req, HTTPD_TYPE_JSON);
+    httpd_resp_sendstr_chunk(req, "[");
+    for(size_t zone = 0; zone < rest_zone_count; zone++) {
+        int len = snprintf(buf, sizeof(buf), "%s{\"zone\":%u,\"open\":%s}", zone ? "," : "",
+                           (unsigned) zone, rest_valves[zone]->get_active() ? "true" : "false");
+        httpd_resp_send_chunk(req, buf, len);
+    }
+    httpd_resp_sendstr_chunk(req, "]");
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+static esp_err_t zones_action(httpd_req_t *req)
+{
+    run_body_t body = {};
+    JsonStream json(run_member, &body);
+    const char *rest;
+    long zone;
+
+    requests++;
+    if(strcmp(req->uri, "/api/zones/stop") == 0) {
+        valve_scheduler_stop_all();
+        httpd_resp_set_status(req, "204 No Content");
+        return httpd_resp_send(req, NULL, 0);
+    }
+    if(!uri_index(req, "/api/zones/", (long) rest_zone_count - 1, &zone, &rest) || strcmp(rest, "/run") != 0) {
+        errors++;
+        return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "no such zone action");
+    }
+    if(read_body(req, json) != ESP_OK) {
+        errors++;
+        return ESP_OK;
+    }
+    if(!body.seen) {
+        errors++;
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "duration is required");
+    }
+    ESP_LOGI(TAG, "Manual run zone %ld for %ld s", zone, body.duration);
+    valve_scheduler_run(zone, body.duration);
+    httpd_resp_set_status(req, "202 Accepted");
+    return httpd_resp_send(req, NULL, 0);
+}
+
+/**
+ * counters for load tests. min_free_heap is the lowest free heap since
+ * boot, so the peak a test drove the heap to is min_free_heap before
+ * minus after.
+ */
+static esp_err_t stats_read(httpd_req_t *req)
+{
+    char buf[320];
+    ws_push_stats_t ws;
+
+    requests++;
+    ws_push_get_stats(&ws);
+    int len = snprintf(buf, sizeof(buf),
+                       "{\"requests\":%" PRIu32 ",\"errors\":%" PRIu32 ",\"body_bytes\":%" PRIu32
+                       ",\"free_heap\":%u,\"min_free_heap\":%u,\"largest_block\":%u"
+                       ",\"ws\":{\"clients\":%u,\"frames\":%" PRIu32 ",\"bytes\":%" PRIu32
+                       ",\"deferred\":%" PRIu32 ",\"rejected\":%" PRIu32 "}}",
+                       requests.load(), errors.load(), body_bytes.load(),
+                       (unsigned) heap_caps_get_free_size(MALLOC_CAP_DEFAULT),
+                       (unsigned) heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT),
+                       (unsigned) heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT),
+                       ws.clients, ws.frames, ws.bytes, ws.deferred, ws.rejected);
+    httpd_resp_set_type(req, HTTPD_TYPE_JSON);
+    return httpd_resp_send(req, buf, len);
+}
+
+static esp_err_t ota_start(httpd_req_t *req)
+{
+    requests++;
+    esp_err_t ret = ota_update_start();
+    if(ret != ESP_OK) {
+        errors++;
+        httpd_resp_set_status(req, "409 Conflict");
+        return httpd_resp_sendstr(req, "update already running");
+    }
+    httpd_resp_set_status(req, "202 Accepted");
+    return httpd_resp_send(req, NULL, 0);
+}
+
+static esp_err_t ota_read(httpd_req_t *req)
+{
+    static const char *states[] = {"idle", "downloading", "verifying", "rebooting", "failed"};
+    ota_status_t ota;
+    char buf[128];
+
+    requests++;
+    ota_update_status(&ota);
+    int len = snprintf(buf, sizeof(buf),
+                       "{\"state\":\"%s\",\"written\":%" PRIu32 ",\"total\":%" PRIu32 ",\"resumes\":%u,\"error\":\"%s\"}",
+                       states[ota.state], ota.written, ota.total, ota.resumes, esp_err_to_name(ota.error));
+    httpd_resp_set_type(req, HTTPD_TYPE_JSON);
+    return httpd_resp_send(req, buf, len);
+}
+
+/* the whole schedule as one CBOR bundle (bundle.h), for provisioning */
+static esp_err_t bundle_read(httpd_req_t *req)
+{
+    uint8_t buf[bundle_size_max(PROGRAM_MAX)];
+
+    requests++;
+    size_t len = program_store_export(buf, sizeof(buf));
+    if(len == 0) {
+        return send_error(req, ESP_ERR_INVALID_SIZE);
+    }
+    httpd_resp_set_type(req, "application/cbor");
+    return httpd_resp_send(req, reinterpret_cast<const char *>(buf), len);
+}
+
+/**
+ * checked chunk by chunk as it comes off the socket; only a complete
+ * valid bundle replaces the table, in one step
+ */
+static esp_err_t bundle_write_req(httpd_req_t *req)
+{
+    program_t staged[PROGRAM_MAX];
+    BundleReader bundle(staged, PROGRAM_MAX, rest_zone_count);
+    uint8_t buf[REST_RECV_CHUNK];
+    size_t remaining = req->content_len;
+
+    requests++;
+    if(remaining > bundle_size_max(PROGRAM_MAX)) {
+        errors++;
+        httpd_resp_set_status(req, "413 Payload Too Large");
+        return httpd_resp_send(req, NULL, 0);
+    }
+    body_bytes += remaining;
+    while(remaining > 0) {
+        int n = httpd_req_recv(req, reinterpret_cast<char *>(buf), remaining < sizeof(buf) ? remaining : sizeof(buf));
+        if(n == HTTPD_SOCK_ERR_TIMEOUT) {
+            continue;
+        }
+        if(n <= 0) {
+            return ESP_FAIL;
+        }
+        remaining -= n;
+        if(bundle.feed(buf, n) == CBOR_ERROR) {
+            break;
+        }
+    }
+    if(!bundle.finish()) {
+        errors++;
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, bundle.error());
+    }
+    esp_err_t ret = program_store_replace(staged, bundle.count());
+    if(ret != ESP_OK) {
+        return send_error(req, ret);
+    }
+    ESP_LOGI(TAG, "Bundle of %u programs applied", (unsigned) bundle.count());
+    return programs_list(req);
+}
+
+static bool tz_member(void *ctx, const char *key, const char *value, json_kind_t kind)
+{
+    char *spec = static_cast<char *>(ctx);
+
+    if(strcmp(key, "tz") == 0) {
+        if(kind != JSON_STRING || strlen(value) > TZ_SPEC_MAX) {
+            return false;
+        }
+        strcpy(spec, value);
+    }
+    return true;
+}
+
+static esp_err_t send_tz(httpd_req_t *req)
+{
+    char spec[TZ_SPEC_MAX + 1];
+    char buf[96];
+    bool dst;
+    int32_t offset = tz_offset(time(NULL), &dst);
+
+    tz_get(spec, sizeof(spec));
+    int len = snprintf(buf, sizeof(buf), "{\"tz\":\"%s\",\"offset\":%" PRId32 ",\"dst\":%s}",
+                       spec, offset, dst ? "true" : "false");
+    httpd_resp_set_type(req, HTTPD_TYPE_JSON);
+    return httpd_resp_send(req, buf, len);
+}
+
+static esp_err_t tz_read(httpd_req_t *req)
+{
+    requests++;
+    return send_tz(req);
+}
+
+/**
+ * PUT {"tz":"CET-1CEST,M3.5.0,M10.5.0/3"}: the zone the programs run in.
+ * kept across reboots; the next starts are recomputed at once.
+ */
+static esp_err_t tz_write(httpd_req_t *req)
+{
+    char spec[TZ_SPEC_MAX + 1] = {};
+    JsonStream json(tz_member, spec);
+
+    requests++;
+    if(read_body(req, json) != ESP_OK) {
+        errors++;
+        return ESP_OK;
+    }
+    esp_err_t ret = tz_store_set(spec);
+    if(ret == ESP_ERR_INVALID_ARG) {
+        errors++;
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "not a POSIX TZ string");
+    }
+    if(ret != ESP_OK) {
+        return send_error(req, ret);
+    }
+    return send_tz(req);
+}
+
+static const httpd_uri_t routes[] = {
+    { .uri = "/api/programs",   .method = HTTP_GET,    .handler = programs_list },
+    { .uri = "/api/programs",   .method = HTTP_POST,   .handler = programs_create },
+    { .uri = "/api/programs/*", .method = HTTP_GET,    .handler = program_read },
+    { .uri = "/api/programs/*", .method = HTTP_PUT,    .handler = program_update },
+    { .uri = "/api/programs/*", .method = HTTP_DELETE, .handler = program_delete },
+    { .uri = "/api/zones",      .method = HTTP_GET,    .handler = zones_list },
+    { .uri = "/api/zones/*",    .method = HTTP_POST,   .handler = zones_action },
+    { .uri = "/api/stats",      .method = HTTP_GET,    .handler = stats_read },
+    { .uri = "/api/ota",        .method = HTTP_POST,   .handler = ota_start },
+    { .uri = "/api/ota",        .method = HTTP_GET,    .handler = ota_read },
+    { .uri = "/api/bundle",     .method = HTTP_GET,    .handler = bundle_read },
+    { .uri = "/api/bundle",     .method = HTTP_PUT,    .handler = bundle_write_req },
+    { .uri = "/api/tz",         .method = HTTP_GET,    .handler = tz_read },
+    { .uri = "/api/tz",         .method = HTTP_PUT,    .handler = tz_write },
+};
+
+/**
+ * holds a wifi reference for the life of the server. once connected
+ * the station manager keeps the link up by itself.
+ */
+static void rest_wifi_task(void* arg)
+{
+    while(wifi_connect(pdMS_TO_TICKS(REST_WIFI_TIMEOUT_MS)) != ESP_OK) {
+        ESP_LOGW(TAG, "No wifi, retrying in %d s", REST_WIFI_RETRY_MS / 1000);
+        vTaskDelay(pdMS_TO_TICKS(REST_WIFI_RETRY_MS));
+    }
+    vTaskDelete(NULL);
+}
+
+/*******************************public*********************************/
+
+esp_err_t rest_api_init(Valve **valves, size_t count)
+{
+    httpd_handle_t server = NULL;
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    esp_err_t ret;
+
+    rest_valves = valves;
+    rest_zone_count = count;
+
+    config.server_port = CONFIG_IRRIGATION_REST_PORT;
+    config.uri_match_fn = httpd_uri_match_wildcard;
+    config.max_uri_handlers = sizeof(routes) / sizeof(routes[0]) + 1; // + /ws
+    static_assert(WS_MAX_CLIENTS < 7, "dashboards would starve REST of the 7 default sockets");
+    config.lru_purge_enable = true;
+    /* beside lwIP, away from the UI (task_layout.h) */
+    config.core_id = CORE_NET;
+
+    /* binds INADDR_ANY, it serves as soon as the station has an address */
+    ret = httpd_start(&server, &config);
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed starting server: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    for(size_t i = 0; i < sizeof(routes) / sizeof(routes[0]); i++) {
+        ret = httpd_register_uri_handler(server, &routes[i]);
+        if(ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed registering %s: %s", routes[i].uri, esp_err_to_name(ret));
+            return ret;
+        }
+    }
+    ret = ws_push_register(server);
+    if(ret != ESP_OK) {
+        return ret;
+    }
+    static StaticTask<REST_WIFI_TASK_STACK> rest_wifi_task_mem;
+    if(rest_wifi_task_mem.create(rest_wifi_task, "rest_wifi", NULL, REST_WIFI_TASK_PRIO, CORE_NET) == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Serving on port %d", CONFIG_IRRIGATION_REST_PORT);
+    return ESP_OK;
+}
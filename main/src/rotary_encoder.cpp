@@ -1,116 +1,371 @@
 #include <inttypes.h>
 #include <stdlib.h>
+#include <atomic>
 #include "driver/gpio.h"
+#include "driver/gpio_filter.h"
+#include "soc/soc_caps.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_sleep.h"
 
 #include "rotary_encoder.h"
+#include "button_gesture.h"
+#include "event_bus.h"
+#include "wake_stats.h"
+#include "hal_gpio.h"
+#include "board_config.h"
+#include "health.h"
+#include "trace.h"
+#include "dlog.h"
+#include "ui_latency.h"
+#include "task_layout.h"
+#include "static_rtos.h"
 
 
 static const char *TAG = "ROTARY";
 
-#define S1_GPIO 5
-#define S2_GPIO 6
-#define KEY_GPIO 7
+static constexpr uint8_t S1_GPIO = board::encoder_s1_gpio;
+static constexpr uint8_t S2_GPIO = board::encoder_s2_gpio;
+static constexpr uint8_t KEY_GPIO = board::encoder_key_gpio;
 #define ESP_INTR_FLAG_DEFAULT 0
 
+/* not a pin: posted by the button timer so its expiry is handled by
+ * trigger_callback, the only task that touches the gesture state.
+ * only a wakeup: button_due carries the expiry, so a full queue does
+ * not lose it */
+#define BUTTON_TIMER_EVT 0xFF
+/* not pins either: the display going dark and coming back */
+#define SLEEP_EVT 0xFE
+#define AWAKE_EVT 0xFD
+
+/* a burst ends after this long without a detent... */
+#define ROTARY_COALESCE_MS 20
+/* ...or after this long in total, so a long spin still updates the UI */
+#define ROTARY_COALESCE_MAX_MS 60
+
+/* velocity curve: detent-to-detent period thresholds */
+#define ROTARY_X10_PERIOD_US 12000
+#define ROTARY_X5_PERIOD_US  35000
+
+/* bus slots rotation may never take, so a button press always fits */
+#define ROTARY_RESERVED_SLOTS 4
+
+#define GPIO_EVT_QUEUE_LEN 10
+#define TRIGGER_TASK_STACK 2048
+
 static QueueHandle_t gpio_evt_queue = NULL;
+static StaticQueue<uint32_t, GPIO_EVT_QUEUE_LEN> gpio_evt_queue_mem;
+static StaticTask<TRIGGER_TASK_STACK> trigger_task_mem;
+static esp_timer_handle_t button_timer = NULL;
+static ButtonGesture button;
+static std::atomic<bool> button_due{false};
+
+/**
+ * light sleep only wakes on GPIO levels. while the display is dark
+ * S1 and KEY wake the chip at the level they are not resting at, and
+ * their ISR masks the pin, as a level interrupt would fire for as long
+ * as the level holds. trigger_callback owns the pin setup: it arms and
+ * disarms, and puts the edges back.
+ */
+static std::atomic<bool> wake_armed{false};
 
 /* queues gpio when edge detected */
 static void IRAM_ATTR gpio_isr_handler(void* arg)
 {
     uint32_t gpio_num = (uint32_t) arg;
-    xQueueSendFromISR(gpio_evt_queue, &gpio_num, NULL);
+    if(wake_armed.load(std::memory_order_relaxed)) {
+        gpio_intr_disable(static_cast<gpio_num_t>(gpio_num)); // in IRAM, CONFIG_GPIO_CTRL_FUNC_IN_IRAM
+    }
+    if(gpio_num == S1_GPIO) {
+        ui_latency_edge();
+    }
+    TRACE(TRACE_GPIO_ISR, gpio_num, 0);
+    BaseType_t sent = xQueueSendFromISR(gpio_evt_queue, &gpio_num, NULL);
+    TRACE(TRACE_QUEUE_SEND, TRACE_Q_GPIO, sent ? uxQueueMessagesWaitingFromISR(gpio_evt_queue) : TRACE_FULL);
 }
 
-volatile int16_t position = 0;
-volatile int8_t direction = 0;
-volatile bool buttonPressed = false;
-static volatile int8_t prevButtonState;
-
 static volatile int S1_prev;
 
+/**
+ * scale factor for one detent given the time since the previous one.
+ * slow turns move one unit per detent, a flick moves ten.
+ */
+static int16_t rotary_accel(uint32_t period_us)
+{
+    if(period_us < ROTARY_X10_PERIOD_US) return 10;
+    if(period_us < ROTARY_X5_PERIOD_US) return 5;
+    return 1;
+}
+
+/**
+ * hand the accumulated burst to the UI. if the UI has fallen behind
+ * and the bus is nearly full, keep accumulating so no detents are lost
+ * and the reserved slots stay free for button presses.
+ */
+static bool rotary_flush(event_t *burst)
+{
+    if(burst->rotate.detents == 0 && burst->rotate.steps == 0) {
+        return true;
+    }
+    if(input_bus.space() <= ROTARY_RESERVED_SLOTS || !input_bus.publish(*burst)) {
+        return false;
+    }
+    DLOGD(TAG, "burst: %d detents, %d steps, fastest %" PRIu32 " us",
+             burst->rotate.detents, burst->rotate.steps, burst->rotate.min_period_us);
+    burst->rotate.detents = 0;
+    burst->rotate.steps = 0;
+    burst->rotate.min_period_us = UINT32_MAX;
+    burst->rotate.edge_us = 0;
+    return true;
+}
+
+/**
+ * esp_timer callback. runs in the esp_timer task, so just flag the
+ * expiry for trigger_callback. if the queue is full of edges the
+ * flag is seen when they are taken.
+ */
+static void button_timer_cb(void* arg)
+{
+    uint32_t evt = BUTTON_TIMER_EVT;
+    button_due.store(true);
+    xQueueSend(gpio_evt_queue, &evt, 0);
+}
+
+/**
+ * point the one-shot button timer at the next gesture deadline
+ */
+static void button_arm()
+{
+    int64_t deadline = button.deadline();
+    esp_timer_stop(button_timer); // not running is fine
+    if(deadline == 0) {
+        return;
+    }
+    int64_t delay = deadline - esp_timer_get_time();
+    esp_timer_start_once(button_timer, delay > 0 ? delay : 0);
+}
+
+static void wake_arm()
+{
+    gpio_wakeup_enable(static_cast<gpio_num_t>(S1_GPIO), Gpio::get(S1_GPIO) ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+    gpio_wakeup_enable(static_cast<gpio_num_t>(KEY_GPIO), Gpio::get(KEY_GPIO) ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+    wake_armed.store(true, std::memory_order_relaxed);
+}
+
+static void wake_disarm()
+{
+    wake_armed.store(false, std::memory_order_relaxed);
+    gpio_wakeup_disable(static_cast<gpio_num_t>(S1_GPIO));
+    gpio_wakeup_disable(static_cast<gpio_num_t>(KEY_GPIO));
+    gpio_set_intr_type(static_cast<gpio_num_t>(S1_GPIO), GPIO_INTR_NEGEDGE);
+    gpio_set_intr_type(static_cast<gpio_num_t>(KEY_GPIO), GPIO_INTR_ANYEDGE);
+    gpio_intr_enable(static_cast<gpio_num_t>(S1_GPIO));
+    gpio_intr_enable(static_cast<gpio_num_t>(KEY_GPIO));
+}
+
+/**
+ * a gesture deadline passed: finish the press it was timing, and
+ * deliver rotation that came before it first
+ */
+static void button_expire(event_t *burst)
+{
+    int64_t now = esp_timer_get_time();
+    /* active low, pulled up */
+    bool pressed = !Gpio::get(KEY_GPIO);
+    button_gesture_t gesture = button.expire(now, pressed);
+    button_arm();
+    if(gesture == BUTTON_NONE) {
+        return;
+    }
+    rotary_flush(burst);
+    event_t press = {};
+    press.type = EVT_BUTTON;
+    press.timestamp_us = now;
+    press.button.gesture = gesture;
+    if(!input_bus.publish(press)) {
+        DLOGE(TAG, "Button gesture dropped, input bus full");
+    }
+    DLOGD(TAG, "Button gesture %d", gesture);
+}
+
 static void trigger_callback(void* arg)
 {
+    bool asleep = false; // display dark, pins armed between inputs
     uint32_t io_num;
-    int S1_level, S2_level, KEY_level;
+    int S1_level, S2_level;
+    event_t burst = {};
+    burst.type = EVT_ROTATE;
+    burst.rotate.min_period_us = UINT32_MAX;
+    int64_t last_detent_us = 0;
+    int64_t burst_start_us = 0;
+    TickType_t wait = portMAX_DELAY;
+
     for (;;) {
-        if(xQueueReceive(gpio_evt_queue, &io_num, portMAX_DELAY)){
-            switch (io_num) {
-                case S1_GPIO:
-                    S1_level = gpio_get_level(static_cast<gpio_num_t>(io_num));
-                    S2_level = gpio_get_level(static_cast<gpio_num_t>(S2_GPIO));
-                    if(S1_level != S1_prev && !S1_level){
-                        if(S2_level){ // CW
-                            direction = 1;
-                            position = position + 1;
-                        } else { // CCW
-                            direction = 0;
-                            position = position - 1;
-                        }
+        BaseType_t received = xQueueReceive(gpio_evt_queue, &io_num, wait);
+        wake_stats_record(WAKE_INPUT);
+        if(button_due.exchange(false)) {
+            button_expire(&burst);
+        }
+        if(received) {
+            TRACE(TRACE_QUEUE_RECV, TRACE_Q_GPIO, uxQueueMessagesWaiting(gpio_evt_queue));
+        } else {
+            /* quiet period elapsed, burst is complete */
+            wait = rotary_flush(&burst) ? portMAX_DELAY : pdMS_TO_TICKS(ROTARY_COALESCE_MS);
+            if(asleep && !wake_armed.load()) {
+                /* woken, but nothing that lit the display */
+                wake_arm();
+            }
+            continue;
+        }
+        if(wake_armed.load() && (io_num == S1_GPIO || io_num == KEY_GPIO)) {
+            /* the wakeup itself, then handled as an edge. come back
+             * to the quiet check to re-arm if the display stays dark */
+            wake_disarm();
+            wait = pdMS_TO_TICKS(ROTARY_COALESCE_MS);
+        }
+        switch (io_num) {
+            case SLEEP_EVT:
+                asleep = true;
+                wake_arm();
+                break;
+            case AWAKE_EVT:
+                asleep = false;
+                if(wake_armed.load()) {
+                    wake_disarm();
+                }
+                break;
+            case S1_GPIO: {
+                uint32_t edge_us = ui_latency_take_edge();
+                S1_level = Gpio::get(S1_GPIO);
+                S2_level = Gpio::get(S2_GPIO);
+                if(S1_level != S1_prev && !S1_level){
+                    int64_t now = esp_timer_get_time();
+                    uint32_t period = UINT32_MAX;
+                    if(last_detent_us != 0 && now - last_detent_us < UINT32_MAX) {
+                        period = static_cast<uint32_t>(now - last_detent_us);
+                    }
+                    last_detent_us = now;
+
+                    if(burst.rotate.detents == 0 && burst.rotate.steps == 0) {
+                        burst_start_us = now;
+                    }
+                    if(burst.rotate.edge_us == 0) {
+                        burst.rotate.edge_us = edge_us != 0 ? edge_us : (uint32_t) now;
                     }
-                    S1_prev = S1_level;
-                    break;
-                case KEY_GPIO:
-                    KEY_level = gpio_get_level(static_cast<gpio_num_t>(KEY_GPIO));
-                    ESP_LOGI(TAG, "Button pressed");
-                    buttonPressed = true;
-                    break;
-                default:
-                    ESP_LOGI(TAG, "Invalid GPIO dequeued");
+                    int16_t dir = S2_level ? 1 : -1; // CW : CCW
+                    burst.rotate.detents += dir;
+                    burst.rotate.steps += dir * rotary_accel(period);
+                    if(period < burst.rotate.min_period_us) {
+                        burst.rotate.min_period_us = period;
+                    }
+                    burst.timestamp_us = now;
+
+                    if(now - burst_start_us >= ROTARY_COALESCE_MAX_MS * 1000LL) {
+                        rotary_flush(&burst);
+                    }
+                    wait = pdMS_TO_TICKS(ROTARY_COALESCE_MS);
+                }
+                S1_prev = S1_level;
+                break;
             }
+            case KEY_GPIO:
+                button.edge(esp_timer_get_time());
+                button_arm();
+                break;
+            case BUTTON_TIMER_EVT:
+                /* handled through button_due */
+                break;
+            default:
+                DLOGW(TAG, "Invalid GPIO %" PRIu32 " dequeued", io_num);
         }
     }
 }
 
+/* through call_on_core(), so the GPIO interrupt lands on that core */
+static void install_isr_service(void *arg)
+{
+    *static_cast<esp_err_t *>(arg) = gpio_install_isr_service(ESP_INTR_FLAG_DEFAULT);
+}
 
 esp_err_t rotary_init() {
     esp_err_t ret;
 
-    // configure S1
-    gpio_config_t io_conf = {};
-    io_conf.intr_type = GPIO_INTR_NEGEDGE;
-    io_conf.mode = GPIO_MODE_INPUT;
-    io_conf.pin_bit_mask = (1ULL << S1_GPIO) | (1ULL << S2_GPIO);
-    io_conf.pull_down_en = static_cast<gpio_pulldown_t>(0);
-    io_conf.pull_up_en = static_cast<gpio_pullup_t>(1);
-    ret = gpio_config(&io_conf);
+    // configure S1, S2 is only sampled
+    ret = Gpio::input(S1_GPIO, HAL_EDGE_FALLING);
+    if(ret == ESP_OK) {
+        ret = Gpio::input(S2_GPIO, HAL_EDGE_NONE);
+    }
     if(ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed initializing S1/S2 GPIO: %s", esp_err_to_name(ret));
         return ret;
     }
 
-    // configure KEY
-    io_conf.intr_type = GPIO_INTR_NEGEDGE;
-    io_conf.mode = GPIO_MODE_INPUT;
-    io_conf.pin_bit_mask = (1ULL << KEY_GPIO);
-    io_conf.pull_down_en = static_cast<gpio_pulldown_t>(0);
-    io_conf.pull_up_en = static_cast<gpio_pullup_t>(1);
-    ret = gpio_config(&io_conf);
+    // configure KEY. both edges: the gesture engine times press and release
+    ret = Gpio::input(KEY_GPIO, HAL_EDGE_ANY);
     if(ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed initializing KEY GPIO: %s", esp_err_to_name(ret));
         return ret;
     }
 
-    S1_prev = gpio_get_level(static_cast<gpio_num_t>(S1_GPIO));
+#if SOC_GPIO_SUPPORT_PIN_GLITCH_FILTER
+    // drop sub-microsecond spikes on KEY in hardware before they reach the ISR
+    gpio_glitch_filter_handle_t key_filter;
+    gpio_pin_glitch_filter_config_t filter_conf = {};
+    filter_conf.clk_src = GLITCH_FILTER_CLK_SRC_DEFAULT;
+    filter_conf.gpio_num = static_cast<gpio_num_t>(KEY_GPIO);
+    ret = gpio_new_pin_glitch_filter(&filter_conf, &key_filter);
+    if(ret == ESP_OK) {
+        ret = gpio_glitch_filter_enable(key_filter);
+    }
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed enabling KEY glitch filter: %s", esp_err_to_name(ret));
+        return ret;
+    }
+#endif
+
+    // one-shot timer shared by debounce and long-press timing
+    esp_timer_create_args_t timer_args = {};
+    timer_args.callback = button_timer_cb;
+    timer_args.name = "button";
+    ret = esp_timer_create(&timer_args, &button_timer);
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed creating button timer: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    S1_prev = Gpio::get(S1_GPIO);
 
     //create a queue to handle gpio event from isr
-    gpio_evt_queue = xQueueCreate(10, sizeof(uint32_t));
+    gpio_evt_queue = gpio_evt_queue_mem.create();
+    health_watch_queue("gpio", gpio_evt_queue);
 
     // task to handle trigger queue
-    xTaskCreate(trigger_callback, "trigger_callback", 2048, NULL, 5, NULL);
+    if(trigger_task_mem.create(trigger_callback, "trigger_callback", NULL, TRIGGER_TASK_PRIO, CORE_CTRL) == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
 
-    //install gpio isr service
-    ret = gpio_install_isr_service(ESP_INTR_FLAG_DEFAULT);
+    //install gpio isr service, on the control core (task_layout.h)
+    esp_err_t ipc = call_on_core(CORE_CTRL, install_isr_service, &ret);
+    if(ipc != ESP_OK) {
+        ret = ipc;
+    }
     if(ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to install ISR service: %s", esp_err_to_name(ret));
         return ret;
     }
 
     //hook isr handler for specific gpio pin
+    /* levels armed by wake_arm() bring the chip out of light sleep */
+    ret = esp_sleep_enable_gpio_wakeup();
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed enabling GPIO wakeup: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
     ret = gpio_isr_handler_add(static_cast<gpio_num_t>(S1_GPIO), gpio_isr_handler, (void*)S1_GPIO);
     if(ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to add S1 to ISR handler: %s", esp_err_to_name(ret));
@@ -122,8 +377,18 @@ esp_err_t rotary_init() {
         return ret;
     }
 
-    prevButtonState = gpio_get_level(static_cast<gpio_num_t>(KEY_GPIO));
-
     return ESP_OK;
 }
 
+/**
+ * the display went dark (true) or lit up again (false). light sleep
+ * is only allowed while it is dark, so the pins must wake the chip.
+ */
+void rotary_sleep(bool asleep)
+{
+    if(gpio_evt_queue == NULL) {
+        return;
+    }
+    uint32_t evt = asleep ? SLEEP_EVT : AWAKE_EVT;
+    xQueueSend(gpio_evt_queue, &evt, portMAX_DELAY);
+}
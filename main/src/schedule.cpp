@@ -0,0 +1,94 @@
+#include <inttypes.h>
+#include <time.h>
+
+#include "schedule.h"
+#include "tz.h"
+
+time_t schedule_next_start(time_t now, uint8_t hour, uint8_t minute, uint8_t wday_bv)
+{
+    struct tm today;
+
+    if((wday_bv & 0x7F) == 0) {
+        return (time_t) -1;
+    }
+    tz_local(now, &today);
+    int32_t day0 = tz_days_from_civil(today.tm_year + 1900, today.tm_mon + 1, today.tm_mday);
+
+    /* today plus the next seven days covers every weekday once more */
+    for(int day = 0; day <= 7; day++) {
+        if(!(wday_bv & (1 << (today.tm_wday + day) % 7))) {
+            continue;
+        }
+        /* the first reading when clocks fall back, just past the change when they spring forward */
+        time_t start = tz_utc((int64_t) (day0 + day) * 86400 + hour * 3600 + minute * 60);
+        if(start > now) {
+            return start;
+        }
+    }
+    return (time_t) -1;
+}
+
+bool program_valid(const program_t *program, uint8_t zone_count)
+{
+    return program->zone < zone_count &&
+           program->hour < 24 &&
+           program->minute < 60 &&
+           (program->wday_bv & ~0x7F) == 0 &&
+           program->duration_sec > 0 &&
+           program->duration_sec <= PROGRAM_DURATION_MAX;
+}
+
+time_t program_next_start(const program_t *program, time_t now)
+{
+    if(!program->enabled) {
+        return (time_t) -1;
+    }
+    return schedule_next_start(now, program->hour, program->minute, program->wday_bv);
+}
+
+time_t programs_next_start(const program_t *programs, size_t count, uint32_t used,
+                           uint8_t zone, time_t now, uint16_t *duration_sec)
+{
+    time_t next = (time_t) -1;
+
+    for(size_t id = 0; id < count; id++) {
+        const program_t *program = &programs[id];
+        if(!(used & (1UL << id)) || program->zone != zone) {
+            continue;
+        }
+        time_t start = program_next_start(program, now);
+        if(start != (time_t) -1 && (next == (time_t) -1 || start < next)) {
+            next = start;
+            *duration_sec = program->duration_sec;
+        }
+    }
+    return next;
+}
+
+time_t schedule_step(zone_plan_t *plans, size_t count, time_t now, bool replan,
+                     zone_next_cb_t next_cb, zone_open_cb_t open_cb, void *ctx)
+{
+    time_t next = (time_t) -1;
+
+    for(size_t i = 0; i < count; i++) {
+        zone_plan_t *plan = &plans[i];
+        /* the clock was stepped past the start: it is skipped, and so is
+         * every other start the step jumped over. one still within the
+         * grace is found again and runs below */
+        if(plan->next_start != (time_t) -1 && now - plan->next_start > SCHEDULE_GRACE_S) {
+            plan->next_start = next_cb(ctx, i, now - SCHEDULE_GRACE_S - 1, &plan->next_duration);
+        }
+        /* a start that fell due just before a replan still runs,
+         * the replan only looks for starts after now */
+        if(plan->next_start != (time_t) -1 && now >= plan->next_start) {
+            open_cb(ctx, i, plan->next_duration);
+            plan->next_start = next_cb(ctx, i, now, &plan->next_duration);
+        } else if(replan) {
+            plan->next_start = next_cb(ctx, i, now, &plan->next_duration);
+        }
+        if(plan->next_start != (time_t) -1 && (next == (time_t) -1 || plan->next_start < next)) {
+            next = plan->next_start;
+        }
+    }
+    return next;
+}
@@ -1,48 +1,99 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <sys/time.h>
 #include "esp_log.h"
 #include "esp_sntp.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_err.h"
-#include "esp_netif_sntp.h"
+
+#include "sntp_setup.h"
 
 static const char *TAG = "SNTP";
 
-bool time_synced = false;
+/* offsets below this are slewed with adjtime so running timers never see
+ * a jump. the slew runs at a few percent, so this is kept to what it
+ * closes in a couple of minutes; anything larger is stepped, the
+ * scheduler skips or runs the starts the step crosses */
+#define SNTP_SLEW_LIMIT_US (2LL * 1000000)
+
+/* asked in order, lwIP moves to the next one when a server stays silent.
+ * needs CONFIG_LWIP_SNTP_MAX_SERVERS >= 3 */
+static const char *sntp_servers[] = {
+    "pool.ntp.org",
+    "time.google.com",
+    "time.cloudflare.com",
+};
 
-// callback function after sync
-static void time_sync_notification_cb(struct timeval *tv) 
+static sntp_result_cb_t s_result_cb = NULL;
+
+/**
+ * replaces the weak default in esp_sntp: decide between slewing and
+ * stepping ourselves so the offset can be measured before it is applied
+ */
+void sntp_sync_time(struct timeval *tv)
 {
-    ESP_LOGI(TAG,"Time synchronized");
-    time_synced = true;
+    struct timeval now;
+    struct timeval outstanding = {0};
+    /* the last slew not finished: this offset is partly its remainder */
+    bool settled = adjtime(NULL, &outstanding) != 0 || (outstanding.tv_sec == 0 && outstanding.tv_usec == 0);
+    gettimeofday(&now, NULL);
+
+    int64_t offset_us = (int64_t) (tv->tv_sec - now.tv_sec) * 1000000LL + (tv->tv_usec - now.tv_usec);
+    bool stepped = false;
+
+    if (llabs(offset_us) < SNTP_SLEW_LIMIT_US) {
+        struct timeval delta = {
+            .tv_sec = (time_t) (offset_us / 1000000LL),
+            .tv_usec = (suseconds_t) (offset_us % 1000000LL),
+        };
+        if (adjtime(&delta, NULL) != 0) {
+            stepped = true;
+        }
+    } else {
+        stepped = true;
+    }
+    if (stepped) {
+        settimeofday(tv, NULL);
+    }
+    /* as the smooth mode does: in progress until adjtime is done */
+    sntp_set_sync_status(stepped ? SNTP_SYNC_STATUS_COMPLETED : SNTP_SYNC_STATUS_IN_PROGRESS);
+
+    ESP_LOGI(TAG, "Time synchronized, offset %lld ms (%s%s)", (long long) (offset_us / 1000),
+             stepped ? "stepped" : "slewing", settled ? "" : ", last slew unfinished");
+    if (s_result_cb) {
+        s_result_cb(offset_us, stepped, settled);
+    }
 }
 
-void initialize_sntp()
+/**
+ * start (or restart) the client against every configured server.
+ * cb fires once per answer.
+ */
+void initialize_sntp(sntp_result_cb_t cb)
 {
+    s_result_cb = cb;
+    if (esp_sntp_enabled()) {
+        esp_sntp_stop();
+    }
     ESP_LOGI(TAG, "Initialize SNTP");
     esp_sntp_setoperatingmode(SNTP_OPMODE_POLL);
-    esp_sntp_setservername(0, "pool.ntp.org");
-    sntp_set_time_sync_notification_cb(time_sync_notification_cb);
+    /* sntp_sync_time below slews small offsets itself, this keeps the
+     * sync status reporting in step with it */
+    sntp_set_sync_mode(SNTP_SYNC_MODE_SMOOTH);
+    for (int i = 0; i < sizeof(sntp_servers) / sizeof(sntp_servers[0]); i++) {
+        esp_sntp_setservername(i, sntp_servers[i]);
+    }
     esp_sntp_init();
 }
 
-/*
-esp_err_t sync_time()
+/**
+ * stop polling. the radio is about to go down.
+ */
+void stop_sntp(void)
 {
-    esp_err_t ret;
-    initialize_sntp();
-
-    while(sntp_get_sync_status() == SNTP_SYNC_STATUS_RESET) {
-        ESP_LOGI(TAG, "Waiting for time to synchronize...");
-	    vTaskDelay(2000 / portTICK_PERIOD_MS);
+    if (esp_sntp_enabled()) {
+        esp_sntp_stop();
     }
-
-    if((ret = esp_netif_sntp_sync_wait(pdMS_TO_TICKS(10000))) != ESP_OK) {
-        ESP_LOGE(TAG, "Failed SNTP init-timeout: %s", esp_err_to_name(ret));
-        return ret;
-    }
-
-    return ESP_OK;
+    s_result_cb = NULL;
 }
-*/
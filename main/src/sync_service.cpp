@@ -0,0 +1,222 @@
+#include <inttypes.h>
+#include <stdlib.h>
+#include <time.h>
+#include <atomic>
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "sync_service.h"
+#include "event_bus.h"
+#include "valve_scheduler.h"
+#include "wake_stats.h"
+#include "telemetry.h"
+#include "ws_push.h"
+#include "wifi_setup.h"
+#include "sntp_setup.h"
+#include "trace.h"
+#include "task_layout.h"
+#include "static_rtos.h"
+
+static const char *TAG = "SYNC";
+
+/* wifi_connect needs more stack than the rest of the app's tasks */
+#define SYNC_TASK_STACK 4096
+static StaticTask<SYNC_TASK_STACK> sync_task_mem;
+
+#define SYNC_WIFI_TIMEOUT_MS 15000
+#define SYNC_NTP_TIMEOUT_MS  10000
+
+/* resync before the measured drift could put the clock this far off */
+#define SYNC_MAX_ERROR_US    2000000LL
+#define SYNC_FIRST_INTERVAL_S (24 * 3600)
+#define SYNC_MIN_INTERVAL_S   3600
+#define SYNC_MAX_INTERVAL_S   (7 * 24 * 3600)
+
+#define REQUEST_BIT BIT0
+#define RESULT_BIT  BIT1
+
+static TaskHandle_t sync_task_handle = NULL;
+static DS3231_RTC *sync_rtc = NULL;
+static std::atomic<bool> busy{false};
+
+/* written by the lwIP task before RESULT_BIT is given */
+static int64_t result_offset_us;
+static bool result_stepped;
+static bool result_settled;
+
+/* esp_timer time of the last sync that measured (not stepped) the clock */
+static int64_t last_sync_us = 0;
+static uint32_t interval_s = SYNC_FIRST_INTERVAL_S;
+
+static void publish(sync_stage_t stage, int32_t offset_ms = 0)
+{
+    event_t evt = {};
+    evt.type = EVT_SYNC;
+    evt.timestamp_us = esp_timer_get_time();
+    evt.sync.stage = stage;
+    evt.sync.offset_ms = offset_ms;
+    evt.sync.next_s = interval_s;
+    TRACE(TRACE_SYNC, stage, offset_ms);
+    if(!sync_bus.publish(evt)) {
+        ESP_LOGW(TAG, "Sync bus full, stage %d dropped", stage);
+    }
+}
+
+/**
+ * runs in the lwIP task
+ */
+static void sntp_result(int64_t offset_us, bool stepped, bool settled)
+{
+    result_offset_us = offset_us;
+    result_stepped = stepped;
+    result_settled = settled;
+    xTaskNotify(sync_task_handle, RESULT_BIT, eSetBits);
+}
+
+/**
+ * space syncs so the drift since the last one stays under
+ * SYNC_MAX_ERROR_US. offset_us / elapsed_s is the drift in ppm. an
+ * offset measured while a slew was still running is not a sample.
+ */
+static void adapt_interval(int64_t offset_us, bool stepped, bool settled)
+{
+    int64_t now_us = esp_timer_get_time();
+
+    if(stepped || !settled || last_sync_us == 0) {
+        /* nothing to measure against: look again soon */
+        interval_s = stepped || !settled ? SYNC_MIN_INTERVAL_S : SYNC_FIRST_INTERVAL_S;
+    } else {
+        int64_t elapsed_s = (now_us - last_sync_us) / 1000000;
+        int64_t abs_offset_us = llabs(offset_us);
+        int64_t next_s = SYNC_MAX_INTERVAL_S;
+        if(abs_offset_us > 0 && elapsed_s > 0) {
+            next_s = SYNC_MAX_ERROR_US * elapsed_s / abs_offset_us;
+        }
+        if(next_s < SYNC_MIN_INTERVAL_S) {
+            next_s = SYNC_MIN_INTERVAL_S;
+        } else if(next_s > SYNC_MAX_INTERVAL_S) {
+            next_s = SYNC_MAX_INTERVAL_S;
+        }
+        ESP_LOGI(TAG, "Drift %.2f ppm over %lld s", elapsed_s ? (double) abs_offset_us / elapsed_s : 0.0,
+                 (long long) elapsed_s);
+        interval_s = (uint32_t) next_s;
+    }
+    last_sync_us = now_us;
+}
+
+/**
+ * one sync: radio up, ask NTP, radio down.
+ * SNTP corrects the clock itself (see sntp_sync_time), this only
+ * waits for the answer and carries the result to the RTC.
+ */
+static bool sync_once()
+{
+    esp_err_t ret;
+    uint32_t bits = 0;
+
+    publish(SYNC_CONNECTING);
+    ret = wifi_connect(pdMS_TO_TICKS(SYNC_WIFI_TIMEOUT_MS));
+    if(ret != ESP_OK) {
+        ESP_LOGW(TAG, "No wifi for sync: %s", esp_err_to_name(ret));
+        return false;
+    }
+
+    publish(SYNC_QUERYING);
+    ulTaskNotifyValueClear(NULL, RESULT_BIT);
+    initialize_sntp(sntp_result);
+
+    TickType_t start = xTaskGetTickCount();
+    TickType_t timeout = pdMS_TO_TICKS(SYNC_NTP_TIMEOUT_MS);
+    while(!(bits & RESULT_BIT)) {
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if(elapsed >= timeout) {
+            break;
+        }
+        /* a request during the sync stays latched for afterwards */
+        uint32_t got = 0;
+        xTaskNotifyWait(0, RESULT_BIT, &got, timeout - elapsed);
+        bits |= got;
+    }
+    stop_sntp();
+    wifi_disconnect();
+
+    if(!(bits & RESULT_BIT)) {
+        ESP_LOGW(TAG, "No NTP answer within %d ms", SYNC_NTP_TIMEOUT_MS);
+        return false;
+    }
+
+    /* the RTC keeps UTC. a slew still in progress is under a second
+     * per minute, well inside what the RTC's whole seconds can show */
+    struct tm utc;
+    time_t t = time(NULL) + (time_t) (result_stepped ? 0 : result_offset_us / 1000000);
+    gmtime_r(&t, &utc);
+    ret = sync_rtc->setTime(&utc);
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed writing RTC: %s", esp_err_to_name(ret));
+    }
+    valve_scheduler_reschedule();
+
+    adapt_interval(result_offset_us, result_stepped, result_settled);
+    return true;
+}
+
+static void sync_task(void* arg)
+{
+    uint32_t bits;
+
+    for(;;) {
+        /* a request made during the last sync was taken by its wait for
+         * RESULT_BIT: still in the value but no longer pending */
+        if(!(ulTaskNotifyValueClear(NULL, REQUEST_BIT) & REQUEST_BIT)) {
+            bits = 0;
+            BaseType_t notified = xTaskNotifyWait(0, REQUEST_BIT, &bits,
+                                                  pdMS_TO_TICKS((uint64_t) interval_s * 1000));
+            wake_stats_record(WAKE_SYNC);
+            if(notified == pdTRUE && !(bits & REQUEST_BIT)) {
+                continue; // a late RESULT_BIT from a sync that timed out
+            }
+        }
+
+        busy.store(true);
+        if(sync_once()) {
+            publish(SYNC_DONE, (int32_t) (result_offset_us / 1000));
+            telemetry_record(TLM_SYNC_OK, TELEMETRY_NO_ZONE, (int32_t) (result_offset_us / 1000));
+            ws_push_set(WS_KEY_SYNC, (int32_t) (result_offset_us / 1000));
+            ESP_LOGI(TAG, "Next sync in %" PRIu32 " s", interval_s);
+        } else {
+            interval_s = SYNC_MIN_INTERVAL_S;
+            publish(SYNC_FAILED);
+            telemetry_record(TLM_SYNC_FAIL, TELEMETRY_NO_ZONE, 0);
+            ws_push_set(WS_KEY_SYNC, WS_SYNC_FAILED);
+        }
+        busy.store(false);
+    }
+}
+
+/*******************************public*********************************/
+
+esp_err_t sync_service_init(DS3231_RTC *rtc)
+{
+    sync_rtc = rtc;
+    sync_task_handle = sync_task_mem.create(sync_task, "sync_task", NULL, SYNC_TASK_PRIO, CORE_NET);
+    if(sync_task_handle == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void sync_service_request()
+{
+    if(sync_task_handle == NULL) {
+        return;
+    }
+    xTaskNotify(sync_task_handle, REQUEST_BIT, eSetBits);
+}
+
+bool sync_service_busy()
+{
+    return busy.load();
+}
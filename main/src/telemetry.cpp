@@ -0,0 +1,461 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "nvs.h"
+#include "mqtt_client.h"
+
+#include "telemetry.h"
+#include "wake_stats.h"
+#include "wifi_setup.h"
+#include "task_layout.h"
+#include "static_rtos.h"
+
+static const char *TAG = "TELEMETRY";
+
+#define TELEMETRY_RING_DEPTH    64
+/* above this the task sends (radio already up) or spills a batch */
+#define TELEMETRY_SPILL_AT      48
+#define TELEMETRY_BATCH         32
+#define TELEMETRY_FLASH_BATCHES 16
+#define TELEMETRY_PAYLOAD_MAX   (TELEMETRY_BATCH * 40 + 32)
+#define TELEMETRY_TEMP_PERIOD_S (15 * 60)
+
+#define TELEMETRY_WIFI_TIMEOUT_MS 15000
+#define TELEMETRY_MQTT_TIMEOUT_MS 10000
+#define TELEMETRY_ACK_TIMEOUT_MS  5000
+#define TELEMETRY_TASK_STACK      4096
+
+#define TELEMETRY_NVS_NAMESPACE "telemetry"
+#define TELEMETRY_NVS_META      "meta"
+
+/* task notification bits */
+#define FILL_BIT      BIT0 // ring crossed TELEMETRY_SPILL_AT
+#define CONNECTED_BIT BIT1
+#define ACKED_BIT     BIT2
+#define FAILED_BIT    BIT3
+
+/**
+ * RAM ring. any task pushes, only the telemetry task removes, so a
+ * batch can be peeked, sent and dropped only once acknowledged.
+ */
+static telemetry_record_t ring[TELEMETRY_RING_DEPTH];
+static uint16_t ring_head = 0; // oldest
+static uint16_t ring_count = 0;
+static portMUX_TYPE ring_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* flash overflow: batches keyed b<seq>, seq in [head, tail) */
+typedef struct {
+    uint32_t head;
+    uint32_t tail;
+} overflow_meta_t;
+
+static overflow_meta_t overflow;
+static telemetry_stats_t stats;
+
+static TaskHandle_t telemetry_task_handle = NULL;
+static esp_mqtt_client_handle_t client = NULL;
+static DS3231_RTC *telemetry_rtc = NULL;
+static char topic[64];
+/* the last PUBACK, set by the MQTT task. it can come before
+ * esp_mqtt_client_publish() has even returned the id */
+static std::atomic<int> acked_msg_id{-1};
+
+/*******************************RAM ring*********************************/
+
+static uint16_t ring_peek(telemetry_record_t *out, uint16_t max)
+{
+    portENTER_CRITICAL(&ring_lock);
+    uint16_t n = ring_count < max ? ring_count : max;
+    for(uint16_t i = 0; i < n; i++) {
+        out[i] = ring[(ring_head + i) % TELEMETRY_RING_DEPTH];
+    }
+    portEXIT_CRITICAL(&ring_lock);
+    return n;
+}
+
+static void ring_drop(uint16_t n)
+{
+    portENTER_CRITICAL(&ring_lock);
+    ring_head = (ring_head + n) % TELEMETRY_RING_DEPTH;
+    ring_count -= n;
+    portEXIT_CRITICAL(&ring_lock);
+}
+
+static uint16_t ring_size()
+{
+    portENTER_CRITICAL(&ring_lock);
+    uint16_t n = ring_count;
+    portEXIT_CRITICAL(&ring_lock);
+    return n;
+}
+
+/*******************************flash overflow*********************************/
+
+static void overflow_key(char *key, uint32_t seq)
+{
+    snprintf(key, 12, "b%" PRIu32, seq);
+}
+
+static esp_err_t overflow_save_meta(nvs_handle_t nvs)
+{
+    esp_err_t ret = nvs_set_blob(nvs, TELEMETRY_NVS_META, &overflow, sizeof(overflow));
+    if(ret == ESP_OK) {
+        ret = nvs_commit(nvs);
+    }
+    return ret;
+}
+
+static void overflow_load()
+{
+    nvs_handle_t nvs;
+    size_t len = sizeof(overflow);
+
+    memset(&overflow, 0, sizeof(overflow));
+    if(nvs_open(TELEMETRY_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return;
+    }
+    if(nvs_get_blob(nvs, TELEMETRY_NVS_META, &overflow, &len) != ESP_OK || len != sizeof(overflow) ||
+       overflow.tail - overflow.head > TELEMETRY_FLASH_BATCHES) {
+        memset(&overflow, 0, sizeof(overflow));
+    }
+    nvs_close(nvs);
+}
+
+/* drop the oldest RAM batch unsent, flash could not take it */
+static void ring_discard(uint16_t n)
+{
+    ring_drop(n);
+    portENTER_CRITICAL(&ring_lock);
+    stats.dropped += n;
+    portEXIT_CRITICAL(&ring_lock);
+}
+
+/**
+ * move the oldest RAM batch to flash. evicts the oldest flash batch
+ * when the overflow is full: the newest data is the most useful. if
+ * flash cannot take it (NVS full or not there) the batch is dropped
+ * and false returned, so the caller does not spin on it.
+ */
+static bool overflow_spill()
+{
+    telemetry_record_t batch[TELEMETRY_BATCH];
+    nvs_handle_t nvs;
+    char key[12];
+
+    uint16_t n = ring_peek(batch, TELEMETRY_BATCH);
+    if(n == 0) {
+        return false;
+    }
+    esp_err_t ret = nvs_open(TELEMETRY_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed spilling batch, %u records dropped: %s", n, esp_err_to_name(ret));
+        ring_discard(n);
+        return false;
+    }
+    if(overflow.tail - overflow.head >= TELEMETRY_FLASH_BATCHES) {
+        size_t len = 0;
+        overflow_key(key, overflow.head);
+        nvs_get_blob(nvs, key, NULL, &len);
+        stats.dropped += len / sizeof(telemetry_record_t);
+        nvs_erase_key(nvs, key);
+        overflow.head++;
+    }
+    overflow_key(key, overflow.tail);
+    ret = nvs_set_blob(nvs, key, batch, n * sizeof(telemetry_record_t));
+    if(ret == ESP_OK) {
+        overflow.tail++;
+        ret = overflow_save_meta(nvs);
+    }
+    nvs_close(nvs);
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed spilling batch, %u records dropped: %s", n, esp_err_to_name(ret));
+        ring_discard(n);
+        return false;
+    }
+    ring_drop(n);
+    stats.spilled += n;
+    ESP_LOGI(TAG, "Spilled %u records, %" PRIu32 " batches in flash", n, overflow.tail - overflow.head);
+    return true;
+}
+
+static uint16_t overflow_peek(telemetry_record_t *batch)
+{
+    nvs_handle_t nvs;
+    char key[12];
+    size_t len = TELEMETRY_BATCH * sizeof(telemetry_record_t);
+
+    if(overflow.head == overflow.tail || nvs_open(TELEMETRY_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return 0;
+    }
+    overflow_key(key, overflow.head);
+    esp_err_t ret = nvs_get_blob(nvs, key, batch, &len);
+    nvs_close(nvs);
+    return ret == ESP_OK ? len / sizeof(telemetry_record_t) : 0;
+}
+
+/* drop the oldest flash batch, sent or unreadable */
+static void overflow_drop()
+{
+    nvs_handle_t nvs;
+    char key[12];
+
+    if(nvs_open(TELEMETRY_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        return;
+    }
+    overflow_key(key, overflow.head);
+    nvs_erase_key(nvs, key);
+    overflow.head++;
+    overflow_save_meta(nvs);
+    nvs_close(nvs);
+}
+
+/*******************************MQTT*********************************/
+
+static void mqtt_event_handler(void *arg, esp_event_base_t base, int32_t event_id, void *event_data)
+{
+    esp_mqtt_event_handle_t event = static_cast<esp_mqtt_event_handle_t>(event_data);
+
+    switch(static_cast<esp_mqtt_event_id_t>(event_id)) {
+        case MQTT_EVENT_CONNECTED:
+            xTaskNotify(telemetry_task_handle, CONNECTED_BIT, eSetBits);
+            break;
+        case MQTT_EVENT_PUBLISHED:
+            acked_msg_id.store(event->msg_id);
+            xTaskNotify(telemetry_task_handle, ACKED_BIT, eSetBits);
+            break;
+        case MQTT_EVENT_DISCONNECTED:
+        case MQTT_EVENT_ERROR:
+            xTaskNotify(telemetry_task_handle, FAILED_BIT, eSetBits);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * wait for any of want, keeping FILL_BIT for the main loop.
+ * returns the bits seen, 0 on timeout.
+ */
+static uint32_t wait_bits(uint32_t want, uint32_t timeout_ms)
+{
+    TickType_t start = xTaskGetTickCount();
+    TickType_t timeout = pdMS_TO_TICKS(timeout_ms);
+    uint32_t seen = 0;
+
+    while(!(seen & want)) {
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if(elapsed >= timeout) {
+            return 0;
+        }
+        uint32_t bits = 0;
+        xTaskNotifyWait(0, want, &bits, timeout - elapsed);
+        seen |= bits;
+    }
+    return seen;
+}
+
+/**
+ * {"t0":<epoch>,"r":[[dt,type,zone,value],...]} with times relative
+ * to the first record, zone -1 if none
+ */
+static int format_batch(char *buf, size_t size, const telemetry_record_t *batch, uint16_t n)
+{
+    int len = snprintf(buf, size, "{\"t0\":%" PRIu32 ",\"r\":[", batch[0].time);
+    for(uint16_t i = 0; i < n && len < (int) size; i++) {
+        const telemetry_record_t *r = &batch[i];
+        len += snprintf(buf + len, size - len, "%s[%" PRIu32 ",%u,%d,%" PRId32 "]", i ? "," : "",
+                        r->time - batch[0].time, r->type, r->zone == TELEMETRY_NO_ZONE ? -1 : r->zone, r->value);
+    }
+    len += snprintf(buf + len, size - len, "]}");
+    return len < (int) size ? len : -1;
+}
+
+/**
+ * publish one batch at QoS 1 and wait for its PUBACK
+ */
+static bool publish_batch(const telemetry_record_t *batch, uint16_t n)
+{
+    static char payload[TELEMETRY_PAYLOAD_MAX];
+
+    int len = format_batch(payload, sizeof(payload), batch, n);
+    if(len < 0) {
+        return false;
+    }
+    ulTaskNotifyValueClear(NULL, ACKED_BIT | FAILED_BIT);
+    int msg_id = esp_mqtt_client_publish(client, topic, payload, len, 1, 0);
+    if(msg_id < 0) {
+        return false;
+    }
+    /* an ack already in counts; one for an older id waits on */
+    int64_t deadline_us = esp_timer_get_time() + TELEMETRY_ACK_TIMEOUT_MS * 1000LL;
+    while(acked_msg_id.load() != msg_id) {
+        int64_t left_ms = (deadline_us - esp_timer_get_time()) / 1000;
+        if(left_ms <= 0 || !(wait_bits(ACKED_BIT | FAILED_BIT, left_ms) & ACKED_BIT)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * one radio burst: connect, send flash batches oldest first, then the
+ * RAM ring, disconnect. anything not acknowledged stays queued.
+ */
+static void flush()
+{
+    telemetry_record_t batch[TELEMETRY_BATCH];
+    uint16_t n;
+
+    if(ring_size() == 0 && overflow.head == overflow.tail) {
+        return;
+    }
+    if(wifi_connect(pdMS_TO_TICKS(TELEMETRY_WIFI_TIMEOUT_MS)) != ESP_OK) {
+        ESP_LOGW(TAG, "No wifi, %u records wait", ring_size());
+        return;
+    }
+    stats.flushes++;
+    int64_t start = esp_timer_get_time();
+
+    ulTaskNotifyValueClear(NULL, CONNECTED_BIT | FAILED_BIT);
+    esp_mqtt_client_start(client);
+    if(wait_bits(CONNECTED_BIT | FAILED_BIT, TELEMETRY_MQTT_TIMEOUT_MS) & CONNECTED_BIT) {
+        bool ok = true;
+        while(ok && (n = overflow_peek(batch)) > 0) {
+            ok = publish_batch(batch, n);
+            if(ok) {
+                overflow_drop();
+                stats.sent += n;
+            }
+        }
+        if(ok && overflow.head != overflow.tail && overflow_peek(batch) == 0) {
+            overflow_drop(); // unreadable, don't let it block the queue
+        }
+        while(ok && (n = ring_peek(batch, TELEMETRY_BATCH)) > 0) {
+            ok = publish_batch(batch, n);
+            if(ok) {
+                ring_drop(n);
+                stats.sent += n;
+            }
+        }
+    } else {
+        ESP_LOGW(TAG, "Broker unreachable");
+    }
+    esp_mqtt_client_stop(client);
+    wifi_disconnect();
+    ESP_LOGI(TAG, "Flush took %lld ms, %" PRIu32 " records sent since boot",
+             (long long) ((esp_timer_get_time() - start) / 1000), stats.sent);
+}
+
+static void telemetry_task(void* arg)
+{
+    int64_t next_flush_us = esp_timer_get_time() + CONFIG_IRRIGATION_MQTT_FLUSH_S * 1000000LL;
+    int64_t next_temp_us = esp_timer_get_time();
+
+    for(;;) {
+        int64_t now = esp_timer_get_time();
+
+        if(now >= next_temp_us) {
+            int16_t temp;
+            if(telemetry_rtc->getTemperature(&temp) == ESP_OK) {
+                telemetry_record(TLM_TEMPERATURE, TELEMETRY_NO_ZONE, temp);
+            }
+            next_temp_us = now + TELEMETRY_TEMP_PERIOD_S * 1000000LL;
+        }
+        if(now >= next_flush_us) {
+            flush();
+            next_flush_us = esp_timer_get_time() + CONFIG_IRRIGATION_MQTT_FLUSH_S * 1000000LL;
+        }
+        while(ring_size() >= TELEMETRY_SPILL_AT) {
+            if(wifi_is_connected()) {
+                flush(); // someone else has the radio up, ride along
+                break;
+            }
+            if(!overflow_spill()) {
+                break;
+            }
+        }
+
+        int64_t next = next_flush_us < next_temp_us ? next_flush_us : next_temp_us;
+        int64_t wait_ms = (next - esp_timer_get_time()) / 1000;
+        xTaskNotifyWait(0, FILL_BIT, NULL, wait_ms > 0 ? pdMS_TO_TICKS(wait_ms) + 1 : 0);
+        wake_stats_record(WAKE_TELEMETRY);
+    }
+}
+
+/*******************************public*********************************/
+
+bool telemetry_record(telemetry_type_t type, uint8_t zone, int32_t value)
+{
+    telemetry_record_t record = {};
+    bool full;
+    uint16_t count;
+
+    record.time = (uint32_t) time(NULL);
+    record.value = value;
+    record.type = type;
+    record.zone = zone;
+
+    portENTER_CRITICAL(&ring_lock);
+    full = ring_count == TELEMETRY_RING_DEPTH;
+    if(full) {
+        stats.dropped++;
+    } else {
+        ring[(ring_head + ring_count) % TELEMETRY_RING_DEPTH] = record;
+        ring_count++;
+        stats.recorded++;
+    }
+    count = ring_count;
+    portEXIT_CRITICAL(&ring_lock);
+
+    if(count == TELEMETRY_SPILL_AT && telemetry_task_handle != NULL) {
+        xTaskNotify(telemetry_task_handle, FILL_BIT, eSetBits);
+    }
+    return !full;
+}
+
+void telemetry_get_stats(telemetry_stats_t *out)
+{
+    *out = stats;
+    out->queued = ring_size();
+    out->batches = overflow.tail - overflow.head;
+}
+
+esp_err_t telemetry_init(DS3231_RTC *rtc)
+{
+    uint8_t mac[6];
+
+    telemetry_rtc = rtc;
+    overflow_load();
+
+    esp_efuse_mac_get_default(mac);
+    snprintf(topic, sizeof(topic), "%s/%02x%02x%02x%02x%02x%02x", CONFIG_IRRIGATION_MQTT_TOPIC,
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+
+    esp_mqtt_client_config_t config = {};
+    config.broker.address.uri = CONFIG_IRRIGATION_MQTT_URI;
+    /* the burst ends the connection, not a lost broker */
+    config.network.disable_auto_reconnect = true;
+    config.buffer.out_size = TELEMETRY_PAYLOAD_MAX + 64;
+    client = esp_mqtt_client_init(&config);
+    if(client == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_mqtt_client_register_event(client, MQTT_EVENT_ANY, mqtt_event_handler, NULL);
+
+    static StaticTask<TELEMETRY_TASK_STACK> telemetry_task_mem;
+    telemetry_task_handle = telemetry_task_mem.create(telemetry_task, "telemetry", NULL, TELEMETRY_TASK_PRIO, CORE_NET);
+    if(telemetry_task_handle == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Publishing to %s on %s, %" PRIu32 " batches waiting in flash", topic,
+             CONFIG_IRRIGATION_MQTT_URI, overflow.tail - overflow.head);
+    return ESP_OK;
+}
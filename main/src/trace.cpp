@@ -0,0 +1,120 @@
+#include <atomic>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
+#include "esp_attr.h"
+#include "esp_console.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "trace.h"
+
+#if CONFIG_IRRIGATION_TRACE
+
+#define TRACE_RECORDS CONFIG_IRRIGATION_TRACE_RECORDS
+static_assert((TRACE_RECORDS & (TRACE_RECORDS - 1)) == 0, "trace ring size must be a power of two");
+
+/* dump format, bumped whenever trace_record_t or the ids change meaning */
+#define TRACE_FORMAT 1
+
+static trace_record_t ring[TRACE_RECORDS];
+static std::atomic<uint32_t> head{0};
+static std::atomic<bool> paused{false};
+
+/**
+ * one atomic add to claim the slot, the sequence number stored last
+ * with release order so a reader that sees it sees the whole record
+ */
+void IRAM_ATTR trace_record(trace_id_t id, uint16_t a, uint32_t b)
+{
+    if(paused.load(std::memory_order_relaxed)) {
+        return;
+    }
+    uint32_t time_us = esp_timer_get_time();
+    uint32_t index = head.fetch_add(1, std::memory_order_relaxed);
+    trace_record_t &r = ring[index & (TRACE_RECORDS - 1)];
+
+    __atomic_store_n(&r.seq, 0, __ATOMIC_RELAXED);
+    r.time_us = time_us;
+    r.id = id;
+    r.core = esp_cpu_get_core_id();
+    r.a = a;
+    r.b = b;
+    __atomic_store_n(&r.seq, index + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * the ring oldest first, one record per line. recording is paused
+ * meanwhile so the dump neither traces itself nor races the writers,
+ * and a slot whose sequence does not match was torn and is skipped.
+ */
+static void trace_dump()
+{
+    paused.store(true, std::memory_order_relaxed);
+    vTaskDelay(1); // let a writer that got past the check finish
+
+    uint32_t end = head.load(std::memory_order_acquire);
+    uint32_t start = end > TRACE_RECORDS ? end - TRACE_RECORDS : 0;
+    uint32_t torn = 0;
+
+    printf("TRACE BEGIN %d %" PRIu32 " %" PRIu32 "\n", TRACE_FORMAT, start, end - start);
+    for(uint32_t i = start; i < end; i++) {
+        trace_record_t r = ring[i & (TRACE_RECORDS - 1)];
+        if(__atomic_load_n(&ring[i & (TRACE_RECORDS - 1)].seq, __ATOMIC_ACQUIRE) != i + 1 || r.seq != i + 1) {
+            torn++;
+            continue;
+        }
+        const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&r);
+        for(size_t k = 0; k < sizeof(r); k++) {
+            printf("%02x", bytes[k]);
+        }
+        putchar('\n');
+    }
+    printf("TRACE END %" PRIu32 "\n", torn);
+    paused.store(false, std::memory_order_relaxed);
+}
+
+static int trace_command(int argc, char **argv)
+{
+    if(argc > 1 && strcmp(argv[1], "dump") == 0) {
+        trace_dump();
+    } else if(argc > 1 && strcmp(argv[1], "clear") == 0) {
+        paused.store(true, std::memory_order_relaxed);
+        vTaskDelay(1);
+        memset(ring, 0, sizeof(ring));
+        head.store(0, std::memory_order_release);
+        paused.store(false, std::memory_order_relaxed);
+    } else {
+        uint32_t written = head.load(std::memory_order_relaxed);
+        printf("%" PRIu32 " records written, ring holds %d (%u bytes)\n", written, TRACE_RECORDS,
+               (unsigned) sizeof(ring));
+    }
+    return 0;
+}
+
+/*******************************public*********************************/
+
+esp_err_t trace_register_command()
+{
+    const esp_console_cmd_t cmd = {
+        .command = "trace",
+        .help = "event trace: 'trace dump' prints the ring for tools/trace_to_perfetto.py, 'trace clear' empties it",
+        .hint = "[dump|clear]",
+        .func = trace_command,
+        .argtable = NULL,
+    };
+    return esp_console_cmd_register(&cmd);
+}
+
+#else
+
+esp_err_t trace_register_command()
+{
+    return ESP_OK;
+}
+
+#endif
@@ -0,0 +1,436 @@
+#include <atomic>
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tz.h"
+
+#define TZ_DAY_S (24 * 3600)
+/* a change without /time happens at 02:00 */
+#define TZ_CHANGE_TIME_DEFAULT (2 * 3600)
+/* POSIX allows -167..167 hours for a change time */
+#define TZ_CHANGE_HOURS_MAX 167
+
+/**
+ * what a conversion needs. published through a ring of slots: a writer
+ * fills a slot nobody is told about yet, then points current at it, so
+ * a reader only retries if the slot it copies is reused under it,
+ * which takes TZ_SLOTS more writes. readers never wait on a writer.
+ */
+typedef struct {
+    tz_rule_t rule;
+    tz_year_t year;
+} tz_cache_t;
+
+typedef struct {
+    tz_cache_t cache;
+    char spec[TZ_SPEC_MAX + 1];
+} tz_slot_t;
+
+#define TZ_SLOTS 4
+
+/* slot 0 before tz_set(): UTC for all time */
+static tz_slot_t slots[TZ_SLOTS] = {
+    {{{0, 0, false, {}, {}}, {INT64_MIN, INT64_MAX, 0, 0, 0, 0}}, "UTC0"},
+};
+static std::atomic<uint32_t> slot_seq[TZ_SLOTS]; // odd while being written
+static std::atomic<uint32_t> claimed{0};         // writes begun
+static std::atomic<uint32_t> current{0};         // the write readers use
+
+/*******************************dates*********************************/
+
+static int64_t floor_div(int64_t a, int64_t b)
+{
+    return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+static bool is_leap(int year)
+{
+    return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+static int month_days(int year, int month)
+{
+    static const uint8_t days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    return month == 2 && is_leap(year) ? 29 : days[month - 1];
+}
+
+/* Howard Hinnant's days_from_civil, valid for any Gregorian date */
+int32_t tz_days_from_civil(int year, int month, int mday)
+{
+    year -= month <= 2;
+    int era = (year >= 0 ? year : year - 399) / 400;
+    int yoe = year - era * 400;
+    int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + mday - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+void tz_civil_from_days(int32_t days, int *year, int *month, int *mday)
+{
+    int32_t z = days + 719468;
+    int era = (z >= 0 ? z : z - 146096) / 146097;
+    int doe = z - era * 146097;
+    int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int mp = (5 * doy + 2) / 153;
+    *mday = doy - (153 * mp + 2) / 5 + 1;
+    *month = mp < 10 ? mp + 3 : mp - 9;
+    *year = yoe + era * 400 + (*month <= 2);
+}
+
+time_t tz_timegm(const struct tm *tm)
+{
+    /* normalise the month so mday, hour and the rest may overflow */
+    int year = tm->tm_year + 1900 + (int) floor_div(tm->tm_mon, 12);
+    int month = (int) (tm->tm_mon - floor_div(tm->tm_mon, 12) * 12) + 1;
+    int64_t days = tz_days_from_civil(year, month, 1) + tm->tm_mday - 1;
+    return days * TZ_DAY_S + tm->tm_hour * 3600 + tm->tm_min * 60 + tm->tm_sec;
+}
+
+/*******************************parsing*********************************/
+
+/* a zone name: alphabetic, or anything but '>' between <> */
+static const char *parse_name(const char *p)
+{
+    const char *start = p;
+    if(*p == '<') {
+        /* no more than POSIX allows: the spec is echoed into JSON as is */
+        while(*++p != '>') {
+            if(!isalnum((unsigned char) *p) && *p != '+' && *p != '-') {
+                return NULL;
+            }
+        }
+        return p - start >= 4 ? p + 1 : NULL;
+    }
+    while((*p >= 'A' && *p <= 'Z') || (*p >= 'a' && *p <= 'z')) {
+        p++;
+    }
+    return p - start >= 3 ? p : NULL;
+}
+
+/* [+-]hh[:mm[:ss]] as seconds */
+static const char *parse_time(const char *p, int max_hours, int32_t *out)
+{
+    int sign = 1;
+    if(*p == '+' || *p == '-') {
+        sign = *p++ == '-' ? -1 : 1;
+    }
+    if(*p < '0' || *p > '9') {
+        return NULL;
+    }
+    char *end;
+    long hours = strtol(p, &end, 10);
+    if(hours > max_hours) {
+        return NULL;
+    }
+    int32_t seconds = hours * 3600;
+    p = end;
+    for(int32_t unit = 60; unit >= 1 && *p == ':'; unit /= 60) {
+        if(p[1] < '0' || p[1] > '9') {
+            return NULL;
+        }
+        long v = strtol(p + 1, &end, 10);
+        if(v > 59) {
+            return NULL;
+        }
+        seconds += v * unit;
+        p = end;
+    }
+    *out = sign * seconds;
+    return p;
+}
+
+static const char *parse_number(const char *p, long min, long max, long *out)
+{
+    if(*p < '0' || *p > '9') {
+        return NULL;
+    }
+    char *end;
+    *out = strtol(p, &end, 10);
+    return *out >= min && *out <= max ? end : NULL;
+}
+
+/* Mm.w.d, Jn or n, then an optional /time */
+static const char *parse_change(const char *p, tz_change_t *change)
+{
+    long v;
+    *change = {};
+    if(*p == 'M') {
+        change->kind = TZ_MONTH_WEEK_DAY;
+        if(!(p = parse_number(p + 1, 1, 12, &v)) || *p != '.') {
+            return NULL;
+        }
+        change->month = v;
+        if(!(p = parse_number(p + 1, 1, 5, &v)) || *p != '.') {
+            return NULL;
+        }
+        change->week = v;
+        if(!(p = parse_number(p + 1, 0, 6, &v))) {
+            return NULL;
+        }
+        change->wday = v;
+    } else if(*p == 'J') {
+        change->kind = TZ_JULIAN;
+        if(!(p = parse_number(p + 1, 1, 365, &v))) {
+            return NULL;
+        }
+        change->day = v;
+    } else {
+        change->kind = TZ_DAY_OF_YEAR;
+        if(!(p = parse_number(p, 0, 365, &v))) {
+            return NULL;
+        }
+        change->day = v;
+    }
+    change->time = TZ_CHANGE_TIME_DEFAULT;
+    if(*p == '/') {
+        p = parse_time(p + 1, TZ_CHANGE_HOURS_MAX, &change->time);
+    }
+    return p;
+}
+
+bool tz_parse(const char *spec, tz_rule_t *rule)
+{
+    const char *p = spec;
+    int32_t posix;
+
+    *rule = {};
+    if(strlen(spec) > TZ_SPEC_MAX || !(p = parse_name(p)) || !(p = parse_time(p, 24, &posix))) {
+        return false;
+    }
+    /* POSIX counts west of UTC as positive */
+    rule->std_offset = -posix;
+    rule->dst_offset = rule->std_offset;
+    if(*p == '\0') {
+        return true;
+    }
+    if(!(p = parse_name(p))) {
+        return false;
+    }
+    rule->dst = true;
+    rule->dst_offset = rule->std_offset + 3600;
+    if(*p != ',' && *p != '\0') {
+        if(!(p = parse_time(p, 24, &posix))) {
+            return false;
+        }
+        rule->dst_offset = -posix;
+    }
+    if(*p == '\0') {
+        /* no rules given: the US ones, as newlib assumes */
+        p = ",M3.2.0,M11.1.0";
+    }
+    if(*p != ',' || !(p = parse_change(p + 1, &rule->start)) || *p != ',' ||
+       !(p = parse_change(p + 1, &rule->end))) {
+        return false;
+    }
+    return *p == '\0';
+}
+
+/*******************************years*********************************/
+
+/* local seconds since 1970 at which change happens in year */
+static int64_t change_local(const tz_change_t *change, int year)
+{
+    int32_t days;
+
+    switch(change->kind) {
+        case TZ_MONTH_WEEK_DAY: {
+            int32_t first = tz_days_from_civil(year, change->month, 1);
+            int first_wday = (int) (((first + 4) % 7 + 7) % 7); // 1970-01-01 was a Thursday
+            int mday = 1 + (change->wday - first_wday + 7) % 7 + (change->week - 1) * 7;
+            while(mday > month_days(year, change->month)) {
+                mday -= 7; // week 5: the last one
+            }
+            days = first + mday - 1;
+            break;
+        }
+        case TZ_JULIAN:
+            days = tz_days_from_civil(year, 1, 1) + change->day - 1 + (is_leap(year) && change->day >= 60);
+            break;
+        default:
+            days = tz_days_from_civil(year, 1, 1) + change->day;
+            break;
+    }
+    return (int64_t) days * TZ_DAY_S + change->time;
+}
+
+void tz_year(const tz_rule_t *rule, int year, tz_year_t *out)
+{
+    out->std_offset = rule->std_offset;
+    out->dst_offset = rule->dst_offset;
+    out->from = (int64_t) tz_days_from_civil(year, 1, 1) * TZ_DAY_S - rule->std_offset;
+    out->to = (int64_t) tz_days_from_civil(year + 1, 1, 1) * TZ_DAY_S - rule->std_offset;
+    if(!rule->dst) {
+        out->dst_start = out->dst_end = out->from;
+        return;
+    }
+    out->dst_start = change_local(&rule->start, year) - rule->std_offset;
+    out->dst_end = change_local(&rule->end, year) - rule->dst_offset;
+}
+
+static int year_of(int64_t t, int32_t std_offset)
+{
+    int year, month, mday;
+    tz_civil_from_days(floor_div(t + std_offset, TZ_DAY_S), &year, &month, &mday);
+    return year;
+}
+
+static bool year_dst(const tz_year_t *year, int64_t t)
+{
+    if(year->dst_start <= year->dst_end) {
+        return t >= year->dst_start && t < year->dst_end;
+    }
+    /* southern hemisphere: DST over the new year */
+    return t >= year->dst_start || t < year->dst_end;
+}
+
+/*******************************cache*********************************/
+
+/* copy len bytes at offset of the current slot, and which write it was */
+static uint32_t slot_read(void *out, size_t offset, size_t len)
+{
+    for(;;) {
+        uint32_t n = current.load(std::memory_order_acquire);
+        uint32_t i = n % TZ_SLOTS;
+        uint32_t seq = slot_seq[i].load(std::memory_order_acquire);
+        if(seq & 1) {
+            continue;
+        }
+        memcpy(out, reinterpret_cast<const uint8_t *>(&slots[i]) + offset, len);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(slot_seq[i].load(std::memory_order_relaxed) == seq) {
+            return n;
+        }
+    }
+}
+
+/**
+ * fill a fresh slot and make it current. a cache refresh (replace =
+ * false) only lands if nothing was published since it read the cache
+ * it refreshes, so it never undoes a tz_set()
+ */
+static void slot_publish(const tz_cache_t *cache, const char *spec, uint32_t read_n, bool replace)
+{
+    uint32_t n = claimed.fetch_add(1, std::memory_order_relaxed) + 1;
+    uint32_t i = n % TZ_SLOTS;
+    tz_slot_t *slot = &slots[i];
+
+    slot_seq[i].fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->cache = *cache;
+    if(spec != NULL) {
+        strncpy(slot->spec, spec, TZ_SPEC_MAX);
+        slot->spec[TZ_SPEC_MAX] = '\0';
+    } else {
+        memcpy(slot->spec, slots[read_n % TZ_SLOTS].spec, sizeof(slot->spec));
+    }
+    slot_seq[i].fetch_add(1, std::memory_order_release);
+
+    if(!replace) {
+        current.compare_exchange_strong(read_n, n, std::memory_order_release);
+        return;
+    }
+    /* a later tz_set() that got in first wins */
+    uint32_t cur = current.load(std::memory_order_relaxed);
+    while((int32_t) (n - cur) > 0 &&
+          !current.compare_exchange_weak(cur, n, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+}
+
+/*******************************public*********************************/
+
+bool tz_set(const char *spec)
+{
+    tz_cache_t cache;
+
+    if(!tz_parse(spec, &cache.rule)) {
+        return false;
+    }
+    tz_year(&cache.rule, year_of(time(NULL), cache.rule.std_offset), &cache.year);
+    slot_publish(&cache, spec, 0, true);
+
+    /* for what still goes through newlib: strftime's %Z, asctime(localtime()) */
+    setenv("TZ", spec, 1);
+    tzset();
+    return true;
+}
+
+void tz_get(char *spec, size_t size)
+{
+    char copy[TZ_SPEC_MAX + 1];
+    slot_read(copy, offsetof(tz_slot_t, spec), sizeof(copy));
+    snprintf(spec, size, "%s", copy);
+}
+
+int32_t tz_offset(time_t t, bool *dst)
+{
+    tz_cache_t cache;
+    uint32_t n = slot_read(&cache, offsetof(tz_slot_t, cache), sizeof(cache));
+
+    if(t < cache.year.from || t >= cache.year.to) {
+        /* another year: work it out, and keep it if it is the new current one */
+        tz_year(&cache.rule, year_of(t, cache.rule.std_offset), &cache.year);
+        int year_now = year_of(time(NULL), cache.rule.std_offset);
+        if(year_now == year_of(t, cache.rule.std_offset)) {
+            slot_publish(&cache, NULL, n, false);
+        }
+    }
+    bool in_dst = year_dst(&cache.year, t);
+    if(dst != NULL) {
+        *dst = in_dst;
+    }
+    return in_dst ? cache.year.dst_offset : cache.year.std_offset;
+}
+
+void tz_local(time_t t, struct tm *tm)
+{
+    bool dst;
+    int64_t local = (int64_t) t + tz_offset(t, &dst);
+    int64_t days = floor_div(local, TZ_DAY_S);
+    int32_t seconds = local - days * TZ_DAY_S;
+    int year, month, mday;
+
+    tz_civil_from_days(days, &year, &month, &mday);
+    tm->tm_year = year - 1900;
+    tm->tm_mon = month - 1;
+    tm->tm_mday = mday;
+    tm->tm_hour = seconds / 3600;
+    tm->tm_min = seconds / 60 % 60;
+    tm->tm_sec = seconds % 60;
+    tm->tm_wday = ((days + 4) % 7 + 7) % 7;
+    tm->tm_yday = days - tz_days_from_civil(year, 1, 1);
+    tm->tm_isdst = dst;
+}
+
+time_t tz_utc(int64_t local)
+{
+    tz_cache_t cache;
+    slot_read(&cache.rule, offsetof(tz_slot_t, cache.rule), sizeof(cache.rule));
+
+    int32_t std = cache.rule.std_offset;
+    int32_t dst = cache.rule.dst_offset;
+    if(!cache.rule.dst || std == dst) {
+        return local - std;
+    }
+    /* a reading is real if the offset it assumes is the one in force then */
+    time_t as_std = local - std;
+    time_t as_dst = local - dst;
+    bool in_dst;
+    bool std_ok = tz_offset(as_std, &in_dst) == std && !in_dst;
+    bool dst_ok = tz_offset(as_dst, &in_dst) == dst && in_dst;
+    if(std_ok && dst_ok) {
+        return as_std < as_dst ? as_std : as_dst; // clocks went back: the first
+    }
+    if(std_ok) {
+        return as_std;
+    }
+    if(dst_ok) {
+        return as_dst;
+    }
+    /* skipped by clocks going forward: past the change by as much */
+    return local - (std < dst ? std : dst);
+}
@@ -0,0 +1,157 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_cpu.h"
+#include "esp_console.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+
+#include "tz.h"
+#include "tz_store.h"
+#include "valve_scheduler.h"
+
+static const char *TAG = "TZ";
+
+#define TZ_NVS_NAMESPACE "tz"
+#define TZ_NVS_KEY       "spec"
+/* conversions timed by "tz bench" */
+#define TZ_BENCH_COUNT 2000
+
+static esp_err_t save(const char *spec)
+{
+    nvs_handle_t nvs;
+    esp_err_t ret = nvs_open(TZ_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if(ret != ESP_OK) {
+        return ret;
+    }
+    ret = nvs_set_str(nvs, TZ_NVS_KEY, spec);
+    if(ret == ESP_OK) {
+        ret = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    return ret;
+}
+
+static bool load(char *spec, size_t size)
+{
+    nvs_handle_t nvs;
+    if(nvs_open(TZ_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return false;
+    }
+    esp_err_t ret = nvs_get_str(nvs, TZ_NVS_KEY, spec, &size);
+    nvs_close(nvs);
+    return ret == ESP_OK;
+}
+
+/**
+ * tz_local() against newlib's localtime_r() over a spread of times
+ * around now, both must agree. newlib re-evaluates the rules on every
+ * call, tz_local() compares against the cached year.
+ */
+static void bench()
+{
+    time_t now = time(NULL);
+    struct tm a, b;
+    uint32_t cached = 0, newlib = 0;
+    unsigned mismatches = 0;
+
+    for(int i = 0; i < TZ_BENCH_COUNT; i++) {
+        time_t t = now + (time_t) (i - TZ_BENCH_COUNT / 2) * 3607;
+        uint32_t t0 = esp_cpu_get_cycle_count();
+        tz_local(t, &a);
+        uint32_t t1 = esp_cpu_get_cycle_count();
+        localtime_r(&t, &b);
+        uint32_t t2 = esp_cpu_get_cycle_count();
+        cached += t1 - t0;
+        newlib += t2 - t1;
+        if(a.tm_year != b.tm_year || a.tm_yday != b.tm_yday || a.tm_hour != b.tm_hour ||
+           a.tm_min != b.tm_min || a.tm_isdst != b.tm_isdst) {
+            mismatches++;
+        }
+    }
+    printf("tz_local    %" PRIu32 " cycles\n", cached / TZ_BENCH_COUNT);
+    printf("localtime_r %" PRIu32 " cycles\n", newlib / TZ_BENCH_COUNT);
+    printf("%u of %d differ\n", mismatches, TZ_BENCH_COUNT);
+}
+
+static int tz_command(int argc, char **argv)
+{
+    if(argc == 2 && strcmp(argv[1], "bench") == 0) {
+        bench();
+        return 0;
+    }
+    if(argc == 2) {
+        esp_err_t ret = tz_store_set(argv[1]);
+        if(ret != ESP_OK) {
+            printf("tz: %s\n", ret == ESP_ERR_INVALID_ARG ? "not a POSIX TZ string" : esp_err_to_name(ret));
+            return 1;
+        }
+    }
+    char spec[TZ_SPEC_MAX + 1];
+    time_t now = time(NULL);
+    struct tm local;
+    bool dst;
+    int32_t offset = tz_offset(now, &dst);
+
+    tz_get(spec, sizeof(spec));
+    tz_local(now, &local);
+    printf("%s\n", spec);
+    printf("%04d-%02d-%02d %02d:%02d:%02d UTC%+" PRId32 ":%02" PRId32 "%s\n",
+           local.tm_year + 1900, local.tm_mon + 1, local.tm_mday, local.tm_hour, local.tm_min, local.tm_sec,
+           offset / 3600, (offset < 0 ? -offset : offset) / 60 % 60, dst ? " DST" : "");
+    return 0;
+}
+
+/*******************************public*********************************/
+
+esp_err_t tz_store_init()
+{
+    char spec[TZ_SPEC_MAX + 1];
+
+    if(load(spec, sizeof(spec)) && tz_set(spec)) {
+        ESP_LOGI(TAG, "%s", spec);
+        return ESP_OK;
+    }
+    if(!tz_set(CONFIG_IRRIGATION_TZ)) {
+        ESP_LOGE(TAG, "CONFIG_IRRIGATION_TZ \"%s\" is not a POSIX TZ string", CONFIG_IRRIGATION_TZ);
+        tz_set("UTC0");
+        return ESP_ERR_INVALID_ARG;
+    }
+    ESP_LOGI(TAG, "%s (default)", CONFIG_IRRIGATION_TZ);
+    return ESP_OK;
+}
+
+esp_err_t tz_store_set(const char *spec)
+{
+    tz_rule_t rule;
+
+    if(strlen(spec) > TZ_SPEC_MAX || !tz_parse(spec, &rule)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    /* kept first: a zone in use but lost at the next boot would move the starts again */
+    esp_err_t ret = save(spec);
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed saving %s: %s", spec, esp_err_to_name(ret));
+        return ret;
+    }
+    tz_set(spec);
+    ESP_LOGI(TAG, "%s", spec);
+    /* next starts move with the wall clock */
+    valve_scheduler_reschedule();
+    return ESP_OK;
+}
+
+esp_err_t tz_register_command()
+{
+    const esp_console_cmd_t cmd = {
+        .command = "tz",
+        .help = "time zone: show it, set a POSIX TZ string, or 'bench' the local time conversion",
+        .hint = "[spec|bench]",
+        .func = tz_command,
+        .argtable = NULL,
+    };
+    return esp_console_cmd_register(&cmd);
+}
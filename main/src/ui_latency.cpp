@@ -0,0 +1,126 @@
+#include <atomic>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "esp_console.h"
+#include "sdkconfig.h"
+
+#include "ui_latency.h"
+#include "sync_service.h"
+#include "wifi_setup.h"
+
+/* latest samples kept per class, the report covers these */
+#define LATENCY_SAMPLES 128
+
+enum latency_class_t : uint8_t {
+    LAT_QUIET,   // radio off, no sync
+    LAT_NETWORK, // Wi-Fi up or a sync running
+    LAT_CLASSES
+};
+
+static const char *class_names[LAT_CLASSES] = {"radio off", "radio on"};
+
+/* time of the oldest S1 edge trigger_callback has not taken, 0 if none */
+static std::atomic<uint32_t> pending_edge{0};
+
+/* written by refresh_disp_task only, read by the console */
+static uint32_t samples[LAT_CLASSES][LATENCY_SAMPLES];
+static std::atomic<uint32_t> recorded[LAT_CLASSES];
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *static_cast<const uint32_t *>(a);
+    uint32_t y = *static_cast<const uint32_t *>(b);
+    return x < y ? -1 : x > y;
+}
+
+/* nearest rank of sorted[0..n) */
+static uint32_t percentile(const uint32_t *sorted, uint32_t n, uint32_t p)
+{
+    uint32_t rank = (n * p + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static void report()
+{
+    uint32_t sorted[LATENCY_SAMPLES];
+
+    printf("%-10s %7s %8s %8s %8s\n", "", "samples", "p50 ms", "p99 ms", "max ms");
+    for(int c = 0; c < LAT_CLASSES; c++) {
+        uint32_t total = recorded[c].load(std::memory_order_acquire);
+        uint32_t n = total < LATENCY_SAMPLES ? total : LATENCY_SAMPLES;
+        if(n == 0) {
+            printf("%-10s %7d\n", class_names[c], 0);
+            continue;
+        }
+        memcpy(sorted, samples[c], n * sizeof(sorted[0]));
+        qsort(sorted, n, sizeof(sorted[0]), compare_u32);
+        uint32_t p99 = percentile(sorted, n, 99);
+        printf("%-10s %7" PRIu32 " %8.1f %8.1f %8.1f%s\n", class_names[c], total,
+               percentile(sorted, n, 50) / 1000.0, p99 / 1000.0, sorted[n - 1] / 1000.0,
+               p99 > CONFIG_IRRIGATION_UI_LATENCY_TARGET_MS * 1000 ? "  over target" : "");
+    }
+    printf("target p99 %d ms, last %d samples of each\n", CONFIG_IRRIGATION_UI_LATENCY_TARGET_MS,
+           LATENCY_SAMPLES);
+}
+
+/**
+ * turn the knob through the menu for a while to fill "radio off", then
+ * "latency sync" and keep turning while the sync connects and queries
+ * to fill "radio on". REST or /ws traffic counts as radio on as well.
+ */
+static int latency_command(int argc, char **argv)
+{
+    if(argc > 1 && strcmp(argv[1], "clear") == 0) {
+        for(int c = 0; c < LAT_CLASSES; c++) {
+            recorded[c].store(0, std::memory_order_release);
+        }
+        return 0;
+    }
+    if(argc > 1 && strcmp(argv[1], "sync") == 0) {
+        sync_service_request();
+        printf("sync started, turn the knob\n");
+        return 0;
+    }
+    report();
+    return 0;
+}
+
+/*******************************public*********************************/
+
+void IRAM_ATTR ui_latency_edge()
+{
+    uint32_t none = 0;
+    pending_edge.compare_exchange_strong(none, (uint32_t) esp_timer_get_time(), std::memory_order_relaxed);
+}
+
+uint32_t ui_latency_take_edge()
+{
+    return pending_edge.exchange(0, std::memory_order_relaxed);
+}
+
+void ui_latency_record(uint32_t input_us)
+{
+    uint32_t latency = (uint32_t) esp_timer_get_time() - input_us;
+    int c = wifi_is_connected() || sync_service_busy() ? LAT_NETWORK : LAT_QUIET;
+    uint32_t n = recorded[c].load(std::memory_order_relaxed);
+
+    samples[c][n % LATENCY_SAMPLES] = latency;
+    recorded[c].store(n + 1, std::memory_order_release);
+}
+
+esp_err_t ui_latency_register_command()
+{
+    const esp_console_cmd_t cmd = {
+        .command = "latency",
+        .help = "encoder edge to LCD flush: p50/p99 with the radio off and on, 'clear' restarts, 'sync' adds network load",
+        .hint = "[clear|sync]",
+        .func = latency_command,
+        .argtable = NULL,
+    };
+    return esp_console_cmd_register(&cmd);
+}
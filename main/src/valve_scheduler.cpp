@@ -0,0 +1,258 @@
+#include <inttypes.h>
+#include <time.h>
+#include <atomic>
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_pm.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "valve_scheduler.h"
+#include "program_store.h"
+#include "schedule.h"
+#include "wake_stats.h"
+#include "telemetry.h"
+#include "ws_push.h"
+#include "trace.h"
+#include "dlog.h"
+#include "history.h"
+#include "board_config.h"
+#include "task_layout.h"
+#include "static_rtos.h"
+
+static const char *TAG = "VALVE_SCHED";
+
+#define RESCHEDULE_BIT BIT0
+#define VALVE_TASK_STACK 3072
+
+typedef struct {
+    Valve *valve;
+    esp_timer_handle_t close_timer; // one-shot, armed while the valve is open
+    std::atomic<bool> holding;      // this open valve holds pm_lock
+    /* the run in progress, for the history */
+    time_t opened_at;
+    int64_t opened_us;
+    uint16_t planned;
+    bool manual;
+} valve_slot_t;
+
+/* one per zone of the board, sized at compile time */
+static valve_slot_t slots[ZONE_COUNT];
+static zone_plan_t plans[ZONE_COUNT];
+static size_t slot_count = 0;
+static TaskHandle_t valve_task_handle = NULL;
+static StaticTask<VALVE_TASK_STACK> valve_task_mem;
+/**
+ * slots are opened by valve_task, the menu and the REST API, and closed
+ * by their timers: every open, close and stop holds this, the close
+ * timer callback included
+ */
+static SemaphoreHandle_t slot_lock = NULL;
+static StaticMutex slot_lock_mem;
+
+/**
+ * held once per open valve. light sleep would put the valve pins in
+ * their sleep configuration and delay the close to the next wakeup.
+ */
+static esp_pm_lock_handle_t pm_lock = NULL;
+
+/* the valve is shut: end its run, in the history as kind */
+static void valve_release(valve_slot_t *slot, history_kind_t kind)
+{
+    if(!slot->holding.exchange(false)) {
+        return;
+    }
+    esp_pm_lock_release(pm_lock);
+    int64_t ran_s = (esp_timer_get_time() - slot->opened_us + 500000) / 1000000;
+    history_record(slot - slots, kind, HIST_REASON_NONE, slot->opened_at, ran_s > UINT16_MAX ? UINT16_MAX : ran_s,
+                   slot->planned);
+}
+
+/**
+ * close timer expiry. runs in the esp_timer task. an expiry that waited
+ * for the lock while the valve was reopened (timer armed again) or
+ * stopped (nothing held) is stale.
+ */
+static void close_timer_cb(void* arg)
+{
+    valve_slot_t *slot = static_cast<valve_slot_t *>(arg);
+
+    wake_stats_record(WAKE_VALVE);
+    xSemaphoreTake(slot_lock, portMAX_DELAY);
+    if(esp_timer_is_active(slot->close_timer) || !slot->holding.load()) {
+        xSemaphoreGive(slot_lock);
+        return;
+    }
+    slot->valve->deactivate_valve();
+    valve_release(slot, slot->manual ? HIST_MANUAL : HIST_RUN);
+    TRACE(TRACE_VALVE_CLOSE, slot - slots, 0);
+    telemetry_record(TLM_VALVE_CLOSE, slot - slots, 0);
+    ws_push_set(WS_KEY_VALVE + (slot - slots), 0);
+    xSemaphoreGive(slot_lock);
+    DLOGI(TAG, "Valve %d closed", (int) (slot - slots));
+}
+
+/**
+ * open a valve and arm its close. a valve toggled off stays shut, and
+ * a programmed start it swallows goes to the history as skipped.
+ * opening an open valve restarts its time, as one longer run.
+ */
+static void open_valve(valve_slot_t *slot, uint16_t duration_sec, bool manual)
+{
+    xSemaphoreTake(slot_lock, portMAX_DELAY);
+    slot->valve->activate_valve();
+    if(!slot->valve->get_active()) {
+        xSemaphoreGive(slot_lock);
+        if(!manual) {
+            history_record(slot - slots, HIST_SKIPPED, HIST_REASON_ZONE_OFF, time(NULL), 0, duration_sec);
+        }
+        return;
+    }
+    if(!slot->holding.load()) {
+        slot->opened_at = time(NULL);
+        slot->opened_us = esp_timer_get_time();
+        slot->planned = 0;
+        slot->manual = manual;
+    }
+    /* what it will have run when this close fires */
+    int64_t planned = (esp_timer_get_time() - slot->opened_us) / 1000000 + duration_sec;
+    slot->planned = planned > UINT16_MAX ? UINT16_MAX : planned;
+    if(!slot->holding.exchange(true)) {
+        esp_pm_lock_acquire(pm_lock);
+    }
+    esp_timer_stop(slot->close_timer); // restart if already running
+    esp_timer_start_once(slot->close_timer, duration_sec * 1000000ULL);
+    xSemaphoreGive(slot_lock);
+    TRACE(TRACE_VALVE_OPEN, slot - slots, duration_sec);
+    telemetry_record(TLM_VALVE_OPEN, slot - slots, duration_sec);
+    ws_push_set(WS_KEY_VALVE + (slot - slots), duration_sec);
+    DLOGI(TAG, "Valve %d open for %u s", (int) (slot - slots), duration_sec);
+}
+
+static time_t plan_next(void *ctx, uint8_t zone, time_t now, uint16_t *duration_sec)
+{
+    return program_store_next_start(zone, now, duration_sec);
+}
+
+static void plan_open(void *ctx, uint8_t zone, uint16_t duration_sec)
+{
+    open_valve(&slots[zone], duration_sec, false);
+}
+
+static void valve_task(void* arg)
+{
+    bool reschedule = true;
+    uint32_t bits;
+
+    for(;;) {
+        time_t now = time(NULL);
+        time_t next = schedule_step(plans, slot_count, now, reschedule, plan_next, plan_open, NULL);
+        reschedule = false;
+
+        /* sleep until the earliest start. the extra tick rounds up so
+         * the wake never lands just before the start second. ticks in
+         * 64 bits: pdMS_TO_TICKS() wraps past ~11.9 h at 100 Hz, and a
+         * start further off than portMAX_DELAY is met by a later wake */
+        TickType_t wait = portMAX_DELAY;
+        if(next != (time_t) -1) {
+            uint64_t ticks = (uint64_t) (next > now ? next - now : 0) * configTICK_RATE_HZ + 1;
+            wait = ticks < portMAX_DELAY - 1 ? (TickType_t) ticks : portMAX_DELAY - 1;
+            DLOGD(TAG, "Next start in %lld s", (long long) (next - now));
+        }
+        bits = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &bits, wait);
+        wake_stats_record(WAKE_VALVE);
+        if(bits & RESCHEDULE_BIT) {
+            reschedule = true;
+        }
+    }
+}
+
+/*******************************public*********************************/
+
+esp_err_t valve_scheduler_init(Valve **valves, size_t count)
+{
+    esp_err_t ret;
+
+    if(count > ZONE_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    slot_lock = slot_lock_mem.create();
+    /* not supported without CONFIG_PM_ENABLE, the chip never sleeps then */
+    ret = esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "valves", &pm_lock);
+    if(ret != ESP_OK && ret != ESP_ERR_NOT_SUPPORTED) {
+        ESP_LOGE(TAG, "Failed creating PM lock: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    for(size_t i = 0; i < count; i++) {
+        slots[i].valve = valves[i];
+        plans[i].next_start = (time_t) -1;
+
+        esp_timer_create_args_t timer_args = {};
+        timer_args.callback = close_timer_cb;
+        timer_args.arg = &slots[i];
+        timer_args.name = "valve_close";
+        ret = esp_timer_create(&timer_args, &slots[i].close_timer);
+        if(ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed creating close timer: %s", esp_err_to_name(ret));
+            return ret;
+        }
+    }
+    slot_count = count;
+
+    valve_task_handle = valve_task_mem.create(valve_task, "valve_task", NULL, VALVE_TASK_PRIO, CORE_CTRL);
+    if(valve_task_handle == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void valve_scheduler_reschedule()
+{
+    if(valve_task_handle != NULL) {
+        xTaskNotify(valve_task_handle, RESCHEDULE_BIT, eSetBits);
+    }
+}
+
+esp_err_t valve_scheduler_run(size_t index, uint16_t duration_sec)
+{
+    if(index >= slot_count) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    open_valve(&slots[index], duration_sec, true);
+    return ESP_OK;
+}
+
+void valve_scheduler_stop_all()
+{
+    xSemaphoreTake(slot_lock, portMAX_DELAY);
+    for(size_t i = 0; i < slot_count; i++) {
+        esp_timer_stop(slots[i].close_timer);
+        if(slots[i].valve->get_active()) {
+            TRACE(TRACE_VALVE_CLOSE, i, 1);
+            telemetry_record(TLM_VALVE_CLOSE, i, 0);
+        }
+        slots[i].valve->deactivate_valve();
+        valve_release(&slots[i], HIST_STOPPED);
+        ws_push_set(WS_KEY_VALVE + i, 0);
+    }
+    xSemaphoreGive(slot_lock);
+    DLOGI(TAG, "All valves stopped");
+}
+
+int64_t valve_scheduler_next_close_us()
+{
+    int64_t next = -1;
+
+    for(size_t i = 0; i < slot_count; i++) {
+        uint64_t expiry;
+        if(esp_timer_is_active(slots[i].close_timer) &&
+           esp_timer_get_expiry_time(slots[i].close_timer, &expiry) == ESP_OK &&
+           (next < 0 || (int64_t) expiry < next)) {
+            next = expiry;
+        }
+    }
+    return next;
+}
@@ -0,0 +1,92 @@
+#include <atomic>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_freertos_hooks.h"
+#include "freertos/FreeRTOS.h"
+
+#include "wake_stats.h"
+
+static const char *TAG = "WAKE_STATS";
+
+static const char *source_names[WAKE_SOURCE_MAX] = {"input", "menu", "display", "valve", "sync", "telemetry"};
+
+static std::atomic<uint32_t> core_wakeups[portNUM_PROCESSORS];
+static std::atomic<uint32_t> source_wakeups[WAKE_SOURCE_MAX];
+static std::atomic<int64_t> window_start_us{0};
+
+static bool idle_hook_core0()
+{
+    core_wakeups[0].fetch_add(1, std::memory_order_relaxed);
+    return true; // let the core sleep
+}
+
+#if portNUM_PROCESSORS > 1
+static bool idle_hook_core1()
+{
+    core_wakeups[1].fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+#endif
+
+esp_err_t wake_stats_init()
+{
+    esp_err_t ret;
+
+    ret = esp_register_freertos_idle_hook_for_cpu(idle_hook_core0, 0);
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed registering idle hook: %s", esp_err_to_name(ret));
+        return ret;
+    }
+#if portNUM_PROCESSORS > 1
+    ret = esp_register_freertos_idle_hook_for_cpu(idle_hook_core1, 1);
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed registering idle hook: %s", esp_err_to_name(ret));
+        return ret;
+    }
+#endif
+    wake_stats_reset();
+    return ESP_OK;
+}
+
+void wake_stats_record(wake_source_t source)
+{
+    source_wakeups[source].fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * start a new measurement window
+ */
+void wake_stats_reset()
+{
+    for(int i = 0; i < portNUM_PROCESSORS; i++) {
+        core_wakeups[i].store(0, std::memory_order_relaxed);
+    }
+    for(int i = 0; i < WAKE_SOURCE_MAX; i++) {
+        source_wakeups[i].store(0, std::memory_order_relaxed);
+    }
+    window_start_us.store(esp_timer_get_time(), std::memory_order_relaxed);
+}
+
+/**
+ * log wakeups per second since the last reset. the window includes
+ * the wakeups that ended it (the event that led to this call).
+ */
+void wake_stats_report(const char *label)
+{
+    int64_t elapsed_us = esp_timer_get_time() - window_start_us.load(std::memory_order_relaxed);
+    float elapsed_s = elapsed_us / 1e6f;
+    uint32_t total = 0;
+
+    if(elapsed_s <= 0) {
+        return;
+    }
+    for(int i = 0; i < portNUM_PROCESSORS; i++) {
+        total += core_wakeups[i].load(std::memory_order_relaxed);
+    }
+    ESP_LOGI(TAG, "%s: %.1f s, %" PRIu32 " core wakeups (%.3f/s)", label, elapsed_s, total, total / elapsed_s);
+    for(int i = 0; i < WAKE_SOURCE_MAX; i++) {
+        ESP_LOGI(TAG, "  %-8s %" PRIu32, source_names[i], source_wakeups[i].load(std::memory_order_relaxed));
+    }
+}
@@ -1,19 +1,22 @@
-/* WiFi station Example
+/* WiFi station manager
 
-   This example code is in the Public Domain (or CC0 licensed, at your option.)
-
-   Unless required by applicable law or agreed to in writing, this
-   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
-   CONDITIONS OF ANY KIND, either express or implied.
+   Started from the ESP-IDF WiFi station example (Public Domain / CC0).
 */
 #include <string.h>
+#include <inttypes.h>
+#include <time.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
+#include "freertos/semphr.h"
 #include "esp_system.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
+#include "esp_pm.h"
 #include "esp_log.h"
+#include "nvs.h"
 #include "nvs_flash.h"
 
 #include "lwip/err.h"
@@ -67,18 +70,137 @@ static EventGroupHandle_t s_wifi_event_group;
 #define WIFI_CONNECTED_BIT BIT0
 #define WIFI_FAIL_BIT      BIT1
 
+/* a dropped link is retried after this, doubling up to the max */
+#define WIFI_BACKOFF_MIN_MS 1000
+#define WIFI_BACKOFF_MAX_MS 60000
+
+#define WIFI_NVS_NAMESPACE "wifi_mgr"
+#define WIFI_NVS_KEY       "fast"
+
 static const char *TAG = "wifi station";
 
+/**
+ * what a reconnect can skip: the scan (bssid/channel) and, while the
+ * lease is young enough, DHCP (address, gateway, dns). kept in NVS so
+ * it survives a reboot.
+ */
+typedef struct {
+    uint8_t valid;
+    uint8_t bssid[6];
+    uint8_t channel;
+    esp_netif_ip_info_t ip_info;
+    esp_netif_dns_info_t dns;
+    int64_t leased_at; // time() the address was leased, 0 if none
+} wifi_cache_t;
+
+static wifi_cache_t s_cache;
+static esp_netif_t *s_netif = NULL;
+static bool s_initialized = false;
 static int s_retry_num = 0;
 
+/* written by the caller before connecting, read by event_handler */
+static volatile bool s_want_connected = false;
+static volatile bool s_fast_path = false;
+static volatile bool s_static_ip = false;
+
+/* wifi_connect() callers still holding the link */
+static int s_users = 0;
+static SemaphoreHandle_t s_lock = NULL;
+/* true while wifi_try_connect() waits, retries are bounded then */
+static volatile bool s_connecting = false;
+/* background reconnects of a dropped link, spaced out by s_backoff_ms */
+static esp_timer_handle_t s_reconnect_timer = NULL;
+static uint32_t s_backoff_ms = WIFI_BACKOFF_MIN_MS;
+
+/**
+ * CPU max while connecting and while power save is off, so the
+ * handshake and bulk transfers are not stretched at the minimum
+ * frequency. an idle link takes no lock: with modem sleep the driver
+ * lets the chip light sleep between beacons itself.
+ */
+static esp_pm_lock_handle_t s_pm_lock = NULL;
+static bool s_power_save = true;
+
+static bool s_radio_on = false;
+static int64_t s_radio_on_since = 0;
+static wifi_stats_t s_stats;
+
+static void wifi_cache_save(void)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(WIFI_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        return;
+    }
+    if (nvs_set_blob(nvs, WIFI_NVS_KEY, &s_cache, sizeof(s_cache)) == ESP_OK) {
+        nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+}
+
+static void wifi_cache_load(void)
+{
+    nvs_handle_t nvs;
+    size_t len = sizeof(s_cache);
+
+    memset(&s_cache, 0, sizeof(s_cache));
+    if (nvs_open(WIFI_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return;
+    }
+    if (nvs_get_blob(nvs, WIFI_NVS_KEY, &s_cache, &len) != ESP_OK || len != sizeof(s_cache)) {
+        memset(&s_cache, 0, sizeof(s_cache));
+    }
+    nvs_close(nvs);
+}
+
+static bool wifi_lease_reusable(void)
+{
+    if (CONFIG_ESP_WIFI_LEASE_REUSE_S == 0 || s_cache.leased_at == 0 || s_cache.ip_info.ip.addr == 0) {
+        return false;
+    }
+    int64_t age = (int64_t) time(NULL) - s_cache.leased_at;
+    return age >= 0 && age < CONFIG_ESP_WIFI_LEASE_REUSE_S;
+}
+
+/* runs in the esp_timer task. gone quiet if the last holder let go */
+static void reconnect_timer_cb(void *arg)
+{
+    if (s_want_connected) {
+        esp_wifi_connect();
+    }
+}
 
 static void event_handler(void* arg, esp_event_base_t event_base,
                                 int32_t event_id, void* event_data)
 {
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
         esp_wifi_connect();
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+        wifi_event_sta_connected_t* event = (wifi_event_sta_connected_t*) event_data;
+        memcpy(s_cache.bssid, event->bssid, sizeof(s_cache.bssid));
+        s_cache.channel = event->channel;
+        if (s_static_ip) {
+            /* address already configured, the link is all we need */
+            s_retry_num = 0;
+            s_backoff_ms = WIFI_BACKOFF_MIN_MS;
+            xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        }
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        if (s_retry_num < EXAMPLE_ESP_MAXIMUM_RETRY) {
+        xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        if (!s_want_connected) {
+            return;
+        }
+        if (!s_connecting) {
+            /* an established link dropped while users hold it. backed
+             * off, so a missing AP does not keep the radio busy */
+            esp_timer_start_once(s_reconnect_timer, s_backoff_ms * 1000ULL);
+            ESP_LOGI(TAG, "link lost, reconnecting in %" PRIu32 " ms", s_backoff_ms);
+            s_backoff_ms = s_backoff_ms * 2 < WIFI_BACKOFF_MAX_MS ? s_backoff_ms * 2 : WIFI_BACKOFF_MAX_MS;
+            return;
+        }
+        if (s_fast_path) {
+            /* cached AP not there, let wifi_connect() fall back to a scan */
+            xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
+        } else if (s_retry_num < EXAMPLE_ESP_MAXIMUM_RETRY) {
             esp_wifi_connect();
             s_retry_num++;
             ESP_LOGI(TAG, "retry to connect to the AP");
@@ -87,38 +209,108 @@ static void event_handler(void* arg, esp_event_base_t event_base,
         }
         ESP_LOGI(TAG,"connect to the AP fail");
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+        if (s_static_ip) {
+            return; // posted by esp_netif_set_ip_info, not a lease
+        }
         ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
         ESP_LOGI(TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
         s_retry_num = 0;
+        s_backoff_ms = WIFI_BACKOFF_MIN_MS;
+        s_cache.ip_info = event->ip_info;
+        esp_netif_get_dns_info(s_netif, ESP_NETIF_DNS_MAIN, &s_cache.dns);
+        s_cache.leased_at = time(NULL);
+        s_cache.valid = 1;
         xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
     }
 }
 
-void wifi_init_sta(void)
+/**
+ * one-time setup: netif, default event loop, driver, handlers and
+ * power save. called once by app_main before any network task starts;
+ * nothing here is locked, so it must not race itself. a second call
+ * does nothing.
+ */
+esp_err_t wifi_manager_init(void)
 {
-    s_wifi_event_group = xEventGroupCreate();
+    esp_err_t ret;
+
+    if (s_initialized) {
+        return ESP_OK;
+    }
+
+    static StaticEventGroup_t event_group_mem;
+    static StaticSemaphore_t lock_mem;
+    s_wifi_event_group = xEventGroupCreateStatic(&event_group_mem);
+    s_lock = xSemaphoreCreateMutexStatic(&lock_mem);
+    if (s_wifi_event_group == NULL || s_lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    ret = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "wifi", &s_pm_lock);
+    if (ret != ESP_OK && ret != ESP_ERR_NOT_SUPPORTED) {
+        return ret;
+    }
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = reconnect_timer_cb,
+        .name = "wifi_reconnect",
+    };
+    ret = esp_timer_create(&timer_args, &s_reconnect_timer);
+    if (ret != ESP_OK) {
+        return ret;
+    }
 
     ESP_ERROR_CHECK(esp_netif_init());
 
-    ESP_ERROR_CHECK(esp_event_loop_create_default());
-    esp_netif_create_default_wifi_sta();
+    /* someone else may already own the default loop */
+    ret = esp_event_loop_create_default();
+    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
+        return ret;
+    }
+    s_netif = esp_netif_create_default_wifi_sta();
 
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+    /* the config is rebuilt on every connect, don't wear flash with it */
+    ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
 
-    esp_event_handler_instance_t instance_any_id;
-    esp_event_handler_instance_t instance_got_ip;
     ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
                                                         ESP_EVENT_ANY_ID,
                                                         &event_handler,
                                                         NULL,
-                                                        &instance_any_id));
+                                                        NULL));
     ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
                                                         IP_EVENT_STA_GOT_IP,
                                                         &event_handler,
                                                         NULL,
-                                                        &instance_got_ip));
+                                                        NULL));
+
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA) );
+    /* sleep the modem between beacons while connected */
+    ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_PS_MAX_MODEM));
 
+    wifi_cache_load();
+    s_initialized = true;
+
+    ESP_LOGI(TAG, "wifi manager initialized");
+    return ESP_OK;
+}
+
+static void wifi_radio_off(void)
+{
+    if (!s_radio_on) {
+        return;
+    }
+    esp_timer_stop(s_reconnect_timer); // not running is fine
+    s_backoff_ms = WIFI_BACKOFF_MIN_MS;
+    esp_wifi_disconnect();
+    esp_wifi_stop();
+    s_radio_on = false;
+    s_stats.radio_on_ms += (esp_timer_get_time() - s_radio_on_since) / 1000;
+    xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT | WIFI_FAIL_BIT);
+}
+
+static esp_err_t wifi_try_connect(TickType_t timeout, bool fast)
+{
     wifi_config_t wifi_config = {
         .sta = {
             .ssid = EXAMPLE_ESP_WIFI_SSID,
@@ -131,13 +323,39 @@ void wifi_init_sta(void)
             .threshold.authmode = ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD,
             .sae_pwe_h2e = ESP_WIFI_SAE_MODE,
             .sae_h2e_identifier = EXAMPLE_H2E_IDENTIFIER,
+            .listen_interval = CONFIG_ESP_WIFI_LISTEN_INTERVAL,
         },
     };
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA) );
+
+    if (fast) {
+        /* straight to the known AP on its channel, no scan */
+        wifi_config.sta.bssid_set = true;
+        memcpy(wifi_config.sta.bssid, s_cache.bssid, sizeof(s_cache.bssid));
+        wifi_config.sta.channel = s_cache.channel;
+    }
+
+    s_fast_path = fast;
+    s_static_ip = fast && wifi_lease_reusable();
+    if (s_static_ip) {
+        esp_netif_dhcpc_stop(s_netif); // already stopped is fine
+        esp_netif_set_ip_info(s_netif, &s_cache.ip_info);
+        esp_netif_set_dns_info(s_netif, ESP_NETIF_DNS_MAIN, &s_cache.dns);
+    } else {
+        esp_netif_dhcpc_start(s_netif); // already started is fine
+    }
+
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config) );
-    ESP_ERROR_CHECK(esp_wifi_start() );
 
-    ESP_LOGI(TAG, "wifi_init_sta finished.");
+    xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT | WIFI_FAIL_BIT);
+    s_retry_num = 0;
+    s_want_connected = true;
+    s_connecting = true;
+
+    int64_t start = esp_timer_get_time();
+    s_radio_on_since = start;
+    s_radio_on = true;
+    esp_pm_lock_acquire(s_pm_lock);
+    ESP_ERROR_CHECK(esp_wifi_start() );
 
     /* Waiting until either the connection is established (WIFI_CONNECTED_BIT) or connection failed for the maximum
      * number of re-tries (WIFI_FAIL_BIT). The bits are set by event_handler() (see above) */
@@ -145,35 +363,139 @@ void wifi_init_sta(void)
             WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
             pdFALSE,
             pdFALSE,
-            portMAX_DELAY);
+            timeout);
+    s_connecting = false;
+    esp_pm_lock_release(s_pm_lock);
 
-    /* xEventGroupWaitBits() returns the bits before the call returned, hence we can test which event actually
-     * happened. */
     if (bits & WIFI_CONNECTED_BIT) {
-        ESP_LOGI(TAG, "connected to ap SSID:%s password:%s",
-                 EXAMPLE_ESP_WIFI_SSID, EXAMPLE_ESP_WIFI_PASS);
-    } else if (bits & WIFI_FAIL_BIT) {
-        ESP_LOGI(TAG, "Failed to connect to SSID:%s, password:%s",
-                 EXAMPLE_ESP_WIFI_SSID, EXAMPLE_ESP_WIFI_PASS);
-    } else {
-        ESP_LOGE(TAG, "UNEXPECTED EVENT");
+        uint32_t ms = (esp_timer_get_time() - start) / 1000;
+        s_stats.connects++;
+        s_stats.last_connect_ms = ms;
+        if (fast) {
+            s_stats.fast_connects++;
+            s_stats.avg_fast_ms += ((int32_t) ms - (int32_t) s_stats.avg_fast_ms) / (int32_t) s_stats.fast_connects;
+        } else {
+            uint32_t scans = s_stats.connects - s_stats.fast_connects;
+            s_stats.avg_scan_ms += ((int32_t) ms - (int32_t) s_stats.avg_scan_ms) / (int32_t) scans;
+        }
+        ESP_LOGI(TAG, "connected to ap SSID:%s in %" PRIu32 " ms (%s%s)", EXAMPLE_ESP_WIFI_SSID, ms,
+                 fast ? "cached AP" : "full scan", s_static_ip ? ", reused lease" : "");
+        wifi_cache_save();
+        return ESP_OK;
+    }
+
+    s_want_connected = false;
+    wifi_radio_off();
+    if (bits & WIFI_FAIL_BIT) {
+        ESP_LOGI(TAG, "Failed to connect to SSID:%s", EXAMPLE_ESP_WIFI_SSID);
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Timed out connecting to SSID:%s", EXAMPLE_ESP_WIFI_SSID);
+    return ESP_ERR_TIMEOUT;
+}
+
+/**
+ * bring the radio up and wait (up to timeout per attempt) for a link
+ * with an address. tries the cached AP first, then a full scan.
+ * every ESP_OK takes a reference that wifi_disconnect() gives back;
+ * the radio stays on while any caller holds one and a dropped link is
+ * re-established in the background.
+ */
+esp_err_t wifi_connect(TickType_t timeout)
+{
+    esp_err_t ret;
+
+    if (!s_initialized) {
+        /* wifi_manager_init() failed or was never called from app_main */
+        ESP_LOGE(TAG, "wifi_connect() before wifi_manager_init()");
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_users > 0) {
+        /* up, or reconnecting on its own */
+        s_users++;
+        xSemaphoreGive(s_lock);
+        return ESP_OK;
     }
+
+#if CONFIG_ESP_WIFI_FAST_RECONNECT
+    bool fast = s_cache.valid;
+#else
+    bool fast = false;
+#endif
+    ret = wifi_try_connect(timeout, fast);
+    if (ret != ESP_OK && fast) {
+        ESP_LOGI(TAG, "cached AP unreachable, scanning");
+        s_cache.valid = 0;
+        s_cache.leased_at = 0;
+        wifi_cache_save();
+        ret = wifi_try_connect(timeout, false);
+    }
+    if (ret == ESP_OK) {
+        s_users++;
+    }
+    xSemaphoreGive(s_lock);
+    return ret;
 }
 
-/*
-void initialize_wifi(void)
+/**
+ * give back a wifi_connect() reference. the last one drops the link
+ * and stops the radio; the driver stays initialized. only call it
+ * after a wifi_connect() that returned ESP_OK.
+ */
+esp_err_t wifi_disconnect(void)
 {
-    //Initialize NVS
-    esp_err_t ret = nvs_flash_init();
-    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-      ESP_ERROR_CHECK(nvs_flash_erase());
-      ret = nvs_flash_init();
+    if (!s_initialized) {
+        return ESP_ERR_INVALID_STATE;
     }
-    ESP_ERROR_CHECK(ret);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_users > 1) {
+        s_users--;
+        xSemaphoreGive(s_lock);
+        return ESP_OK;
+    }
+    s_users = 0;
+    s_want_connected = false;
+    wifi_radio_off();
+    xSemaphoreGive(s_lock);
+    ESP_LOGI(TAG, "radio off, %" PRIu64 " ms on since boot", s_stats.radio_on_ms);
+    return ESP_OK;
+}
 
-    ESP_LOGI(TAG, "ESP_WIFI_MODE_STA");
-    wifi_init_sta();
+/**
+ * bulk transfers turn power save off for the length of the transfer:
+ * the radio is on for less time in total than when it naps per beacon
+ */
+void wifi_set_power_save(bool enable)
+{
+    if (!s_initialized) {
+        return;
+    }
+    if (enable == s_power_save) {
+        return;
+    }
+    s_power_save = enable;
+    if (enable) {
+        esp_pm_lock_release(s_pm_lock);
+    } else {
+        esp_pm_lock_acquire(s_pm_lock);
+    }
+    esp_wifi_set_ps(enable ? WIFI_PS_MAX_MODEM : WIFI_PS_NONE);
 }
-*/
 
+bool wifi_is_connected(void)
+{
+    return s_initialized && (xEventGroupGetBits(s_wifi_event_group) & WIFI_CONNECTED_BIT);
+}
 
+/**
+ * connect timings for comparing the fast path against a full scan.
+ * radio-on time is the energy proxy: the radio dominates the budget.
+ */
+void wifi_get_stats(wifi_stats_t *stats)
+{
+    *stats = s_stats;
+    if (s_radio_on) {
+        stats->radio_on_ms += (esp_timer_get_time() - s_radio_on_since) / 1000;
+    }
+}
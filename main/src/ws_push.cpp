@@ -0,0 +1,301 @@
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_http_server.h"
+#include "freertos/FreeRTOS.h"
+#include "lwip/sockets.h"
+
+#include "ws_push.h"
+
+static const char *TAG = "WS_PUSH";
+
+/* a client skipped for backpressure is retried after this */
+#define WS_RETRY_US  200000
+#define WS_HEADER    7
+#define WS_FIELD     5
+#define WS_FRAME_MAX (WS_HEADER + WS_KEY_MAX * WS_FIELD)
+
+typedef struct {
+    int fd;       // -1 if free
+    bool stale;   // missed a delta, owed a snapshot
+} ws_client_t;
+
+static httpd_handle_t ws_server = NULL;
+static ws_client_t clients[WS_MAX_CLIENTS];
+
+/* written by any task, read by the flush work in the httpd task */
+static int32_t values[WS_KEY_MAX];
+static uint32_t dirty = 0;      // bit per key
+static uint32_t known = 0;      // keys ever set, what a snapshot carries
+static portMUX_TYPE values_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static std::atomic<bool> flush_queued{false};
+static esp_timer_handle_t retry_timer = NULL;
+static uint16_t seq = 0;
+static ws_push_stats_t stats;
+
+static_assert(WS_KEY_MAX <= 32, "dirty is a 32 bit mask");
+
+static void flush_work(void *arg);
+
+static void schedule_flush()
+{
+    if(ws_server == NULL || flush_queued.exchange(true)) {
+        return;
+    }
+    if(httpd_queue_work(ws_server, flush_work, NULL) != ESP_OK) {
+        flush_queued = false;
+    }
+}
+
+static void retry_cb(void *arg)
+{
+    schedule_flush();
+}
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    for(int i = 0; i < 4; i++) {
+        p[i] = v >> (8 * i);
+    }
+}
+
+static size_t build_frame(uint8_t *frame, char kind, uint32_t mask, const int32_t *snapshot)
+{
+    size_t len = WS_HEADER;
+
+    frame[0] = kind;
+    put_u16(frame + 1, seq);
+    put_u32(frame + 3, (uint32_t) time(NULL));
+    for(uint8_t key = 0; key < WS_KEY_MAX; key++) {
+        if(mask & (1UL << key)) {
+            frame[len] = key;
+            put_u32(frame + len + 1, (uint32_t) snapshot[key]);
+            len += WS_FIELD;
+        }
+    }
+    return len;
+}
+
+/**
+ * a send that would block would stall the whole server, so a client
+ * whose socket buffer is full is skipped this round
+ */
+static bool writable(int fd)
+{
+    fd_set set;
+    struct timeval zero = {};
+
+    FD_ZERO(&set);
+    FD_SET(fd, &set);
+    return select(fd + 1, NULL, &set, NULL, &zero) > 0;
+}
+
+static bool send_frame(int fd, uint8_t *data, size_t len)
+{
+    httpd_ws_frame_t frame = {};
+    frame.final = true;
+    frame.type = HTTPD_WS_TYPE_BINARY;
+    frame.payload = data;
+    frame.len = len;
+    if(httpd_ws_send_frame_async(ws_server, fd, &frame) != ESP_OK) {
+        return false;
+    }
+    stats.frames++;
+    stats.bytes += len;
+    return true;
+}
+
+/**
+ * runs in the httpd task, so sends never race the handler
+ */
+static void flush_work(void *arg)
+{
+    static uint8_t delta[WS_FRAME_MAX];
+    static uint8_t snapshot[WS_FRAME_MAX];
+    int32_t copy[WS_KEY_MAX];
+    uint32_t mask, all;
+    bool retry = false;
+
+    flush_queued = false;
+    portENTER_CRITICAL(&values_lock);
+    memcpy(copy, values, sizeof(copy));
+    mask = dirty;
+    all = known;
+    dirty = 0;
+    portEXIT_CRITICAL(&values_lock);
+
+    /* seq counts deltas only, so a gap is always a lost delta. a
+     * snapshot carries the latest and restarts the client's count */
+    size_t delta_len = 0;
+    if(mask) {
+        seq++;
+        delta_len = build_frame(delta, 'D', mask, copy);
+    }
+    size_t snapshot_len = 0;
+
+    for(ws_client_t &client : clients) {
+        if(client.fd < 0) {
+            continue;
+        }
+        if(httpd_ws_get_fd_info(ws_server, client.fd) != HTTPD_WS_CLIENT_WEBSOCKET) {
+            client.fd = -1; // closed since
+            stats.clients--;
+            continue;
+        }
+        if(!client.stale && delta_len == 0) {
+            continue;
+        }
+        if(!writable(client.fd)) {
+            client.stale = true;
+            stats.deferred++;
+            retry = true;
+            continue;
+        }
+        bool sent;
+        if(client.stale) {
+            if(snapshot_len == 0) {
+                snapshot_len = build_frame(snapshot, 'S', all, copy);
+            }
+            sent = send_frame(client.fd, snapshot, snapshot_len);
+        } else {
+            sent = send_frame(client.fd, delta, delta_len);
+        }
+        if(!sent) {
+            ESP_LOGI(TAG, "Client %d gone", client.fd);
+            client.fd = -1;
+            stats.clients--;
+            continue;
+        }
+        client.stale = false;
+    }
+    if(retry) {
+        esp_timer_stop(retry_timer);
+        esp_timer_start_once(retry_timer, WS_RETRY_US);
+    }
+}
+
+/**
+ * called once after the handshake (HTTP_GET), then per incoming frame.
+ * dashboards only listen, their frames are read and dropped.
+ */
+static esp_err_t ws_handler(httpd_req_t *req)
+{
+    if(req->method == HTTP_GET) {
+        int fd = httpd_req_to_sockfd(req);
+        for(ws_client_t &client : clients) {
+            if(client.fd < 0 || httpd_ws_get_fd_info(ws_server, client.fd) != HTTPD_WS_CLIENT_WEBSOCKET) {
+                if(client.fd < 0) {
+                    stats.clients++;
+                }
+                client.fd = fd;
+                client.stale = true; // first frame is a snapshot
+                ESP_LOGI(TAG, "Client %d connected, %u of %d", fd, stats.clients, WS_MAX_CLIENTS);
+                schedule_flush();
+                return ESP_OK;
+            }
+        }
+        /* the server has already sent the 101 by now, so the client
+         * sees the socket close right after its handshake */
+        stats.rejected++;
+        ESP_LOGW(TAG, "Client %d closed, %d already connected", fd, WS_MAX_CLIENTS);
+        return ESP_FAIL; // closes the socket
+    }
+
+    uint8_t buf[32];
+    httpd_ws_frame_t frame = {};
+    esp_err_t ret = httpd_ws_recv_frame(req, &frame, 0);
+    if(ret != ESP_OK) {
+        return ret;
+    }
+    while(frame.len > 0) {
+        size_t n = frame.len < sizeof(buf) ? frame.len : sizeof(buf);
+        frame.payload = buf;
+        ret = httpd_ws_recv_frame(req, &frame, n);
+        if(ret != ESP_OK) {
+            return ret;
+        }
+        frame.len -= n;
+    }
+    return ESP_OK;
+}
+
+/*******************************public*********************************/
+
+esp_err_t ws_push_register(httpd_handle_t server)
+{
+    esp_err_t ret;
+
+    for(ws_client_t &client : clients) {
+        client.fd = -1;
+    }
+
+    esp_timer_create_args_t timer_args = {};
+    timer_args.callback = retry_cb;
+    timer_args.name = "ws_retry";
+    ret = esp_timer_create(&timer_args, &retry_timer);
+    if(ret != ESP_OK) {
+        return ret;
+    }
+
+    httpd_uri_t uri = {};
+    uri.uri = "/ws";
+    uri.method = HTTP_GET;
+    uri.handler = ws_handler;
+    uri.is_websocket = true;
+    ret = httpd_register_uri_handler(server, &uri);
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed registering /ws: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    ws_server = server;
+    return ESP_OK;
+}
+
+void ws_push_set(uint8_t key, int32_t value)
+{
+    bool changed;
+
+    if(key >= WS_KEY_MAX) {
+        return;
+    }
+    portENTER_CRITICAL(&values_lock);
+    changed = !(known & (1UL << key)) || values[key] != value;
+    if(changed) {
+        values[key] = value;
+        known |= 1UL << key;
+        dirty |= 1UL << key;
+    }
+    portEXIT_CRITICAL(&values_lock);
+    if(changed) {
+        schedule_flush();
+    }
+}
+
+void ws_push_bump(uint8_t key)
+{
+    if(key >= WS_KEY_MAX) {
+        return;
+    }
+    portENTER_CRITICAL(&values_lock);
+    values[key]++;
+    known |= 1UL << key;
+    dirty |= 1UL << key;
+    portEXIT_CRITICAL(&values_lock);
+    schedule_flush();
+}
+
+void ws_push_get_stats(ws_push_stats_t *out)
+{
+    *out = stats;
+}
@@ -0,0 +1,232 @@
+#!/usr/bin/env python3
+"""Copy schedule bundles between controllers, over HTTP or the console.
+
+A bundle is every program of a controller as one CBOR map (bundle.h):
+
+    {0: version, 1: zones, 2: [[zone, hour, minute, days, duration, enabled], ...]}
+
+Pull one from a unit that is set up, keep or edit it as JSON, and push
+it to the others:
+
+    tools/bundle.py pull --url http://192.168.1.20 -o site.cbor
+    tools/bundle.py pull --port /dev/ttyACM0 -o site.cbor
+    tools/bundle.py show site.cbor > site.json
+    tools/bundle.py pack site.json -o site.cbor
+    tools/bundle.py push site.cbor --url http://192.168.1.21 --url http://192.168.1.22
+    tools/bundle.py push site.cbor --port /dev/ttyACM1
+
+The controller checks the bundle as it arrives and applies it whole or
+not at all. Zones and hours are numbered from 0, days is a bit mask
+with Sunday as bit 0, duration is in seconds.
+"""
+import argparse
+import json
+import sys
+import time
+import urllib.request
+
+BUNDLE_VERSION = 1
+KEY_VERSION, KEY_ZONES, KEY_PROGRAMS = range(3)
+FIELDS = ["zone", "hour", "minute", "days", "duration", "enabled"]
+# "bundle data <hex>" must fit the console's 64 character lines
+LINE_BYTES = 24
+
+
+def cbor_head(major, value):
+    if value < 24:
+        return bytes([major << 5 | value])
+    for info, size in ((24, 1), (25, 2), (26, 4), (27, 8)):
+        if value < 1 << (8 * size):
+            return bytes([major << 5 | info]) + value.to_bytes(size, "big")
+    raise ValueError("integer too large")
+
+
+def cbor_encode(item):
+    if isinstance(item, bool):
+        return b"\xf5" if item else b"\xf4"
+    if isinstance(item, int):
+        if item < 0:
+            raise ValueError("negative numbers are not used in bundles")
+        return cbor_head(0, item)
+    if isinstance(item, list):
+        return cbor_head(4, len(item)) + b"".join(cbor_encode(i) for i in item)
+    if isinstance(item, dict):
+        return cbor_head(5, len(item)) + b"".join(cbor_encode(k) + cbor_encode(v) for k, v in item.items())
+    raise ValueError("cannot encode %r" % (item,))
+
+
+def cbor_decode(data, pos=0):
+    """The item at pos and the position after it."""
+    head = data[pos]
+    major, info = head >> 5, head & 0x1F
+    pos += 1
+    if major == 7:
+        simple = {20: False, 21: True, 22: None}
+        if info not in simple:
+            raise ValueError("unsupported simple value %d" % info)
+        return simple[info], pos
+    if info < 24:
+        value = info
+    elif info <= 27:
+        size = 1 << (info - 24)
+        value = int.from_bytes(data[pos:pos + size], "big")
+        pos += size
+    else:
+        raise ValueError("indefinite lengths are not used in bundles")
+    if major == 0:
+        return value, pos
+    if major == 1:
+        return -1 - value, pos
+    if major == 4:
+        items = []
+        for _ in range(value):
+            item, pos = cbor_decode(data, pos)
+            items.append(item)
+        return items, pos
+    if major == 5:
+        pairs = {}
+        for _ in range(value):
+            key, pos = cbor_decode(data, pos)
+            pairs[key], pos = cbor_decode(data, pos)
+        return pairs, pos
+    raise ValueError("unsupported major type %d" % major)
+
+
+def to_json(bundle):
+    items, end = cbor_decode(bundle)
+    if end != len(bundle):
+        sys.exit("trailing bytes after the bundle")
+    if items.get(KEY_VERSION) != BUNDLE_VERSION:
+        sys.exit("bundle version %s, this script reads %d" % (items.get(KEY_VERSION), BUNDLE_VERSION))
+    return {
+        "version": items[KEY_VERSION],
+        "zones": items.get(KEY_ZONES),
+        "programs": [dict(zip(FIELDS, p)) for p in items.get(KEY_PROGRAMS, [])],
+    }
+
+
+def from_json(doc):
+    programs = [[p[f] for f in FIELDS[:-1]] + [bool(p.get("enabled", True))] for p in doc["programs"]]
+    return cbor_encode({KEY_VERSION: BUNDLE_VERSION, KEY_ZONES: doc.get("zones", 0), KEY_PROGRAMS: programs})
+
+
+def console(link, command):
+    """Send a command line, return the first BUNDLE reply."""
+    link.write(command.encode() + b"\r\n")
+    while True:
+        raw = link.readline()
+        if not raw:
+            sys.exit("timed out waiting for a reply to %r" % command)
+        line = raw.decode("ascii", "replace").strip()
+        # the console echoes the command, replies start with BUNDLE
+        if line.startswith("BUNDLE"):
+            return line
+
+
+def pull_serial(port, baud):
+    import serial  # pyserial, only needed to talk to the device
+
+    with serial.Serial(port, baud, timeout=5) as link:
+        link.reset_input_buffer()
+        line = console(link, "bundle export")
+        if not line.startswith("BUNDLE BEGIN"):
+            sys.exit(line)
+        length = int(line.split()[2])
+        data = b""
+        while True:
+            raw = link.readline()
+            if not raw:
+                sys.exit("timed out in the export")
+            line = raw.decode("ascii", "replace").strip()
+            if line.startswith("BUNDLE END"):
+                break
+            data += bytes.fromhex(line)
+        if len(data) != length:
+            sys.exit("export of %d bytes, expected %d" % (len(data), length))
+        return data
+
+
+def push_serial(port, baud, bundle):
+    import serial
+
+    with serial.Serial(port, baud, timeout=5) as link:
+        link.reset_input_buffer()
+        console(link, "bundle begin")
+        for i in range(0, len(bundle), LINE_BYTES):
+            reply = console(link, "bundle data " + bundle[i:i + LINE_BYTES].hex())
+            if reply != "BUNDLE OK":
+                sys.exit("%s: %s" % (port, reply))
+        reply = console(link, "bundle end")
+        if not reply.startswith("BUNDLE APPLIED"):
+            sys.exit("%s: %s" % (port, reply))
+        print("%s: %s" % (port, reply))
+
+
+def pull_http(url):
+    with urllib.request.urlopen(url.rstrip("/") + "/api/bundle", timeout=10) as response:
+        return response.read()
+
+
+def push_http(url, bundle):
+    request = urllib.request.Request(url.rstrip("/") + "/api/bundle", data=bundle, method="PUT",
+                                     headers={"Content-Type": "application/cbor"})
+    began = time.monotonic()
+    try:
+        with urllib.request.urlopen(request, timeout=10) as response:
+            programs = json.load(response)
+    except urllib.error.HTTPError as err:
+        sys.exit("%s: %d %s" % (url, err.code, err.read().decode(errors="replace")))
+    print("%s: %d programs applied in %.0f ms" % (url, len(programs), (time.monotonic() - began) * 1000))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+    for name in ("pull", "push"):
+        p = sub.add_parser(name)
+        if name == "push":
+            p.add_argument("bundle")
+        else:
+            p.add_argument("-o", "--output", required=True)
+        p.add_argument("--url", action="append", default=[], help="controller with the REST API")
+        p.add_argument("--port", action="append", default=[], help="controller console port")
+        p.add_argument("--baud", type=int, default=115200)
+    p = sub.add_parser("show", help="bundle as JSON")
+    p.add_argument("bundle")
+    p = sub.add_parser("pack", help="JSON back to a bundle")
+    p.add_argument("json")
+    p.add_argument("-o", "--output", required=True)
+    args = parser.parse_args()
+
+    if args.command == "show":
+        with open(args.bundle, "rb") as f:
+            json.dump(to_json(f.read()), sys.stdout, indent=1)
+        print()
+    elif args.command == "pack":
+        with open(args.json) as f:
+            bundle = from_json(json.load(f))
+        with open(args.output, "wb") as f:
+            f.write(bundle)
+        print("%d bytes" % len(bundle))
+    elif args.command == "pull":
+        if len(args.url) + len(args.port) != 1:
+            sys.exit("pull from one --url or --port")
+        bundle = pull_http(args.url[0]) if args.url else pull_serial(args.port[0], args.baud)
+        to_json(bundle)  # refuse to save something unreadable
+        with open(args.output, "wb") as f:
+            f.write(bundle)
+        print("%d bytes" % len(bundle))
+    else:
+        with open(args.bundle, "rb") as f:
+            bundle = f.read()
+        to_json(bundle)
+        if not args.url and not args.port:
+            sys.exit("push to at least one --url or --port")
+        for url in args.url:
+            push_http(url, bundle)
+        for port in args.port:
+            push_serial(port, args.baud, bundle)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+"""Static RAM per subsystem from the linker map, against a budget.
+
+Every long-lived task stack, queue and buffer is a static (see
+static_rtos.h), so the .bss and .data each object file of the main
+component puts into internal RAM is what that code costs, and nothing
+is left to a heap that Wi-Fi start and stop cycles fragment. The build
+runs this after linking (top-level CMakeLists.txt):
+
+    tools/mem_budget.py build/irrigation-proj.map
+
+It prints RAM per subsystem and per file and exits 1 if a subsystem
+is over its budget. --warn-only reports without failing.
+"""
+import argparse
+import re
+import sys
+
+# source file -> subsystem. a main component file missing here is
+# reported under "other" so it is noticed.
+SUBSYSTEMS = {
+    "UI": ["irrigation-proj.cpp", "menu.cpp", "DFRobot_LCD.cpp", "rotary_encoder.cpp",
+           "button_gesture.cpp", "event_bus.cpp", "lcd_bench.cpp"],
+    "I2C": ["i2c_bus.cpp", "DS3231_RTC.cpp"],
+    "scheduler": ["valve_scheduler.cpp", "schedule.cpp", "program_store.cpp", "Valve.cpp",
+                  "bundle.cpp", "cbor_stream.cpp", "tz.cpp", "tz_store.cpp"],
+    "network": ["wifi_setup.c", "sntp_setup.c", "sync_service.cpp", "rest_api.cpp", "ws_push.cpp",
+                "telemetry.cpp", "ota_update.cpp", "json_stream.cpp"],
+    "diagnostics": ["health.cpp", "trace.cpp", "wake_stats.cpp", "boot_timeline.cpp",
+                    "diag_console.cpp", "dlog.cpp", "ui_latency.cpp"],
+    "power": ["power.cpp"],
+    "history": ["history.cpp"],
+}
+
+# bytes of internal RAM each subsystem may take statically
+BUDGETS = {
+    "UI": 16 * 1024,
+    "I2C": 512,
+    "scheduler": 6 * 1024,
+    "network": 24 * 1024,
+    "diagnostics": 24 * 1024,
+    "power": 64,
+    "history": 5 * 1024,
+    "other": 0,
+}
+
+RAM_SECTIONS = re.compile(r"^\.(bss|data|sbss|sdata|dram\d*\.\w+)(\.|$)")
+# " .bss.name  0x3fc9a000  0x400 esp-idf/main/libmain.a(trace.cpp.obj)",
+# or the same with the name alone on the line before
+PLACEMENT = re.compile(r"^\s*(\S+)?\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+\S*libmain\.a\(([^)]+)\.obj\)")
+COMMON = re.compile(r"^\s*COMMON\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+\S*libmain\.a\(([^)]+)\.obj\)")
+
+
+def ram_per_file(lines):
+    files = {}
+    pending = None
+    in_map = False
+    for line in lines:
+        if line.startswith("Linker script and memory map"):
+            in_map = True
+            continue
+        if not in_map:
+            continue
+        stripped = line.strip()
+        # a long section name sits alone, the placement follows
+        if stripped.startswith(".") and len(stripped.split()) == 1:
+            pending = stripped
+            continue
+        common = COMMON.match(line)
+        if common:
+            size, source = int(common.group(2), 16), common.group(3)
+            files[source] = files.get(source, 0) + size
+            pending = None
+            continue
+        placed = PLACEMENT.match(line)
+        if placed:
+            section = placed.group(1) or pending
+            size, source = int(placed.group(3), 16), placed.group(4)
+            if section and RAM_SECTIONS.match(section) and size:
+                files[source] = files.get(source, 0) + size
+        pending = None
+    return files
+
+
+def subsystem_of(source):
+    for name, sources in SUBSYSTEMS.items():
+        if source in sources:
+            return name
+    return "other"
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("map", help="linker map, build/<project>.map")
+    parser.add_argument("--warn-only", action="store_true")
+    args = parser.parse_args()
+
+    with open(args.map, errors="replace") as f:
+        files = ram_per_file(f)
+    if not files:
+        sys.exit("no libmain.a RAM sections in %s" % args.map)
+
+    per_subsystem = {}
+    for source, size in files.items():
+        per_subsystem.setdefault(subsystem_of(source), []).append((size, source))
+
+    over = []
+    print("%-12s %8s %8s" % ("subsystem", "static", "budget"))
+    for name in list(SUBSYSTEMS) + ["other"]:
+        entries = sorted(per_subsystem.get(name, []), reverse=True)
+        total = sum(size for size, _ in entries)
+        if not entries and name == "other":
+            continue
+        flag = ""
+        if total > BUDGETS[name]:
+            flag = "  OVER"
+            over.append(name)
+        print("%-12s %8d %8d%s" % (name, total, BUDGETS[name], flag))
+        for size, source in entries:
+            print("  %-22s %8d" % (source, size))
+    print("%-12s %8d" % ("total", sum(files.values())))
+
+    if over and not args.warn_only:
+        sys.exit("static RAM over budget: %s" % ", ".join(over))
+
+
+if __name__ == "__main__":
+    main()
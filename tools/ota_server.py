@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+"""Serve a firmware image for OTA testing, with Range support.
+
+    tools/ota_server.py build/irrigation-proj.bin --port 8070 --drop-after 300000
+
+--drop-after closes the connection once that many bytes of a response
+are sent, so each attempt gets further and the device's resume path is
+exercised. Requests are logged with their range.
+"""
+import argparse
+import http.server
+import os
+import re
+
+
+def make_handler(image, drop_after):
+    class Handler(http.server.BaseHTTPRequestHandler):
+        protocol_version = "HTTP/1.1"
+
+        def do_GET(self):
+            size = os.path.getsize(image)
+            first, last = 0, size - 1
+            match = re.match(r"bytes=(\d+)-(\d*)", self.headers.get("Range", ""))
+            if match:
+                first = int(match.group(1))
+                if match.group(2):
+                    last = min(int(match.group(2)), size - 1)
+                if first >= size:
+                    self.send_response(416)
+                    self.send_header("Content-Range", "bytes */%d" % size)
+                    self.send_header("Content-Length", "0")
+                    self.end_headers()
+                    return
+                self.send_response(206)
+                self.send_header("Content-Range", "bytes %d-%d/%d" % (first, last, size))
+            else:
+                self.send_response(200)
+            length = last - first + 1
+            self.send_header("Content-Type", "application/octet-stream")
+            self.send_header("Content-Length", str(length))
+            self.send_header("Accept-Ranges", "bytes")
+            self.end_headers()
+
+            sent = 0
+            with open(image, "rb") as f:
+                f.seek(first)
+                while sent < length:
+                    chunk = f.read(min(4096, length - sent))
+                    if drop_after and sent + len(chunk) > drop_after:
+                        self.wfile.write(chunk[:drop_after - sent])
+                        self.log_message("dropped after %d bytes", drop_after)
+                        self.close_connection = True
+                        return
+                    self.wfile.write(chunk)
+                    sent += len(chunk)
+
+    return Handler
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("image")
+    parser.add_argument("--port", type=int, default=8070)
+    parser.add_argument("--drop-after", type=int, default=0,
+                        help="bytes per response before the connection is cut")
+    args = parser.parse_args()
+
+    server = http.server.ThreadingHTTPServer(("", args.port), make_handler(args.image, args.drop_after))
+    print("serving %s (%d bytes) on port %d" % (args.image, os.path.getsize(args.image), args.port))
+    server.serve_forever()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+"""Load test for the irrigation REST API.
+
+Runs a mix of list, read and update requests from several keep-alive
+connections and reports throughput and latency. The device's peak heap
+use is read from /api/stats: min_free_heap before the run minus after.
+
+    tools/rest_load.py 192.168.1.40 --requests 2000 --clients 4
+"""
+import argparse
+import http.client
+import json
+import statistics
+import threading
+import time
+
+
+def stats(host, port):
+    conn = http.client.HTTPConnection(host, port, timeout=10)
+    conn.request("GET", "/api/stats")
+    body = json.loads(conn.getresponse().read())
+    conn.close()
+    return body
+
+
+def client(host, port, count, program_id, latencies, failures):
+    conn = http.client.HTTPConnection(host, port, timeout=10)
+    update = json.dumps({"duration": 600}).encode()
+    for i in range(count):
+        if i % 4 == 3 and program_id is not None:
+            method, path, body = "PUT", "/api/programs/%d" % program_id, update
+        elif i % 2:
+            method, path, body = "GET", "/api/zones", None
+        else:
+            method, path, body = "GET", "/api/programs", None
+        start = time.perf_counter()
+        try:
+            conn.request(method, path, body=body,
+                         headers={"Content-Type": "application/json"} if body else {})
+            resp = conn.getresponse()
+            resp.read()
+            if resp.status >= 300:
+                failures.append(resp.status)
+        except (OSError, http.client.HTTPException) as err:
+            failures.append(str(err))
+            conn.close()
+            conn = http.client.HTTPConnection(host, port, timeout=10)
+            continue
+        latencies.append(time.perf_counter() - start)
+    conn.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--requests", type=int, default=1000)
+    parser.add_argument("--clients", type=int, default=4,
+                        help="keep below the server's max_open_sockets (7)")
+    args = parser.parse_args()
+
+    conn = http.client.HTTPConnection(args.host, args.port, timeout=10)
+    conn.request("GET", "/api/programs")
+    programs = json.loads(conn.getresponse().read())
+    conn.close()
+    program_id = programs[0]["id"] if programs else None
+
+    before = stats(args.host, args.port)
+    latencies, failures = [], []
+    per_client = args.requests // args.clients
+    threads = [threading.Thread(target=client,
+                                args=(args.host, args.port, per_client, program_id, latencies, failures))
+               for _ in range(args.clients)]
+    start = time.perf_counter()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    elapsed = time.perf_counter() - start
+    after = stats(args.host, args.port)
+
+    latencies.sort()
+    print("requests   %d ok, %d failed in %.1f s" % (len(latencies), len(failures), elapsed))
+    print("throughput %.1f req/s" % (len(latencies) / elapsed))
+    if latencies:
+        print("latency    p50 %.1f ms, p99 %.1f ms, max %.1f ms" % (
+            statistics.median(latencies) * 1000,
+            latencies[int(len(latencies) * 0.99) - 1] * 1000,
+            latencies[-1] * 1000))
+    print("heap       min free %d -> %d bytes (peak use +%d), largest block %d" % (
+        before["min_free_heap"], after["min_free_heap"],
+        before["min_free_heap"] - after["min_free_heap"], after["largest_block"]))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,201 @@
+#!/usr/bin/env python3
+"""Turn a "trace dump" from the console into a Chrome/Perfetto trace.
+
+The dump is the ring of 16 byte records from trace.cpp, one hex line
+each between TRACE BEGIN and TRACE END. Capture it from the monitor
+into a file, or let the script ask the device itself:
+
+    tools/trace_to_perfetto.py capture.log -o trace.json
+    tools/trace_to_perfetto.py --port /dev/ttyACM0 -o trace.json
+
+and open trace.json in https://ui.perfetto.dev or chrome://tracing.
+Each core gets a track with GPIO interrupts, menu moves and LCD
+redraws, I2C transfers, valve runs and sync attempts get their own,
+and queue depths are counters. A summary of the worst cases goes to
+stdout.
+"""
+import argparse
+import json
+import struct
+import sys
+
+TRACE_FORMAT = 1
+RECORD = struct.Struct("<IIBBHI")
+FULL = 0xFFFFFFFF
+
+(TRACE_NONE, TRACE_GPIO_ISR, TRACE_QUEUE_SEND, TRACE_QUEUE_RECV, TRACE_I2C_BEGIN,
+ TRACE_I2C_END, TRACE_VALVE_OPEN, TRACE_VALVE_CLOSE, TRACE_MENU, TRACE_LCD_BEGIN,
+ TRACE_LCD_END, TRACE_SYNC) = range(12)
+
+QUEUES = ["gpio_evt", "input_bus", "ui_bus", "sync_bus"]
+SYNC_STAGES = ["idle", "connecting", "querying", "done", "failed"]
+DISPLAY = ["menu", "sync status", "splash"]
+
+PID = 1
+TID_CORE = 1  # + core
+TID_I2C = 10
+TID_VALVES = 11
+TID_SYNC = 12
+
+
+def read_dump(lines):
+    """Records of the last complete dump in a capture, oldest first."""
+    records, inside, torn, done = [], False, 0, None
+    for line in lines:
+        line = line.strip()
+        if line.startswith("TRACE BEGIN"):
+            fmt = int(line.split()[2])
+            if fmt != TRACE_FORMAT:
+                sys.exit("dump format %d, this script reads %d" % (fmt, TRACE_FORMAT))
+            records, inside = [], True
+        elif line.startswith("TRACE END") and inside:
+            torn, inside, done = int(line.split()[2]), False, records
+        elif inside and len(line) == RECORD.size * 2:
+            records.append(RECORD.unpack(bytes.fromhex(line)))
+    if done is None:
+        sys.exit("no complete TRACE BEGIN ... TRACE END in the input")
+    return done, torn
+
+
+def fetch(port, baud):
+    import serial  # pyserial, only needed to talk to the device
+
+    with serial.Serial(port, baud, timeout=5) as link:
+        link.reset_input_buffer()
+        link.write(b"trace dump\r\n")
+        lines = []
+        while True:
+            raw = link.readline()
+            if not raw:
+                sys.exit("timed out waiting for the dump")
+            line = raw.decode("ascii", "replace")
+            lines.append(line)
+            if line.startswith("TRACE END"):
+                return lines
+
+
+def unwrap(records):
+    """Records carry the low 32 bits of esp_timer, about 71 minutes."""
+    epoch, last = 0, None
+    for seq, t, ident, core, a, b in records:
+        if last is not None and t < last and last - t > 1 << 31:
+            epoch += 1 << 32
+        last = t
+        yield seq, epoch + t, ident, core, a, b
+
+
+def convert(records):
+    events = []
+    names = {TID_I2C: "i2c", TID_VALVES: "valves", TID_SYNC: "sync"}
+    i2c_open = {}
+    valve_open = {}
+    sync_start = None
+    lcd_start = {}
+    worst = {"i2c": (0, None), "lcd": (0, None), "valve late": (0, None)}
+    dropped = {}
+
+    def note(what, value, ts):
+        if value > worst[what][0]:
+            worst[what] = (value, ts)
+
+    for seq, ts, ident, core, a, b in unwrap(records):
+        tid = TID_CORE + core
+        names.setdefault(tid, "core %d" % core)
+        if ident == TRACE_GPIO_ISR:
+            events.append({"ph": "i", "s": "t", "name": "gpio %d" % a, "ts": ts, "pid": PID, "tid": tid})
+        elif ident in (TRACE_QUEUE_SEND, TRACE_QUEUE_RECV):
+            queue = QUEUES[a] if a < len(QUEUES) else "queue %d" % a
+            if b == FULL:
+                dropped[queue] = dropped.get(queue, 0) + 1
+                events.append({"ph": "i", "s": "t", "name": "%s full" % queue, "ts": ts, "pid": PID, "tid": tid})
+            else:
+                events.append({"ph": "C", "name": queue, "ts": ts, "pid": PID, "args": {"depth": b}})
+        elif ident == TRACE_I2C_BEGIN:
+            i2c_open[a] = ts
+            events.append({"ph": "B", "name": "i2c 0x%02x" % a, "ts": ts, "pid": PID, "tid": TID_I2C,
+                           "args": {"bytes": b}})
+        elif ident == TRACE_I2C_END:
+            args = {"result": b} if b else {}
+            events.append({"ph": "E", "ts": ts, "pid": PID, "tid": TID_I2C, "args": args})
+            if a in i2c_open:
+                note("i2c", ts - i2c_open.pop(a), ts)
+        elif ident == TRACE_VALVE_OPEN:
+            valve_open[a] = (ts, b)
+            events.append({"ph": "b", "cat": "valve", "id": a, "name": "zone %d" % (a + 1), "ts": ts,
+                           "pid": PID, "tid": TID_VALVES, "args": {"seconds": b}})
+        elif ident == TRACE_VALVE_CLOSE:
+            args = {"stopped": True} if b else {}
+            if a in valve_open:
+                opened, seconds = valve_open.pop(a)
+                late_us = ts - opened - seconds * 1000000
+                if not b:
+                    args["late_ms"] = late_us / 1000
+                    note("valve late", late_us, ts)
+            events.append({"ph": "e", "cat": "valve", "id": a, "name": "zone %d" % (a + 1), "ts": ts,
+                           "pid": PID, "tid": TID_VALVES, "args": args})
+        elif ident == TRACE_MENU:
+            events.append({"ph": "i", "s": "t", "name": "menu", "ts": ts, "pid": PID, "tid": tid,
+                           "args": {"node": a, "cursor": b & 0xFFFF, "editing": bool(b >> 16)}})
+        elif ident == TRACE_LCD_BEGIN:
+            lcd_start[core] = ts
+            name = "lcd " + (DISPLAY[a] if a < len(DISPLAY) else str(a))
+            events.append({"ph": "B", "name": name, "ts": ts, "pid": PID, "tid": tid})
+        elif ident == TRACE_LCD_END:
+            events.append({"ph": "E", "ts": ts, "pid": PID, "tid": tid})
+            if core in lcd_start:
+                note("lcd", ts - lcd_start.pop(core), ts)
+        elif ident == TRACE_SYNC:
+            stage = SYNC_STAGES[a] if a < len(SYNC_STAGES) else str(a)
+            if stage == "connecting":
+                sync_start = ts
+                events.append({"ph": "b", "cat": "sync", "id": 0, "name": "sync", "ts": ts, "pid": PID,
+                               "tid": TID_SYNC})
+            elif stage in ("done", "failed") and sync_start is not None:
+                args = {"result": stage}
+                if stage == "done":
+                    args["offset_ms"] = struct.unpack("<i", struct.pack("<I", b))[0]
+                events.append({"ph": "e", "cat": "sync", "id": 0, "name": "sync", "ts": ts, "pid": PID,
+                               "tid": TID_SYNC, "args": args})
+                sync_start = None
+            events.append({"ph": "i", "s": "t", "name": stage, "ts": ts, "pid": PID, "tid": TID_SYNC})
+
+    events.append({"ph": "M", "name": "process_name", "pid": PID, "args": {"name": "irrigation"}})
+    for tid, name in names.items():
+        events.append({"ph": "M", "name": "thread_name", "pid": PID, "tid": tid, "args": {"name": name}})
+    return events, worst, dropped
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("capture", nargs="?", help="monitor log holding a trace dump")
+    parser.add_argument("--port", help="serial port to ask for a dump instead")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("-o", "--output", default="trace.json")
+    args = parser.parse_args()
+
+    if args.port:
+        lines = fetch(args.port, args.baud)
+    elif args.capture:
+        with open(args.capture, errors="replace") as f:
+            lines = f.readlines()
+    else:
+        parser.error("give a capture file or --port")
+
+    records, torn = read_dump(lines)
+    events, worst, dropped = convert(records)
+    with open(args.output, "w") as f:
+        json.dump({"traceEvents": events, "displayTimeUnit": "ms"}, f)
+
+    if records:
+        span = (records[-1][1] - records[0][1]) & 0xFFFFFFFF
+        print("%d records over %.3f s, %d torn" % (len(records), span / 1e6, torn))
+    for what, (value, ts) in worst.items():
+        if ts is not None:
+            print("worst %-10s %8.3f ms at %.6f s" % (what, value / 1000, ts / 1e6))
+    for queue, count in sorted(dropped.items()):
+        print("%s full %d times" % (queue, count))
+    print("wrote %s" % args.output)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+"""Compare /ws push against 1 s polling of /api/zones.
+
+Opens a valve through the REST API, stops it again, and measures how
+long each channel takes to show the change. It then idles both channels
+for a while and counts what crossed the air: polling costs a request
+every second whether or not anything changed, push costs nothing until
+something does. Packets per minute stand in for radio duty cycle, each
+one keeps the station awake for a beacon interval or so.
+
+    tools/ws_bench.py 192.168.1.40 --zone 0 --rounds 10 --idle 60
+"""
+import argparse
+import base64
+import http.client
+import json
+import os
+import socket
+import statistics
+import struct
+import threading
+import time
+
+WS_KEY_VALVE = 0x10
+
+
+class WsClient:
+    """Just enough RFC 6455 for the device's unmasked binary frames."""
+
+    def __init__(self, host, port):
+        self.sock = socket.create_connection((host, port), timeout=10)
+        key = base64.b64encode(os.urandom(16)).decode()
+        self.sock.sendall(("GET /ws HTTP/1.1\r\nHost: %s\r\nUpgrade: websocket\r\n"
+                           "Connection: Upgrade\r\nSec-WebSocket-Key: %s\r\n"
+                           "Sec-WebSocket-Version: 13\r\n\r\n" % (host, key)).encode())
+        head = b""
+        while b"\r\n\r\n" not in head:
+            chunk = self.sock.recv(1)
+            if not chunk:
+                raise ConnectionError("closed during handshake")
+            head += chunk
+        if b" 101 " not in head.split(b"\r\n")[0]:
+            raise ConnectionError(head.split(b"\r\n")[0].decode())
+        self.rx_bytes = len(head)
+
+    def _read(self, n):
+        data = b""
+        while len(data) < n:
+            chunk = self.sock.recv(n - len(data))
+            if not chunk:
+                raise ConnectionError("closed")
+            data += chunk
+        self.rx_bytes += n
+        return data
+
+    def frame(self):
+        b0, b1 = self._read(2)
+        n = b1 & 0x7F
+        if n == 126:
+            n = struct.unpack(">H", self._read(2))[0]
+        elif n == 127:
+            n = struct.unpack(">Q", self._read(8))[0]
+        payload = self._read(n)
+        if b0 & 0x0F != 0x2:
+            return None
+        kind, seq, sent = struct.unpack("<cHI", payload[:7])
+        fields = {}
+        for off in range(7, len(payload), 5):
+            key, value = struct.unpack("<Bi", payload[off:off + 5])
+            fields[key] = value
+        return kind.decode(), seq, fields
+
+
+def post(host, port, path, body=None):
+    conn = http.client.HTTPConnection(host, port, timeout=10)
+    conn.request("POST", path, body=json.dumps(body).encode() if body else None,
+                 headers={"Content-Type": "application/json"} if body else {})
+    status = conn.getresponse().status
+    conn.close()
+    if status != 200:
+        raise RuntimeError("%s returned %d" % (path, status))
+
+
+class Poller(threading.Thread):
+    """GET /api/zones once a second on a keep-alive connection."""
+
+    def __init__(self, host, port, zone):
+        super().__init__(daemon=True)
+        self.conn = http.client.HTTPConnection(host, port, timeout=10)
+        self.zone = zone
+        self.open = None
+        self.changed = threading.Event()
+        self.requests = 0
+        self.rx_bytes = 0
+        self.running = True
+
+    def run(self):
+        while self.running:
+            self.conn.request("GET", "/api/zones")
+            body = self.conn.getresponse().read()
+            self.requests += 1
+            self.rx_bytes += len(body)
+            state = json.loads(body)[self.zone]["open"]
+            if state != self.open:
+                self.open = state
+                self.changed.set()
+            time.sleep(1.0)
+
+
+def pct(values, q):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(q * len(values)))]
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--zone", type=int, default=0)
+    parser.add_argument("--rounds", type=int, default=10)
+    parser.add_argument("--idle", type=int, default=60, help="seconds of idle traffic to count")
+    args = parser.parse_args()
+
+    ws = WsClient(args.host, args.port)
+    kind, _, snapshot = ws.frame()
+    assert kind == "S", "first frame must be a snapshot"
+    poller = Poller(args.host, args.port, args.zone)
+    poller.start()
+    while poller.open is None:
+        time.sleep(0.1)
+
+    key = WS_KEY_VALVE + args.zone
+    push, poll = [], []
+    for i in range(args.rounds):
+        opening = i % 2 == 0
+        poller.changed.clear()
+        start = time.perf_counter()
+        if opening:
+            post(args.host, args.port, "/api/zones/%d/run" % args.zone, {"duration": 30})
+        else:
+            post(args.host, args.port, "/api/zones/stop")
+        while True:
+            frame = ws.frame()
+            if frame and key in frame[2] and (frame[2][key] != 0) == opening:
+                push.append(time.perf_counter() - start)
+                break
+        poller.changed.wait(5)
+        poll.append(time.perf_counter() - start)
+    post(args.host, args.port, "/api/zones/stop")
+
+    ws_bytes, poll_bytes, poll_reqs = ws.rx_bytes, poller.rx_bytes, poller.requests
+    time.sleep(args.idle)
+    idle_ws = ws.rx_bytes - ws_bytes
+    idle_poll = poller.rx_bytes - poll_bytes
+    idle_reqs = poller.requests - poll_reqs
+    poller.running = False
+
+    print("change latency   push p50 %.0f ms p99 %.0f ms, poll p50 %.0f ms p99 %.0f ms"
+          % (statistics.median(push) * 1e3, pct(push, 0.99) * 1e3,
+             statistics.median(poll) * 1e3, pct(poll, 0.99) * 1e3))
+    scale = 60.0 / args.idle
+    print("idle per minute  push %.0f B, poll %.0f requests %.0f B"
+          % (idle_ws * scale, idle_reqs * scale, idle_poll * scale))
+
+
+if __name__ == "__main__":
+    main()